@@ -0,0 +1,87 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <dlog.hpp>
+#include <dnet/util/buffer_pool.hpp>
+#include <dnet/util/types.hpp>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+// ============================================================ //
+// Compares how the worker used to allocate a max sized packet for every
+// read, against reading into one buffer and copying into a pooled one.
+// ============================================================ //
+
+using Packet = std::vector<u8>;
+using Clock = std::chrono::steady_clock;
+
+constexpr int kIterations = 1000000;
+constexpr size_t kDatagramSize = 512;
+
+/**
+ * Stands in for the socket read, writes @size bytes to @buf.
+ */
+static void FakeRead(u8* buf, const size_t size) {
+  std::memset(buf, 0xA, size);
+}
+
+template <typename TFn>
+static void Measure(const char* name, TFn fn) {
+  size_t checksum = 0;
+  const auto start = Clock::now();
+  for (int i = 0; i < kIterations; i++) {
+    checksum += fn();
+  }
+  const auto stop = Clock::now();
+  const double seconds =
+      std::chrono::duration_cast<std::chrono::duration<double>>(stop - start)
+          .count();
+  DLOG_INFO("[{}] {:.0f} packets/sec ({})", name, kIterations / seconds,
+            checksum);
+}
+
+int main() {
+  Measure("allocate per read", []() {
+    Packet packet(std::numeric_limits<u16>::max());
+    FakeRead(packet.data(), kDatagramSize);
+    packet.resize(kDatagramSize);
+    return packet.size();
+  });
+
+  dnet::BufferPool<Packet> pool{};
+  Packet read_buffer(std::numeric_limits<u16>::max());
+  Measure("pool", [&pool, &read_buffer]() {
+    FakeRead(read_buffer.data(), kDatagramSize);
+    Packet packet = pool.Acquire(kDatagramSize);
+    packet.assign(read_buffer.data(), read_buffer.data() + kDatagramSize);
+    const size_t size = packet.size();
+    // the user hands it back
+    pool.Release(std::move(packet));
+    return size;
+  });
+
+  return 0;
+}
@@ -0,0 +1,133 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <dlog.hpp>
+#include <dnet/net/connect_many.hpp>
+#include <dnet/net/endpoint.hpp>
+#include <dnet/net/poller.hpp>
+#include <dnet/net/tcp.hpp>
+#include <dnet/util/types.hpp>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// ============================================================ //
+// Time to open many connections, one blocking Connect after the other, or
+// all at once with ConnectMany. Over loopback the handshake completes
+// inside the connect call, so this mostly measures the call overhead.
+// Across a network, the sequential version pays a round trip per peer.
+// The server accepts from its own thread, with the default backlog.
+// ============================================================ //
+
+using Clock = std::chrono::steady_clock;
+
+constexpr u16 kPort = 5000;
+
+/**
+ * Accept clients, and keep them open, until @run is cleared.
+ */
+static std::thread StartAccepting(const dnet::Tcp& listener,
+                                  const std::atomic<bool>& run) {
+  return std::thread([&listener, &run]() {
+    dnet::Poller poller{};
+    if (poller.Add(listener.GetHandle(), 0, dnet::poll_flag::kRead) !=
+        dnet::Result::kSuccess) {
+      return;
+    }
+    std::vector<dnet::Tcp> clients{};
+    dnet::PollEvent event{};
+    while (run.load(std::memory_order_relaxed)) {
+      if (poller.Wait(&event, 1, 10) > 0) {
+        for (auto client = listener.Accept(); client.has_value();
+             client = listener.Accept()) {
+          clients.push_back(std::move(client.value()));
+        }
+      }
+    }
+  });
+}
+
+static double MillisecondsSince(const Clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(
+             Clock::now() - start)
+      .count();
+}
+
+static void MeasureSequential(const dnet::Tcp& listener, const size_t count) {
+  std::atomic<bool> run{true};
+  std::thread server = StartAccepting(listener, run);
+  std::vector<dnet::Tcp> clients(count);
+  size_t connected = 0;
+  const auto start = Clock::now();
+  for (dnet::Tcp& client : clients) {
+    if (client.Connect("127.0.0.1", kPort) == dnet::Result::kSuccess) {
+      connected++;
+    }
+  }
+  const double ms = MillisecondsSince(start);
+  run = false;
+  server.join();
+  DLOG_INFO("[{} peers, sequential] {:.2f} ms, {} connected", count, ms,
+            connected);
+}
+
+static void MeasureConnectMany(const dnet::Tcp& listener, const size_t count) {
+  std::atomic<bool> run{true};
+  std::thread server = StartAccepting(listener, run);
+  const auto endpoint = dnet::Endpoint::Resolve("127.0.0.1", kPort);
+  if (!endpoint.has_value()) {
+    DLOG_ERROR("failed to resolve");
+    run = false;
+    server.join();
+    return;
+  }
+  std::vector<dnet::Tcp> clients(count);
+  const std::vector<dnet::Endpoint> endpoints(count, endpoint.value());
+  std::vector<dnet::Result> results(count, dnet::Result::kFail);
+  const auto start = Clock::now();
+  const size_t connected =
+      dnet::ConnectMany(clients.data(), endpoints.data(), count,
+                        std::chrono::seconds(5), results.data());
+  const double ms = MillisecondsSince(start);
+  run = false;
+  server.join();
+  DLOG_INFO("[{} peers, ConnectMany] {:.2f} ms, {} connected", count, ms,
+            connected);
+}
+
+int main() {
+  dnet::Tcp listener{};
+  if (listener.StartServer(kPort) != dnet::Result::kSuccess ||
+      listener.SetBlocking(false) != dnet::Result::kSuccess) {
+    DLOG_ERROR("failed to listen [{}]", listener.LastErrorToString());
+    return 1;
+  }
+  for (const size_t count : {100, 500, 1000}) {
+    MeasureSequential(listener, count);
+    MeasureConnectMany(listener, count);
+  }
+  return 0;
+}
@@ -0,0 +1,90 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <dlog.hpp>
+#include <dnet/net/endpoint.hpp>
+#include <dnet/net/udp.hpp>
+#include <dnet/util/types.hpp>
+#include <dnet/util/util.hpp>
+#include <chrono>
+#include <vector>
+
+// ============================================================ //
+// Datagrams per second sent with WriteTo when given the address as a
+// string, resolved on every call, compared to a resolved Endpoint.
+// ============================================================ //
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t kDatagramCount = 200000;
+constexpr size_t kDatagramSize = 64;
+
+template <typename TSend>
+static void Measure(const char* name, const dnet::Udp& receiver, TSend send) {
+  std::vector<u8> buf(kDatagramSize);
+  const auto start = Clock::now();
+  for (size_t i = 0; i < kDatagramCount; i++) {
+    if (!send()) {
+      DLOG_ERROR("[{}] failed to send", name);
+      return;
+    }
+    // drain as we go, so the socket buffer never overflows
+    if (!receiver.Read(buf.data(), buf.size()).has_value()) {
+      DLOG_ERROR("[{}] failed to read", name);
+      return;
+    }
+  }
+  const auto stop = Clock::now();
+  const double seconds =
+      std::chrono::duration_cast<std::chrono::duration<double>>(stop - start)
+          .count();
+  DLOG_INFO("[{}] {:.0f} datagrams/sec", name, kDatagramCount / seconds);
+}
+
+int main() {
+  dnet::Startup();
+
+  constexpr u16 port = 4500;
+  dnet::Udp receiver{};
+  dnet::Udp sender{};
+  if (receiver.StartServer(port) != dnet::Result::kSuccess ||
+      sender.Open() != dnet::Result::kSuccess) {
+    DLOG_ERROR("failed to set up [{}]", receiver.LastErrorToString());
+    return 1;
+  }
+
+  const std::vector<u8> payload(kDatagramSize, 0xA);
+  Measure("string", receiver, [&] {
+    return sender.WriteTo(payload.data(), payload.size(), "127.0.0.1", port)
+        .has_value();
+  });
+  const auto endpoint = dnet::Endpoint::Resolve("127.0.0.1", port).value();
+  Measure("endpoint", receiver, [&] {
+    return sender.WriteTo(payload.data(), payload.size(), endpoint)
+        .has_value();
+  });
+
+  dnet::Shutdown();
+  return 0;
+}
@@ -0,0 +1,92 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <dlog.hpp>
+#include <dnet/net/endpoint.hpp>
+#include <dnet/net/endpoint_map.hpp>
+#include <dnet/util/types.hpp>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// ============================================================ //
+// Lookups per second of 50k peers, by the source endpoint of a datagram,
+// in an EndpointMap compared to a std::unordered_map.
+// ============================================================ //
+
+using Clock = std::chrono::steady_clock;
+
+constexpr u32 kPeerCount = 50000;
+constexpr size_t kLookupCount = 10000000;
+
+template <typename TFind>
+static void Measure(const char* name, const std::vector<dnet::Endpoint>& order,
+                    TFind find) {
+  u64 sum = 0;
+  const auto start = Clock::now();
+  for (size_t i = 0; i < kLookupCount; i++) {
+    sum += find(order[i % order.size()]);
+  }
+  const auto stop = Clock::now();
+  const double seconds =
+      std::chrono::duration_cast<std::chrono::duration<double>>(stop - start)
+          .count();
+  DLOG_INFO("[{}] {:.0f} lookups/sec (checksum {})", name,
+            kLookupCount / seconds, sum);
+}
+
+int main() {
+  std::vector<dnet::Endpoint> endpoints{};
+  for (u32 i = 0; i < kPeerCount; i++) {
+    const std::string ip = "10." + std::to_string((i >> 16) & 0xff) + "." +
+                           std::to_string((i >> 8) & 0xff) + "." +
+                           std::to_string(i & 0xff);
+    endpoints.push_back(
+        dnet::Endpoint::Resolve(ip, static_cast<u16>(1024 + i % 7)).value());
+  }
+
+  dnet::EndpointMap<u32> map{kPeerCount};
+  std::unordered_map<dnet::Endpoint, u32> unordered{};
+  unordered.reserve(kPeerCount);
+  for (u32 i = 0; i < kPeerCount; i++) {
+    map.Insert(endpoints[i], i);
+    unordered.emplace(endpoints[i], i);
+  }
+
+  // datagrams come in from peers in no particular order
+  std::vector<dnet::Endpoint> order = endpoints;
+  std::shuffle(order.begin(), order.end(), std::mt19937{1337});
+
+  Measure("unordered_map", order, [&](const dnet::Endpoint& endpoint) {
+    return unordered.find(endpoint)->second;
+  });
+  Measure("endpoint_map", order, [&](const dnet::Endpoint& endpoint) {
+    return *map.Find(endpoint);
+  });
+  return 0;
+}
@@ -0,0 +1,192 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <dlog.hpp>
+#include <dnet/net/udp.hpp>
+#include <dnet/network_handler.hpp>
+#include <dnet/util/types.hpp>
+#include <dnet/util/util.hpp>
+#include <dutil/queue.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ============================================================ //
+// Compares the poller based network worker with the old loop that
+// slept for 100us whenever it was idle.
+// ============================================================ //
+
+using Packet = std::vector<u8>;
+using Clock = std::chrono::steady_clock;
+
+/**
+ * A copy of how the network worker used to run, it checks the queue and
+ * socket, then sleeps for 100us if there was nothing to do.
+ */
+class PollingSender {
+ public:
+  PollingSender(const std::string& ip, const u16 port) {
+    const auto res = udp_.Connect(ip, port);
+    if (res != dnet::Result::kSuccess) {
+      DLOG_ERROR("failed to connect [{}]", udp_.LastErrorToString());
+    }
+    thread_ = std::thread(&PollingSender::Loop, this);
+  }
+
+  ~PollingSender() {
+    run_ = false;
+    thread_.join();
+  }
+
+  bool Send(Packet&& packet) {
+    return queue_.Push(std::move(packet)) == dutil::QueueResult::kSuccess;
+  }
+
+ private:
+  void Loop() {
+    Packet packet(std::numeric_limits<u16>::max());
+    while (run_) {
+      bool did_work = false;
+      if (udp_.CanWrite() && !queue_.Empty()) {
+        did_work = true;
+        Packet to_send{};
+        queue_.Pop(to_send);
+        udp_.Write(to_send.data(), to_send.size());
+      }
+      if (udp_.CanRead()) {
+        did_work = true;
+        udp_.Read(packet.data(), packet.size());
+      }
+      if (!did_work) {
+        constexpr std::chrono::microseconds sleep_time_us{100};
+        std::this_thread::sleep_for(sleep_time_us);
+      }
+    }
+  }
+
+  dutil::Queue<Packet> queue_{512};
+  dnet::Udp udp_{};
+  std::atomic<bool> run_{true};
+  std::thread thread_{};
+};
+
+/**
+ * Measure the time from handing a packet to the sender, until it can be
+ * read from the sink socket.
+ */
+template <typename TSendFn>
+static void MeasureLatency(const std::string& name, dnet::Udp& sink,
+                           TSendFn send_fn) {
+  constexpr int kIterations = 5000;
+  constexpr size_t kPacketSize = 32;
+  std::vector<s64> samples_ns{};
+  samples_ns.reserve(kIterations);
+  Packet buf(std::numeric_limits<u16>::max());
+
+  for (int i = 0; i < kIterations; i++) {
+    const auto start = Clock::now();
+    if (!send_fn(Packet(kPacketSize, static_cast<u8>(i)))) {
+      DLOG_ERROR("[{}] failed to send", name);
+      return;
+    }
+    const auto maybe_bytes = sink.Read(buf.data(), buf.size());
+    const auto stop = Clock::now();
+    if (!maybe_bytes.has_value()) {
+      DLOG_ERROR("[{}] failed to read [{}]", name, sink.LastErrorToString());
+      return;
+    }
+    samples_ns.push_back(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start)
+            .count());
+  }
+
+  std::sort(samples_ns.begin(), samples_ns.end());
+  const auto percentile = [&samples_ns](const double p) {
+    return samples_ns[static_cast<size_t>(p * (samples_ns.size() - 1))] /
+           1000.0;
+  };
+  DLOG_INFO("[{}] send to wire latency p50 {:.1f} us, p99 {:.1f} us", name,
+            percentile(0.5), percentile(0.99));
+}
+
+/**
+ * @return Process cpu time used, in percent of one core, while the sender
+ * was idle.
+ */
+static double MeasureIdleCpu() {
+  constexpr auto kIdleTime = std::chrono::seconds(1);
+  const std::clock_t start = std::clock();
+  std::this_thread::sleep_for(kIdleTime);
+  const std::clock_t stop = std::clock();
+  const double cpu_s = static_cast<double>(stop - start) / CLOCKS_PER_SEC;
+  return 100.0 * cpu_s /
+         std::chrono::duration_cast<std::chrono::duration<double>>(kIdleTime)
+             .count();
+}
+
+int main() {
+  dnet::Startup();
+
+  constexpr u16 port = 4000;
+  dnet::Udp sink{};
+  if (sink.StartServer(port) != dnet::Result::kSuccess) {
+    DLOG_ERROR("failed to start sink [{}]", sink.LastErrorToString());
+    return 1;
+  }
+
+  {
+    PollingSender sender{"localhost", port};
+    MeasureLatency("sleep loop", sink, [&sender](Packet&& packet) {
+      return sender.Send(std::move(packet));
+    });
+    DLOG_INFO("[sleep loop] idle cpu {:.2f}%", MeasureIdleCpu());
+  }
+
+  {
+    dnet::NetworkHandler<Packet, dnet::Udp> nh{};
+    if (nh.Connect("localhost", port) != dnet::Result::kSuccess) {
+      DLOG_ERROR("network handler failed to queue the connect");
+      return 1;
+    }
+    while (!nh.HasEvent()) {
+      std::this_thread::yield();
+    }
+    if (nh.GetEvent().type() != dnet::NetworkEvent::Type::kConnected) {
+      DLOG_ERROR("network handler failed to connect");
+      return 1;
+    }
+    MeasureLatency("poller", sink, [&nh](Packet&& packet) {
+      return nh.Send(std::move(packet));
+    });
+    DLOG_INFO("[poller] idle cpu {:.2f}%", MeasureIdleCpu());
+  }
+
+  dnet::Shutdown();
+  return 0;
+}
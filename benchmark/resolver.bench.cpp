@@ -0,0 +1,110 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <dlog.hpp>
+#include <dnet/net/endpoint.hpp>
+#include <dnet/net/resolver.hpp>
+#include <dnet/net/udp.hpp>
+#include <dnet/util/types.hpp>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// ============================================================ //
+// Name lookups per second, calling the system resolver each time, or
+// going through a Resolver. Then WriteTo with a host name, the udp
+// fan-out case, which now hits the cache.
+// ============================================================ //
+
+using Clock = std::chrono::steady_clock;
+
+constexpr u16 kPort = 5100;
+constexpr auto kDuration = std::chrono::seconds(1);
+
+template <typename TResolve>
+static void Measure(const char* name, const std::string& host,
+                    TResolve resolve) {
+  u64 lookups = 0;
+  u64 failures = 0;
+  const auto start = Clock::now();
+  while (Clock::now() - start < kDuration) {
+    // different ports, as a fan-out to several services on the host
+    for (u16 i = 0; i < 64; i++) {
+      if (!resolve(host, static_cast<u16>(kPort + i)).has_value()) {
+        failures++;
+      }
+    }
+    lookups += 64;
+  }
+  const double seconds =
+      std::chrono::duration_cast<std::chrono::duration<double>>(Clock::now() -
+                                                                start)
+          .count();
+  DLOG_INFO("[{}, {}] {:.0f} lookups/sec, {} failed", name, host,
+            lookups / seconds, failures);
+}
+
+static void MeasureWriteTo() {
+  dnet::Udp server{};
+  dnet::Udp client{};
+  if (server.StartServer(kPort) != dnet::Result::kSuccess ||
+      server.SetBlocking(false) != dnet::Result::kSuccess ||
+      client.Connect("127.0.0.1", kPort) != dnet::Result::kSuccess) {
+    DLOG_ERROR("failed to set up [{}]", server.LastErrorToString());
+    return;
+  }
+  const u8 byte = 1;
+  u8 read = 0;
+  u64 sent = 0;
+  const auto start = Clock::now();
+  while (Clock::now() - start < kDuration) {
+    for (int i = 0; i < 64; i++) {
+      if (client.WriteTo(&byte, 1, "localhost", kPort) == 1) {
+        sent++;
+      }
+      // keep the receive buffer from filling
+      (void)server.Read(&read, 1);
+    }
+  }
+  const double seconds =
+      std::chrono::duration_cast<std::chrono::duration<double>>(Clock::now() -
+                                                                start)
+          .count();
+  DLOG_INFO("[WriteTo localhost] {:.0f} datagrams/sec", sent / seconds);
+}
+
+int main() {
+  for (const std::string host : {"localhost", "127.0.0.1"}) {
+    Measure("system resolver", host, [](const std::string& h, const u16 port) {
+      return dnet::Endpoint::Resolve(h, port);
+    });
+    dnet::Resolver resolver{};
+    Measure("Resolver", host, [&resolver](const std::string& h, const u16 port) {
+      return resolver.Resolve(h, port);
+    });
+  }
+  MeasureWriteTo();
+  return 0;
+}
@@ -0,0 +1,248 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <dlog.hpp>
+#include <dnet/net/poller.hpp>
+#include <dnet/net/socket.hpp>
+#include <dnet/net/tcp.hpp>
+#include <dnet/net/udp.hpp>
+#include <dnet/util/types.hpp>
+#include <dnet/util/util.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// ============================================================ //
+// Accepts and datagrams per second, by amount of server threads. Either
+// all threads share one socket, or each has its own SO_REUSEPORT socket on
+// the same port, pinned to its own cpu with SO_INCOMING_CPU steering.
+// Usage: reuse_port_bench [thread count]...
+// ============================================================ //
+
+using Clock = std::chrono::steady_clock;
+
+constexpr u16 kTcpPort = 4800;
+constexpr u16 kUdpPort = 4801;
+constexpr auto kDuration = std::chrono::seconds(1);
+constexpr u32 kClientThreads = 4;
+// distinct flows per sending thread, for the kernel to spread
+constexpr u32 kSocketsPerSender = 8;
+constexpr size_t kDatagramSize = 64;
+constexpr size_t kBatchSize = 32;
+
+/**
+ * Open the server sockets, one shared or one per thread.
+ */
+template <typename TTransport>
+static bool Listen(std::vector<std::unique_ptr<TTransport>>& sockets,
+                   const u16 port, const u32 threads, const bool reuse_port) {
+  const u32 count = reuse_port ? threads : 1;
+  const u32 cpu_count = std::thread::hardware_concurrency();
+  for (u32 i = 0; i < count; i++) {
+    dnet::ListenOptions options{};
+    options.reuse_port = reuse_port;
+    if (reuse_port && cpu_count > 0) {
+      options.incoming_cpu = i % cpu_count;
+    }
+    auto socket = std::make_unique<TTransport>();
+    if (socket->StartServer(port, options) != dnet::Result::kSuccess ||
+        socket->SetBlocking(false) != dnet::Result::kSuccess) {
+      return false;
+    }
+    sockets.push_back(std::move(socket));
+  }
+  return true;
+}
+
+/**
+ * Run @serve(socket) on @threads threads, pinned, until @run is cleared.
+ */
+template <typename TTransport, typename TServe>
+static std::vector<std::thread> StartServers(
+    const std::vector<std::unique_ptr<TTransport>>& sockets, const u32 threads,
+    const std::atomic<bool>& run, TServe serve) {
+  std::vector<std::thread> servers{};
+  const u32 cpu_count = std::thread::hardware_concurrency();
+  for (u32 i = 0; i < threads; i++) {
+    const TTransport& socket = *sockets[i % sockets.size()];
+    servers.emplace_back([&socket, &run, serve]() {
+      dnet::Poller poller{};
+      if (poller.Add(socket.GetHandle(), 0, dnet::poll_flag::kRead) !=
+          dnet::Result::kSuccess) {
+        return;
+      }
+      dnet::PollEvent event{};
+      while (run.load(std::memory_order_relaxed)) {
+        if (poller.Wait(&event, 1, 10) > 0) {
+          serve(socket);
+        }
+      }
+    });
+    if (cpu_count > 0) {
+      dnet::PinThreadToCpu(servers.back(), i % cpu_count);
+    }
+  }
+  return servers;
+}
+
+static void MeasureAccepts(const u32 threads, const bool reuse_port) {
+  std::vector<std::unique_ptr<dnet::Tcp>> listeners{};
+  if (!Listen(listeners, kTcpPort, threads, reuse_port)) {
+    DLOG_ERROR("failed to listen, reuse port {}", reuse_port);
+    return;
+  }
+  std::atomic<bool> run{true};
+  std::atomic<u64> accepts{0};
+  auto servers =
+      StartServers(listeners, threads, run, [&accepts](const dnet::Tcp& tcp) {
+        // the accepted connection is closed right away
+        while (tcp.Accept().has_value()) {
+          accepts.fetch_add(1, std::memory_order_relaxed);
+        }
+      });
+
+  std::vector<std::thread> clients{};
+  const auto start = Clock::now();
+  for (u32 i = 0; i < kClientThreads; i++) {
+    clients.emplace_back([start]() {
+      u8 byte = 0;
+      while (Clock::now() - start < kDuration) {
+        dnet::Tcp client{};
+        if (client.Connect("127.0.0.1", kTcpPort) != dnet::Result::kSuccess) {
+          return;
+        }
+        // wait for the server to close first, so that it is the server side
+        // that lingers in TIME_WAIT, rather than the client's ports
+        (void)client.Read(&byte, 1);
+      }
+    });
+  }
+  for (std::thread& client : clients) {
+    client.join();
+  }
+  const double seconds =
+      std::chrono::duration_cast<std::chrono::duration<double>>(Clock::now() -
+                                                                start)
+          .count();
+  run = false;
+  for (std::thread& server : servers) {
+    server.join();
+  }
+  DLOG_INFO("[{} threads, {}] {:.0f} accepts/sec", threads,
+            reuse_port ? "reuse port" : "shared socket",
+            accepts.load() / seconds);
+}
+
+static void MeasureDatagrams(const u32 threads, const bool reuse_port) {
+  std::vector<std::unique_ptr<dnet::Udp>> receivers{};
+  if (!Listen(receivers, kUdpPort, threads, reuse_port)) {
+    DLOG_ERROR("failed to listen, reuse port {}", reuse_port);
+    return;
+  }
+  std::atomic<bool> run{true};
+  std::atomic<u64> datagrams{0};
+  auto servers =
+      StartServers(receivers, threads, run, [&datagrams](const dnet::Udp& udp) {
+        std::vector<u8> storage(kBatchSize * kDatagramSize);
+        dnet::DatagramBuffer buffers[kBatchSize];
+        for (size_t i = 0; i < kBatchSize; i++) {
+          buffers[i].data = storage.data() + i * kDatagramSize;
+          buffers[i].capacity = kDatagramSize;
+        }
+        for (;;) {
+          const auto read = udp.ReadBatch(buffers, kBatchSize);
+          if (!read.has_value() || read.value() <= 0) {
+            return;
+          }
+          datagrams.fetch_add(static_cast<u64>(read.value()),
+                              std::memory_order_relaxed);
+        }
+      });
+
+  std::vector<std::thread> senders{};
+  const auto start = Clock::now();
+  for (u32 i = 0; i < kClientThreads; i++) {
+    senders.emplace_back([start]() {
+      std::vector<dnet::Udp> sockets(kSocketsPerSender);
+      for (dnet::Udp& socket : sockets) {
+        if (socket.Connect("127.0.0.1", kUdpPort) != dnet::Result::kSuccess) {
+          return;
+        }
+      }
+      const std::vector<u8> payload(kDatagramSize, 1);
+      dnet::IoBuffer batch[kBatchSize];
+      for (dnet::IoBuffer& buffer : batch) {
+        buffer = dnet::IoBuffer{payload.data(), payload.size()};
+      }
+      while (Clock::now() - start < kDuration) {
+        for (dnet::Udp& socket : sockets) {
+          (void)socket.WriteBatch(batch, kBatchSize);
+        }
+      }
+    });
+  }
+  for (std::thread& sender : senders) {
+    sender.join();
+  }
+  const double seconds =
+      std::chrono::duration_cast<std::chrono::duration<double>>(Clock::now() -
+                                                                start)
+          .count();
+  // let the receivers drain what is queued
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  run = false;
+  for (std::thread& server : servers) {
+    server.join();
+  }
+  DLOG_INFO("[{} threads, {}] {:.0f} datagrams/sec", threads,
+            reuse_port ? "reuse port" : "shared socket",
+            datagrams.load() / seconds);
+}
+
+int main(int argc, char** argv) {
+  dnet::Startup();
+
+  std::vector<u32> thread_counts{};
+  for (int i = 1; i < argc; i++) {
+    thread_counts.push_back(static_cast<u32>(std::atoi(argv[i])));
+  }
+  if (thread_counts.empty()) {
+    thread_counts = {1, 2, 4};
+  }
+  for (const u32 threads : thread_counts) {
+    MeasureAccepts(threads, false);
+    MeasureAccepts(threads, true);
+  }
+  for (const u32 threads : thread_counts) {
+    MeasureDatagrams(threads, false);
+    MeasureDatagrams(threads, true);
+  }
+
+  dnet::Shutdown();
+  return 0;
+}
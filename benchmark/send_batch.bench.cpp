@@ -0,0 +1,142 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <dlog.hpp>
+#include <dnet/net/tcp.hpp>
+#include <dnet/network_handler.hpp>
+#include <dnet/util/types.hpp>
+#include <dnet/util/util.hpp>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// ============================================================ //
+// Compares queueing small packets one by one with Send, against
+// queueing them in batches with SendBatch, over tcp.
+// ============================================================ //
+
+using Packet = std::vector<u8>;
+using Clock = std::chrono::steady_clock;
+using Handler = dnet::NetworkHandler<Packet, dnet::Tcp>;
+
+constexpr size_t kPacketSize = 32;
+constexpr size_t kPacketCount = 200000;
+
+/**
+ * Read from @client until @bytes_total bytes has arrived.
+ */
+static void Drain(dnet::Tcp& client, const size_t bytes_total) {
+  std::vector<u8> buf(1 << 16);
+  size_t bytes = 0;
+  while (bytes < bytes_total) {
+    const auto maybe_bytes = client.Read(buf.data(), buf.size());
+    if (!maybe_bytes.has_value() || maybe_bytes.value() <= 0) {
+      DLOG_ERROR("failed to read [{}]", client.LastErrorToString());
+      return;
+    }
+    bytes += static_cast<size_t>(maybe_bytes.value());
+  }
+}
+
+/**
+ * Send kPacketCount packets with @send_fn, and measure the time until the
+ * last byte has been read by the server.
+ * @param send_fn Called as send_fn(handler, packets, count), must return
+ * how many packets it queued.
+ * @return False if the handler failed to connect.
+ */
+template <typename TSendFn>
+static bool MeasureThroughput(const char* name, dnet::Tcp& server,
+                              const u16 port, TSendFn send_fn) {
+  Handler nh{};
+  if (nh.Connect("localhost", port) != dnet::Result::kSuccess) {
+    DLOG_ERROR("[{}] failed to start connecting", name);
+    return false;
+  }
+  while (!nh.HasEvent()) {
+    std::this_thread::yield();
+  }
+  if (nh.GetEvent().type() != dnet::NetworkEvent::Type::kConnected) {
+    DLOG_ERROR("[{}] failed to connect", name);
+    return false;
+  }
+  auto maybe_client = server.Accept();
+  if (!maybe_client.has_value()) {
+    DLOG_ERROR("[{}] failed to accept [{}]", name, server.LastErrorToString());
+    return false;
+  }
+
+  constexpr size_t kBatchSize = 64;
+  const std::vector<Packet> packets(kBatchSize, Packet(kPacketSize, 0xA));
+
+  const auto start = Clock::now();
+  std::thread reader{Drain, std::ref(maybe_client.value()),
+                     kPacketSize * kPacketCount};
+  size_t sent = 0;
+  while (sent < kPacketCount) {
+    const size_t count = std::min(kBatchSize, kPacketCount - sent);
+    const size_t queued = send_fn(nh, packets.data(), count);
+    if (queued == 0) {
+      std::this_thread::yield();
+    }
+    sent += queued;
+  }
+  reader.join();
+  const auto stop = Clock::now();
+
+  const double seconds =
+      std::chrono::duration_cast<std::chrono::duration<double>>(stop - start)
+          .count();
+  DLOG_INFO("[{}] {:.0f} msgs/sec", name, kPacketCount / seconds);
+  return true;
+}
+
+int main() {
+  dnet::Startup();
+
+  constexpr u16 port = 4200;
+  dnet::Tcp server{};
+  if (server.StartServer(port) != dnet::Result::kSuccess) {
+    DLOG_ERROR("failed to start server [{}]", server.LastErrorToString());
+    return 1;
+  }
+
+  const bool ok =
+      MeasureThroughput("Send", server, port,
+                        [](Handler& nh, const Packet* packets, size_t count) {
+                          size_t queued = 0;
+                          while (queued < count && nh.Send(packets[queued])) {
+                            ++queued;
+                          }
+                          return queued;
+                        }) &&
+      MeasureThroughput("SendBatch", server, port,
+                        [](Handler& nh, const Packet* packets, size_t count) {
+                          return nh.SendBatch(packets, count);
+                        });
+
+  dnet::Shutdown();
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,201 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <dlog.hpp>
+#include <dnet/net/socket_options.hpp>
+#include <dnet/net/tcp.hpp>
+#include <dnet/util/types.hpp>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ============================================================ //
+// Round trip latency, and bulk throughput, over loopback tcp for each
+// SocketOptions preset. The request is written as a header and a body,
+// two small writes, which is where Nagle's algorithm and delayed acks
+// meet.
+// ============================================================ //
+
+using Clock = std::chrono::steady_clock;
+
+constexpr u16 kLatencyPort = 4900;
+constexpr u16 kThroughputPort = 4901;
+constexpr auto kDuration = std::chrono::seconds(1);
+constexpr size_t kHeaderSize = 8;
+constexpr size_t kRequestSize = 64;
+constexpr size_t kChunkSize = 64 * 1024;
+
+struct Preset {
+  std::string name;
+  dnet::SocketOptions options;
+};
+
+/**
+ * Only Nagle's algorithm off, to tell its share of the low latency preset.
+ */
+static dnet::SocketOptions NoDelayOnly() {
+  dnet::SocketOptions options{};
+  options.no_delay = true;
+  return options;
+}
+
+static double Seconds(const Clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::duration<double>>(
+             Clock::now() - start)
+      .count();
+}
+
+/**
+ * Read exactly @size bytes.
+ */
+static bool ReadAll(const dnet::Tcp& tcp, u8* buf, const size_t size) {
+  size_t read = 0;
+  while (read < size) {
+    const auto maybe_bytes = tcp.Read(buf + read, size - read);
+    if (!maybe_bytes.has_value() || maybe_bytes.value() <= 0) {
+      return false;
+    }
+    read += static_cast<size_t>(maybe_bytes.value());
+  }
+  return true;
+}
+
+/**
+ * Accept one client on @port and run @serve on it, in a thread.
+ */
+template <typename TServe>
+static std::thread StartServer(dnet::Tcp& listener, const Preset& preset,
+                               const u16 port, TServe serve) {
+  listener.set_options(preset.options);
+  if (listener.StartServer(port) != dnet::Result::kSuccess) {
+    DLOG_ERROR("failed to listen [{}]", listener.LastErrorToString());
+    return std::thread{};
+  }
+  return std::thread([&listener, serve]() {
+    auto maybe_client = listener.Accept();
+    if (maybe_client.has_value()) {
+      serve(maybe_client.value());
+    }
+  });
+}
+
+static void MeasureLatency(const Preset& preset) {
+  dnet::Tcp listener{};
+  std::thread server =
+      StartServer(listener, preset, kLatencyPort, [](const dnet::Tcp& tcp) {
+        std::vector<u8> request(kRequestSize);
+        while (ReadAll(tcp, request.data(), request.size())) {
+          if (!tcp.Write(request.data(), request.size()).has_value()) {
+            return;
+          }
+        }
+      });
+  if (!server.joinable()) {
+    return;
+  }
+
+  dnet::Tcp client{};
+  client.set_options(preset.options);
+  if (client.Connect("127.0.0.1", kLatencyPort) != dnet::Result::kSuccess) {
+    DLOG_ERROR("failed to connect [{}]", client.LastErrorToString());
+    server.join();
+    return;
+  }
+  std::vector<u8> request(kRequestSize, 1);
+  u64 round_trips = 0;
+  const auto start = Clock::now();
+  while (Clock::now() - start < kDuration) {
+    (void)client.Write(request.data(), kHeaderSize);
+    (void)client.Write(request.data() + kHeaderSize,
+                       kRequestSize - kHeaderSize);
+    if (!ReadAll(client, request.data(), request.size())) {
+      break;
+    }
+    round_trips++;
+  }
+  const double seconds = Seconds(start);
+  client.Disconnect();
+  server.join();
+  DLOG_INFO("[{}] {:.1f} us per round trip, {} round trips", preset.name,
+            round_trips > 0 ? seconds * 1e6 / round_trips : 0.0, round_trips);
+}
+
+static void MeasureThroughput(const Preset& preset) {
+  dnet::Tcp listener{};
+  std::thread server =
+      StartServer(listener, preset, kThroughputPort, [](const dnet::Tcp& tcp) {
+        std::vector<u8> buf(kChunkSize);
+        for (;;) {
+          const auto maybe_bytes = tcp.Read(buf.data(), buf.size());
+          if (!maybe_bytes.has_value() || maybe_bytes.value() <= 0) {
+            return;
+          }
+        }
+      });
+  if (!server.joinable()) {
+    return;
+  }
+
+  dnet::Tcp client{};
+  client.set_options(preset.options);
+  if (client.Connect("127.0.0.1", kThroughputPort) != dnet::Result::kSuccess) {
+    DLOG_ERROR("failed to connect [{}]", client.LastErrorToString());
+    server.join();
+    return;
+  }
+  const std::vector<u8> chunk(kChunkSize, 1);
+  u64 bytes = 0;
+  const auto start = Clock::now();
+  while (Clock::now() - start < kDuration) {
+    const auto maybe_bytes = client.Write(chunk.data(), chunk.size());
+    if (!maybe_bytes.has_value()) {
+      break;
+    }
+    bytes += static_cast<u64>(maybe_bytes.value());
+  }
+  const double seconds = Seconds(start);
+  client.Disconnect();
+  server.join();
+  DLOG_INFO("[{}] {:.0f} MB/sec", preset.name, bytes / seconds / 1e6);
+}
+
+int main() {
+  const std::vector<Preset> presets{
+      {"system default", dnet::SocketOptions{}},
+      {"no delay only", NoDelayOnly()},
+      {"low latency", dnet::SocketOptions::LowLatency()},
+      {"bulk throughput", dnet::SocketOptions::BulkThroughput()}};
+
+  DLOG_INFO("Latency, {} byte requests in two writes", kRequestSize);
+  for (const Preset& preset : presets) {
+    MeasureLatency(preset);
+  }
+  DLOG_INFO("Throughput, {} byte writes", kChunkSize);
+  for (const Preset& preset : presets) {
+    MeasureThroughput(preset);
+  }
+  return 0;
+}
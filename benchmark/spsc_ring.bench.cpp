@@ -0,0 +1,142 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <dlog.hpp>
+#include <dnet/util/spsc_ring.hpp>
+#include <dnet/util/types.hpp>
+#include <dutil/queue.hpp>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ============================================================ //
+// Compares the SpscRing with the dutil::Queue it replaced in SharedData,
+// both in throughput and in the latency of handing a value to another
+// thread and back. Waiting threads yield, so that the numbers stay
+// meaningful on machines with few cores.
+// ============================================================ //
+
+using Clock = std::chrono::steady_clock;
+
+constexpr u64 kThroughputCount = 10000000;
+constexpr int kPingPongCount = 200000;
+constexpr size_t kCapacity = 512;
+
+/**
+ * Adapts the two queues to the same interface.
+ */
+struct RingAdapter {
+  dnet::SpscRing<u64> ring{kCapacity};
+  bool Push(const u64 value) {
+    return ring.Push(value) == dnet::Result::kSuccess;
+  }
+  bool Pop(u64& value) { return ring.Pop(value) == dnet::Result::kSuccess; }
+};
+
+struct QueueAdapter {
+  dutil::Queue<u64> queue{kCapacity};
+  bool Push(const u64 value) {
+    return queue.Push(value) == dutil::QueueResult::kSuccess;
+  }
+  bool Pop(u64& value) {
+    return queue.Pop(value) == dutil::QueueResult::kSuccess;
+  }
+};
+
+template <typename TQueue>
+static void MeasureThroughput(const std::string& name) {
+  TQueue queue{};
+  const auto start = Clock::now();
+  std::thread producer{[&queue]() {
+    for (u64 i = 0; i < kThroughputCount; i++) {
+      while (!queue.Push(i)) {
+        std::this_thread::yield();
+      }
+    }
+  }};
+  u64 popped = 0;
+  u64 value;
+  while (popped < kThroughputCount) {
+    if (queue.Pop(value)) {
+      ++popped;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+  const double seconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  DLOG_INFO("[{}] throughput {:.1f} M items/sec", name,
+            kThroughputCount / seconds / 1e6);
+}
+
+template <typename TQueue>
+static void MeasurePingPong(const std::string& name) {
+  TQueue ping{};
+  TQueue pong{};
+  std::thread echo{[&ping, &pong]() {
+    u64 value;
+    for (int i = 0; i < kPingPongCount; i++) {
+      while (!ping.Pop(value)) {
+        std::this_thread::yield();
+      }
+      while (!pong.Push(value)) {
+        std::this_thread::yield();
+      }
+    }
+  }};
+
+  std::vector<s64> samples_ns{};
+  samples_ns.reserve(kPingPongCount);
+  u64 value;
+  for (int i = 0; i < kPingPongCount; i++) {
+    const auto start = Clock::now();
+    while (!ping.Push(static_cast<u64>(i))) {
+      std::this_thread::yield();
+    }
+    while (!pong.Pop(value)) {
+      std::this_thread::yield();
+    }
+    samples_ns.push_back(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                             start)
+            .count());
+  }
+  echo.join();
+
+  std::sort(samples_ns.begin(), samples_ns.end());
+  DLOG_INFO("[{}] round trip p50 {} ns, p99 {} ns", name,
+            samples_ns[samples_ns.size() / 2],
+            samples_ns[samples_ns.size() * 99 / 100]);
+}
+
+int main() {
+  MeasureThroughput<QueueAdapter>("dutil::Queue");
+  MeasureThroughput<RingAdapter>("SpscRing");
+  MeasurePingPong<QueueAdapter>("dutil::Queue");
+  MeasurePingPong<RingAdapter>("SpscRing");
+  return 0;
+}
@@ -0,0 +1,154 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <dlog.hpp>
+#include <dnet/net/tcp.hpp>
+#include <dnet/tcp_connection.hpp>
+#include <dnet/util/types.hpp>
+#include <dnet/util/util.hpp>
+#include <chrono>
+#include <optional>
+#include <vector>
+
+// ============================================================ //
+// Compares reading small packets the way TcpConnection used to, one
+// read for the header and one for the payload, against the buffered
+// TcpConnection::Read.
+// ============================================================ //
+
+using Payload = std::vector<u8>;
+using Connection = dnet::TcpConnection<Payload>;
+using Header = Connection::Header;
+using Clock = std::chrono::steady_clock;
+
+// small enough that a whole round fits in the socket buffers, so the
+// reads can be timed on their own
+constexpr int kRoundPacketCount = 10000;
+constexpr int kRounds = 20;
+constexpr size_t kPayloadSize = 32;
+
+/**
+ * A copy of how TcpConnection::Read used to work.
+ */
+static bool UnbufferedRead(const dnet::Tcp& tcp, Payload& payload_out) {
+  Header header{};
+  size_t bytes = 0;
+  while (bytes < Header::header_size()) {
+    const auto maybe_bytes =
+        tcp.Read(header.get() + bytes, Header::header_size() - bytes);
+    if (!maybe_bytes.has_value() || maybe_bytes.value() <= 0) {
+      return false;
+    }
+    bytes += static_cast<size_t>(maybe_bytes.value());
+  }
+  payload_out.resize(header.payload_size());
+  bytes = 0;
+  while (bytes < header.payload_size()) {
+    const auto maybe_bytes = tcp.Read(payload_out.data() + bytes,
+                                      header.payload_size() - bytes);
+    if (!maybe_bytes.has_value() || maybe_bytes.value() <= 0) {
+      return false;
+    }
+    bytes += static_cast<size_t>(maybe_bytes.value());
+  }
+  return true;
+}
+
+/**
+ * Each round, write a batch of packets with @client, then time reading
+ * them back with @read_fn.
+ * @param read_fn Called as read_fn(payload_out), must return if it
+ * succeeded.
+ */
+template <typename TReadFn>
+static void Measure(const char* name, Connection& client, TReadFn read_fn) {
+  const Payload payload(kPayloadSize, 0xA);
+  Payload payload_out{};
+  Clock::duration elapsed{};
+  for (int round = 0; round < kRounds; round++) {
+    for (int i = 0; i < kRoundPacketCount; i++) {
+      if (client.Write(dnet::HeaderDataExample{}, payload) !=
+          dnet::Result::kSuccess) {
+        DLOG_ERROR("[{}] failed to write [{}]", name,
+                   client.LastErrorToString());
+        return;
+      }
+    }
+    const auto start = Clock::now();
+    for (int i = 0; i < kRoundPacketCount; i++) {
+      if (!read_fn(payload_out)) {
+        DLOG_ERROR("[{}] failed to read packet {}", name, i);
+        return;
+      }
+    }
+    elapsed += Clock::now() - start;
+  }
+  const double seconds =
+      std::chrono::duration_cast<std::chrono::duration<double>>(elapsed)
+          .count();
+  DLOG_INFO("[{}] {:.0f} msgs/sec", name,
+            kRounds * kRoundPacketCount / seconds);
+}
+
+int main() {
+  dnet::Startup();
+
+  {
+    constexpr u16 port = 4300;
+    dnet::Tcp server{};
+    Connection client{};
+    if (server.StartServer(port) != dnet::Result::kSuccess ||
+        client.Connect("localhost", port) != dnet::Result::kSuccess) {
+      DLOG_ERROR("failed to set up [{}]", server.LastErrorToString());
+      return 1;
+    }
+    std::optional<dnet::Tcp> peer = server.Accept();
+    if (peer.has_value()) {
+      Measure("unbuffered", client, [&peer](Payload& payload_out) {
+        return UnbufferedRead(peer.value(), payload_out);
+      });
+    }
+  }
+
+  {
+    constexpr u16 port = 4301;
+    Connection server{};
+    Connection client{};
+    if (server.StartServer(port) != dnet::Result::kSuccess ||
+        client.Connect("localhost", port) != dnet::Result::kSuccess) {
+      DLOG_ERROR("failed to set up [{}]", server.LastErrorToString());
+      return 1;
+    }
+    std::optional<Connection> peer = server.Accept();
+    if (peer.has_value()) {
+      Measure("buffered", client, [&peer](Payload& payload_out) {
+        auto [res, header_data] = peer.value().Read(payload_out);
+        return res == dnet::Result::kSuccess;
+      });
+    }
+  }
+
+  dnet::Shutdown();
+  return 0;
+}
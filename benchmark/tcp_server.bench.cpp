@@ -0,0 +1,207 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <dlog.hpp>
+#include <dnet/net/poller.hpp>
+#include <dnet/tcp_connection.hpp>
+#include <dnet/tcp_server.hpp>
+#include <dnet/util/types.hpp>
+#include <dnet/util/util.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+// ============================================================ //
+// Echo round trips per second with 1k and 10k clients all in flight at
+// once, served by a thread per client, as in examples/echo_server.cpp,
+// compared to a TcpServer with a single event loop.
+// Usage: tcp_server_bench [client count]...
+// ============================================================ //
+
+using Payload = std::vector<u8>;
+using Connection = dnet::TcpConnection<Payload>;
+using Server = dnet::TcpServer<Payload>;
+using Clock = std::chrono::steady_clock;
+
+constexpr u16 kThreadPerClientPort = 4700;
+constexpr u16 kTcpServerPort = 4701;
+constexpr u32 kRounds = 20;
+constexpr size_t kPayloadSize = 64;
+// for both servers and the clients, the default 64k adds up at 10k clients
+constexpr size_t kRecvBufferSize = 4 * 1024;
+
+static void Flush(Connection& client) {
+  dnet::Result res;
+  do {
+    res = client.Flush();
+  } while (res == dnet::Result::kWouldBlock);
+}
+
+/**
+ * Connect @count clients, then have each send a packet and wait for its
+ * echo @kRounds times, all clients at once.
+ * @return Round trips per second, 0 if something failed.
+ */
+static double RunClients(const u16 port, const u32 count) {
+  std::vector<Connection> clients(count);
+  dnet::Poller poller{};
+  for (u32 i = 0; i < count; i++) {
+    Connection& client = clients[i];
+    client.set_recv_buffer_size(kRecvBufferSize);
+    if (client.Connect("localhost", port) != dnet::Result::kSuccess ||
+        client.SetBlocking(false) != dnet::Result::kSuccess ||
+        poller.Add(client.GetHandle(), i, dnet::poll_flag::kRead) !=
+            dnet::Result::kSuccess) {
+      DLOG_ERROR("failed to connect client {} [{}]", i,
+                 client.LastErrorToString());
+      return 0;
+    }
+  }
+
+  const Payload payload(kPayloadSize, 1);
+  std::vector<u32> rounds_left(count, kRounds);
+  const auto start = Clock::now();
+  for (Connection& client : clients) {
+    (void)client.WriteBuffered(dnet::HeaderDataExample{}, payload);
+    Flush(client);
+  }
+
+  constexpr int kMaxEvents = 256;
+  dnet::PollEvent events[kMaxEvents];
+  Payload echo{};
+  u64 done = 0;
+  while (done < static_cast<u64>(count) * kRounds) {
+    const int event_count =
+        poller.Wait(events, kMaxEvents, dnet::Poller::kInfinite);
+    if (event_count < 0) {
+      return 0;
+    }
+    for (int i = 0; i < event_count; i++) {
+      const auto index = static_cast<u32>(events[i].token);
+      Connection& client = clients[index];
+      for (;;) {
+        auto [res, header_data] = client.TryRead(echo);
+        if (res == dnet::Result::kNeedMoreData) {
+          break;
+        }
+        if (res != dnet::Result::kSuccess) {
+          DLOG_ERROR("client {} lost its connection", index);
+          return 0;
+        }
+        done++;
+        if (--rounds_left[index] > 0) {
+          (void)client.WriteBuffered(header_data, payload);
+        }
+      }
+      Flush(client);
+    }
+  }
+  const double seconds =
+      std::chrono::duration_cast<std::chrono::duration<double>>(Clock::now() -
+                                                                start)
+          .count();
+  return done / seconds;
+}
+
+static void Serve(Connection client) {
+  Payload payload{};
+  for (;;) {
+    auto [res, header_data] = client.Read(payload);
+    if (res != dnet::Result::kSuccess ||
+        client.Write(header_data, payload) != dnet::Result::kSuccess) {
+      return;
+    }
+  }
+}
+
+static void MeasureThreadPerClient(const u32 count) {
+  Connection server{};
+  if (server.StartServer(kThreadPerClientPort) != dnet::Result::kSuccess) {
+    DLOG_ERROR("failed to start server [{}]", server.LastErrorToString());
+    return;
+  }
+  std::vector<std::thread> threads{};
+  threads.reserve(count);
+  std::thread acceptor{[&]() {
+    while (threads.size() < count) {
+      auto maybe_client = server.Accept();
+      if (!maybe_client.has_value()) {
+        return;
+      }
+      maybe_client.value().set_recv_buffer_size(kRecvBufferSize);
+      threads.emplace_back(Serve, std::move(maybe_client.value()));
+    }
+  }};
+
+  const double rate = RunClients(kThreadPerClientPort, count);
+  // the clients are gone, so are the threads serving them
+  acceptor.join();
+  const size_t thread_count = threads.size();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  DLOG_INFO("[thread per client] {} clients, {} threads, {:.0f} echoes/sec",
+            count, thread_count + 1, rate);
+}
+
+static void MeasureTcpServer(const u32 count) {
+  dnet::TcpServerOptions options{};
+  options.recv_buffer_size = kRecvBufferSize;
+  Server server{options};
+  server.set_on_message([](Server::Client& client,
+                           const dnet::HeaderDataExample& header_data,
+                           Payload& payload) {
+    (void)client.Write(header_data, payload);
+  });
+  if (server.Start(kTcpServerPort) != dnet::Result::kSuccess) {
+    DLOG_ERROR("failed to start server");
+    return;
+  }
+  const double rate = RunClients(kTcpServerPort, count);
+  DLOG_INFO("[tcp server] {} clients, {} threads, {:.0f} echoes/sec", count,
+            server.loop_count(), rate);
+}
+
+int main(int argc, char** argv) {
+  dnet::Startup();
+  // each client takes two descriptors, its own and the server's
+  dnet::SetNofdSoftLimit(dnet::NOFD_HARD_LIMIT);
+
+  std::vector<u32> counts{};
+  for (int i = 1; i < argc; i++) {
+    counts.push_back(static_cast<u32>(std::atoi(argv[i])));
+  }
+  if (counts.empty()) {
+    counts = {1000, 10000};
+  }
+  for (const u32 count : counts) {
+    MeasureThreadPerClient(count);
+    MeasureTcpServer(count);
+  }
+
+  dnet::Shutdown();
+  return 0;
+}
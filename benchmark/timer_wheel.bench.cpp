@@ -0,0 +1,133 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <dlog.hpp>
+#include <dnet/util/timer_wheel.hpp>
+#include <dnet/util/types.hpp>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <random>
+#include <vector>
+
+// ============================================================ //
+// 100k connections that each hold a timeout, moved every time the
+// connection hears from its peer, in a TimerWheel compared to a std::multimap
+// ordered by deadline. Then time runs for a minute of idle timeouts.
+// ============================================================ //
+
+using Clock = dnet::TimerWheel::Clock;
+using std::chrono::milliseconds;
+
+constexpr u32 kConnectionCount = 100000;
+constexpr size_t kRearmCount = 5000000;
+constexpr s64 kTimeoutMs = 10000;
+constexpr s64 kRunMs = 60000;
+
+static double SecondsSince(const Clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::duration<double>>(
+             Clock::now() - start)
+      .count();
+}
+
+static void MeasureWheel(const std::vector<u32>& order) {
+  const Clock::time_point epoch = Clock::now();
+  dnet::TimerWheel wheel{epoch};
+  std::vector<dnet::TimerId> timers(kConnectionCount);
+  u64 fired = 0;
+  const auto Arm = [&](const u32 connection, const s64 now_ms) {
+    timers[connection] = wheel.Schedule(
+        epoch + milliseconds(now_ms + kTimeoutMs), [&fired]() { fired++; });
+  };
+  for (u32 i = 0; i < kConnectionCount; i++) {
+    Arm(i, i % kTimeoutMs);
+  }
+
+  auto start = Clock::now();
+  for (size_t i = 0; i < kRearmCount; i++) {
+    const u32 connection = order[i % order.size()];
+    wheel.Cancel(timers[connection]);
+    Arm(connection, i % kTimeoutMs);
+  }
+  DLOG_INFO("[timer_wheel] {:.0f} rearms/sec",
+            kRearmCount / SecondsSince(start));
+
+  start = Clock::now();
+  u64 wakeups = 0;
+  for (s64 now_ms = 0; now_ms < kRunMs;) {
+    wheel.Advance(epoch + milliseconds(now_ms));
+    wakeups++;
+    const int timeout_ms = wheel.TimeoutMs(epoch + milliseconds(now_ms));
+    now_ms = timeout_ms >= 0 ? now_ms + timeout_ms : kRunMs;
+  }
+  DLOG_INFO("[timer_wheel] {} fired over {} wakeups in {:.3f} sec", fired,
+            wakeups, SecondsSince(start));
+}
+
+static void MeasureMultimap(const std::vector<u32>& order) {
+  using Map = std::multimap<s64, u32>;
+  Map timers{};
+  std::vector<Map::iterator> handles(kConnectionCount);
+  const auto Arm = [&](const u32 connection, const s64 now_ms) {
+    handles[connection] = timers.emplace(now_ms + kTimeoutMs, connection);
+  };
+  for (u32 i = 0; i < kConnectionCount; i++) {
+    Arm(i, i % kTimeoutMs);
+  }
+
+  auto start = Clock::now();
+  for (size_t i = 0; i < kRearmCount; i++) {
+    const u32 connection = order[i % order.size()];
+    timers.erase(handles[connection]);
+    Arm(connection, i % kTimeoutMs);
+  }
+  DLOG_INFO("[multimap] {:.0f} rearms/sec", kRearmCount / SecondsSince(start));
+
+  start = Clock::now();
+  u64 fired = 0;
+  u64 wakeups = 0;
+  for (s64 now_ms = 0; now_ms < kRunMs;) {
+    while (!timers.empty() && timers.begin()->first <= now_ms) {
+      timers.erase(timers.begin());
+      fired++;
+    }
+    wakeups++;
+    now_ms = timers.empty() ? kRunMs : timers.begin()->first;
+  }
+  DLOG_INFO("[multimap] {} fired over {} wakeups in {:.3f} sec", fired,
+            wakeups, SecondsSince(start));
+}
+
+int main() {
+  std::vector<u32> order(kConnectionCount);
+  for (u32 i = 0; i < kConnectionCount; i++) {
+    order[i] = i;
+  }
+  std::shuffle(order.begin(), order.end(), std::mt19937{1337});
+
+  MeasureMultimap(order);
+  MeasureWheel(order);
+  return 0;
+}
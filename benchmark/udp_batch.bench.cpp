@@ -0,0 +1,107 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <dlog.hpp>
+#include <dnet/net/udp.hpp>
+#include <dnet/util/types.hpp>
+#include <dnet/util/util.hpp>
+#include <chrono>
+#include <vector>
+
+// ============================================================ //
+// Sends datagrams over loopback with WriteToBatch, and reads them back
+// with ReadFromBatch, at different batch sizes.
+// ============================================================ //
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t kDatagramCount = 200000;
+constexpr size_t kDatagramSize = 64;
+
+static void Measure(const dnet::Udp& sender, const dnet::Udp& receiver,
+                    const u16 port, const size_t batch_size) {
+  const std::vector<u8> payload(kDatagramSize, 0xA);
+  const std::vector<dnet::IoBuffer> out(
+      batch_size, dnet::IoBuffer{payload.data(), payload.size()});
+  const auto endpoint = dnet::Endpoint::Resolve("127.0.0.1", port).value();
+  const std::vector<dnet::Endpoint> endpoints(batch_size, endpoint);
+
+  std::vector<u8> storage(batch_size * kDatagramSize);
+  std::vector<dnet::DatagramBuffer> in{};
+  for (size_t i = 0; i < batch_size; i++) {
+    in.push_back(
+        dnet::DatagramBuffer{&storage[i * kDatagramSize], kDatagramSize, 0});
+  }
+  std::vector<dnet::Endpoint> from_endpoints(batch_size);
+
+  const auto start = Clock::now();
+  for (size_t done = 0; done < kDatagramCount; done += batch_size) {
+    // a batch at a time, small enough to never overflow the socket buffer
+    const auto maybe_sent =
+        sender.WriteToBatch(out.data(), batch_size, endpoints.data());
+    if (!maybe_sent.has_value() ||
+        maybe_sent.value() != static_cast<int>(batch_size)) {
+      DLOG_ERROR("[{}] failed to send [{}]", batch_size,
+                 sender.LastErrorToString());
+      return;
+    }
+    size_t received = 0;
+    while (received < batch_size) {
+      const auto maybe_received = receiver.ReadFromBatch(
+          &in[received], batch_size - received, &from_endpoints[received]);
+      if (!maybe_received.has_value()) {
+        DLOG_ERROR("[{}] failed to read [{}]", batch_size,
+                   receiver.LastErrorToString());
+        return;
+      }
+      received += static_cast<size_t>(maybe_received.value());
+    }
+  }
+  const auto stop = Clock::now();
+  const double seconds =
+      std::chrono::duration_cast<std::chrono::duration<double>>(stop - start)
+          .count();
+  DLOG_INFO("[batch {}] {:.0f} datagrams/sec", batch_size,
+            kDatagramCount / seconds);
+}
+
+int main() {
+  dnet::Startup();
+
+  constexpr u16 port = 4400;
+  dnet::Udp receiver{};
+  dnet::Udp sender{};
+  if (receiver.StartServer(port) != dnet::Result::kSuccess ||
+      sender.Open() != dnet::Result::kSuccess) {
+    DLOG_ERROR("failed to set up [{}]", receiver.LastErrorToString());
+    return 1;
+  }
+
+  for (const size_t batch_size : {1, 8, 32, 64}) {
+    Measure(sender, receiver, port, batch_size);
+  }
+
+  dnet::Shutdown();
+  return 0;
+}
@@ -0,0 +1,152 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <dlog.hpp>
+#include <dnet/net/udp.hpp>
+#include <dnet/util/types.hpp>
+#include <dnet/util/util.hpp>
+#include <chrono>
+#include <vector>
+
+// ============================================================ //
+// Bulk throughput over loopback, in datagrams of kDatagramSize, sent and
+// read one syscall per datagram, in batches (sendmmsg and recvmmsg), and
+// with segmentation offload (UDP_SEGMENT and UDP_GRO).
+// ============================================================ //
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t kDatagramSize = 1200;
+constexpr size_t kRoundSize =
+    dnet::Socket::kMaxSegmentedSize / kDatagramSize;
+constexpr size_t kRounds = 20000;
+
+enum class Mode { kSingle, kBatch, kOffload };
+
+/**
+ * Send kRoundSize datagrams, then read them back.
+ * @return False on failure.
+ */
+static bool Round(const Mode mode, const dnet::Udp& sender,
+                  const dnet::Udp& receiver, const std::vector<u8>& payload,
+                  std::vector<u8>& storage) {
+  if (mode == Mode::kSingle) {
+    for (size_t i = 0; i < kRoundSize; i++) {
+      if (!sender.Write(&payload[i * kDatagramSize], kDatagramSize)) {
+        return false;
+      }
+    }
+    for (size_t i = 0; i < kRoundSize; i++) {
+      if (!receiver.Read(storage.data(), storage.size())) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  if (mode == Mode::kBatch) {
+    dnet::IoBuffer out[kRoundSize];
+    dnet::DatagramBuffer in[kRoundSize];
+    for (size_t i = 0; i < kRoundSize; i++) {
+      out[i] = dnet::IoBuffer{&payload[i * kDatagramSize], kDatagramSize};
+      in[i] = dnet::DatagramBuffer{&storage[i * kDatagramSize], kDatagramSize,
+                                   0};
+    }
+    const auto sent = sender.WriteBatch(out, kRoundSize);
+    if (!sent || sent.value() != static_cast<int>(kRoundSize)) {
+      return false;
+    }
+    for (size_t received = 0; received < kRoundSize;) {
+      const auto read =
+          receiver.ReadBatch(&in[received], kRoundSize - received);
+      if (!read) {
+        return false;
+      }
+      received += static_cast<size_t>(read.value());
+    }
+    return true;
+  }
+
+  const auto sent =
+      sender.WriteSegmented(payload.data(), payload.size(), kDatagramSize);
+  if (!sent || sent.value() != static_cast<int>(kRoundSize)) {
+    return false;
+  }
+  dnet::IoBuffer datagrams[dnet::Socket::kMaxSegments];
+  for (size_t received = 0; received < kRoundSize;) {
+    const auto read = receiver.ReadSegmented(storage.data(), storage.size(),
+                                             datagrams,
+                                             dnet::Socket::kMaxSegments);
+    if (!read) {
+      return false;
+    }
+    received += static_cast<size_t>(read.value());
+  }
+  return true;
+}
+
+static void Measure(const char* name, const Mode mode, const u16 port) {
+  dnet::Udp receiver{};
+  dnet::Udp sender{};
+  if (receiver.StartServer(port) != dnet::Result::kSuccess ||
+      sender.Connect("127.0.0.1", port) != dnet::Result::kSuccess) {
+    DLOG_ERROR("[{}] failed to set up [{}]", name,
+               receiver.LastErrorToString());
+    return;
+  }
+  if (mode == Mode::kOffload &&
+      receiver.SetReceiveOffload(true) != dnet::Result::kSuccess) {
+    DLOG_WARNING("[{}] no receive offload", name);
+  }
+
+  const std::vector<u8> payload(kRoundSize * kDatagramSize, 0xA);
+  std::vector<u8> storage(dnet::Socket::kMaxSegmentedSize);
+  const auto start = Clock::now();
+  for (size_t i = 0; i < kRounds; i++) {
+    if (!Round(mode, sender, receiver, payload, storage)) {
+      DLOG_ERROR("[{}] failed [{}]", name, sender.LastErrorToString());
+      return;
+    }
+  }
+  const auto stop = Clock::now();
+  const double seconds =
+      std::chrono::duration_cast<std::chrono::duration<double>>(stop - start)
+          .count();
+  const double bytes =
+      static_cast<double>(kRounds * kRoundSize * kDatagramSize);
+  DLOG_INFO("[{}] {:.0f} MB/sec{}", name, bytes / seconds / 1e6,
+            mode == Mode::kOffload && !sender.HasSegmentationOffload()
+                ? ", fell back to batches"
+                : "");
+}
+
+int main() {
+  dnet::Startup();
+  Measure("single", Mode::kSingle, 4600);
+  Measure("batch", Mode::kBatch, 4601);
+  Measure("offload", Mode::kOffload, 4602);
+  dnet::Shutdown();
+  return 0;
+}
@@ -0,0 +1,151 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <dlog.hpp>
+#include <dnet/net/udp.hpp>
+#include <dnet/network_handler.hpp>
+#include <dnet/util/types.hpp>
+#include <dnet/util/util.hpp>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <thread>
+#include <vector>
+
+// ============================================================ //
+// Messages per second received by a MultiNetworkHandler, as the amount of
+// workers goes from 1 to one per hardware thread.
+// ============================================================ //
+
+using Packet = std::vector<u8>;
+using Handler = dnet::MultiNetworkHandler<Packet, dnet::Udp>;
+using Clock = std::chrono::steady_clock;
+
+constexpr u16 kBasePort = 4100;
+constexpr int kConnections = 64;
+constexpr int kBlasters = 4;
+constexpr auto kMeasureTime = std::chrono::seconds(1);
+
+/**
+ * Wait for the handler to say hello on each peer, to learn the address of
+ * its connection, then flood the connections with small datagrams.
+ */
+static void Blast(std::vector<dnet::Udp>& peers, const int first,
+                  const int count, std::atomic<bool>& run) {
+  std::vector<dnet::Endpoint> endpoints(count);
+  Packet buf(std::numeric_limits<u16>::max());
+  for (int i = 0; i < count; i++) {
+    const auto maybe_bytes = peers[first + i].ReadFrom(
+        buf.data(), buf.size(), endpoints[i]);
+    if (!maybe_bytes.has_value()) {
+      DLOG_ERROR("failed to read hello [{}]",
+                 peers[first + i].LastErrorToString());
+      return;
+    }
+  }
+
+  const Packet payload(32, 0xA);
+  while (run) {
+    for (int i = 0; i < count && run; i++) {
+      peers[first + i].WriteTo(payload.data(), payload.size(), endpoints[i]);
+    }
+  }
+}
+
+static void MeasureThroughput(std::vector<dnet::Udp>& peers,
+                              const u32 worker_count) {
+  Handler nh{dnet::WorkerPoolOptions{worker_count, true}};
+
+  std::vector<dnet::ConnectionId> ids{};
+  for (int i = 0; i < kConnections; i++) {
+    ids.push_back(nh.Connect("localhost", static_cast<u16>(kBasePort + i)));
+  }
+  int connected = 0;
+  while (connected < kConnections) {
+    if (nh.HasEvent()) {
+      if (nh.GetEvent().type() != dnet::NetworkEvent::Type::kConnected) {
+        DLOG_ERROR("failed to connect");
+        return;
+      }
+      ++connected;
+    }
+  }
+  for (const auto id : ids) {
+    nh.Send(id, Packet(1, 0));
+  }
+
+  std::atomic<bool> run{true};
+  std::vector<std::thread> blasters{};
+  constexpr int per_blaster = kConnections / kBlasters;
+  for (int i = 0; i < kBlasters; i++) {
+    blasters.emplace_back(Blast, std::ref(peers), i * per_blaster,
+                          per_blaster, std::ref(run));
+  }
+
+  u64 messages = 0;
+  const auto start = Clock::now();
+  while (Clock::now() - start < kMeasureTime) {
+    // keep the event queues drained, they are bounded
+    while (nh.HasEvent()) {
+      nh.GetEvent();
+    }
+    while (nh.Recv().has_value()) {
+      ++messages;
+    }
+  }
+  const auto elapsed = Clock::now() - start;
+
+  run = false;
+  for (auto& blaster : blasters) {
+    blaster.join();
+  }
+
+  const double seconds =
+      std::chrono::duration_cast<std::chrono::duration<double>>(elapsed)
+          .count();
+  DLOG_INFO("{:>3} workers: {:>10.0f} msgs/sec", worker_count,
+            messages / seconds);
+}
+
+int main() {
+  dnet::Startup();
+
+  std::vector<dnet::Udp> peers(kConnections);
+  for (int i = 0; i < kConnections; i++) {
+    if (peers[i].StartServer(static_cast<u16>(kBasePort + i)) !=
+        dnet::Result::kSuccess) {
+      DLOG_ERROR("failed to start peer [{}]", peers[i].LastErrorToString());
+      return 1;
+    }
+  }
+
+  const u32 max_workers = dnet::WorkerPoolOptions::DefaultWorkerCount();
+  for (u32 workers = 1; workers < max_workers; workers *= 2) {
+    MeasureThroughput(peers, workers);
+  }
+  MeasureThroughput(peers, max_workers);
+
+  dnet::Shutdown();
+  return 0;
+}
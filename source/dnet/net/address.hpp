@@ -37,6 +37,11 @@ inline chif_net_address_family AddressFamilyToChifNet(const AddressFamily addres
       CHIF_NET_ADDRESS_FAMILY_IPV6;
 }
 
+inline AddressFamily AddressFamilyFromChifNet(const chif_net_address_family address_family) {
+  return address_family == CHIF_NET_ADDRESS_FAMILY_IPV6 ? AddressFamily::kIPv6 :
+      AddressFamily::kIPv4;
+}
+
 }
 
 #endif//ADDRESS_HPP_
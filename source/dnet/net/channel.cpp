@@ -0,0 +1,57 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "channel.hpp"
+
+namespace dnet {
+
+void ReorderBuffer::Insert(const u32 id, const std::vector<u8>& message) {
+  if (SequenceGreaterThan(next_id_, id) ||
+      id - next_id_ >= ReassemblyTable::kSlots) {
+    return;
+  }
+  std::vector<u8>* slot = waiting_.Insert(id);
+  if (slot != nullptr) {
+    slot->assign(message.begin(), message.end());
+  }
+}
+
+const std::vector<u8>* ReorderBuffer::Pop() {
+  std::vector<u8>* next = waiting_.Find(next_id_);
+  if (next == nullptr) {
+    return nullptr;
+  }
+  popped_.swap(*next);
+  waiting_.Remove(next_id_);
+  ++next_id_;
+  return &popped_;
+}
+
+void ReorderBuffer::Reset() {
+  waiting_.Reset();
+  next_id_ = 0;
+}
+
+}  // namespace dnet
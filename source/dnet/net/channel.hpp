@@ -0,0 +1,78 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef CHANNEL_HPP_
+#define CHANNEL_HPP_
+
+#include <dnet/net/fragment.hpp>
+#include <dnet/util/sequence_buffer.hpp>
+#include <dnet/util/types.hpp>
+#include <vector>
+
+namespace dnet {
+
+/**
+ * Delivery guarantee of a channel on a UdpConnection.
+ */
+enum class ChannelType : u8 {
+  // resent until acked, handed out in the order sent
+  kReliableOrdered,
+  // resent until acked, handed out as soon as complete
+  kReliableUnordered,
+  // never resent, anything older than the newest received is dropped
+  kUnreliableSequenced,
+};
+
+/**
+ * Holds messages of an ordered channel that completed ahead of an earlier
+ * one, until the earlier one arrives. The sender has at most
+ * OutgoingMessages::kMaxMessages in flight, so that many slots suffice.
+ */
+class ReorderBuffer {
+ public:
+  /**
+   * Store message @id, unless it was already handed out.
+   */
+  void Insert(u32 id, const std::vector<u8>& message);
+
+  /**
+   * @return The next message in order, or nullptr if it has not arrived.
+   * Valid until the next call.
+   */
+  const std::vector<u8>* Pop();
+
+  bool HasNext() const { return waiting_.Exists(next_id_); }
+
+  void Reset();
+
+ private:
+  SequenceBuffer<std::vector<u8>, ReassemblyTable::kSlots> waiting_{};
+  std::vector<u8> popped_{};
+  u32 next_id_ = 0;
+};
+
+}  // namespace dnet
+
+#endif  // CHANNEL_HPP_
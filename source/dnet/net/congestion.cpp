@@ -0,0 +1,124 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "congestion.hpp"
+#include <cmath>
+
+namespace dnet {
+
+// ============================================================ //
+// NewReno
+// ============================================================ //
+
+void NewReno::OnPacketsAcked(const size_t bytes, const Duration srtt,
+                             const TimePoint now) {
+  if (in_recovery_ && now - recovery_start_ < srtt) {
+    // acks for packets sent before the window was cut
+    return;
+  }
+  in_recovery_ = false;
+  if (in_slow_start()) {
+    window_ += bytes;
+    return;
+  }
+  // one datagram per window of acked bytes
+  acked_bytes_ += bytes;
+  if (acked_bytes_ >= window_) {
+    acked_bytes_ -= window_;
+    window_ += kDatagramSize;
+  }
+}
+
+void NewReno::OnPacketsLost(size_t, const Duration srtt,
+                            const TimePoint now) {
+  if (in_recovery_ && now - recovery_start_ < srtt) {
+    // the same congestion event
+    return;
+  }
+  in_recovery_ = true;
+  recovery_start_ = now;
+  slow_start_threshold_ = window_ / 2 > kMinWindow ? window_ / 2 : kMinWindow;
+  window_ = slow_start_threshold_;
+  acked_bytes_ = 0;
+}
+
+u64 NewReno::PacingRate(const Duration srtt) const {
+  const auto srtt_us =
+      std::chrono::duration_cast<std::chrono::microseconds>(srtt).count();
+  if (srtt_us <= 0) {
+    return 0;
+  }
+  // as linux, twice the window per rtt in slow start, 1.25 times after
+  const u64 rate = static_cast<u64>(window_) * 1000000 / srtt_us;
+  return in_slow_start() ? rate * 2 : rate * 5 / 4;
+}
+
+// ============================================================ //
+// Pacer
+// ============================================================ //
+
+Pacer::Pacer(const size_t burst)
+    : burst_(burst), tokens_(static_cast<double>(burst)) {}
+
+bool Pacer::TrySend(const size_t bytes, const TimePoint now) {
+  if (rate_ == 0) {
+    return true;
+  }
+  const double tokens = TokensAt(now);
+  if (tokens < static_cast<double>(bytes) &&
+      tokens < static_cast<double>(burst_)) {
+    return false;
+  }
+  tokens_ = tokens - static_cast<double>(bytes);
+  last_ = now;
+  return true;
+}
+
+Pacer::Duration Pacer::TimeUntilSend(const size_t bytes,
+                                     const TimePoint now) const {
+  if (rate_ == 0) {
+    return Duration{};
+  }
+  const double needed =
+      (bytes < burst_ ? static_cast<double>(bytes)
+                      : static_cast<double>(burst_)) -
+      TokensAt(now);
+  if (needed <= 0) {
+    return Duration{};
+  }
+  const double seconds = needed / static_cast<double>(rate_);
+  return std::chrono::duration_cast<Duration>(
+      std::chrono::duration<double>(std::ceil(seconds * 1e9) / 1e9));
+}
+
+double Pacer::TokensAt(const TimePoint now) const {
+  const double elapsed =
+      std::chrono::duration_cast<std::chrono::duration<double>>(now - last_)
+          .count();
+  const double tokens = tokens_ + elapsed * static_cast<double>(rate_);
+  return tokens < static_cast<double>(burst_) ? tokens
+                                              : static_cast<double>(burst_);
+}
+
+}  // namespace dnet
@@ -0,0 +1,169 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CONGESTION_HPP_
+#define CONGESTION_HPP_
+
+#include <dnet/util/types.hpp>
+#include <chrono>
+#include <cstddef>
+
+namespace dnet {
+
+// ============================================================ //
+// Congestion control
+// ============================================================ //
+
+/*
+ * A congestion control policy is a class with these members, so that
+ * UdpConnection can be given one as a template parameter:
+ *
+ *   bool CanSend(size_t bytes_in_flight) const;
+ *   void OnPacketSent(size_t bytes, TimePoint now);
+ *   void OnPacketsAcked(size_t bytes, Duration srtt, TimePoint now);
+ *   void OnPacketsLost(size_t bytes, Duration srtt, TimePoint now);
+ *   u64 PacingRate(Duration srtt) const;  // bytes per second, 0 unpaced
+ *
+ * Acked and lost bytes are reported in aggregate, as they are found out,
+ * which is also what a model based on delivery rate needs.
+ */
+
+/**
+ * Window based congestion control in the style of NewReno, RFC 6582. The
+ * window grows by the acked bytes in slow start, and by about one
+ * datagram per round trip after, and is halved at most once per round
+ * trip on loss.
+ */
+class NewReno {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using TimePoint = Clock::time_point;
+  using Duration = Clock::duration;
+
+  static constexpr size_t kDatagramSize = 1200;
+  static constexpr size_t kInitialWindow = 10 * kDatagramSize;
+  static constexpr size_t kMinWindow = 2 * kDatagramSize;
+
+  bool CanSend(size_t bytes_in_flight) const {
+    return bytes_in_flight < window_;
+  }
+
+  void OnPacketSent(size_t, TimePoint) {}
+
+  void OnPacketsAcked(size_t bytes, Duration srtt, TimePoint now);
+
+  void OnPacketsLost(size_t bytes, Duration srtt, TimePoint now);
+
+  /**
+   * @return The window spread over a round trip, with some headroom so
+   * that pacing alone never limits the window. 0 before any rtt sample.
+   */
+  u64 PacingRate(Duration srtt) const;
+
+  /**
+   * @return Congestion window, in bytes.
+   */
+  size_t window() const { return window_; }
+
+  size_t slow_start_threshold() const { return slow_start_threshold_; }
+
+  bool in_slow_start() const { return window_ < slow_start_threshold_; }
+
+ private:
+  size_t window_ = kInitialWindow;
+  size_t slow_start_threshold_ = static_cast<size_t>(-1);
+  // acked bytes not yet turned into window growth, in congestion avoidance
+  size_t acked_bytes_ = 0;
+  TimePoint recovery_start_{};
+  bool in_recovery_ = false;
+};
+
+/**
+ * Congestion control that never limits, for links known to have room.
+ */
+class NoCongestionControl {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using TimePoint = Clock::time_point;
+  using Duration = Clock::duration;
+
+  bool CanSend(size_t) const { return true; }
+  void OnPacketSent(size_t, TimePoint) {}
+  void OnPacketsAcked(size_t, Duration, TimePoint) {}
+  void OnPacketsLost(size_t, Duration, TimePoint) {}
+  u64 PacingRate(Duration) const { return 0; }
+};
+
+// ============================================================ //
+// Pacing
+// ============================================================ //
+
+/**
+ * Token bucket that spreads sends out over time, instead of sending a
+ * whole window in one burst that overflows the queues along the path.
+ */
+class Pacer {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using TimePoint = Clock::time_point;
+  using Duration = Clock::duration;
+
+  static constexpr size_t kDefaultBurst = 4 * NewReno::kDatagramSize;
+
+  /**
+   * @param burst Bytes that can be sent back to back, after being idle.
+   */
+  explicit Pacer(size_t burst = kDefaultBurst);
+
+  /**
+   * @param bytes_per_second 0 turns pacing off.
+   */
+  void set_rate(u64 bytes_per_second) { rate_ = bytes_per_second; }
+
+  u64 rate() const { return rate_; }
+
+  /**
+   * Take tokens for @bytes, if there are enough. A datagram larger than
+   * the burst may be sent once the bucket is full.
+   * @return False if the send has to wait, see TimeUntilSend.
+   */
+  bool TrySend(size_t bytes, TimePoint now);
+
+  /**
+   * @return How long until TrySend of @bytes would succeed.
+   */
+  Duration TimeUntilSend(size_t bytes, TimePoint now) const;
+
+ private:
+  double TokensAt(TimePoint now) const;
+
+  size_t burst_;
+  u64 rate_ = 0;
+  double tokens_;
+  TimePoint last_{};
+};
+
+}  // namespace dnet
+
+#endif  // CONGESTION_HPP_
@@ -0,0 +1,113 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef CONNECT_MANY_HPP_
+#define CONNECT_MANY_HPP_
+
+#include <dnet/net/endpoint.hpp>
+#include <dnet/net/poller.hpp>
+#include <dnet/util/result.hpp>
+#include <dnet/util/types.hpp>
+#include <chrono>
+#include <cstddef>
+
+namespace dnet {
+
+/**
+ * Connect @connections[i] to @endpoints[i], with every handshake in flight
+ * at once, so that connecting to many peers takes about one round trip
+ * rather than one per peer. Connections that have not succeeded when
+ * @timeout has passed are given up on.
+ *
+ * @tparam TConnection Tcp or TcpConnection.
+ * @param results_out One Result per connection, kSuccess, or kFail if it
+ * failed or timed out. Connected ones are left blocking, like after
+ * Connect, the others disconnected.
+ * @return Amount of connections made.
+ */
+template <typename TConnection>
+size_t ConnectMany(TConnection* connections, const Endpoint* endpoints,
+                   const size_t count, const std::chrono::milliseconds timeout,
+                   Result* results_out) {
+  using Clock = std::chrono::steady_clock;
+  const auto deadline = Clock::now() + timeout;
+  Poller poller{};
+  size_t pending = 0;
+  for (size_t i = 0; i < count; i++) {
+    results_out[i] = connections[i].ConnectNonBlocking(endpoints[i]);
+    if (results_out[i] == Result::kWouldBlock &&
+        poller.Add(connections[i].GetHandle(), i, poll_flag::kWrite) !=
+            Result::kSuccess) {
+      results_out[i] = Result::kFail;
+    }
+    if (results_out[i] == Result::kWouldBlock) {
+      pending++;
+    }
+  }
+
+  constexpr int kMaxEvents = 64;
+  PollEvent events[kMaxEvents];
+  while (pending > 0) {
+    const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - Clock::now());
+    if (left.count() <= 0) {
+      break;
+    }
+    const int event_count =
+        poller.Wait(events, kMaxEvents, static_cast<int>(left.count()));
+    if (event_count < 0) {
+      break;
+    }
+    for (int i = 0; i < event_count; i++) {
+      const size_t index = static_cast<size_t>(events[i].token);
+      const Result res = connections[index].FinishConnect();
+      if (res != Result::kWouldBlock &&
+          results_out[index] == Result::kWouldBlock) {
+        (void)poller.Remove(connections[index].GetHandle());
+        results_out[index] = res;
+        pending--;
+      }
+    }
+  }
+
+  size_t connected = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (results_out[i] == Result::kSuccess &&
+        connections[i].SetBlocking(true) == Result::kSuccess) {
+      connected++;
+      continue;
+    }
+    if (results_out[i] == Result::kWouldBlock) {
+      (void)poller.Remove(connections[i].GetHandle());
+    }
+    results_out[i] = Result::kFail;
+    connections[i].Disconnect();
+  }
+  return connected;
+}
+
+}  // namespace dnet
+
+#endif  // CONNECT_MANY_HPP_
@@ -0,0 +1,111 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "control.hpp"
+#include <random>
+
+namespace dnet {
+
+static u64 RotateLeft(const u64 x, const int bits) {
+  return (x << bits) | (x >> (64 - bits));
+}
+
+static void SipRound(u64& v0, u64& v1, u64& v2, u64& v3) {
+  v0 += v1;
+  v1 = RotateLeft(v1, 13);
+  v1 ^= v0;
+  v0 = RotateLeft(v0, 32);
+  v2 += v3;
+  v3 = RotateLeft(v3, 16);
+  v3 ^= v2;
+  v0 += v3;
+  v3 = RotateLeft(v3, 21);
+  v3 ^= v0;
+  v2 += v1;
+  v1 = RotateLeft(v1, 17);
+  v1 ^= v2;
+  v2 = RotateLeft(v2, 32);
+}
+
+HandshakeCookies::HandshakeCookies() {
+  std::random_device device{};
+  for (u64& key : key_) {
+    key = (static_cast<u64>(device()) << 32) ^ static_cast<u64>(device());
+  }
+}
+
+u64 HandshakeCookies::Make(const Endpoint& peer,
+                           const Clock::time_point now) const {
+  const u64 cookie = Hash(peer, Period(now));
+  // 0 means no cookie
+  return cookie == 0 ? 1 : cookie;
+}
+
+bool HandshakeCookies::Check(const Endpoint& peer, const u64 cookie,
+                             const Clock::time_point now) const {
+  if (cookie == 0) {
+    return false;
+  }
+  const u64 period = Period(now);
+  for (const u64 made_in : {period, period - 1}) {
+    const u64 expected = Hash(peer, made_in);
+    if (cookie == (expected == 0 ? 1 : expected)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+u64 HandshakeCookies::Hash(const Endpoint& peer, const u64 period) const {
+  // the message is the period, then the sockaddr, padded with zeros to
+  // whole words
+  constexpr size_t kWords = 1 + (Endpoint::kStorageSize + 7) / 8;
+  u64 words[kWords] = {period};
+  std::memcpy(&words[1], peer.data(), peer.length());
+  const size_t length = sizeof(period) + peer.length();
+
+  u64 v0 = key_[0] ^ 0x736f6d6570736575ull;
+  u64 v1 = key_[1] ^ 0x646f72616e646f6dull;
+  u64 v2 = key_[0] ^ 0x6c7967656e657261ull;
+  u64 v3 = key_[1] ^ 0x7465646279746573ull;
+  for (const u64 word : words) {
+    v3 ^= word;
+    SipRound(v0, v1, v2, v3);
+    SipRound(v0, v1, v2, v3);
+    v0 ^= word;
+  }
+  // the length goes in the last word, as the tail of the message
+  const u64 last = static_cast<u64>(length) << 56;
+  v3 ^= last;
+  SipRound(v0, v1, v2, v3);
+  SipRound(v0, v1, v2, v3);
+  v0 ^= last;
+  v2 ^= 0xff;
+  for (int i = 0; i < 4; i++) {
+    SipRound(v0, v1, v2, v3);
+  }
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+}  // namespace dnet
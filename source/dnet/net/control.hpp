@@ -0,0 +1,156 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef CONTROL_HPP_
+#define CONTROL_HPP_
+
+#include <dnet/net/endpoint.hpp>
+#include <dnet/net/reliability.hpp>
+#include <dnet/util/types.hpp>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <optional>
+
+namespace dnet {
+
+/**
+ * Handshake packets are a UdpHeader with id 0, which no packet tracked by
+ * Reliability has, and the kUdpControl flag, followed by a ControlType and
+ * a cookie. They are not acked, whoever waits on an answer sends them
+ * again.
+ */
+enum class ControlType : u8 {
+  // client asks to be let in, answered with kAccept, kChallenge, or
+  // kDisconnect if full
+  kConnect,
+  kAccept,
+  // either end is leaving, or the server does not know the client
+  kDisconnect,
+  // the cookie to send back in the next kConnect, see HandshakeCookies
+  kChallenge,
+};
+
+struct ControlMessage {
+  ControlType type = ControlType::kConnect;
+  // 0 if none
+  u64 cookie = 0;
+};
+
+enum class ConnectionState : u8 {
+  kDisconnected,
+  kConnecting,
+  kConnected,
+};
+
+// every control packet has room for a cookie, so a kChallenge is never
+// larger than the kConnect it answers
+constexpr size_t kControlPacketSize =
+    sizeof(UdpHeader) + sizeof(ControlType) + sizeof(u64);
+
+using ControlPacket = std::array<u8, kControlPacketSize>;
+
+inline ControlPacket MakeControlPacket(const ControlType type,
+                                       const u64 cookie = 0) {
+  const UdpHeader header{0, 0, 0, kUdpControl};
+  ControlPacket packet{};
+  std::memcpy(packet.data(), &header, sizeof(UdpHeader));
+  packet[sizeof(UdpHeader)] = static_cast<u8>(type);
+  std::memcpy(packet.data() + sizeof(UdpHeader) + sizeof(ControlType),
+              &cookie, sizeof(cookie));
+  return packet;
+}
+
+/**
+ * @return The control packet in @datagram, or nullopt if it is not one.
+ */
+inline std::optional<ControlMessage> ParseControlPacket(const u8* datagram,
+                                                        const size_t size) {
+  if (size != kControlPacketSize) {
+    return std::nullopt;
+  }
+  UdpHeader header{};
+  std::memcpy(&header, datagram, sizeof(UdpHeader));
+  const u8 type = datagram[sizeof(UdpHeader)];
+  if (header.id != 0 || (header.flags & kUdpControl) == 0 ||
+      type > static_cast<u8>(ControlType::kChallenge)) {
+    return std::nullopt;
+  }
+  ControlMessage message{};
+  message.type = static_cast<ControlType>(type);
+  std::memcpy(&message.cookie,
+              datagram + sizeof(UdpHeader) + sizeof(ControlType),
+              sizeof(message.cookie));
+  return message;
+}
+
+// ============================================================ //
+
+/**
+ * Stateless handshake cookies, as the cookies of SCTP or DTLS. A server
+ * answers a kConnect with a kChallenge, and only lets the peer in once a
+ * kConnect comes back with the cookie. So the peer has shown it receives
+ * at the address it sends from, and spoofed kConnects cost the server no
+ * memory.
+ *
+ * A cookie is a keyed hash, with the rounds of SipHash-2-4, of the
+ * endpoint and the current period, with a random key. It is valid for the period it was made in,
+ * and the one after.
+ */
+class HandshakeCookies {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr Clock::duration kPeriod = std::chrono::seconds(10);
+
+  /**
+   * With a key from std::random_device.
+   */
+  HandshakeCookies();
+
+  HandshakeCookies(u64 key0, u64 key1) : key_{key0, key1} {}
+
+  /**
+   * @return The cookie of @peer, never 0.
+   */
+  u64 Make(const Endpoint& peer, Clock::time_point now = Clock::now()) const;
+
+  bool Check(const Endpoint& peer, u64 cookie,
+             Clock::time_point now = Clock::now()) const;
+
+ private:
+  u64 Hash(const Endpoint& peer, u64 period) const;
+
+  static u64 Period(Clock::time_point now) {
+    return static_cast<u64>(now.time_since_epoch() / kPeriod);
+  }
+
+  u64 key_[2];
+};
+
+}  // namespace dnet
+
+#endif  // CONTROL_HPP_
@@ -0,0 +1,118 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "endpoint.hpp"
+#include <dnet/util/platform.hpp>
+#include <cstring>
+#if defined(DNET_PLATFORM_WINDOWS)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+namespace dnet {
+
+static_assert(sizeof(sockaddr_in6) <= Endpoint::kStorageSize,
+              "Endpoint storage cannot hold a sockaddr_in6");
+
+std::optional<Endpoint> Endpoint::Resolve(
+    const std::string& address, const u16 port,
+    const AddressFamily address_family) {
+  addrinfo hints{};
+  hints.ai_family =
+      address_family == AddressFamily::kIPv6 ? AF_INET6 : AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  addrinfo* result = nullptr;
+  const std::string portstr = std::to_string(port);
+  if (getaddrinfo(address.c_str(), portstr.c_str(), &hints, &result) != 0) {
+    return std::nullopt;
+  }
+  const Endpoint endpoint =
+      FromSockaddr(result->ai_addr, static_cast<size_t>(result->ai_addrlen));
+  freeaddrinfo(result);
+  return std::optional<Endpoint>{endpoint};
+}
+
+Endpoint Endpoint::FromSockaddr(const void* address, const size_t length) {
+  Endpoint endpoint{};
+  const auto family = static_cast<const sockaddr*>(address)->sa_family;
+  // only copy the meaningful part, so equal endpoints are equal bytes
+  size_t used = 0;
+  if (family == AF_INET && length >= sizeof(sockaddr_in)) {
+    used = sizeof(sockaddr_in);
+  } else if (family == AF_INET6 && length >= sizeof(sockaddr_in6)) {
+    used = sizeof(sockaddr_in6);
+  }
+  std::memcpy(endpoint.storage_, address, used);
+  if (used == sizeof(sockaddr_in)) {
+    auto* in4 = reinterpret_cast<sockaddr_in*>(endpoint.storage_);
+    std::memset(in4->sin_zero, 0, sizeof(in4->sin_zero));
+  }
+  endpoint.length_ = static_cast<u32>(used);
+
+  // fnv-1a
+  u64 hash = 14695981039346656037ull;
+  for (size_t i = 0; i < used; i++) {
+    hash = (hash ^ endpoint.storage_[i]) * 1099511628211ull;
+  }
+  endpoint.hash_ = static_cast<size_t>(hash);
+  return endpoint;
+}
+
+std::optional<std::string> Endpoint::GetIp() const {
+  char ip[INET6_ADDRSTRLEN] = {};
+  const auto* address = reinterpret_cast<const sockaddr*>(storage_);
+  if (length_ == sizeof(sockaddr_in6) && address->sa_family == AF_INET6) {
+    const auto* in6 = reinterpret_cast<const sockaddr_in6*>(storage_);
+    inet_ntop(AF_INET6, &in6->sin6_addr, ip, sizeof(ip));
+  } else if (length_ == sizeof(sockaddr_in)) {
+    const auto* in4 = reinterpret_cast<const sockaddr_in*>(storage_);
+    inet_ntop(AF_INET, &in4->sin_addr, ip, sizeof(ip));
+  } else {
+    return std::nullopt;
+  }
+  return std::optional<std::string>{std::string(ip)};
+}
+
+u16 Endpoint::GetPort() const {
+  const auto* address = reinterpret_cast<const sockaddr*>(storage_);
+  if (length_ == sizeof(sockaddr_in6) && address->sa_family == AF_INET6) {
+    return ntohs(reinterpret_cast<const sockaddr_in6*>(storage_)->sin6_port);
+  }
+  if (length_ == sizeof(sockaddr_in)) {
+    return ntohs(reinterpret_cast<const sockaddr_in*>(storage_)->sin_port);
+  }
+  return 0;
+}
+
+bool Endpoint::operator==(const Endpoint& other) const {
+  return hash_ == other.hash_ && length_ == other.length_ &&
+         std::memcmp(storage_, other.storage_, length_) == 0;
+}
+
+}  // namespace dnet
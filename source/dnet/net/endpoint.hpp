@@ -0,0 +1,108 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ENDPOINT_HPP_
+#define ENDPOINT_HPP_
+
+#include <dnet/net/address.hpp>
+#include <dnet/util/types.hpp>
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <string>
+#include <type_traits>
+
+namespace dnet {
+
+/**
+ * An ip address and port in the binary form the socket calls use, so that
+ * sending to, or comparing, endpoints needs no string handling. Resolve it
+ * once from a string, then reuse it for every datagram.
+ */
+class Endpoint {
+ public:
+  // room for a sockaddr_in6, the largest address we store
+  static constexpr size_t kStorageSize = 28;
+
+  Endpoint() = default;
+
+  /**
+   * Resolve @address, a hostname or ip, and @port.
+   * @return The endpoint, or nullopt if it could not be resolved.
+   */
+  static std::optional<Endpoint> Resolve(
+      const std::string& address, u16 port,
+      AddressFamily address_family = AddressFamily::kIPv4);
+
+  /**
+   * Wrap a sockaddr filled in by a socket call.
+   * @param address Points to a sockaddr_in or sockaddr_in6.
+   */
+  static Endpoint FromSockaddr(const void* address, size_t length);
+
+  /**
+   * @return Ip address as a string, or nullopt if empty.
+   */
+  std::optional<std::string> GetIp() const;
+
+  u16 GetPort() const;
+
+  bool IsEmpty() const { return length_ == 0; }
+
+  size_t Hash() const { return hash_; }
+
+  /**
+   * Pointer to the sockaddr, for the socket calls.
+   */
+  const void* data() const { return storage_; }
+
+  size_t length() const { return length_; }
+
+  bool operator==(const Endpoint& other) const;
+
+  bool operator!=(const Endpoint& other) const { return !(*this == other); }
+
+ private:
+  // all bytes after length_ are kept zero, so they can be compared and
+  // hashed as they are
+  alignas(8) u8 storage_[kStorageSize] = {};
+  u32 length_ = 0;
+  size_t hash_ = 0;
+};
+
+static_assert(std::is_trivially_copyable_v<Endpoint>,
+              "Endpoint is copied around by value, keep it trivial");
+
+}  // namespace dnet
+
+namespace std {
+template <>
+struct hash<dnet::Endpoint> {
+  size_t operator()(const dnet::Endpoint& endpoint) const {
+    return endpoint.Hash();
+  }
+};
+}  // namespace std
+
+#endif  // ENDPOINT_HPP_
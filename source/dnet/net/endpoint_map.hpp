@@ -0,0 +1,225 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef ENDPOINT_MAP_HPP_
+#define ENDPOINT_MAP_HPP_
+
+#include <dnet/net/endpoint.hpp>
+#include <dnet/util/types.hpp>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace dnet {
+
+/**
+ * Hash map from Endpoint to @T, with open addressing and linear probing
+ * in one flat array. Endpoints carry their hash, so a lookup is one index
+ * computation and, at the load factor kept here, a probe or two.
+ * Erasing shifts the following entries back, rather than leaving
+ * tombstones, so lookups stay fast as peers come and go.
+ *
+ * Pointers to values are invalidated by Insert and Erase.
+ * @tparam T Default constructible and movable.
+ */
+template <typename T>
+class EndpointMap {
+ public:
+  /**
+   * @param expected_size Entries to make room for up front.
+   */
+  explicit EndpointMap(size_t expected_size = 16);
+
+  /**
+   * @return The value, or nullptr if @key is not in the map.
+   */
+  T* Find(const Endpoint& key);
+
+  const T* Find(const Endpoint& key) const;
+
+  /**
+   * Insert, or replace, the value of @key.
+   * @return The stored value.
+   */
+  T* Insert(const Endpoint& key, T value);
+
+  /**
+   * @return True if @key was in the map.
+   */
+  bool Erase(const Endpoint& key);
+
+  void Clear();
+
+  /**
+   * Call @fn with the key and value of every entry, in no order. The map
+   * must not be changed meanwhile.
+   */
+  template <typename TFn>
+  void ForEach(TFn&& fn);
+
+  size_t size() const { return size_; }
+
+  bool empty() const { return size_ == 0; }
+
+  size_t capacity() const { return slots_.size(); }
+
+ private:
+  struct Slot {
+    Endpoint key{};
+    T value{};
+    bool used = false;
+  };
+
+  /**
+   * @return Index of the slot holding @key, or capacity() if none.
+   */
+  size_t IndexOf(const Endpoint& key) const;
+
+  void Grow();
+
+  // a power of two, at most half full
+  std::vector<Slot> slots_;
+  size_t mask_;
+  size_t size_ = 0;
+};
+
+// ============================================================ //
+// template definition
+// ============================================================ //
+
+template <typename T>
+EndpointMap<T>::EndpointMap(const size_t expected_size) {
+  size_t capacity = 16;
+  while (capacity < 2 * expected_size) {
+    capacity *= 2;
+  }
+  slots_.resize(capacity);
+  mask_ = capacity - 1;
+}
+
+template <typename T>
+T* EndpointMap<T>::Find(const Endpoint& key) {
+  const size_t index = IndexOf(key);
+  return index == slots_.size() ? nullptr : &slots_[index].value;
+}
+
+template <typename T>
+const T* EndpointMap<T>::Find(const Endpoint& key) const {
+  const size_t index = IndexOf(key);
+  return index == slots_.size() ? nullptr : &slots_[index].value;
+}
+
+template <typename T>
+T* EndpointMap<T>::Insert(const Endpoint& key, T value) {
+  const size_t found = IndexOf(key);
+  if (found != slots_.size()) {
+    slots_[found].value = std::move(value);
+    return &slots_[found].value;
+  }
+  if (2 * (size_ + 1) > slots_.size()) {
+    Grow();
+  }
+  size_t index = key.Hash() & mask_;
+  while (slots_[index].used) {
+    index = (index + 1) & mask_;
+  }
+  Slot& slot = slots_[index];
+  slot.key = key;
+  slot.value = std::move(value);
+  slot.used = true;
+  ++size_;
+  return &slot.value;
+}
+
+template <typename T>
+bool EndpointMap<T>::Erase(const Endpoint& key) {
+  size_t hole = IndexOf(key);
+  if (hole == slots_.size()) {
+    return false;
+  }
+  slots_[hole] = Slot{};
+  --size_;
+  // move back every entry of the run after the hole that may sit in it,
+  // those whose home slot is not between the hole and themselves
+  for (size_t index = (hole + 1) & mask_; slots_[index].used;
+       index = (index + 1) & mask_) {
+    const size_t home = slots_[index].key.Hash() & mask_;
+    if (((index - home) & mask_) >= ((index - hole) & mask_)) {
+      slots_[hole] = std::move(slots_[index]);
+      slots_[index] = Slot{};
+      hole = index;
+    }
+  }
+  return true;
+}
+
+template <typename T>
+void EndpointMap<T>::Clear() {
+  for (Slot& slot : slots_) {
+    slot = Slot{};
+  }
+  size_ = 0;
+}
+
+template <typename T>
+template <typename TFn>
+void EndpointMap<T>::ForEach(TFn&& fn) {
+  for (Slot& slot : slots_) {
+    if (slot.used) {
+      fn(static_cast<const Endpoint&>(slot.key), slot.value);
+    }
+  }
+}
+
+template <typename T>
+size_t EndpointMap<T>::IndexOf(const Endpoint& key) const {
+  for (size_t index = key.Hash() & mask_; slots_[index].used;
+       index = (index + 1) & mask_) {
+    if (slots_[index].key == key) {
+      return index;
+    }
+  }
+  return slots_.size();
+}
+
+template <typename T>
+void EndpointMap<T>::Grow() {
+  std::vector<Slot> old = std::move(slots_);
+  slots_ = std::vector<Slot>(old.size() * 2);
+  mask_ = slots_.size() - 1;
+  for (Slot& slot : old) {
+    if (slot.used) {
+      size_t index = slot.key.Hash() & mask_;
+      while (slots_[index].used) {
+        index = (index + 1) & mask_;
+      }
+      slots_[index] = std::move(slot);
+    }
+  }
+}
+
+}  // namespace dnet
+
+#endif  // ENDPOINT_MAP_HPP_
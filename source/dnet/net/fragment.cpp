@@ -0,0 +1,258 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "fragment.hpp"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace dnet {
+
+// ============================================================ //
+// OutgoingMessages
+// ============================================================ //
+
+OutgoingMessages::OutgoingMessages() : messages_(kMaxMessages) {}
+
+std::optional<u32> OutgoingMessages::Add(const u8* data, const size_t size,
+                                         const size_t max_fragment_size,
+                                         DeliveryCallback on_delivery) {
+  const size_t count = FragmentCount(size, max_fragment_size);
+  if (!HasRoom() || size > kMaxMessageSize || count > kMaxFragments ||
+      bytes_in_flight_ + size > kMaxReassemblyBytes) {
+    return std::nullopt;
+  }
+  const u32 id = next_id_++;
+  Message& message = messages_[id % kMaxMessages];
+  message.id = id;
+  message.used = true;
+  message.data.assign(data, data + size);
+  message.count = static_cast<u16>(count);
+  message.acked = 0;
+  message.next_unsent = 0;
+  message.acked_fragments.reset();
+  message.resend.clear();
+  message.on_delivery = std::move(on_delivery);
+  bytes_in_flight_ += size;
+  return std::optional<u32>{id};
+}
+
+bool OutgoingMessages::PeekNext(FragmentHeader& header_out,
+                                const u8*& data_out, size_t& size_out) const {
+  const size_t next = NextWithWork();
+  if (next == kMaxMessages) {
+    return false;
+  }
+  const Message* message = &messages_[next];
+  const u16 index = message->resend.empty() ? message->next_unsent
+                                            : message->resend.back();
+  const size_t message_size = message->data.size();
+  const size_t fragment_size = FragmentSize(message_size, message->count);
+  const size_t offset = index * fragment_size;
+  header_out = FragmentHeader{message->id, static_cast<u32>(message_size),
+                              index, message->count};
+  data_out = message->data.data() + offset;
+  size_out = offset + fragment_size < message_size ? fragment_size
+                                                   : message_size - offset;
+  return true;
+}
+
+void OutgoingMessages::PopNext() {
+  const size_t next = NextWithWork();
+  if (next == kMaxMessages) {
+    return;
+  }
+  Message* message = &messages_[next];
+  if (message->resend.empty()) {
+    ++message->next_unsent;
+  } else {
+    message->resend.pop_back();
+    ++fragments_resent_;
+  }
+}
+
+void OutgoingMessages::OnFragmentDelivered(const u32 message_id,
+                                           const u16 index,
+                                           const bool delivered) {
+  Message& message = messages_[message_id % kMaxMessages];
+  if (!message.used || message.id != message_id ||
+      message.acked_fragments.test(index)) {
+    return;
+  }
+  if (!delivered) {
+    message.resend.push_back(index);
+    return;
+  }
+  message.acked_fragments.set(index);
+  if (++message.acked < message.count) {
+    return;
+  }
+
+  message.used = false;
+  bytes_in_flight_ -= message.data.size();
+  while (oldest_id_ != next_id_ && !messages_[oldest_id_ % kMaxMessages].used) {
+    ++oldest_id_;
+  }
+  // moved out, the callback may add a message in this slot
+  const DeliveryCallback on_delivery = std::move(message.on_delivery);
+  if (on_delivery) {
+    on_delivery(message_id);
+  }
+}
+
+void OutgoingMessages::Reset() {
+  for (Message& message : messages_) {
+    message.used = false;
+    message.on_delivery = {};
+  }
+  next_id_ = 0;
+  oldest_id_ = 0;
+  bytes_in_flight_ = 0;
+  fragments_resent_ = 0;
+}
+
+bool OutgoingMessages::HasRoom() const {
+  return next_id_ - oldest_id_ < kMaxMessages;
+}
+
+size_t OutgoingMessages::NextWithWork() const {
+  for (u32 id = oldest_id_; id != next_id_; id++) {
+    const Message& message = messages_[id % kMaxMessages];
+    if (message.used &&
+        (!message.resend.empty() || message.next_unsent < message.count)) {
+      return id % kMaxMessages;
+    }
+  }
+  return kMaxMessages;
+}
+
+// ============================================================ //
+// ReassemblyTable
+// ============================================================ //
+
+ReassemblyTable::ReassemblyTable(const size_t max_bytes)
+    : slots_(kSlots), max_bytes_(max_bytes) {}
+
+const std::vector<u8>* ReassemblyTable::Insert(const FragmentHeader& header,
+                                               const u8* data,
+                                               const size_t size) {
+  if (header.count == 0 || header.count > kMaxFragments ||
+      header.index >= header.count || header.message_size > kMaxMessageSize ||
+      completed_.Exists(header.message_id) ||
+      SequenceGreaterThan(
+          static_cast<u32>(completed_.sequence() - completed_.size()),
+          header.message_id)) {
+    return nullptr;
+  }
+  const size_t fragment_size = FragmentSize(header.message_size, header.count);
+  const size_t offset = header.index * fragment_size;
+  if (offset > header.message_size) {
+    return nullptr;
+  }
+  const size_t expected = offset + fragment_size < header.message_size
+                              ? fragment_size
+                              : header.message_size - offset;
+  if (size != expected) {
+    return nullptr;
+  }
+
+  Slot& slot = slots_[header.message_id % kSlots];
+  if (!slot.used || slot.message_id != header.message_id) {
+    // a newer message takes over the slot of an abandoned one
+    if (slot.used && SequenceGreaterThan(slot.message_id, header.message_id)) {
+      return nullptr;
+    }
+    if (!Reserve(slot, header.message_size)) {
+      return nullptr;
+    }
+    slot.message_id = header.message_id;
+    slot.used = true;
+    slot.count = header.count;
+    slot.received = 0;
+    slot.fragments.reset();
+  } else if (slot.count != header.count ||
+             slot.data.size() != header.message_size) {
+    return nullptr;
+  }
+  if (slot.fragments.test(header.index)) {
+    return nullptr;
+  }
+  slot.fragments.set(header.index);
+  std::memcpy(slot.data.data() + offset, data, size);
+  if (++slot.received < slot.count) {
+    return nullptr;
+  }
+
+  slot.used = false;
+  completed_.Insert(header.message_id);
+  return &slot.data;
+}
+
+void ReassemblyTable::Reset() {
+  for (Slot& slot : slots_) {
+    slot.used = false;
+  }
+  completed_.Reset();
+}
+
+size_t ReassemblyTable::held_bytes() const {
+  size_t held = 0;
+  for (const Slot& slot : slots_) {
+    held += slot.data.capacity();
+  }
+  return held;
+}
+
+bool ReassemblyTable::Reserve(Slot& target, const size_t size) {
+  // whatever the target held is replaced
+  const auto HeldByOthers = [this, &target]() {
+    return held_bytes() - target.data.capacity();
+  };
+  if (HeldByOthers() + std::max(size, target.data.capacity()) > max_bytes_) {
+    // give back what done messages kept, and what messages in progress
+    // kept from larger ones before them
+    for (Slot& slot : slots_) {
+      if (&slot == &target) {
+        continue;
+      }
+      if (!slot.used) {
+        std::vector<u8>{}.swap(slot.data);
+      } else if (slot.data.capacity() > slot.data.size()) {
+        std::vector<u8>(slot.data).swap(slot.data);
+      }
+    }
+    if (HeldByOthers() + size > max_bytes_) {
+      return false;
+    }
+    if (target.data.capacity() > size) {
+      std::vector<u8>{}.swap(target.data);
+    }
+  }
+  // exactly, rather than the growth of resize
+  target.data.reserve(size);
+  target.data.resize(size);
+  return true;
+}
+
+}  // namespace dnet
@@ -0,0 +1,217 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FRAGMENT_HPP_
+#define FRAGMENT_HPP_
+
+#include <dnet/util/sequence_buffer.hpp>
+#include <dnet/util/types.hpp>
+#include <bitset>
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <vector>
+
+namespace dnet {
+
+/**
+ * Placed after the UdpHeader of a packet carrying part of a message.
+ * All fragments of a message are of equal size, apart from the last, so
+ * the offset of a fragment follows from its index.
+ */
+struct FragmentHeader {
+  u32 message_id;
+  u32 message_size;
+  u16 index;
+  u16 count;
+};
+
+constexpr size_t kMaxFragments = 1024;
+constexpr size_t kMaxMessageSize = 4 * 1024 * 1024;
+// bytes of messages a channel sends at once, so also the most a
+// ReassemblyTable holds, whatever the message sizes its peer claims
+constexpr size_t kMaxReassemblyBytes = 2 * kMaxMessageSize;
+
+/**
+ * @return Number of fragments a message is split in.
+ */
+inline size_t FragmentCount(const size_t message_size,
+                            const size_t max_fragment_size) {
+  return message_size == 0
+             ? 1
+             : (message_size + max_fragment_size - 1) / max_fragment_size;
+}
+
+/**
+ * @return Size of every fragment of a message but the last.
+ */
+inline size_t FragmentSize(const size_t message_size, const size_t count) {
+  return (message_size + count - 1) / count;
+}
+
+// ============================================================ //
+// Sending
+// ============================================================ //
+
+/**
+ * Messages being sent, kept until every fragment is acked. Fragments
+ * reported lost are queued to be sent again, the others are not.
+ */
+class OutgoingMessages {
+ public:
+  // the ids of messages in flight are at most kMaxMessages apart
+  static constexpr size_t kMaxMessages = 8;
+
+  using DeliveryCallback = std::function<void(u32 message_id)>;
+
+  OutgoingMessages();
+
+  /**
+   * Copy @size bytes of @data, to be sent in fragments of at most
+   * @max_fragment_size bytes.
+   * @return The message id, or nullopt if kMaxMessages are in flight, or
+   * the message would put more than kMaxReassemblyBytes in flight, or is
+   * larger than kMaxMessageSize, or kMaxFragments fragments.
+   */
+  std::optional<u32> Add(const u8* data, size_t size,
+                         size_t max_fragment_size,
+                         DeliveryCallback on_delivery);
+
+  /**
+   * @return True if there is a fragment to send, put in the out params.
+   */
+  bool PeekNext(FragmentHeader& header_out, const u8*& data_out,
+                size_t& size_out) const;
+
+  /**
+   * The fragment from PeekNext has been sent.
+   */
+  void PopNext();
+
+  /**
+   * The packet carrying fragment @index of @message_id was delivered, or
+   * lost. Stale reports, of messages already done, are ignored.
+   */
+  void OnFragmentDelivered(u32 message_id, u16 index, bool delivered);
+
+  void Reset();
+
+  bool HasRoom() const;
+
+  u64 fragments_resent() const { return fragments_resent_; }
+
+ private:
+  struct Message {
+    u32 id = 0;
+    bool used = false;
+    std::vector<u8> data{};
+    u16 count = 0;
+    u16 acked = 0;
+    // fragments never sent yet start here
+    u16 next_unsent = 0;
+    std::bitset<kMaxFragments> acked_fragments{};
+    std::vector<u16> resend{};
+    DeliveryCallback on_delivery{};
+  };
+
+  /**
+   * @return Index of the oldest message with a fragment to send, or
+   * kMaxMessages if none.
+   */
+  size_t NextWithWork() const;
+
+  // indexed by id modulo size
+  std::vector<Message> messages_;
+  u32 next_id_ = 0;
+  // oldest message that may still be in flight
+  u32 oldest_id_ = 0;
+  // sum of the sizes of the messages in flight
+  size_t bytes_in_flight_ = 0;
+  u64 fragments_resent_ = 0;
+};
+
+// ============================================================ //
+// Receiving
+// ============================================================ //
+
+/**
+ * Puts fragments back together, in a fixed number of slots indexed by
+ * message id modulo the slot count. Fragments of a message that was
+ * recently completed are dropped, so resent copies do not start it over.
+ *
+ * The memory of all slots together is kept within a budget. The first
+ * fragment of a message allocates its whole size, so a message that
+ * does not fit is dropped, rather than trusting the size a peer claims.
+ * OutgoingMessages keeps a sender within the default budget.
+ */
+class ReassemblyTable {
+ public:
+  static constexpr size_t kSlots = 2 * OutgoingMessages::kMaxMessages;
+
+  explicit ReassemblyTable(size_t max_bytes = kMaxReassemblyBytes);
+
+  /**
+   * Store a fragment of @size bytes.
+   * @return The whole message, when this was the last fragment missing,
+   * else nullptr. Valid until the next call.
+   */
+  const std::vector<u8>* Insert(const FragmentHeader& header, const u8* data,
+                                size_t size);
+
+  void Reset();
+
+  /**
+   * @return Bytes allocated by the slots, at most max_bytes.
+   */
+  size_t held_bytes() const;
+
+  size_t max_bytes() const { return max_bytes_; }
+
+ private:
+  struct Slot {
+    u32 message_id = 0;
+    bool used = false;
+    u16 count = 0;
+    u16 received = 0;
+    std::bitset<kMaxFragments> fragments{};
+    // kept between messages, so a slot only allocates when it grows
+    std::vector<u8> data{};
+  };
+
+  struct Completed {};
+
+  /**
+   * Make room for a message of @size bytes in @target, within the budget.
+   * @return False if it does not fit.
+   */
+  bool Reserve(Slot& target, size_t size);
+
+  std::vector<Slot> slots_;
+  SequenceBuffer<Completed, 256> completed_{};
+  size_t max_bytes_;
+};
+
+}  // namespace dnet
+
+#endif  // FRAGMENT_HPP_
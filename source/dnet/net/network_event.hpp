@@ -25,10 +25,18 @@
 #ifndef NETWORK_EVENT_HPP_
 #define NETWORK_EVENT_HPP_
 
+#include <dnet/util/types.hpp>
 #include <string>
 
 namespace dnet {
 
+/**
+ * Identifies a connection owned by a network handler.
+ */
+using ConnectionId = u32;
+
+constexpr ConnectionId kInvalidConnectionId = 0;
+
 class NetworkEvent {
  public:
   enum class Type {
@@ -53,10 +61,18 @@ class NetworkEvent {
 
   NetworkEvent(Type type) : type_(type) {}
 
+  NetworkEvent(Type type, ConnectionId connection_id)
+      : type_(type), connection_id_(connection_id) {}
+
   Type type() const { return type_; }
 
   void set_type(Type type) { type_ = type; }
 
+  /**
+   * @return The connection the event is about.
+   */
+  ConnectionId connection_id() const { return connection_id_; }
+
   std::string ToString() const {
     std::string str{};
     switch (type_) {
@@ -87,6 +103,7 @@ class NetworkEvent {
 
  private:
   Type type_ = Type::kInvalid;
+  ConnectionId connection_id_ = kInvalidConnectionId;
 };
 
 }  // namespace dnet
@@ -0,0 +1,264 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "poller.hpp"
+#include <algorithm>
+#if defined(DNET_PLATFORM_LINUX)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
+#else
+#include <chrono>
+#include <thread>
+#endif
+
+namespace dnet {
+
+#if defined(DNET_PLATFORM_LINUX)
+
+// token reserved for the eventfd used by Wake
+constexpr u64 kWakeToken = ~static_cast<u64>(0);
+
+static u32 InterestToEpoll(const u32 interest) {
+  u32 events = 0;
+  if (interest & poll_flag::kRead) {
+    events |= EPOLLIN | EPOLLRDHUP;
+  }
+  if (interest & poll_flag::kWrite) {
+    events |= EPOLLOUT;
+  }
+  return events;
+}
+
+static u32 EpollToFlags(const u32 events) {
+  u32 flags = 0;
+  // a hang up is reported as readable, the following read will fail
+  if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) {
+    flags |= poll_flag::kRead;
+  }
+  if (events & EPOLLOUT) {
+    flags |= poll_flag::kWrite;
+  }
+  if (events & EPOLLERR) {
+    flags |= poll_flag::kError;
+  }
+  return flags;
+}
+
+Poller::Poller()
+    : epoll_fd_(epoll_create1(EPOLL_CLOEXEC)),
+      wake_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+  if (epoll_fd_ != -1 && wake_fd_ != -1) {
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = kWakeToken;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event);
+  }
+}
+
+Poller::~Poller() { Close(); }
+
+Poller::Poller(Poller&& other) noexcept
+    : epoll_fd_(other.epoll_fd_), wake_fd_(other.wake_fd_) {
+  other.epoll_fd_ = -1;
+  other.wake_fd_ = -1;
+}
+
+Poller& Poller::operator=(Poller&& other) noexcept {
+  if (this != &other) {
+    Close();
+    epoll_fd_ = other.epoll_fd_;
+    wake_fd_ = other.wake_fd_;
+    other.epoll_fd_ = -1;
+    other.wake_fd_ = -1;
+  }
+  return *this;
+}
+
+void Poller::Close() {
+  if (epoll_fd_ != -1) {
+    close(epoll_fd_);
+    epoll_fd_ = -1;
+  }
+  if (wake_fd_ != -1) {
+    close(wake_fd_);
+    wake_fd_ = -1;
+  }
+}
+
+Result Poller::Add(const chif_net_socket socket, const u64 token,
+                   const u32 interest) {
+  epoll_event event{};
+  event.events = InterestToEpoll(interest);
+  event.data.u64 = token;
+  const int res = epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, socket, &event);
+  return res == 0 ? Result::kSuccess : Result::kFail;
+}
+
+Result Poller::Modify(const chif_net_socket socket, const u64 token,
+                      const u32 interest) {
+  epoll_event event{};
+  event.events = InterestToEpoll(interest);
+  event.data.u64 = token;
+  const int res = epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, socket, &event);
+  return res == 0 ? Result::kSuccess : Result::kFail;
+}
+
+Result Poller::Remove(const chif_net_socket socket) {
+  epoll_event event{};
+  const int res = epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, socket, &event);
+  return res == 0 ? Result::kSuccess : Result::kFail;
+}
+
+void Poller::Wake() {
+  const u64 one = 1;
+  // can only fail if the counter would overflow, then a wake is pending anyway
+  [[maybe_unused]] const auto res = write(wake_fd_, &one, sizeof(one));
+}
+
+int Poller::Wait(PollEvent* events_out, const int max_events,
+                 const int timeout_ms) {
+  constexpr int kMaxEpollEvents = 64;
+  epoll_event events[kMaxEpollEvents];
+  // room for the wake event, so that it cannot starve the sockets
+  const int max = std::min(max_events + 1, kMaxEpollEvents);
+
+  int res;
+  do {
+    res = epoll_wait(epoll_fd_, events, max, timeout_ms);
+  } while (res == -1 && errno == EINTR);
+  if (res == -1) {
+    return -1;
+  }
+
+  int count = 0;
+  for (int i = 0; i < res; i++) {
+    if (events[i].data.u64 == kWakeToken) {
+      u64 value;
+      [[maybe_unused]] const auto bytes = read(wake_fd_, &value, sizeof(value));
+    } else if (count < max_events) {
+      events_out[count].token = events[i].data.u64;
+      events_out[count].flags = EpollToFlags(events[i].events);
+      ++count;
+    }
+  }
+  return count;
+}
+
+#else
+
+Poller::Poller() = default;
+
+Poller::~Poller() { Close(); }
+
+Poller::Poller(Poller&& other) noexcept
+    : registrations_(std::move(other.registrations_)),
+      woken_(other.woken_.load()) {}
+
+Poller& Poller::operator=(Poller&& other) noexcept {
+  if (this != &other) {
+    registrations_ = std::move(other.registrations_);
+    woken_ = other.woken_.load();
+  }
+  return *this;
+}
+
+void Poller::Close() { registrations_.clear(); }
+
+Result Poller::Add(const chif_net_socket socket, const u64 token,
+                   const u32 interest) {
+  registrations_.push_back(Registration{socket, token, interest});
+  return Result::kSuccess;
+}
+
+Result Poller::Modify(const chif_net_socket socket, const u64 token,
+                      const u32 interest) {
+  for (auto& registration : registrations_) {
+    if (registration.socket == socket) {
+      registration.token = token;
+      registration.interest = interest;
+      return Result::kSuccess;
+    }
+  }
+  return Result::kFail;
+}
+
+Result Poller::Remove(const chif_net_socket socket) {
+  const auto it = std::find_if(
+      registrations_.begin(), registrations_.end(),
+      [socket](const Registration& r) { return r.socket == socket; });
+  if (it == registrations_.end()) {
+    return Result::kFail;
+  }
+  registrations_.erase(it);
+  return Result::kSuccess;
+}
+
+void Poller::Wake() { woken_ = true; }
+
+int Poller::Wait(PollEvent* events_out, const int max_events,
+                 const int timeout_ms) {
+  const auto start = std::chrono::steady_clock::now();
+  while (true) {
+    int count = 0;
+    for (const auto& registration : registrations_) {
+      if (count == max_events) {
+        break;
+      }
+      u32 flags = 0;
+      int can = 0;
+      if ((registration.interest & poll_flag::kRead) &&
+          chif_net_can_read(registration.socket, &can, 0) ==
+              CHIF_NET_RESULT_SUCCESS &&
+          can != 0) {
+        flags |= poll_flag::kRead;
+      }
+      if ((registration.interest & poll_flag::kWrite) &&
+          chif_net_can_write(registration.socket, &can, 0) ==
+              CHIF_NET_RESULT_SUCCESS &&
+          can != 0) {
+        flags |= poll_flag::kWrite;
+      }
+      if (flags != 0) {
+        events_out[count++] = PollEvent{registration.token, flags};
+      }
+    }
+
+    if (woken_.exchange(false) || count > 0) {
+      return count;
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    if (timeout_ms != kInfinite &&
+        elapsed >= std::chrono::milliseconds(timeout_ms)) {
+      return 0;
+    }
+    constexpr std::chrono::microseconds sleep_time_us{100};
+    std::this_thread::sleep_for(sleep_time_us);
+  }
+}
+
+#endif
+
+}  // namespace dnet
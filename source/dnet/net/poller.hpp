@@ -0,0 +1,121 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef POLLER_HPP_
+#define POLLER_HPP_
+
+#include <atomic>
+#include <chif_net/chif_net.h>
+#include <dnet/util/platform.hpp>
+#include <dnet/util/result.hpp>
+#include <dnet/util/types.hpp>
+#include <vector>
+
+namespace dnet {
+
+/**
+ * Readiness flags used both as interest when registering a socket, and as
+ * the reported readiness in a PollEvent.
+ */
+namespace poll_flag {
+constexpr u32 kRead = 1 << 0;
+constexpr u32 kWrite = 1 << 1;
+// only reported, an error is pending on the socket
+constexpr u32 kError = 1 << 2;
+}  // namespace poll_flag
+
+struct PollEvent {
+  // the token the socket was registered with
+  u64 token;
+  // poll_flag bits
+  u32 flags;
+};
+
+/**
+ * Wait for readiness on many sockets at once, and allow another thread to
+ * interrupt the wait. Uses epoll and an eventfd on Linux, on other platforms
+ * it falls back to polling the registered sockets: each pass costs up to two
+ * system calls per socket, and a socket that becomes ready while Wait
+ * sleeps between passes is reported up to 100us late.
+ *
+ * Add, Modify, Remove and Wait must be called from the same thread, Wake
+ * may be called from any thread.
+ */
+class Poller {
+ public:
+  Poller();
+  ~Poller();
+
+  // no copy
+  Poller(const Poller& other) = delete;
+  Poller& operator=(const Poller& other) = delete;
+
+  Poller(Poller&& other) noexcept;
+  Poller& operator=(Poller&& other) noexcept;
+
+  /**
+   * @param token Will be reported back in the PollEvent.
+   * @param interest poll_flag bits.
+   */
+  Result Add(chif_net_socket socket, u64 token, u32 interest);
+
+  Result Modify(chif_net_socket socket, u64 token, u32 interest);
+
+  Result Remove(chif_net_socket socket);
+
+  /**
+   * Thread safe. Make the current, or if none, the next call to Wait return.
+   */
+  void Wake();
+
+  /**
+   * Block until a registered socket is ready, Wake is called or the timeout
+   * expires. Wake-ups are consumed and not reported as events.
+   * @param timeout_ms How long to wait, kInfinite to wait until woken.
+   * @return Amount of events placed in events_out, or -1 on failure.
+   */
+  int Wait(PollEvent* events_out, int max_events, int timeout_ms);
+
+  static constexpr int kInfinite = -1;
+
+ private:
+  void Close();
+
+#if defined(DNET_PLATFORM_LINUX)
+  int epoll_fd_;
+  int wake_fd_;
+#else
+  struct Registration {
+    chif_net_socket socket;
+    u64 token;
+    u32 interest;
+  };
+  std::vector<Registration> registrations_{};
+  std::atomic<bool> woken_{false};
+#endif
+};
+
+}  // namespace dnet
+
+#endif  // POLLER_HPP_
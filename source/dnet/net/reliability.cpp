@@ -0,0 +1,189 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "reliability.hpp"
+#include <utility>
+
+namespace dnet {
+
+UdpHeader Reliability::PrepareHeader(DeliveryCallback on_delivery,
+                                     const TimePoint now, const size_t bytes) {
+  const UdpHeader header = NextHeader();
+  SentPacket* packet = sent_.Insert(header.id);
+  packet->on_delivery = std::move(on_delivery);
+  packet->sent_at = now;
+  packet->bytes = bytes;
+  bytes_in_flight_ += bytes;
+  return header;
+}
+
+UdpHeader Reliability::PrepareAckHeader() { return NextHeader(); }
+
+UdpHeader Reliability::NextHeader() {
+  const u32 id = local_sequence_;
+  // 0 means no ack in acked_id, so it is never used as an id
+  local_sequence_ = local_sequence_ + 1 == 0 ? 1 : local_sequence_ + 1;
+  ++packets_sent_;
+
+  // the slot is about to be reused, whatever was in it is lost
+  ExpireBefore(static_cast<u32>(id - kBufferSize + 1));
+
+  UdpHeader header{id, 0, 0, 0};
+  if (has_received_) {
+    header.acked_id = received_.sequence() - 1;
+    for (u32 bit = 0; bit < kAckBits; bit++) {
+      if (received_.Exists(header.acked_id - 1 - bit)) {
+        header.acked_bitmask |= 1u << bit;
+      }
+    }
+  }
+  return header;
+}
+
+bool Reliability::ProcessHeader(const UdpHeader& header,
+                                const TimePoint now) {
+  if (header.acked_id != 0) {
+    Acknowledge(header.acked_id, now);
+    for (u32 bit = 0; bit < kAckBits; bit++) {
+      if (header.acked_bitmask & (1u << bit)) {
+        Acknowledge(header.acked_id - 1 - bit, now);
+      }
+    }
+    if (SequenceGreaterThan(header.acked_id, newest_ack_)) {
+      newest_ack_ = header.acked_id;
+      // no later ack can cover these
+      ExpireBefore(newest_ack_ - kAckBits);
+    }
+  }
+
+  if (header.id == 0 || received_.Exists(header.id) ||
+      received_.Insert(header.id) == nullptr) {
+    return false;
+  }
+  has_received_ = true;
+  return true;
+}
+
+void Reliability::Update(const TimePoint now) {
+  bool back_off = false;
+  while (SequenceGreaterThan(local_sequence_, oldest_unacked_)) {
+    const SentPacket* packet = sent_.Find(oldest_unacked_);
+    // deadlines follow the send order, so the first packet still waiting
+    // for its deadline ends the scan
+    if (packet != nullptr && !packet->acked &&
+        packet->sent_at + rto_ + max_ack_delay_ > now) {
+      break;
+    }
+    // packets sent before the last back off timing out is the same event
+    back_off = back_off || (packet != nullptr && !packet->acked &&
+                            packet->sent_at >= last_back_off_);
+    ExpireOldest();
+  }
+  if (back_off) {
+    // RFC 6298 5.5, back off until an ack gives a new sample
+    rto_ = rto_ * 2 < kMaxRto ? rto_ * 2 : kMaxRto;
+    last_back_off_ = now;
+  }
+}
+
+void Reliability::Reset() {
+  sent_.Reset();
+  received_.Reset();
+  local_sequence_ = 1;
+  oldest_unacked_ = 1;
+  newest_ack_ = 0;
+  has_received_ = false;
+  packets_sent_ = 0;
+  packets_delivered_ = 0;
+  packets_lost_ = 0;
+  bytes_in_flight_ = 0;
+  bytes_delivered_ = 0;
+  bytes_lost_ = 0;
+  srtt_ = Duration{};
+  rttvar_ = Duration{};
+  rto_ = kInitialRto;
+  last_back_off_ = TimePoint{};
+  has_rtt_sample_ = false;
+}
+
+void Reliability::Acknowledge(const u32 id, const TimePoint now) {
+  SentPacket* packet = sent_.Find(id);
+  if (packet == nullptr || packet->acked) {
+    return;
+  }
+  packet->acked = true;
+  ++packets_delivered_;
+  bytes_in_flight_ -= packet->bytes;
+  bytes_delivered_ += packet->bytes;
+  AddRttSample(now - packet->sent_at);
+  // moved out, the callback may send, and so insert into sent_
+  const DeliveryCallback on_delivery = std::move(packet->on_delivery);
+  if (on_delivery) {
+    on_delivery(id, true);
+  }
+}
+
+void Reliability::AddRttSample(const Duration sample) {
+  // RFC 6298 2.2 and 2.3, with alpha 1/8 and beta 1/4
+  if (!has_rtt_sample_) {
+    srtt_ = sample;
+    rttvar_ = sample / 2;
+    has_rtt_sample_ = true;
+  } else {
+    const Duration error = srtt_ > sample ? srtt_ - sample : sample - srtt_;
+    rttvar_ = (rttvar_ * 3 + error) / 4;
+    srtt_ = (srtt_ * 7 + sample) / 8;
+  }
+  const Duration rto = srtt_ + rttvar_ * 4;
+  rto_ = rto < min_rto_ ? min_rto_ : rto > kMaxRto ? kMaxRto : rto;
+}
+
+void Reliability::ExpireBefore(const u32 id) {
+  while (SequenceGreaterThan(id, oldest_unacked_) &&
+         SequenceGreaterThan(local_sequence_, oldest_unacked_)) {
+    ExpireOldest();
+  }
+}
+
+void Reliability::ExpireOldest() {
+  const u32 expired = oldest_unacked_++;
+  SentPacket* packet = sent_.Find(expired);
+  if (packet == nullptr) {
+    return;
+  }
+  const bool lost = !packet->acked;
+  const size_t bytes = packet->bytes;
+  const DeliveryCallback on_delivery = std::move(packet->on_delivery);
+  sent_.Remove(expired);
+  if (lost) {
+    ++packets_lost_;
+    bytes_in_flight_ -= bytes;
+    bytes_lost_ += bytes;
+    if (on_delivery) {
+      on_delivery(expired, false);
+    }
+  }
+}
+
+}  // namespace dnet
@@ -0,0 +1,252 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef RELIABILITY_HPP_
+#define RELIABILITY_HPP_
+
+#include <dnet/util/sequence_buffer.hpp>
+#include <dnet/util/types.hpp>
+#include <chrono>
+#include <functional>
+
+namespace dnet {
+
+/**
+ * Header, to be placed in front of each payload.
+ */
+struct UdpHeader {
+  // sequence number of this packet, 0 is never sent
+  u32 id;
+  // most recent id received from the remote, 0 if none yet
+  u32 acked_id;
+  // bit n set means id acked_id - 1 - n has also been received
+  u32 acked_bitmask;
+  // what follows the header, see UdpHeaderFlags
+  u32 flags;
+};
+
+enum UdpHeaderFlags : u32 {
+  // a FragmentHeader and a part of a message follow
+  kUdpFragment = 1u << 0,
+  // a u32 sequence number of the channel and the payload follow
+  kUdpSequenced = 1u << 1,
+  // a handshake packet, see control.hpp
+  kUdpControl = 1u << 2,
+  // the channel, in the bits above kUdpChannelShift
+  kUdpChannelMask = 0xffu << 8,
+};
+
+constexpr u32 kUdpChannelShift = 8;
+
+/**
+ * The protocol state of a reliable udp connection, kept apart from the
+ * socket so it can be driven by anything that moves UdpHeaders around.
+ *
+ * Each outgoing packet gets the next sequence number, and carries acks for
+ * the most recent packet received plus the 32 before it. Since every packet
+ * acks 33 ids, an ack is only lost if 33 packets in a row are lost.
+ *
+ * A sent packet is reported delivered when an ack for it arrives, and lost
+ * once the acks have moved so far past it that none can cover it anymore,
+ * when kBufferSize newer packets have been sent, or when its retransmit
+ * deadline passes without an ack.
+ *
+ * The deadline is the send time plus the retransmission timeout (RTO),
+ * estimated from the round trip times of acked packets as in RFC 6298,
+ * plus the longest the peer holds back an ack, as in the PTO of QUIC.
+ * Otherwise, on a link faster than the ack delay, every delayed ack would
+ * arrive after the deadline.
+ * As with the single timer of the RFC, backing off the rto, or a new
+ * estimate, moves the deadlines of all packets in flight.
+ * A lost payload is resent with a new id, so an ack always tells which
+ * send it answers, and every first ack of a packet is a valid rtt sample.
+ */
+class Reliability {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using TimePoint = Clock::time_point;
+  using Duration = Clock::duration;
+
+  static constexpr size_t kBufferSize = 1024;
+  static constexpr u32 kAckBits = 32;
+  // rto before the first rtt sample
+  static constexpr Duration kInitialRto = std::chrono::seconds(1);
+  // the RFC minimum of 1s is far too slow on a lan, this only guards
+  // against clock granularity, and an ack waiting for outgoing traffic
+  static constexpr Duration kDefaultMinRto = std::chrono::milliseconds(1);
+  static constexpr Duration kMaxRto = std::chrono::seconds(60);
+
+  /**
+   * Called once per sent packet, with its id and whether it was delivered.
+   * It may prepare new headers, for example to resend a lost payload.
+   */
+  using DeliveryCallback = std::function<void(u32 id, bool delivered)>;
+
+  /**
+   * Stamp the header of the next outgoing packet, and remember the packet
+   * until it is delivered or lost.
+   * @param on_delivery Optional, called when the fate of the packet is known.
+   * @param bytes Size of the packet, counted in the byte statistics.
+   */
+  UdpHeader PrepareHeader(DeliveryCallback on_delivery = {},
+                          TimePoint now = Clock::now(), size_t bytes = 0);
+
+  /**
+   * Stamp the header of an outgoing packet that only carries acks. The peer
+   * does not ack such packets, so they are not remembered, and are never
+   * reported delivered or lost, nor back off the rto. They still count in
+   * packets_sent.
+   */
+  UdpHeader PrepareAckHeader();
+
+  /**
+   * Process the header of an incoming packet, reporting the packets it acks.
+   * @return False if the packet is a duplicate, or too old to track, and
+   * its payload should be dropped.
+   */
+  bool ProcessHeader(const UdpHeader& header, TimePoint now = Clock::now());
+
+  /**
+   * Report the packets whose retransmit deadline has passed as lost, and
+   * back off the rto. Call regularly, for example once per tick.
+   */
+  void Update(TimePoint now = Clock::now());
+
+  /**
+   * Forget all state, as for a new connection.
+   */
+  void Reset();
+
+  /**
+   * @return Id that the next outgoing packet will get.
+   */
+  u32 local_sequence() const { return local_sequence_; }
+
+  /**
+   * @return Most recent id received, 0 if none.
+   */
+  u32 remote_sequence() const {
+    return has_received_ ? received_.sequence() - 1 : 0;
+  }
+
+  u64 packets_sent() const { return packets_sent_; }
+
+  u64 packets_delivered() const { return packets_delivered_; }
+
+  u64 packets_lost() const { return packets_lost_; }
+
+  /**
+   * @return Bytes sent, and neither delivered nor lost yet.
+   */
+  size_t bytes_in_flight() const { return bytes_in_flight_; }
+
+  u64 bytes_delivered() const { return bytes_delivered_; }
+
+  u64 bytes_lost() const { return bytes_lost_; }
+
+  // ============================================================ //
+  // Round trip time
+  // ============================================================ //
+
+  /**
+   * @return Smoothed round trip time, zero before the first sample.
+   */
+  Duration srtt() const { return srtt_; }
+
+  /**
+   * @return Round trip time variation, zero before the first sample.
+   */
+  Duration rttvar() const { return rttvar_; }
+
+  /**
+   * @return Current retransmission timeout.
+   */
+  Duration rto() const { return rto_; }
+
+  bool has_rtt_sample() const { return has_rtt_sample_; }
+
+  void set_min_rto(const Duration min_rto) { min_rto_ = min_rto; }
+
+  /**
+   * @param max_ack_delay Longest the peer waits for an outgoing packet to
+   * carry its acks, before sending them on their own.
+   */
+  void set_max_ack_delay(const Duration max_ack_delay) {
+    max_ack_delay_ = max_ack_delay;
+  }
+
+ private:
+  struct SentPacket {
+    DeliveryCallback on_delivery{};
+    TimePoint sent_at{};
+    size_t bytes = 0;
+    bool acked = false;
+  };
+
+  struct ReceivedPacket {};
+
+  /**
+   * @return Header with the next id and the acks of the received packets.
+   */
+  UdpHeader NextHeader();
+
+  void Acknowledge(u32 id, TimePoint now);
+
+  void AddRttSample(Duration sample);
+
+  /**
+   * Report every unacked packet before @id as lost.
+   */
+  void ExpireBefore(u32 id);
+
+  /**
+   * Forget the oldest tracked packet, reporting it lost if unacked.
+   */
+  void ExpireOldest();
+
+  SequenceBuffer<SentPacket, kBufferSize> sent_{};
+  SequenceBuffer<ReceivedPacket, kBufferSize> received_{};
+  u32 local_sequence_ = 1;
+  // sent packets before this have been delivered or lost
+  u32 oldest_unacked_ = 1;
+  u32 newest_ack_ = 0;
+  bool has_received_ = false;
+  u64 packets_sent_ = 0;
+  u64 packets_delivered_ = 0;
+  u64 packets_lost_ = 0;
+  size_t bytes_in_flight_ = 0;
+  u64 bytes_delivered_ = 0;
+  u64 bytes_lost_ = 0;
+  Duration srtt_{};
+  Duration rttvar_{};
+  Duration rto_ = kInitialRto;
+  Duration min_rto_ = kDefaultMinRto;
+  Duration max_ack_delay_{};
+  TimePoint last_back_off_{};
+  bool has_rtt_sample_ = false;
+};
+
+}  // namespace dnet
+
+#endif  // RELIABILITY_HPP_
@@ -0,0 +1,114 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "resolver.hpp"
+#include <functional>
+#include <iterator>
+
+namespace dnet {
+
+Resolver::Resolver(const Clock::duration ttl,
+                   const Clock::duration negative_ttl)
+    : ttl_(ttl), negative_ttl_(negative_ttl) {}
+
+Resolver& Resolver::Default() {
+  static Resolver resolver{};
+  return resolver;
+}
+
+std::optional<Endpoint> Resolver::Resolve(const std::string& host,
+                                          const u16 port,
+                                          const AddressFamily address_family) {
+  const Key key{host, port, address_family};
+  std::unique_lock<std::mutex> lock{mutex_};
+  while (true) {
+    const auto it = entries_.find(key);
+    if (it != entries_.end() && Clock::now() < it->second.expiry) {
+      return it->second.endpoint;
+    }
+    if (in_flight_.count(key) == 0) {
+      break;
+    }
+    resolved_.wait(lock);
+  }
+  in_flight_.insert(key);
+  lookups_++;
+  lock.unlock();
+
+  const auto endpoint = Endpoint::Resolve(host, port, address_family);
+  lock.lock();
+  Store(key, endpoint, Clock::now());
+  in_flight_.erase(key);
+  lock.unlock();
+  resolved_.notify_all();
+  return endpoint;
+}
+
+void Resolver::Clear() {
+  std::lock_guard<std::mutex> lock{mutex_};
+  entries_.clear();
+}
+
+void Resolver::set_ttl(const Clock::duration ttl) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  ttl_ = ttl;
+}
+
+void Resolver::set_negative_ttl(const Clock::duration negative_ttl) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  negative_ttl_ = negative_ttl;
+}
+
+size_t Resolver::size() const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  return entries_.size();
+}
+
+u64 Resolver::lookups() const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  return lookups_;
+}
+
+size_t Resolver::KeyHash::operator()(const Key& key) const {
+  const size_t rest = (static_cast<size_t>(key.port) << 1) |
+                      (key.address_family == AddressFamily::kIPv6 ? 1 : 0);
+  return std::hash<std::string>{}(key.host) * 31 + rest;
+}
+
+void Resolver::Store(const Key& key, const std::optional<Endpoint>& endpoint,
+                     const Clock::time_point now) {
+  if (entries_.size() >= kMaxEntries && entries_.count(key) == 0) {
+    for (auto it = entries_.begin(); it != entries_.end();) {
+      it = now < it->second.expiry ? std::next(it) : entries_.erase(it);
+    }
+    if (entries_.size() >= kMaxEntries) {
+      entries_.clear();
+    }
+  }
+  entries_[key] =
+      Entry{endpoint, now + (endpoint.has_value() ? ttl_ : negative_ttl_)};
+}
+
+}  // namespace dnet
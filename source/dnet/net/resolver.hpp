@@ -0,0 +1,132 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef RESOLVER_HPP_
+#define RESOLVER_HPP_
+
+#include <dnet/net/address.hpp>
+#include <dnet/net/endpoint.hpp>
+#include <dnet/util/types.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace dnet {
+
+/**
+ * Remembers resolved host names, so that repeated connects and sends to
+ * the same host and port do not each call the system resolver. An entry
+ * is trusted for the ttl, failed lookups for the shorter negative ttl, so
+ * that a missing name does not hammer the resolver either.
+ *
+ * Thread safe. The system resolver is called without holding the lock, so
+ * a slow lookup only holds up callers asking for the same name. Those wait
+ * for the first caller's result, so a name is only looked up once
+ * however many threads ask for it at the same time.
+ */
+class Resolver {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit Resolver(Clock::duration ttl = std::chrono::seconds(60),
+                    Clock::duration negative_ttl = std::chrono::seconds(5));
+
+  /**
+   * The cache Socket uses for Connect, Bind and WriteTo with a host name.
+   */
+  static Resolver& Default();
+
+  /**
+   * @return Endpoint of @host and @port, from the cache when fresh, or
+   * nullopt if it could not be resolved.
+   */
+  std::optional<Endpoint> Resolve(
+      const std::string& host, u16 port,
+      AddressFamily address_family = AddressFamily::kIPv4);
+
+  /**
+   * Forget every entry, such as after a network change.
+   */
+  void Clear();
+
+  void set_ttl(Clock::duration ttl);
+
+  void set_negative_ttl(Clock::duration negative_ttl);
+
+  size_t size() const;
+
+  /**
+   * @return Amount of times the system resolver has been called.
+   */
+  u64 lookups() const;
+
+  // when full, expired entries are dropped, and if none were, all of them
+  static constexpr size_t kMaxEntries = 4096;
+
+ private:
+  struct Key {
+    std::string host;
+    u16 port;
+    AddressFamily address_family;
+
+    bool operator==(const Key& other) const {
+      return port == other.port && address_family == other.address_family &&
+             host == other.host;
+    }
+  };
+
+  struct KeyHash {
+    size_t operator()(const Key& key) const;
+  };
+
+  struct Entry {
+    std::optional<Endpoint> endpoint;
+    Clock::time_point expiry;
+  };
+
+  /**
+   * With mutex_ held.
+   */
+  void Store(const Key& key, const std::optional<Endpoint>& endpoint,
+             Clock::time_point now);
+
+  mutable std::mutex mutex_{};
+  std::unordered_map<Key, Entry, KeyHash> entries_{};
+  // being looked up, other callers wait on resolved_ for the result
+  std::unordered_set<Key, KeyHash> in_flight_{};
+  std::condition_variable resolved_{};
+  Clock::duration ttl_;
+  Clock::duration negative_ttl_;
+  u64 lookups_ = 0;
+};
+
+}  // namespace dnet
+
+#endif  // RESOLVER_HPP_
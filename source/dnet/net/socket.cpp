@@ -23,10 +23,80 @@
  */
 
 #include "socket.hpp"
+#include <dnet/net/resolver.hpp>
 #include <dnet/util/dnet_assert.hpp>
+#include <dnet/util/platform.hpp>
+#include <utility>
+#if defined(DNET_PLATFORM_WINDOWS)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <cerrno>
+#endif
+#if defined(DNET_PLATFORM_LINUX)
+#include <netinet/udp.h>
+#include <cstring>
+// older headers lack the offload options
+#if !defined(UDP_SEGMENT)
+#define UDP_SEGMENT 103
+#endif
+#if !defined(UDP_GRO)
+#define UDP_GRO 104
+#endif
+#if !defined(SO_INCOMING_CPU)
+#define SO_INCOMING_CPU 49
+#endif
+#endif
 
 namespace dnet {
 
+/**
+ * For the calls chif_net does not wrap, translate the platform's error.
+ */
+static chif_net_result LastPlatformError() {
+#if defined(DNET_PLATFORM_WINDOWS)
+  const int error = WSAGetLastError();
+  const bool closed = error == WSAECONNRESET || error == WSAECONNABORTED ||
+                      error == WSAESHUTDOWN;
+#else
+  const bool closed = errno == EPIPE || errno == ECONNRESET;
+#endif
+  return closed ? CHIF_NET_RESULT_TCP_CONNECTION_CLOSED
+                : CHIF_NET_RESULT_UNKNOWN;
+}
+
+static bool SetIntOption(const chif_net_socket socket, const int level,
+                         const int name, const int value) {
+#if defined(DNET_PLATFORM_WINDOWS)
+  return setsockopt(socket, level, name,
+                    reinterpret_cast<const char*>(&value),
+                    sizeof(value)) == 0;
+#else
+  return setsockopt(socket, level, name, &value, sizeof(value)) == 0;
+#endif
+}
+
+static std::optional<int> GetIntOption(const chif_net_socket socket,
+                                       const int level, const int name) {
+  int value = 0;
+#if defined(DNET_PLATFORM_WINDOWS)
+  int len = sizeof(value);
+  const int res =
+      getsockopt(socket, level, name, reinterpret_cast<char*>(&value), &len);
+#else
+  socklen_t len = sizeof(value);
+  const int res = getsockopt(socket, level, name, &value, &len);
+#endif
+  if (res == 0) {
+    return value;
+  }
+  return std::nullopt;
+}
+
 Socket::Socket(const TransportProtocol transport_protocol,
                const AddressFamily address_family)
     : socket_(CHIF_NET_INVALID_SOCKET),
@@ -42,7 +112,9 @@ Socket::Socket(Socket&& other) noexcept
     : socket_(other.socket_),
       proto_(other.proto_),
       af_(other.af_),
-      last_error_(other.last_error_) {
+      last_error_(other.last_error_),
+      segmentation_offload_(other.segmentation_offload_),
+      options_(other.options_) {
   other.socket_ = CHIF_NET_INVALID_SOCKET;
 }
 
@@ -52,6 +124,8 @@ Socket& Socket::operator=(Socket&& other) noexcept {
     proto_ = other.proto_;
     af_ = other.af_;
     last_error_ = other.last_error_;
+    segmentation_offload_ = other.segmentation_offload_;
+    options_ = other.options_;
     other.socket_ = CHIF_NET_INVALID_SOCKET;
   }
   return *this;
@@ -71,23 +145,36 @@ Result Socket::Open() {
   const auto res = chif_net_open_socket(&socket_, proto_, af_);
   if (res != CHIF_NET_RESULT_SUCCESS) {
     last_error_ = res;
+    return Result::kFail;
   }
-  return (res == CHIF_NET_RESULT_SUCCESS ? Result::kSuccess : Result::kFail);
+  segmentation_offload_ = ProbeSegmentationOffload();
+  return ApplyOptions();
 }
 
 Result Socket::Bind(const u16 port) const {
-  chif_net_address addr;
-  const std::string portstr{std::to_string(port)};
   // TODO allow ipv6
-  auto res =
-      chif_net_create_address(&addr, "localhost", portstr.c_str(), af_, proto_);
-  if (res == CHIF_NET_RESULT_SUCCESS) {
-    res = chif_net_bind(socket_, &addr);
+  const auto maybe_endpoint = Resolver::Default().Resolve(
+      "localhost", port, AddressFamilyFromChifNet(af_));
+  if (!maybe_endpoint.has_value()) {
+    last_error_ = CHIF_NET_RESULT_UNKNOWN;
+    return Result::kFail;
   }
-  if (res != CHIF_NET_RESULT_SUCCESS) {
-    last_error_ = res;
+  return Bind(maybe_endpoint.value());
+}
+
+Result Socket::Bind(const Endpoint& endpoint) const {
+#if defined(DNET_PLATFORM_WINDOWS)
+  const int res = bind(socket_, static_cast<const sockaddr*>(endpoint.data()),
+                       static_cast<int>(endpoint.length()));
+#else
+  const int res = bind(socket_, static_cast<const sockaddr*>(endpoint.data()),
+                       static_cast<socklen_t>(endpoint.length()));
+#endif
+  if (res == 0) {
+    return Result::kSuccess;
   }
-  return (res == CHIF_NET_RESULT_SUCCESS ? Result::kSuccess : Result::kFail);
+  last_error_ = LastPlatformError();
+  return Result::kFail;
 }
 
 Result Socket::Listen() const {
@@ -104,7 +191,13 @@ std::optional<Socket> Socket::Accept() const {
   chif_net_socket cli_sock;
   const auto res = chif_net_accept(socket_, &cli_address, &cli_sock);
   if (res == CHIF_NET_RESULT_SUCCESS) {
-    return std::optional<Socket>{Socket(cli_sock, proto_, af_)};
+    Socket client(cli_sock, proto_, af_);
+    client.options_ = options_;
+    if (client.ApplyOptions() == Result::kSuccess) {
+      return std::optional<Socket>{std::move(client)};
+    }
+    last_error_ = client.last_error_;
+    return std::nullopt;
   }
   last_error_ = res;
   return std::nullopt;
@@ -120,25 +213,69 @@ std::optional<int> Socket::Read(u8* buf_out, const size_t buflen) const {
   return std::nullopt;
 }
 
+std::optional<int> Socket::ReadNonBlocking(u8* buf_out,
+                                          const size_t buflen) const {
+#if defined(DNET_PLATFORM_WINDOWS)
+  // no per call flag, ask first instead
+  if (!CanRead()) {
+    return std::optional<int>{0};
+  }
+  const int bytes = recv(socket_, reinterpret_cast<char*>(buf_out),
+                         static_cast<int>(buflen), 0);
+  const bool would_block = bytes < 0 && WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+  ssize_t bytes;
+  do {
+    bytes = recv(socket_, buf_out, buflen, MSG_DONTWAIT);
+  } while (bytes < 0 && errno == EINTR);
+  const bool would_block =
+      bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+#endif
+  if (bytes > 0) {
+    return std::optional<int>{static_cast<int>(bytes)};
+  }
+  if (would_block) {
+    return std::optional<int>{0};
+  }
+  last_error_ =
+      bytes == 0 ? CHIF_NET_RESULT_TCP_CONNECTION_CLOSED : LastPlatformError();
+  return std::nullopt;
+}
+
 std::optional<int> Socket::ReadFrom(u8* buf_out, const size_t buflen,
                                         std::string& addr_out,
                                         u16& port_out) const {
-  int bytes;
-  chif_net_address source_addr;
-  source_addr.address_family = af_;
-  auto res = chif_net_readfrom(socket_, buf_out, buflen, &bytes, &source_addr);
-  if (res == CHIF_NET_RESULT_SUCCESS) {
-    addr_out.resize(CHIF_NET_IPVX_STRING_LENGTH);
-    res = chif_net_ip_from_address(&source_addr, addr_out.data(),
-                                   addr_out.capacity());
-    if (res == CHIF_NET_RESULT_SUCCESS) {
-      res = chif_net_port_from_address(&source_addr, &port_out);
-      if (res == CHIF_NET_RESULT_SUCCESS) {
-        return std::optional<int>{bytes};
-      }
-    }
+  Endpoint endpoint{};
+  const auto maybe_bytes = ReadFrom(buf_out, buflen, endpoint);
+  if (maybe_bytes.has_value()) {
+    addr_out = endpoint.GetIp().value_or("");
+    port_out = endpoint.GetPort();
   }
-  last_error_ = res;
+  return maybe_bytes;
+}
+
+std::optional<int> Socket::ReadFrom(u8* buf_out, const size_t buflen,
+                                    Endpoint& endpoint_out) const {
+  sockaddr_storage storage{};
+#if defined(DNET_PLATFORM_WINDOWS)
+  int length = sizeof(storage);
+  const int bytes =
+      recvfrom(socket_, reinterpret_cast<char*>(buf_out),
+               static_cast<int>(buflen), 0,
+               reinterpret_cast<sockaddr*>(&storage), &length);
+#else
+  socklen_t length = sizeof(storage);
+  ssize_t bytes;
+  do {
+    bytes = recvfrom(socket_, buf_out, buflen, 0,
+                     reinterpret_cast<sockaddr*>(&storage), &length);
+  } while (bytes < 0 && errno == EINTR);
+#endif
+  if (bytes >= 0) {
+    endpoint_out = Endpoint::FromSockaddr(&storage, length);
+    return std::optional<int>{static_cast<int>(bytes)};
+  }
+  last_error_ = LastPlatformError();
   return std::nullopt;
 }
 
@@ -152,49 +289,565 @@ std::optional<int> Socket::Write(const u8* buf, const size_t buflen) const {
   return std::nullopt;
 }
 
+std::optional<int> Socket::WriteNonBlocking(const u8* buf,
+                                           const size_t buflen) const {
+#if defined(DNET_PLATFORM_WINDOWS)
+  // no per call flag, ask first instead
+  if (!CanWrite()) {
+    return std::optional<int>{0};
+  }
+  const int bytes = send(socket_, reinterpret_cast<const char*>(buf),
+                         static_cast<int>(buflen), 0);
+  const bool would_block = bytes < 0 && WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+#if defined(MSG_NOSIGNAL)
+  constexpr int flags = MSG_DONTWAIT | MSG_NOSIGNAL;
+#else
+  constexpr int flags = MSG_DONTWAIT;
+#endif
+  ssize_t bytes;
+  do {
+    bytes = send(socket_, buf, buflen, flags);
+  } while (bytes < 0 && errno == EINTR);
+  const bool would_block =
+      bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+#endif
+  if (bytes >= 0) {
+    return std::optional<int>{static_cast<int>(bytes)};
+  }
+  if (would_block) {
+    return std::optional<int>{0};
+  }
+  last_error_ = LastPlatformError();
+  return std::nullopt;
+}
+
 std::optional<int> Socket::WriteTo(const u8* buf, const size_t buflen,
                                        const std::string& addr,
                                        const u16 port) const {
-  int bytes;
-  chif_net_address target_addr;
-  const std::string portstr = std::to_string(port);
-  auto res = chif_net_create_address(&target_addr, addr.c_str(),
-                                     portstr.c_str(), af_, proto_);
-  if (res == CHIF_NET_RESULT_SUCCESS) {
-    res = chif_net_writeto(socket_, buf, buflen, &bytes, &target_addr);
-    if (res == CHIF_NET_RESULT_SUCCESS) {
-      return std::optional<int>{bytes};
-    }
+  const auto maybe_endpoint =
+      Resolver::Default().Resolve(addr, port, AddressFamilyFromChifNet(af_));
+  if (!maybe_endpoint.has_value()) {
+    last_error_ = CHIF_NET_RESULT_UNKNOWN;
+    return std::nullopt;
   }
-  last_error_ = res;
+  return WriteTo(buf, buflen, maybe_endpoint.value());
+}
+
+std::optional<int> Socket::WriteTo(const u8* buf, const size_t buflen,
+                                   const Endpoint& endpoint) const {
+#if defined(DNET_PLATFORM_WINDOWS)
+  const int bytes =
+      sendto(socket_, reinterpret_cast<const char*>(buf),
+             static_cast<int>(buflen), 0,
+             static_cast<const sockaddr*>(endpoint.data()),
+             static_cast<int>(endpoint.length()));
+#else
+#if defined(MSG_NOSIGNAL)
+  constexpr int flags = MSG_NOSIGNAL;
+#else
+  constexpr int flags = 0;
+#endif
+  ssize_t bytes;
+  do {
+    bytes = sendto(socket_, buf, buflen, flags,
+                   static_cast<const sockaddr*>(endpoint.data()),
+                   static_cast<socklen_t>(endpoint.length()));
+  } while (bytes < 0 && errno == EINTR);
+#endif
+  if (bytes >= 0) {
+    return std::optional<int>{static_cast<int>(bytes)};
+  }
+  last_error_ = LastPlatformError();
   return std::nullopt;
 }
 
-void Socket::Close() { chif_net_close_socket(&socket_); }
+std::optional<int> Socket::WriteV(const IoBuffer* buffers,
+                                  const size_t count) const {
+  const size_t used = count < kMaxIoBuffers ? count : kMaxIoBuffers;
+#if defined(DNET_PLATFORM_WINDOWS)
+  WSABUF wsa_buffers[kMaxIoBuffers];
+  for (size_t i = 0; i < used; i++) {
+    wsa_buffers[i].buf =
+        reinterpret_cast<char*>(const_cast<u8*>(buffers[i].data));
+    wsa_buffers[i].len = static_cast<ULONG>(buffers[i].size);
+  }
+  DWORD bytes = 0;
+  const int res = WSASend(socket_, wsa_buffers, static_cast<DWORD>(used),
+                          &bytes, 0, nullptr, nullptr);
+  if (res == 0) {
+    return std::optional<int>{static_cast<int>(bytes)};
+  }
+#else
+  iovec iov[kMaxIoBuffers];
+  for (size_t i = 0; i < used; i++) {
+    iov[i].iov_base = const_cast<u8*>(buffers[i].data);
+    iov[i].iov_len = buffers[i].size;
+  }
+  msghdr msg{};
+  msg.msg_iov = iov;
+  msg.msg_iovlen = used;
+#if defined(MSG_NOSIGNAL)
+  constexpr int flags = MSG_NOSIGNAL;
+#else
+  constexpr int flags = 0;
+#endif
+  ssize_t bytes;
+  do {
+    bytes = sendmsg(socket_, &msg, flags);
+  } while (bytes < 0 && errno == EINTR);
+  if (bytes >= 0) {
+    return std::optional<int>{static_cast<int>(bytes)};
+  }
+#endif
+  last_error_ = LastPlatformError();
+  return std::nullopt;
+}
 
-Result Socket::Connect(const std::string& address, const u16 port) {
-  chif_net_address addr;
-  const std::string portstr = std::to_string(port);
-  auto res = chif_net_create_address(&addr, address.c_str(), portstr.c_str(),
-                                     af_, proto_);
-  if (res == CHIF_NET_RESULT_SUCCESS) {
-    if (socket_ != CHIF_NET_INVALID_SOCKET) {
-      Close();
+std::optional<int> Socket::ReadBatch(DatagramBuffer* buffers,
+                                     const size_t count) const {
+  return ReadBatchImpl(buffers, count, nullptr);
+}
+
+std::optional<int> Socket::ReadFromBatch(DatagramBuffer* buffers,
+                                         const size_t count,
+                                         Endpoint* endpoints_out) const {
+  return ReadBatchImpl(buffers, count, endpoints_out);
+}
+
+std::optional<int> Socket::WriteBatch(const IoBuffer* buffers,
+                                      const size_t count) const {
+  return WriteBatchImpl(buffers, count, nullptr);
+}
+
+std::optional<int> Socket::WriteToBatch(const IoBuffer* buffers,
+                                        const size_t count,
+                                        const Endpoint* endpoints) const {
+  return WriteBatchImpl(buffers, count, endpoints);
+}
+
+std::optional<int> Socket::ReadBatchImpl(DatagramBuffer* buffers,
+                                         const size_t count,
+                                         Endpoint* endpoints_out) const {
+  const size_t used = count < kMaxBatch ? count : kMaxBatch;
+#if defined(DNET_PLATFORM_LINUX)
+  mmsghdr msgs[kMaxBatch];
+  iovec iov[kMaxBatch];
+  sockaddr_storage storages[kMaxBatch];
+  for (size_t i = 0; i < used; i++) {
+    iov[i].iov_base = buffers[i].data;
+    iov[i].iov_len = buffers[i].capacity;
+    msgs[i] = mmsghdr{};
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    if (endpoints_out != nullptr) {
+      msgs[i].msg_hdr.msg_name = &storages[i];
+      msgs[i].msg_hdr.msg_namelen = sizeof(storages[i]);
+    }
+  }
+  int received;
+  do {
+    received = recvmmsg(socket_, msgs, static_cast<unsigned int>(used),
+                        MSG_WAITFORONE, nullptr);
+  } while (received < 0 && errno == EINTR);
+  if (received < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return std::optional<int>{0};
     }
+    last_error_ = LastPlatformError();
+    return std::nullopt;
+  }
+  for (int i = 0; i < received; i++) {
+    buffers[i].size = msgs[i].msg_len;
+    if (endpoints_out != nullptr) {
+      endpoints_out[i] =
+          Endpoint::FromSockaddr(&storages[i], msgs[i].msg_hdr.msg_namelen);
+    }
+  }
+  return std::optional<int>{received};
+#else
+  size_t received = 0;
+  // like recvmmsg, wait for the first and take what is there after that
+  while (received < used && (received == 0 || CanRead())) {
+    DatagramBuffer& buffer = buffers[received];
+    const auto maybe_bytes =
+        endpoints_out != nullptr
+            ? ReadFrom(buffer.data, buffer.capacity, endpoints_out[received])
+            : Read(buffer.data, buffer.capacity);
+    if (!maybe_bytes.has_value()) {
+      if (received == 0) {
+        return std::nullopt;
+      }
+      break;
+    }
+    buffer.size = static_cast<size_t>(maybe_bytes.value());
+    ++received;
+  }
+  return std::optional<int>{static_cast<int>(received)};
+#endif
+}
 
-    res = chif_net_open_socket(&socket_, proto_, af_);
-    if (res == CHIF_NET_RESULT_SUCCESS) {
-      res = chif_net_connect(socket_, &addr);
-      if (res == CHIF_NET_RESULT_SUCCESS) {
-        return Result::kSuccess;
+std::optional<int> Socket::WriteBatchImpl(const IoBuffer* buffers,
+                                          const size_t count,
+                                          const Endpoint* endpoints) const {
+  const size_t used = count < kMaxBatch ? count : kMaxBatch;
+#if defined(DNET_PLATFORM_LINUX)
+  mmsghdr msgs[kMaxBatch];
+  iovec iov[kMaxBatch];
+  for (size_t i = 0; i < used; i++) {
+    iov[i].iov_base = const_cast<u8*>(buffers[i].data);
+    iov[i].iov_len = buffers[i].size;
+    msgs[i] = mmsghdr{};
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    if (endpoints != nullptr) {
+      msgs[i].msg_hdr.msg_name = const_cast<void*>(endpoints[i].data());
+      msgs[i].msg_hdr.msg_namelen =
+          static_cast<socklen_t>(endpoints[i].length());
+    }
+  }
+  int sent;
+  do {
+    sent = sendmmsg(socket_, msgs, static_cast<unsigned int>(used),
+                    MSG_NOSIGNAL);
+  } while (sent < 0 && errno == EINTR);
+  if (sent < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return std::optional<int>{0};
+    }
+    last_error_ = LastPlatformError();
+    return std::nullopt;
+  }
+  return std::optional<int>{sent};
+#else
+  size_t sent = 0;
+  for (; sent < used; sent++) {
+    const IoBuffer& buffer = buffers[sent];
+    const auto maybe_bytes =
+        endpoints != nullptr ? WriteTo(buffer.data, buffer.size, endpoints[sent])
+                             : Write(buffer.data, buffer.size);
+    if (!maybe_bytes.has_value()) {
+      if (sent == 0) {
+        return std::nullopt;
       }
+      break;
     }
   }
+  return std::optional<int>{static_cast<int>(sent)};
+#endif
+}
 
-  last_error_ = res;
+std::optional<int> Socket::WriteSegmented(const u8* buf, const size_t buflen,
+                                          const size_t segment_size) const {
+  return WriteSegmentedImpl(buf, buflen, segment_size, nullptr);
+}
+
+std::optional<int> Socket::WriteToSegmented(const u8* buf, const size_t buflen,
+                                            const size_t segment_size,
+                                            const Endpoint& endpoint) const {
+  return WriteSegmentedImpl(buf, buflen, segment_size, &endpoint);
+}
+
+std::optional<int> Socket::WriteSegmentedImpl(const u8* buf,
+                                              const size_t buflen,
+                                              const size_t segment_size,
+                                              const Endpoint* endpoint) const {
+  dnet_assert(segment_size > 0 && segment_size <= kMaxSegmentedSize,
+              "Segment size out of range");
+  size_t segments = (buflen + segment_size - 1) / segment_size;
+  if (segments > kMaxSegments) {
+    segments = kMaxSegments;
+  }
+  if (segments > kMaxSegmentedSize / segment_size) {
+    segments = kMaxSegmentedSize / segment_size;
+  }
+  const size_t bytes =
+      segments * segment_size < buflen ? segments * segment_size : buflen;
+  if (segments <= 1) {
+    const auto maybe_bytes = endpoint != nullptr
+                                 ? WriteTo(buf, bytes, *endpoint)
+                                 : Write(buf, bytes);
+    return maybe_bytes.has_value() ? std::optional<int>{1} : std::nullopt;
+  }
+
+#if defined(DNET_PLATFORM_LINUX)
+  if (segmentation_offload_) {
+    iovec iov{const_cast<u8*>(buf), bytes};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (endpoint != nullptr) {
+      msg.msg_name = const_cast<void*>(endpoint->data());
+      msg.msg_namelen = static_cast<socklen_t>(endpoint->length());
+    }
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(u16))] = {};
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(u16));
+    const u16 gso_size = static_cast<u16>(segment_size);
+    std::memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+
+    ssize_t sent;
+    do {
+      sent = sendmsg(socket_, &msg, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    if (sent >= 0) {
+      return std::optional<int>{static_cast<int>(segments)};
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return std::optional<int>{0};
+    }
+    if (errno == EIO || errno == ENOPROTOOPT || errno == EOPNOTSUPP) {
+      // the kernel, or the device, can not segment, stop asking it to
+      segmentation_offload_ = false;
+    } else if (errno != EINVAL) {
+      last_error_ = LastPlatformError();
+      return std::nullopt;
+    }
+    // EINVAL is about this write, such as a segment larger than the mtu
+    // of the route, so only it is sent in a batch
+  }
+#endif
+
+  IoBuffer datagrams[kMaxSegments];
+  SplitSegments(buf, bytes, segment_size, datagrams, segments);
+  if (endpoint == nullptr) {
+    return WriteBatchImpl(datagrams, segments, nullptr);
+  }
+  Endpoint endpoints[kMaxSegments];
+  for (size_t i = 0; i < segments; i++) {
+    endpoints[i] = *endpoint;
+  }
+  return WriteBatchImpl(datagrams, segments, endpoints);
+}
+
+bool Socket::ProbeSegmentationOffload() const {
+#if defined(DNET_PLATFORM_LINUX)
+  if (proto_ != CHIF_NET_TRANSPORT_PROTOCOL_UDP) {
+    return false;
+  }
+  // kernels with UDP_SEGMENT know the option, even if it is not set
+  int value = 0;
+  socklen_t length = sizeof(value);
+  return getsockopt(socket_, SOL_UDP, UDP_SEGMENT, &value, &length) == 0;
+#else
+  return false;
+#endif
+}
+
+Result Socket::SetReceiveOffload(const bool enable) const {
+#if defined(DNET_PLATFORM_LINUX)
+  const int value = enable ? 1 : 0;
+  if (setsockopt(socket_, SOL_UDP, UDP_GRO, &value, sizeof(value)) == 0) {
+    return Result::kSuccess;
+  }
+  last_error_ = LastPlatformError();
+  return Result::kFail;
+#else
+  (void)enable;
+  return Result::kFail;
+#endif
+}
+
+std::optional<int> Socket::ReadSegmented(u8* buf_out, const size_t buflen,
+                                         IoBuffer* datagrams_out,
+                                         const size_t count) const {
+  return ReadSegmentedImpl(buf_out, buflen, datagrams_out, count, nullptr);
+}
+
+std::optional<int> Socket::ReadFromSegmented(u8* buf_out, const size_t buflen,
+                                             IoBuffer* datagrams_out,
+                                             const size_t count,
+                                             Endpoint& endpoint_out) const {
+  return ReadSegmentedImpl(buf_out, buflen, datagrams_out, count,
+                           &endpoint_out);
+}
+
+std::optional<int> Socket::ReadSegmentedImpl(u8* buf_out, const size_t buflen,
+                                             IoBuffer* datagrams_out,
+                                             const size_t count,
+                                             Endpoint* endpoint_out) const {
+#if defined(DNET_PLATFORM_LINUX)
+  iovec iov{buf_out, buflen};
+  sockaddr_storage storage{};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  if (endpoint_out != nullptr) {
+    msg.msg_name = &storage;
+    msg.msg_namelen = sizeof(storage);
+  }
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t received;
+  do {
+    received = recvmsg(socket_, &msg, 0);
+  } while (received < 0 && errno == EINTR);
+  if (received < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return std::optional<int>{0};
+    }
+    last_error_ = LastPlatformError();
+    return std::nullopt;
+  }
+  const auto bytes = static_cast<size_t>(received);
+  // without the control message, it is a single datagram
+  size_t segment_size = bytes;
+  for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+      int gso_size = 0;
+      std::memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+      if (gso_size > 0) {
+        segment_size = static_cast<size_t>(gso_size);
+      }
+    }
+  }
+  if (endpoint_out != nullptr) {
+    *endpoint_out = Endpoint::FromSockaddr(&storage, msg.msg_namelen);
+  }
+  return std::optional<int>{static_cast<int>(
+      SplitSegments(buf_out, bytes, segment_size, datagrams_out, count))};
+#else
+  const auto maybe_bytes = endpoint_out != nullptr
+                               ? ReadFrom(buf_out, buflen, *endpoint_out)
+                               : Read(buf_out, buflen);
+  if (!maybe_bytes.has_value()) {
+    return std::nullopt;
+  }
+  const auto bytes = static_cast<size_t>(maybe_bytes.value());
+  return std::optional<int>{static_cast<int>(
+      SplitSegments(buf_out, bytes, bytes, datagrams_out, count))};
+#endif
+}
+
+void Socket::Close() { chif_net_close_socket(&socket_); }
+
+Result Socket::Connect(const std::string& address, const u16 port) {
+  const auto maybe_endpoint = Resolver::Default().Resolve(
+      address, port, AddressFamilyFromChifNet(af_));
+  if (!maybe_endpoint.has_value()) {
+    last_error_ = CHIF_NET_RESULT_UNKNOWN;
+    return Result::kFail;
+  }
+  return Connect(maybe_endpoint.value());
+}
+
+Result Socket::Connect(const Endpoint& endpoint) {
+  if (socket_ != CHIF_NET_INVALID_SOCKET) {
+    Close();
+  }
+  if (Open() != Result::kSuccess) {
+    return Result::kFail;
+  }
+#if defined(DNET_PLATFORM_WINDOWS)
+  const int res = connect(socket_,
+                          static_cast<const sockaddr*>(endpoint.data()),
+                          static_cast<int>(endpoint.length()));
+#else
+  const int res = connect(socket_,
+                          static_cast<const sockaddr*>(endpoint.data()),
+                          static_cast<socklen_t>(endpoint.length()));
+#endif
+  if (res == 0) {
+    return Result::kSuccess;
+  }
+  last_error_ = LastPlatformError();
+  Close();
+  return Result::kFail;
+}
+
+Result Socket::Connect(const std::string& address, const u16 port,
+                       const std::chrono::milliseconds timeout) {
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  Result res = ConnectNonBlocking(address, port);
+  if (res == Result::kWouldBlock) {
+    const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+    int can = 0;
+    // a failed connect is reported writable too, FinishConnect tells
+    (void)chif_net_can_write(socket_, &can,
+                             left.count() > 0 ? static_cast<int>(left.count())
+                                              : 0);
+    res = FinishConnect();
+    if (res == Result::kWouldBlock) {
+      // timed out
+      last_error_ = CHIF_NET_RESULT_UNKNOWN;
+      res = Result::kFail;
+    }
+  }
+  if (res == Result::kSuccess) {
+    res = SetBlocking(true);
+  }
+  if (res != Result::kSuccess) {
+    Close();
+    return Result::kFail;
+  }
+  return Result::kSuccess;
+}
+
+Result Socket::ConnectNonBlocking(const Endpoint& endpoint) {
+  if (socket_ != CHIF_NET_INVALID_SOCKET) {
+    Close();
+  }
+  if (Open() != Result::kSuccess) {
+    return Result::kFail;
+  }
+  if (SetBlocking(false) != Result::kSuccess) {
+    last_error_ = LastPlatformError();
+    Close();
+    return Result::kFail;
+  }
+#if defined(DNET_PLATFORM_WINDOWS)
+  const int res = connect(socket_,
+                          static_cast<const sockaddr*>(endpoint.data()),
+                          static_cast<int>(endpoint.length()));
+  const bool in_flight = res != 0 && WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+  const int res = connect(socket_,
+                          static_cast<const sockaddr*>(endpoint.data()),
+                          static_cast<socklen_t>(endpoint.length()));
+  const bool in_flight = res != 0 && errno == EINPROGRESS;
+#endif
+  if (res == 0) {
+    return Result::kSuccess;
+  }
+  if (in_flight) {
+    return Result::kWouldBlock;
+  }
+  last_error_ = LastPlatformError();
+  Close();
   return Result::kFail;
 }
 
+Result Socket::ConnectNonBlocking(const std::string& address,
+                                  const u16 port) {
+  const auto maybe_endpoint = Resolver::Default().Resolve(
+      address, port, AddressFamilyFromChifNet(af_));
+  if (!maybe_endpoint.has_value()) {
+    last_error_ = CHIF_NET_RESULT_UNKNOWN;
+    return Result::kFail;
+  }
+  return ConnectNonBlocking(maybe_endpoint.value());
+}
+
+Result Socket::FinishConnect() const {
+  // check writable before the error, so that a failure arriving in between
+  // is not taken for success
+  const bool writable = CanWrite();
+  const auto maybe_error = GetIntOption(socket_, SOL_SOCKET, SO_ERROR);
+  if (!maybe_error.has_value() || maybe_error.value() != 0) {
+    last_error_ = CHIF_NET_RESULT_UNKNOWN;
+    return Result::kFail;
+  }
+  return writable ? Result::kSuccess : Result::kWouldBlock;
+}
+
 bool Socket::CanWrite() const {
   int can;
   const auto res = chif_net_can_write(socket_, &can, 0);
@@ -212,6 +865,19 @@ bool Socket::HasError() const {
   return (res != CHIF_NET_RESULT_SUCCESS);
 }
 
+Result Socket::ClearError() const {
+  int error = 0;
+#if defined(DNET_PLATFORM_WINDOWS)
+  int len = sizeof(error);
+  const int res = getsockopt(socket_, SOL_SOCKET, SO_ERROR,
+                             reinterpret_cast<char*>(&error), &len);
+#else
+  socklen_t len = sizeof(error);
+  const int res = getsockopt(socket_, SOL_SOCKET, SO_ERROR, &error, &len);
+#endif
+  return res == 0 ? Result::kSuccess : Result::kFail;
+}
+
 std::optional<std::string> Socket::GetIp() const {
   char ip[CHIF_NET_IPVX_STRING_LENGTH];
   const auto res =
@@ -258,6 +924,114 @@ Result Socket::SetReuseAddr(const bool reuse) const {
   return (res == CHIF_NET_RESULT_SUCCESS ? Result::kSuccess : Result::kFail);
 }
 
+Result Socket::SetReusePort(const bool reuse) const {
+#if defined(SO_REUSEPORT) && !defined(DNET_PLATFORM_WINDOWS)
+  const int value = reuse ? 1 : 0;
+  if (setsockopt(socket_, SOL_SOCKET, SO_REUSEPORT, &value, sizeof(value)) ==
+      0) {
+    return Result::kSuccess;
+  }
+  last_error_ = LastPlatformError();
+  return Result::kFail;
+#else
+  (void)reuse;
+  return Result::kFail;
+#endif
+}
+
+Result Socket::SetIncomingCpu(const u32 cpu) const {
+#if defined(DNET_PLATFORM_LINUX)
+  const int value = static_cast<int>(cpu);
+  if (setsockopt(socket_, SOL_SOCKET, SO_INCOMING_CPU, &value,
+                 sizeof(value)) == 0) {
+    return Result::kSuccess;
+  }
+  last_error_ = LastPlatformError();
+  return Result::kFail;
+#else
+  (void)cpu;
+  return Result::kFail;
+#endif
+}
+
+Result Socket::ApplyOptions() {
+  const bool tcp = proto_ == CHIF_NET_TRANSPORT_PROTOCOL_TCP;
+  bool ok = true;
+  if (ok && options_.send_buffer_size) {
+    ok = SetIntOption(socket_, SOL_SOCKET, SO_SNDBUF,
+                      *options_.send_buffer_size);
+  }
+  if (ok && options_.recv_buffer_size) {
+    ok = SetIntOption(socket_, SOL_SOCKET, SO_RCVBUF,
+                      *options_.recv_buffer_size);
+  }
+  if (ok && tcp && options_.no_delay) {
+    ok = SetIntOption(socket_, IPPROTO_TCP, TCP_NODELAY,
+                      *options_.no_delay ? 1 : 0);
+  }
+#if defined(DNET_PLATFORM_LINUX)
+  if (ok && tcp && options_.quick_ack) {
+    ok = SetIntOption(socket_, IPPROTO_TCP, TCP_QUICKACK,
+                      *options_.quick_ack ? 1 : 0);
+  }
+#if defined(SO_BUSY_POLL)
+  if (ok && options_.busy_poll_us) {
+    ok = SetIntOption(socket_, SOL_SOCKET, SO_BUSY_POLL,
+                      *options_.busy_poll_us);
+  }
+#endif
+  if (ok && options_.priority) {
+    ok = SetIntOption(socket_, SOL_SOCKET, SO_PRIORITY, *options_.priority);
+  }
+#endif
+#if defined(TCP_NOTSENT_LOWAT)
+  if (ok && tcp && options_.not_sent_low_water) {
+    ok = SetIntOption(socket_, IPPROTO_TCP, TCP_NOTSENT_LOWAT,
+                      *options_.not_sent_low_water);
+  }
+#endif
+  if (ok) {
+    return Result::kSuccess;
+  }
+  last_error_ = LastPlatformError();
+  Close();
+  return Result::kFail;
+}
+
+std::optional<SocketOptions> Socket::GetOptions() const {
+  const bool tcp = proto_ == CHIF_NET_TRANSPORT_PROTOCOL_TCP;
+  SocketOptions options{};
+  options.send_buffer_size = GetIntOption(socket_, SOL_SOCKET, SO_SNDBUF);
+  options.recv_buffer_size = GetIntOption(socket_, SOL_SOCKET, SO_RCVBUF);
+  if (!options.send_buffer_size || !options.recv_buffer_size) {
+    last_error_ = LastPlatformError();
+    return std::nullopt;
+  }
+  if (tcp) {
+    if (const auto value = GetIntOption(socket_, IPPROTO_TCP, TCP_NODELAY)) {
+      options.no_delay = *value != 0;
+    }
+  }
+#if defined(DNET_PLATFORM_LINUX)
+  if (tcp) {
+    if (const auto value = GetIntOption(socket_, IPPROTO_TCP, TCP_QUICKACK)) {
+      options.quick_ack = *value != 0;
+    }
+  }
+#if defined(SO_BUSY_POLL)
+  options.busy_poll_us = GetIntOption(socket_, SOL_SOCKET, SO_BUSY_POLL);
+#endif
+  options.priority = GetIntOption(socket_, SOL_SOCKET, SO_PRIORITY);
+#endif
+#if defined(TCP_NOTSENT_LOWAT)
+  if (tcp) {
+    options.not_sent_low_water =
+        GetIntOption(socket_, IPPROTO_TCP, TCP_NOTSENT_LOWAT);
+  }
+#endif
+  return options;
+}
+
 Result Socket::SetBlocking(const bool blocking) const {
   const auto res = chif_net_set_blocking(socket_, blocking);
   return (res == CHIF_NET_RESULT_SUCCESS ? Result::kSuccess : Result::kFail);
@@ -26,16 +26,49 @@
 #define SOCKET_HPP_
 
 #include <chif_net/chif_net.h>
-#include <dnet/net/transport.hpp>
 #include <dnet/net/address.hpp>
+#include <dnet/net/endpoint.hpp>
+#include <dnet/net/socket_options.hpp>
+#include <dnet/net/transport.hpp>
 #include <dnet/util/result.hpp>
 #include <dnet/util/types.hpp>
+#include <chrono>
 #include <optional>
 #include <string>
 #include <tuple>
 
 namespace dnet {
 
+/**
+ * One piece of a vectored write, or one datagram of a batched write.
+ */
+struct IoBuffer {
+  const u8* data = nullptr;
+  size_t size = 0;
+};
+
+/**
+ * One datagram of a batched read.
+ */
+struct DatagramBuffer {
+  u8* data = nullptr;
+  size_t capacity = 0;
+  // set by the read, amount of received bytes
+  size_t size = 0;
+};
+
+/**
+ * How a server socket is set up, see Tcp::StartServer and Udp::StartServer.
+ */
+struct ListenOptions {
+  // let several sockets, typically one per thread, bind the same port. The
+  // kernel spreads new connections and datagrams over them by flow.
+  bool reuse_port = false;
+  // with reuse_port, prefer giving this socket the flows whose packets the
+  // kernel processes on this cpu. Best effort, Linux only.
+  std::optional<u32> incoming_cpu{};
+};
+
 //template <typename TTransportProtocol, typename TAddressFamily>
 class Socket {
  public:
@@ -52,8 +85,14 @@ class Socket {
 
   Result Open();
 
+  /**
+   * Bind to @port on localhost. The address is resolved through
+   * Resolver::Default.
+   */
   Result Bind(const u16 port) const;
 
+  Result Bind(const Endpoint& endpoint) const;
+
   Result Listen() const;
 
   std::optional<Socket> Accept() const;
@@ -63,23 +102,198 @@ class Socket {
    */
   std::optional<int> Read(u8* buf_out, const size_t buflen) const;
 
+  /**
+   * Read without blocking, also on a blocking socket.
+   * @return Amount of read bytes, 0 if nothing has arrived, or nullopt on
+   * failure. A closed connection is a failure with the last error set to
+   * CHIF_NET_RESULT_TCP_CONNECTION_CLOSED.
+   */
+  std::optional<int> ReadNonBlocking(u8* buf_out, size_t buflen) const;
+
   /**
    * Places the address and port in the addr_out and port_out fields.
    */
   std::optional<int> ReadFrom(u8* buf_out, const size_t buflen,
                                   std::string& addr_out, u16& port_out) const;
+
+  /**
+   * Like ReadFrom, but the source is given as an Endpoint, without
+   * formatting it as a string.
+   */
+  std::optional<int> ReadFrom(u8* buf_out, size_t buflen,
+                              Endpoint& endpoint_out) const;
   /**
    * @return Amount of written bytes, or nullopt on failure.
    */
   std::optional<int> Write(const u8* buf, const size_t buflen) const;
 
+  /**
+   * Write without blocking, also on a blocking socket.
+   * @return Amount of written bytes, 0 if the socket's send buffer is full,
+   * or nullopt on failure.
+   */
+  std::optional<int> WriteNonBlocking(const u8* buf, size_t buflen) const;
+
+  /**
+   * Resolves @addr through Resolver::Default, which still costs a lookup
+   * in the cache. Prefer the Endpoint version when sending to the same
+   * address repeatedly.
+   */
   std::optional<int> WriteTo(const u8* buf, const size_t buflen,
                                  const std::string& addr, const u16 port) const;
 
+  std::optional<int> WriteTo(const u8* buf, size_t buflen,
+                             const Endpoint& endpoint) const;
+
+  /**
+   * Write the buffers back to back with a single syscall. Like Write, it
+   * may write less than asked for, see AdvanceIoBuffers.
+   * @param count At most kMaxIoBuffers buffers are written, the rest are
+   * ignored.
+   * @return Amount of written bytes, or nullopt on failure.
+   */
+  std::optional<int> WriteV(const IoBuffer* buffers, size_t count) const;
+
+  static constexpr size_t kMaxIoBuffers = 16;
+
+  // ============================================================ //
+  // Batched datagrams, one syscall for many datagrams where the
+  // platform supports it (recvmmsg and sendmmsg), a loop elsewhere.
+  // At most kMaxBatch datagrams are handled per call.
+  // ============================================================ //
+
+  /**
+   * Read datagrams from the connected peer. Waits for the first datagram,
+   * then takes the ones that have already arrived.
+   * @return Amount of read datagrams, or nullopt on failure.
+   */
+  std::optional<int> ReadBatch(DatagramBuffer* buffers, size_t count) const;
+
+  /**
+   * Like ReadBatch, but also tells where each datagram came from.
+   * @param endpoints_out Array of @count elements.
+   */
+  std::optional<int> ReadFromBatch(DatagramBuffer* buffers, size_t count,
+                                   Endpoint* endpoints_out) const;
+
+  /**
+   * Write datagrams to the connected peer.
+   * @return Amount of written datagrams, or nullopt on failure.
+   */
+  std::optional<int> WriteBatch(const IoBuffer* buffers, size_t count) const;
+
+  /**
+   * Write datagram i to endpoints[i].
+   * @return Amount of written datagrams, or nullopt on failure.
+   */
+  std::optional<int> WriteToBatch(const IoBuffer* buffers, size_t count,
+                                  const Endpoint* endpoints) const;
+
+  static constexpr size_t kMaxBatch = 64;
+
+  // ============================================================ //
+  // Segmentation offload, one buffer holding many datagrams of the same
+  // size. On Linux the kernel splits it on send (UDP_SEGMENT), and
+  // coalesces datagrams that arrive back to back on receive (UDP_GRO).
+  // Without kernel support, the same calls fall back to batches.
+  // ============================================================ //
+
+  /**
+   * Write @buflen bytes of @buf as datagrams of @segment_size bytes, the
+   * last may be shorter, to the connected peer. At most kMaxSegments
+   * datagrams, and kMaxSegmentedSize bytes, are written per call.
+   * @return Amount of written datagrams, or nullopt on failure.
+   */
+  std::optional<int> WriteSegmented(const u8* buf, size_t buflen,
+                                    size_t segment_size) const;
+
+  std::optional<int> WriteToSegmented(const u8* buf, size_t buflen,
+                                      size_t segment_size,
+                                      const Endpoint& endpoint) const;
+
+  /**
+   * Let the kernel coalesce received datagrams, see ReadSegmented.
+   * @return kFail if not supported, each read then gets one datagram.
+   */
+  Result SetReceiveOffload(bool enable) const;
+
+  /**
+   * Read one datagram, or with receive offload, as many as the kernel
+   * coalesced, and point @datagrams_out at each of them in @buf_out.
+   * @param buflen Should be kMaxSegmentedSize, or coalesced datagrams may
+   * be cut off.
+   * @param count Size of @datagrams_out, kMaxSegments takes all there is.
+   * @return Amount of read datagrams, or nullopt on failure.
+   */
+  std::optional<int> ReadSegmented(u8* buf_out, size_t buflen,
+                                   IoBuffer* datagrams_out,
+                                   size_t count) const;
+
+  /**
+   * Like ReadSegmented, and tell where the datagrams came from.
+   */
+  std::optional<int> ReadFromSegmented(u8* buf_out, size_t buflen,
+                                       IoBuffer* datagrams_out, size_t count,
+                                       Endpoint& endpoint_out) const;
+
+  static constexpr size_t kMaxSegments = 64;
+  // largest udp payload over ipv4
+  static constexpr size_t kMaxSegmentedSize = 65507;
+
+  /**
+   * @return False if the kernel lacks support, found out when the socket
+   * was opened, or by a segmented write.
+   */
+  bool HasSegmentationOffload() const { return segmentation_offload_; }
+
+  /**
+   * Turn off segmentation offload, segmented writes then go out as
+   * batches. It can not be turned on where HasSegmentationOffload is false.
+   */
+  void DisableSegmentationOffload() { segmentation_offload_ = false; }
+
   void Close();
 
+  /**
+   * Resolves @address through Resolver::Default, so reconnecting to the
+   * same host does not call the system resolver every time.
+   */
   Result Connect(const std::string& address, u16 port);
 
+  /**
+   * Connect to an endpoint resolved beforehand.
+   */
+  Result Connect(const Endpoint& endpoint);
+
+  /**
+   * Like Connect, but give up once @timeout has passed, instead of waiting
+   * for the system's own timeout on an unreachable host.
+   * @return kFail if the connect failed or timed out.
+   */
+  Result Connect(const std::string& address, u16 port,
+                 std::chrono::milliseconds timeout);
+
+  /**
+   * Start connecting to @endpoint without waiting for the handshake. The
+   * socket is reopened, and left non-blocking. Once the Poller, or
+   * CanWrite, reports the socket writable, call FinishConnect.
+   * @return kSuccess if connected right away, kWouldBlock while the
+   * handshake is in flight, or kFail.
+   */
+  Result ConnectNonBlocking(const Endpoint& endpoint);
+
+  /**
+   * Resolves @address first, which may block, see Resolver.
+   */
+  Result ConnectNonBlocking(const std::string& address, u16 port);
+
+  /**
+   * Check on a connect started by ConnectNonBlocking.
+   * @return kSuccess once connected, kWouldBlock while in flight, or kFail
+   * if the connect failed, such as when refused.
+   */
+  Result FinishConnect() const;
+
   /**
    * @return Any error occured while attempting to check, will return false.
    */
@@ -95,6 +309,12 @@ class Socket {
    */
   bool HasError() const;
 
+  /**
+   * Read and reset the pending error on the socket, such as an ICMP error
+   * reported for an earlier datagram.
+   */
+  Result ClearError() const;
+
   /**
    * @return Ip address, or nullopt on failure.
    */
@@ -112,22 +332,129 @@ class Socket {
 
   Result SetReuseAddr(const bool reuse) const;
 
+  /**
+   * Allow other sockets with this option to bind the same port, see
+   * ListenOptions::reuse_port. Set before binding.
+   * @return kFail if not supported.
+   */
+  Result SetReusePort(bool reuse) const;
+
+  /**
+   * See ListenOptions::incoming_cpu.
+   * @return kFail if not supported.
+   */
+  Result SetIncomingCpu(u32 cpu) const;
+
   Result SetBlocking(const bool blocking) const;
 
+  /**
+   * Options applied by the next Open and Connect, and to accepted sockets,
+   * see SocketOptions. Does not change an already open socket.
+   */
+  void set_options(const SocketOptions& options) { options_ = options; }
+
+  const SocketOptions& options() const { return options_; }
+
+  /**
+   * Read the options back from the open socket. Set fields are what the
+   * system uses, which may differ from what was asked for, such as doubled
+   * buffer sizes. Fields the platform, or a udp socket, lacks are unset.
+   * @return Options, or nullopt on failure.
+   */
+  std::optional<SocketOptions> GetOptions() const;
+
   std::string LastErrorToString() const;
 
   chif_net_result GetLastError() const { return last_error_; }
 
+  /**
+   * @return The underlying socket, use it to register the socket with a
+   * Poller.
+   */
+  chif_net_socket GetHandle() const { return socket_; }
+
  private:
   chif_net_socket socket_;
   chif_net_transport_protocol proto_;
   chif_net_address_family af_;
   mutable chif_net_result last_error_;
+  // probed by Open, and cleared if a write finds out otherwise
+  mutable bool segmentation_offload_ = false;
+  SocketOptions options_{};
+
+  /**
+   * Set every option in options_ on the socket, close it if one fails.
+   */
+  Result ApplyOptions();
+
+  /**
+   * @return True if the kernel can segment udp writes, UDP_SEGMENT.
+   */
+  bool ProbeSegmentationOffload() const;
+
+  /**
+   * Shared by the batched reads, and writes. Without addresses they act on
+   * the connected peer.
+   */
+  std::optional<int> ReadBatchImpl(DatagramBuffer* buffers, size_t count,
+                                   Endpoint* endpoints_out) const;
+  std::optional<int> WriteBatchImpl(const IoBuffer* buffers, size_t count,
+                                    const Endpoint* endpoints) const;
+
+  std::optional<int> WriteSegmentedImpl(const u8* buf, size_t buflen,
+                                        size_t segment_size,
+                                        const Endpoint* endpoint) const;
+  std::optional<int> ReadSegmentedImpl(u8* buf_out, size_t buflen,
+                                       IoBuffer* datagrams_out, size_t count,
+                                       Endpoint* endpoint_out) const;
 
   Socket(chif_net_socket& socket, const chif_net_transport_protocol transport_protocol,
                const chif_net_address_family address_family);
 };
 
+/**
+ * Skip past @bytes written bytes, after a partial WriteV.
+ * @param buffers In, the buffers that were written. Out, the first buffer
+ * with bytes left, adjusted to begin at the first unwritten byte.
+ * @param count In and out, amount of buffers.
+ */
+inline void AdvanceIoBuffers(IoBuffer*& buffers, size_t& count, size_t bytes) {
+  while (count > 0 && bytes >= buffers->size) {
+    bytes -= buffers->size;
+    ++buffers;
+    --count;
+  }
+  if (count > 0) {
+    buffers->data += bytes;
+    buffers->size -= bytes;
+  }
+}
+
+/**
+ * Point @datagrams_out at each @segment_size bytes of @data, the last may
+ * be shorter, as a coalesced read or a segmented write holds them.
+ * @return Amount of datagrams, at most @count.
+ */
+inline size_t SplitSegments(const u8* data, const size_t size,
+                            const size_t segment_size, IoBuffer* datagrams_out,
+                            const size_t count) {
+  if (size == 0 || count == 0) {
+    // an empty datagram is still one
+    if (count > 0) {
+      datagrams_out[0] = IoBuffer{data, 0};
+    }
+    return count > 0 ? 1 : 0;
+  }
+  size_t datagrams = 0;
+  for (size_t offset = 0; offset < size && datagrams < count;
+       offset += segment_size) {
+    const size_t left = size - offset;
+    datagrams_out[datagrams++] =
+        IoBuffer{data + offset, left < segment_size ? left : segment_size};
+  }
+  return datagrams;
+}
+
 }  // namespace dnet
 
 #endif  // SOCKET_HPP_
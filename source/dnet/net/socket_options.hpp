@@ -0,0 +1,93 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef SOCKET_OPTIONS_HPP_
+#define SOCKET_OPTIONS_HPP_
+
+#include <dnet/util/types.hpp>
+#include <optional>
+
+namespace dnet {
+
+/**
+ * Tuning of a socket. A Socket applies its options right after the socket
+ * is created, before it connects or binds, and to every socket it accepts.
+ * If one cannot be set, the socket is closed and the call fails, so a
+ * socket is never used with only part of its options.
+ *
+ * Unset options keep the system default. Tcp options are skipped on udp
+ * sockets, and options the platform lacks are skipped. Read the effective
+ * values back with Socket::GetOptions.
+ */
+struct SocketOptions {
+  // TCP_NODELAY, send small writes right away instead of merging them
+  std::optional<bool> no_delay{};
+  // SO_SNDBUF and SO_RCVBUF in bytes. Linux doubles the value, and caps it
+  // at net.core.wmem_max and rmem_max.
+  std::optional<int> send_buffer_size{};
+  std::optional<int> recv_buffer_size{};
+  // TCP_QUICKACK, ack right away rather than delaying to piggyback on a
+  // reply. Linux only, and one-shot: the kernel turns it off again after
+  // the next acks it sends, so it is not part of any preset.
+  std::optional<bool> quick_ack{};
+  // SO_BUSY_POLL, microseconds to busy poll the device queue on a blocking
+  // read. Linux only, raising it above net.core.busy_read needs
+  // CAP_NET_ADMIN.
+  std::optional<int> busy_poll_us{};
+  // SO_PRIORITY, queueing priority of sent packets, 0 to 6 unprivileged.
+  // Linux only.
+  std::optional<int> priority{};
+  // TCP_NOTSENT_LOWAT, bytes of unsent data at which the socket stops being
+  // writable, keeps queued data, and so latency, in user space
+  std::optional<int> not_sent_low_water{};
+
+  /**
+   * For request and response traffic of small packets, such as game state
+   * or rpc. Every write leaves at once, and little is queued in the kernel.
+   */
+  static SocketOptions LowLatency() {
+    SocketOptions options{};
+    options.no_delay = true;
+    options.priority = 6;
+    options.not_sent_low_water = 16 * 1024;
+    return options;
+  }
+
+  /**
+   * For moving large amounts of data. Writes are merged into full
+   * segments, and the buffers fit a large window.
+   */
+  static SocketOptions BulkThroughput() {
+    SocketOptions options{};
+    options.no_delay = false;
+    options.send_buffer_size = 4 * 1024 * 1024;
+    options.recv_buffer_size = 4 * 1024 * 1024;
+    return options;
+  }
+};
+
+}  // namespace dnet
+
+#endif  // SOCKET_OPTIONS_HPP_
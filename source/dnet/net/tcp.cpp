@@ -39,12 +39,19 @@ Tcp& Tcp::operator=(Tcp&& other) noexcept {
 
 Tcp::Tcp(Socket&& socket) : socket_(std::move(socket)) {}
 
-Result Tcp::StartServer(u16 port) {
+Result Tcp::StartServer(u16 port, const ListenOptions& options) {
   Result res = socket_.Open();
   if (res == Result::kSuccess) {
     // After closing the program, the port can be left in an occupied state,
     // setting resue to true allows for instant reuse of that port.
     res = socket_.SetReuseAddr(true);
+    if (res == Result::kSuccess && options.reuse_port) {
+      res = socket_.SetReusePort(true);
+    }
+    if (res == Result::kSuccess && options.incoming_cpu.has_value()) {
+      // only steers, the socket works the same without it
+      (void)socket_.SetIncomingCpu(options.incoming_cpu.value());
+    }
     if (res == Result::kSuccess) {
       res = socket_.Bind(port);
       if (res == Result::kSuccess) {
@@ -28,6 +28,7 @@
 #include <dnet/net/socket.hpp>
 #include <dnet/util/result.hpp>
 #include <dnet/util/types.hpp>
+#include <chrono>
 #include <optional>
 #include <string>
 #include <tuple>
@@ -36,6 +37,9 @@ namespace dnet {
 
 class Tcp {
  public:
+  // a byte stream, consecutive writes may be merged into one
+  static constexpr bool kIsStream = true;
+
   Tcp();
 
   // no copy
@@ -49,7 +53,10 @@ class Tcp {
   explicit Tcp(Socket&& socket);
 
  public:
-  Result StartServer(u16 port);
+  /**
+   * Start listening on @port. Will also open the socket.
+   */
+  Result StartServer(u16 port, const ListenOptions& options = ListenOptions{});
 
   std::optional<Tcp> Accept() const;
 
@@ -57,16 +64,64 @@ class Tcp {
     return socket_.Connect(address, port);
   }
 
+  Result Connect(const Endpoint& endpoint) {
+    return socket_.Connect(endpoint);
+  }
+
+  /**
+   * Give up after @timeout, see Socket::Connect.
+   */
+  Result Connect(const std::string& address, u16 port,
+                 std::chrono::milliseconds timeout) {
+    return socket_.Connect(address, port, timeout);
+  }
+
+  /**
+   * Start connecting without waiting, see Socket::ConnectNonBlocking.
+   */
+  Result ConnectNonBlocking(const Endpoint& endpoint) {
+    return socket_.ConnectNonBlocking(endpoint);
+  }
+
+  Result ConnectNonBlocking(const std::string& address, u16 port) {
+    return socket_.ConnectNonBlocking(address, port);
+  }
+
+  Result FinishConnect() const { return socket_.FinishConnect(); }
+
   void Disconnect() { socket_.Close(); }
 
   std::optional<int> Read(u8* buf_out, size_t buflen) const {
     return socket_.Read(buf_out, buflen);
   };
 
+  /**
+   * @return Amount of read bytes, 0 if nothing has arrived, see
+   * Socket::ReadNonBlocking.
+   */
+  std::optional<int> ReadNonBlocking(u8* buf_out, size_t buflen) const {
+    return socket_.ReadNonBlocking(buf_out, buflen);
+  }
+
   std::optional<int> Write(const u8* buf, size_t buflen) const {
     return socket_.Write(buf, buflen);
   };
 
+  /**
+   * @return Amount of written bytes, 0 if the send buffer is full, see
+   * Socket::WriteNonBlocking.
+   */
+  std::optional<int> WriteNonBlocking(const u8* buf, size_t buflen) const {
+    return socket_.WriteNonBlocking(buf, buflen);
+  }
+
+  /**
+   * Write several buffers with one syscall, see Socket::WriteV.
+   */
+  std::optional<int> WriteV(const IoBuffer* buffers, size_t count) const {
+    return socket_.WriteV(buffers, count);
+  }
+
   bool CanWrite() const { return socket_.CanWrite(); }
 
   bool CanRead() const { return socket_.CanRead(); }
@@ -75,6 +130,8 @@ class Tcp {
 
   bool HasError() const { return socket_.HasError(); }
 
+  Result ClearError() const { return socket_.ClearError(); }
+
   std::optional<std::string> GetIp() const { return socket_.GetIp(); }
 
   std::optional<u16> GetPort() const { return socket_.GetPort(); }
@@ -96,8 +153,26 @@ class Tcp {
     return socket_.SetBlocking(blocking);
   }
 
+  /**
+   * Options for the next StartServer and Connect, see SocketOptions.
+   */
+  void set_options(const SocketOptions& options) {
+    socket_.set_options(options);
+  }
+
+  const SocketOptions& options() const { return socket_.options(); }
+
+  /**
+   * @return The options in effect, see Socket::GetOptions.
+   */
+  std::optional<SocketOptions> GetOptions() const {
+    return socket_.GetOptions();
+  }
+
   chif_net_result GetLastError() const { return socket_.GetLastError(); }
 
+  chif_net_socket GetHandle() const { return socket_.GetHandle(); }
+
  private:
   Socket socket_;
 };
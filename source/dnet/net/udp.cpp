@@ -39,10 +39,17 @@ Udp& Udp::operator=(Udp&& other) noexcept {
 
 Udp::Udp(Socket&& socket) : socket_(std::move(socket)) {}
 
-Result Udp::StartServer(u16 port) {
+Result Udp::StartServer(u16 port, const ListenOptions& options) {
   Result res = socket_.Open();
   if (res == Result::kSuccess) {
     res = socket_.SetReuseAddr(true);
+    if (res == Result::kSuccess && options.reuse_port) {
+      res = socket_.SetReusePort(true);
+    }
+    if (res == Result::kSuccess && options.incoming_cpu.has_value()) {
+      // only steers, the socket works the same without it
+      (void)socket_.SetIncomingCpu(options.incoming_cpu.value());
+    }
     if (res == Result::kSuccess) {
       res = socket_.Bind(port);
       if (res == Result::kSuccess) {
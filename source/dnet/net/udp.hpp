@@ -36,6 +36,9 @@ namespace dnet {
 
 class Udp {
  public:
+  // every write is its own datagram, writes must not be merged
+  static constexpr bool kIsStream = false;
+
   Udp();
 
   // no copy
@@ -52,7 +55,7 @@ class Udp {
   /**
    * Start listening on @port. Will also open the socket.
    */
-  Result StartServer(const u16 port);
+  Result StartServer(u16 port, const ListenOptions& options = ListenOptions{});
 
   Result Open() { return socket_.Open(); }
 
@@ -60,6 +63,24 @@ class Udp {
     return socket_.Connect(address, port);
   }
 
+  Result Connect(const Endpoint& endpoint) {
+    return socket_.Connect(endpoint);
+  }
+
+  /**
+   * A datagram socket has no handshake, so this completes right away,
+   * see Socket::ConnectNonBlocking.
+   */
+  Result ConnectNonBlocking(const Endpoint& endpoint) {
+    return socket_.ConnectNonBlocking(endpoint);
+  }
+
+  Result ConnectNonBlocking(const std::string& address, u16 port) {
+    return socket_.ConnectNonBlocking(address, port);
+  }
+
+  Result FinishConnect() const { return socket_.FinishConnect(); }
+
   void Disconnect() { socket_.Close(); }
 
   /**
@@ -78,6 +99,11 @@ class Udp {
     return socket_.ReadFrom(buf_out, buflen, addr_out, port_out);
   }
 
+  std::optional<int> ReadFrom(u8* buf_out, const size_t buflen,
+                              Endpoint& endpoint_out) const {
+    return socket_.ReadFrom(buf_out, buflen, endpoint_out);
+  }
+
   /**
    * @return Amount of written bytes, or nullopt on failure.
    */
@@ -91,12 +117,94 @@ class Udp {
     return socket_.WriteTo(buf, buflen, addr, port);
   }
 
+  /**
+   * Send to an endpoint resolved beforehand, see Resolver.
+   */
+  std::optional<int> WriteTo(const u8* buf, const size_t buflen,
+                             const Endpoint& endpoint) const {
+    return socket_.WriteTo(buf, buflen, endpoint);
+  }
+
+  // ============================================================ //
+  // Batched datagrams, see Socket for details
+  // ============================================================ //
+
+  /**
+   * @return Amount of read datagrams, or nullopt on failure.
+   */
+  std::optional<int> ReadBatch(DatagramBuffer* buffers, size_t count) const {
+    return socket_.ReadBatch(buffers, count);
+  }
+
+  std::optional<int> ReadFromBatch(DatagramBuffer* buffers, size_t count,
+                                   Endpoint* endpoints_out) const {
+    return socket_.ReadFromBatch(buffers, count, endpoints_out);
+  }
+
+  /**
+   * @return Amount of written datagrams, or nullopt on failure.
+   */
+  std::optional<int> WriteBatch(const IoBuffer* buffers, size_t count) const {
+    return socket_.WriteBatch(buffers, count);
+  }
+
+  std::optional<int> WriteToBatch(const IoBuffer* buffers, size_t count,
+                                  const Endpoint* endpoints) const {
+    return socket_.WriteToBatch(buffers, count, endpoints);
+  }
+
+  // ============================================================ //
+  // Segmentation offload, see Socket for details
+  // ============================================================ //
+
+  /**
+   * @return Amount of written datagrams, or nullopt on failure.
+   */
+  std::optional<int> WriteSegmented(const u8* buf, size_t buflen,
+                                    size_t segment_size) const {
+    return socket_.WriteSegmented(buf, buflen, segment_size);
+  }
+
+  std::optional<int> WriteToSegmented(const u8* buf, size_t buflen,
+                                      size_t segment_size,
+                                      const Endpoint& endpoint) const {
+    return socket_.WriteToSegmented(buf, buflen, segment_size, endpoint);
+  }
+
+  Result SetReceiveOffload(bool enable) const {
+    return socket_.SetReceiveOffload(enable);
+  }
+
+  /**
+   * @return Amount of read datagrams, or nullopt on failure.
+   */
+  std::optional<int> ReadSegmented(u8* buf_out, size_t buflen,
+                                   IoBuffer* datagrams_out,
+                                   size_t count) const {
+    return socket_.ReadSegmented(buf_out, buflen, datagrams_out, count);
+  }
+
+  std::optional<int> ReadFromSegmented(u8* buf_out, size_t buflen,
+                                       IoBuffer* datagrams_out, size_t count,
+                                       Endpoint& endpoint_out) const {
+    return socket_.ReadFromSegmented(buf_out, buflen, datagrams_out, count,
+                                     endpoint_out);
+  }
+
+  bool HasSegmentationOffload() const {
+    return socket_.HasSegmentationOffload();
+  }
+
+  void DisableSegmentationOffload() { socket_.DisableSegmentationOffload(); }
+
   bool CanWrite() const { return socket_.CanWrite(); }
 
   bool CanRead() const { return socket_.CanRead(); }
 
   bool HasError() const { return socket_.HasError(); }
 
+  Result ClearError() const { return socket_.ClearError(); }
+
   std::optional<std::string> GetIp() const { return socket_.GetIp(); }
 
   std::optional<u16> GetPort() const { return socket_.GetPort(); }
@@ -118,8 +226,26 @@ class Udp {
     return socket_.SetBlocking(blocking);
   }
 
+  /**
+   * Options for the next StartServer and Connect, see SocketOptions.
+   */
+  void set_options(const SocketOptions& options) {
+    socket_.set_options(options);
+  }
+
+  const SocketOptions& options() const { return socket_.options(); }
+
+  /**
+   * @return The options in effect, see Socket::GetOptions.
+   */
+  std::optional<SocketOptions> GetOptions() const {
+    return socket_.GetOptions();
+  }
+
   chif_net_result GetLastError() const { return socket_.GetLastError(); }
 
+  chif_net_socket GetHandle() const { return socket_.GetHandle(); }
+
  private:
   Socket socket_;
 };
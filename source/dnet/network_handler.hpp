@@ -25,40 +25,151 @@
 #ifndef NETWORK_HANDLER_HPP_
 #define NETWORK_HANDLER_HPP_
 
-#include <chrono>
+#include <dnet/net/endpoint.hpp>
 #include <dnet/net/network_event.hpp>
-#include <dnet/util/dnet_assert.hpp>
+#include <dnet/net/poller.hpp>
+#include <dnet/net/resolver.hpp>
+#include <dnet/util/buffer_pool.hpp>
 #include <dnet/util/result.hpp>
+#include <dnet/util/spsc_ring.hpp>
+#include <dnet/util/timer_wheel.hpp>
 #include <dnet/util/types.hpp>
-#include <dutil/queue.hpp>
+#include <dnet/util/util.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <limits>
+#include <memory>
 #include <optional>
 #include <string>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
 namespace dnet {
 
+/**
+ * A packet together with the connection it was received on, or should be
+ * sent to.
+ */
+template <typename TPacket>
+struct TaggedPacket {
+  ConnectionId connection_id = kInvalidConnectionId;
+  TPacket packet{};
+};
+
+/**
+ * A received packet that is given back to its worker's buffer pool when it
+ * goes out of scope, unless taken with Release. Must be destroyed on the
+ * thread that owns the handler, and before the handler.
+ */
+template <typename TPacket>
+class PooledPacket {
+ public:
+  PooledPacket(TaggedPacket<TPacket>&& tagged,
+               SpscRing<TPacket>* recycle_queue)
+      : tagged_(std::move(tagged)), recycle_queue_(recycle_queue) {}
+
+  // no copy
+  PooledPacket(const PooledPacket& other) = delete;
+  PooledPacket& operator=(const PooledPacket& other) = delete;
+
+  PooledPacket(PooledPacket&& other) noexcept
+      : tagged_(std::move(other.tagged_)),
+        recycle_queue_(other.recycle_queue_) {
+    other.recycle_queue_ = nullptr;
+  }
+
+  PooledPacket& operator=(PooledPacket&& other) noexcept {
+    if (this != &other) {
+      Recycle();
+      tagged_ = std::move(other.tagged_);
+      recycle_queue_ = other.recycle_queue_;
+      other.recycle_queue_ = nullptr;
+    }
+    return *this;
+  }
+
+  ~PooledPacket() { Recycle(); }
+
+  TPacket& packet() { return tagged_.packet; }
+  const TPacket& packet() const { return tagged_.packet; }
+
+  ConnectionId connection_id() const { return tagged_.connection_id; }
+
+  /**
+   * Take ownership of the packet, it will not be recycled.
+   */
+  TPacket Release() {
+    recycle_queue_ = nullptr;
+    return std::move(tagged_.packet);
+  }
+
+ private:
+  void Recycle() {
+    if (recycle_queue_ != nullptr) {
+      // if the worker is behind the ring is full, then the buffer is freed
+      // with this packet instead
+      (void)recycle_queue_->Push(std::move(tagged_.packet));
+      recycle_queue_ = nullptr;
+    }
+  }
+
+  TaggedPacket<TPacket> tagged_;
+  SpscRing<TPacket>* recycle_queue_;
+};
+
+/**
+ * Connection state the worker publishes to the main thread. Written by the
+ * worker, read by the main thread.
+ */
+using ConnectedFlag = std::shared_ptr<std::atomic<bool>>;
+
+/**
+ * Work that the main thread hands to the worker thread.
+ */
+struct WorkerCommand {
+  enum class Type { kConnect, kDisconnect };
+
+  Type type = Type::kConnect;
+  ConnectionId connection_id = kInvalidConnectionId;
+  // set with kConnect, empty if the name could not be resolved
+  Endpoint endpoint{};
+  ConnectedFlag is_connected{};
+};
+
 /**
  * Structure used to communicate between worker thread and main thread.
+ * Every queue is a single producer, single consumer ring. The main thread
+ * produces to send_queue, command_queue and recycle_queue, the worker to
+ * recv_queue and eventQueue.
  */
 template <typename TPacket>
 struct SharedData {
-  dutil::Queue<TPacket> send_queue{512};
-  dutil::Queue<TPacket> recv_queue{512};
-  dutil::Queue<NetworkEvent> eventQueue{512};
-  bool run_worker_thread_flag = true;
-  bool connect_flag = false;
-  bool is_connected = false;
-  bool disconnect_flag = false;
-  std::string ip{""};
-  u16 port = 0;
+  SpscRing<TaggedPacket<TPacket>> send_queue{512};
+  SpscRing<TaggedPacket<TPacket>> recv_queue{512};
+  SpscRing<NetworkEvent> eventQueue{512};
+  SpscRing<WorkerCommand> command_queue{512};
+  // received packets given back to the worker's buffer pool
+  SpscRing<TPacket> recycle_queue{512};
+  std::atomic<bool> run_worker_thread_flag{true};
+  // the worker sleeps in poller.Wait, wake it when giving it work
+  Poller poller{};
+  // set before the worker starts, 0 to never time out
+  std::chrono::milliseconds idle_timeout{0};
+  // set before the worker starts
+  size_t max_pending_send_bytes = 0;
+  std::chrono::milliseconds connect_timeout{0};
 
   SharedData() = default;
 
+  // no copy, the worker thread holds a reference
   SharedData(const SharedData& other) = delete;
   SharedData& operator=(const SharedData& other) = delete;
 
-  SharedData(SharedData&& other) noexcept = default;
-  SharedData& operator=(SharedData&& other) noexcept = default;
+  SharedData(SharedData&& other) = delete;
+  SharedData& operator=(SharedData&& other) = delete;
 };
 
 /**
@@ -69,35 +180,210 @@ template <typename TPacket, typename TTransport>
 void Loop(SharedData<TPacket>& shared_data);
 }  // namespace network_worker
 
+/**
+ * How a MultiNetworkHandler spreads its connections over worker threads.
+ */
+struct WorkerPoolOptions {
+  // amount of worker threads, each connection is owned by one of them
+  u32 worker_count = DefaultWorkerCount();
+  // pin worker n to cpu n, to keep the connections' state in that core's
+  // cache. Best effort, ignored where unsupported.
+  bool pin_workers = false;
+  // disconnect connections that have received nothing for this long, 0 to
+  // keep them until disconnected
+  std::chrono::milliseconds idle_timeout{0};
+  // stream transports only, a connection whose peer does not read what is
+  // sent to it is disconnected once this many bytes wait to be written.
+  // Also the most held for any connection that is still connecting, a
+  // connect sent more fails with kFailedToConnect
+  size_t max_pending_send_bytes = 4 * 1024 * 1024;
+  // a connect that has not completed by then fails with kFailedToConnect.
+  // Connects never block the worker, others are served meanwhile.
+  std::chrono::milliseconds connect_timeout{10000};
+
+  /**
+   * @return One worker per hardware thread.
+   */
+  static u32 DefaultWorkerCount() {
+    const u32 count = std::thread::hardware_concurrency();
+    return count > 0 ? count : 1;
+  }
+};
+
+// ============================================================ //
+// MultiNetworkHandler declaration
+// ============================================================ //
+
+/**
+ * Network handler that serves many connections from a pool of worker
+ * threads. Each connection is assigned to one worker, by hash of its
+ * ConnectionId, and stays on that worker for its lifetime. Packets and
+ * events are tagged with the ConnectionId returned from Connect.
+ *
+ * The handler talks to its workers through lock free single producer rings,
+ * so all of its methods must be called from the same thread.
+ *
+ * @tparam TPacket The packet type that will be sent to and received from
+ * the connections.
+ * @tparam TTransport The transport type each connection uses.
+ */
+template <typename TPacket, typename TTransport>
+class MultiNetworkHandler {
+ public:
+  explicit MultiNetworkHandler(
+      const WorkerPoolOptions& options = WorkerPoolOptions{});
+
+  // no copy
+  MultiNetworkHandler(const MultiNetworkHandler& other) = delete;
+  MultiNetworkHandler& operator=(const MultiNetworkHandler& other) = delete;
+
+  MultiNetworkHandler(MultiNetworkHandler&& other) noexcept;
+  MultiNetworkHandler& operator=(MultiNetworkHandler&& other) noexcept;
+
+  ~MultiNetworkHandler();
+
+  /**
+   * @return If the packet was successfully queued for sending. Packets to
+   * a connection that is still connecting are held by the worker, and
+   * written once it connects, see WorkerPoolOptions::max_pending_send_bytes.
+   * Packets to a closed connection are dropped.
+   */
+  bool Send(ConnectionId connection_id, const TPacket& packet);
+  bool Send(ConnectionId connection_id, TPacket&& packet);
+
+  /**
+   * Queue @count packets to the same connection, waking the worker once.
+   * @return Amount of packets queued, the rest did not fit in the queue.
+   */
+  size_t SendBatch(ConnectionId connection_id, const TPacket* packets,
+                   size_t count);
+
+  /**
+   * Retrieve the first packet from the queue, from any connection. Packets
+   * and events are only ordered within the same connection.
+   */
+  std::optional<TaggedPacket<TPacket>> Recv();
+
+  /**
+   * Retrieve up to @max packets, from any connection.
+   * @return Amount of packets written to @packets_out.
+   */
+  size_t RecvBatch(TaggedPacket<TPacket>* packets_out, size_t max);
+
+  /**
+   * Retrieve up to @max packets, from any connection.
+   * @param consume Called as consume(TaggedPacket<TPacket>&&) for each packet.
+   * @return Amount of packets retrieved.
+   */
+  template <typename TConsume>
+  size_t RecvBatch(size_t max, TConsume&& consume);
+
+  /**
+   * Like Recv, but the packet's buffer goes back to the worker when the
+   * PooledPacket is destroyed.
+   */
+  std::optional<PooledPacket<TPacket>> RecvPooled();
+
+  /**
+   * Give a received packet's buffer back to the workers, to be reused for
+   * future packets instead of allocating.
+   */
+  void Recycle(TPacket&& packet);
+
+  bool HasEvent();
+
+  NetworkEvent GetEvent();
+
+  /**
+   * Start connecting to a remote device. A kConnected or kFailedToConnect
+   * event with the returned id will follow. @ip is resolved on the calling
+   * thread, through Resolver::Default, so a lookup that is not cached
+   * blocks the caller rather than the worker.
+   * @return Id of the new connection, or kInvalidConnectionId if the
+   * request could not be queued.
+   */
+  ConnectionId Connect(const std::string& ip, u16 port);
+
+  bool IsConnected(ConnectionId connection_id);
+
+  /**
+   * Start disconnecting, a kDisconnected event will follow.
+   * @return kFail if the request could not be queued, try again later.
+   */
+  Result Disconnect(ConnectionId connection_id);
+
+  u32 GetWorkerCount() const { return static_cast<u32>(shards_.size()); }
+
+  /**
+   * @return Index of the worker that owns the connection.
+   */
+  u32 GetShardIndex(ConnectionId connection_id) const;
+
+  const SharedData<TPacket>& GetSharedData(u32 shard_index);
+
+ private:
+  struct Shard {
+    std::unique_ptr<SharedData<TPacket>> shared_data;
+    std::thread worker;
+  };
+
+  /**
+   * Forget connections that the worker reported as gone.
+   */
+  void OnEvent(const NetworkEvent& event);
+
+  SharedData<TPacket>& ShardOf(ConnectionId connection_id) {
+    return *shards_[GetShardIndex(connection_id)].shared_data;
+  }
+
+  void Stop();
+
+  std::vector<Shard> shards_{};
+  std::unordered_map<ConnectionId, ConnectedFlag> connections_{};
+  ConnectionId next_connection_id_ = kInvalidConnectionId + 1;
+  // where to start looking for packets and events, to be fair to all shards
+  u32 next_recv_shard_ = 0;
+  u32 next_event_shard_ = 0;
+  u32 next_recycle_shard_ = 0;
+};
+
 // ============================================================ //
 // NetworkHandler declaration
 // ============================================================ //
 
 /**
- * Thread safe network handler
+ * Network handler, a MultiNetworkHandler limited to a single connection.
+ * All methods must be called from the same thread.
  *
  * @tparam TPacket The packet type that will be sent to
  */
 template <typename TPacket, typename TTransport>
 class NetworkHandler {
  public:
-  NetworkHandler();
+  NetworkHandler() = default;
 
   // no copy
   NetworkHandler(const NetworkHandler& other) = delete;
   NetworkHandler& operator=(const NetworkHandler& other) = delete;
 
-  NetworkHandler(NetworkHandler&& other) noexcept;
-  NetworkHandler& operator=(NetworkHandler&& other) noexcept;
+  NetworkHandler(NetworkHandler&& other) noexcept = default;
+  NetworkHandler& operator=(NetworkHandler&& other) noexcept = default;
 
-  ~NetworkHandler();
+  ~NetworkHandler() = default;
 
   /**
    * @param data The data to be sent.
    * @return If the data was successfully queued for sending.
    */
-  bool Send(const TPacket& packet);
-  bool Send(TPacket&& packet);
+  bool Send(const TPacket& packet) { return handler_.Send(id_, packet); }
+  bool Send(TPacket&& packet) { return handler_.Send(id_, std::move(packet)); }
+
+  /**
+   * @return Amount of packets queued, the rest did not fit in the queue.
+   */
+  size_t SendBatch(const TPacket* packets, const size_t count) {
+    return handler_.SendBatch(id_, packets, count);
+  }
 
   /**
    * Retrieve the first data from the queue. Call hasData before calling this.
@@ -106,121 +392,360 @@ class NetworkHandler {
    */
   std::optional<TPacket> Recv();
 
-  bool HasEvent();
+  /**
+   * Retrieve up to @max packets from the queue.
+   * @return Amount of packets written to @packets_out.
+   */
+  size_t RecvBatch(TPacket* packets_out, size_t max);
 
-  NetworkEvent GetEvent();
+  /**
+   * Like Recv, but the packet's buffer goes back to the worker when the
+   * PooledPacket is destroyed.
+   */
+  std::optional<PooledPacket<TPacket>> RecvPooled() {
+    return handler_.RecvPooled();
+  }
+
+  /**
+   * Give a received packet's buffer back to the worker, to be reused for
+   * future packets instead of allocating.
+   */
+  void Recycle(TPacket&& packet) { handler_.Recycle(std::move(packet)); }
+
+  bool HasEvent() { return handler_.HasEvent(); }
+
+  NetworkEvent GetEvent() { return handler_.GetEvent(); }
 
   /**
-   * Connect to a remote device
+   * Connect to a remote device, closing the previous connection.
+   * @return kFail if the requests could not be queued, try again later.
    */
-  void Connect(const std::string& ip, u16 port);
+  Result Connect(const std::string& ip, u16 port);
 
-  bool IsConnected();
+  bool IsConnected() { return handler_.IsConnected(id_); }
 
-  void Disconnect();
+  /**
+   * @return kFail if the request could not be queued, try again later.
+   */
+  Result Disconnect() { return handler_.Disconnect(id_); }
 
-  const SharedData<TPacket>& GetSharedData();
+  const SharedData<TPacket>& GetSharedData() {
+    return handler_.GetSharedData(0);
+  }
 
  private:
-  SharedData<TPacket> shared_data_{};
-  std::thread worker_;
+  MultiNetworkHandler<TPacket, TTransport> handler_{
+      WorkerPoolOptions{1, false}};
+  ConnectionId id_ = kInvalidConnectionId;
 };
 
 // ============================================================ //
-// NetworkHandler template definition
+// MultiNetworkHandler template definition
 // ============================================================ //
 
 template <typename TPacket, typename TTransport>
-NetworkHandler<TPacket, TTransport>::NetworkHandler()
-    : worker_(network_worker::Loop<TPacket, TTransport>,
-              std::ref(shared_data_)) {}
+MultiNetworkHandler<TPacket, TTransport>::MultiNetworkHandler(
+    const WorkerPoolOptions& options) {
+  const u32 worker_count = options.worker_count > 0 ? options.worker_count : 1;
+  shards_.reserve(worker_count);
+  for (u32 i = 0; i < worker_count; i++) {
+    Shard shard{std::make_unique<SharedData<TPacket>>(), std::thread{}};
+    shard.shared_data->idle_timeout = options.idle_timeout;
+    shard.shared_data->max_pending_send_bytes = options.max_pending_send_bytes;
+    shard.shared_data->connect_timeout = options.connect_timeout;
+    shard.worker = std::thread(network_worker::Loop<TPacket, TTransport>,
+                               std::ref(*shard.shared_data));
+    if (options.pin_workers) {
+      PinThreadToCpu(shard.worker, i % WorkerPoolOptions::DefaultWorkerCount());
+    }
+    shards_.push_back(std::move(shard));
+  }
+}
 
 template <typename TPacket, typename TTransport>
-NetworkHandler<TPacket, TTransport>::NetworkHandler(
-    NetworkHandler&& other) noexcept
-    : shared_data_(std::move(other.shared_data_)), worker_() {
-  worker_.swap(other.worker_);
-}
+MultiNetworkHandler<TPacket, TTransport>::MultiNetworkHandler(
+    MultiNetworkHandler&& other) noexcept
+    : shards_(std::move(other.shards_)),
+      connections_(std::move(other.connections_)),
+      next_connection_id_(other.next_connection_id_),
+      next_recv_shard_(other.next_recv_shard_),
+      next_event_shard_(other.next_event_shard_),
+      next_recycle_shard_(other.next_recycle_shard_) {}
 
 template <typename TPacket, typename TTransport>
-NetworkHandler<TPacket, TTransport>& NetworkHandler<TPacket, TTransport>::
-operator=(NetworkHandler&& other) noexcept {
+MultiNetworkHandler<TPacket, TTransport>&
+MultiNetworkHandler<TPacket, TTransport>::operator=(
+    MultiNetworkHandler&& other) noexcept {
   if (this != &other) {
-    shared_data_ = std::move(other.shared_data_);
-    worker_ = std::move(other.worker_);
+    Stop();
+    shards_ = std::move(other.shards_);
+    connections_ = std::move(other.connections_);
+    next_connection_id_ = other.next_connection_id_;
+    next_recv_shard_ = other.next_recv_shard_;
+    next_event_shard_ = other.next_event_shard_;
+    next_recycle_shard_ = other.next_recycle_shard_;
   }
   return *this;
 }
 
 template <typename TPacket, typename TTransport>
-NetworkHandler<TPacket, TTransport>::~NetworkHandler() {
-  shared_data_.run_worker_thread_flag = false;
-  worker_.join();
+MultiNetworkHandler<TPacket, TTransport>::~MultiNetworkHandler() {
+  Stop();
 }
 
 template <typename TPacket, typename TTransport>
-bool NetworkHandler<TPacket, TTransport>::Send(const TPacket& packet) {
-  const dutil::QueueResult res = shared_data_.send_queue.Push(packet);
-  return res == dutil::QueueResult::kSuccess;
+void MultiNetworkHandler<TPacket, TTransport>::Stop() {
+  // tell every worker before joining, so they shut down in parallel
+  for (auto& shard : shards_) {
+    shard.shared_data->run_worker_thread_flag.store(false,
+                                                    std::memory_order_release);
+    shard.shared_data->poller.Wake();
+  }
+  for (auto& shard : shards_) {
+    shard.worker.join();
+  }
+  shards_.clear();
 }
 
-// TODO perfect forwarding
 template <typename TPacket, typename TTransport>
-bool NetworkHandler<TPacket, TTransport>::Send(TPacket&& packet) {
-  const dutil::QueueResult res =
-      shared_data_.send_queue.Push(std::move(packet));
-  return res == dutil::QueueResult::kSuccess;
+bool MultiNetworkHandler<TPacket, TTransport>::Send(
+    const ConnectionId connection_id, const TPacket& packet) {
+  SharedData<TPacket>& shared_data = ShardOf(connection_id);
+  const Result res =
+      shared_data.send_queue.Push(TaggedPacket<TPacket>{connection_id, packet});
+  if (res == Result::kSuccess) {
+    shared_data.poller.Wake();
+    return true;
+  }
+  return false;
 }
 
 template <typename TPacket, typename TTransport>
-std::optional<TPacket> NetworkHandler<TPacket, TTransport>::Recv() {
-  TPacket packet;
-  const dutil::QueueResult res = shared_data_.recv_queue.Pop(packet);
-  if (res == dutil::QueueResult::kSuccess) {
-    return std::optional<TPacket>(std::move(packet));
+bool MultiNetworkHandler<TPacket, TTransport>::Send(
+    const ConnectionId connection_id, TPacket&& packet) {
+  SharedData<TPacket>& shared_data = ShardOf(connection_id);
+  const Result res = shared_data.send_queue.Push(
+      TaggedPacket<TPacket>{connection_id, std::move(packet)});
+  if (res == Result::kSuccess) {
+    shared_data.poller.Wake();
+    return true;
+  }
+  return false;
+}
+
+template <typename TPacket, typename TTransport>
+size_t MultiNetworkHandler<TPacket, TTransport>::SendBatch(
+    const ConnectionId connection_id, const TPacket* packets,
+    const size_t count) {
+  SharedData<TPacket>& shared_data = ShardOf(connection_id);
+  const size_t queued = shared_data.send_queue.PushBatch(
+      count, [connection_id, packets](const size_t i) {
+        return TaggedPacket<TPacket>{connection_id, packets[i]};
+      });
+  if (queued > 0) {
+    shared_data.poller.Wake();
+  }
+  return queued;
+}
+
+template <typename TPacket, typename TTransport>
+std::optional<TaggedPacket<TPacket>>
+MultiNetworkHandler<TPacket, TTransport>::Recv() {
+  TaggedPacket<TPacket> packet;
+  const u32 shard_count = GetWorkerCount();
+  for (u32 i = 0; i < shard_count; i++) {
+    const u32 shard_index = (next_recv_shard_ + i) % shard_count;
+    const Result res =
+        shards_[shard_index].shared_data->recv_queue.Pop(packet);
+    if (res == Result::kSuccess) {
+      next_recv_shard_ = (shard_index + 1) % shard_count;
+      return std::optional<TaggedPacket<TPacket>>(std::move(packet));
+    }
   }
   return std::nullopt;
 }
 
 template <typename TPacket, typename TTransport>
-bool NetworkHandler<TPacket, TTransport>::HasEvent() {
-  return !shared_data_.eventQueue.Empty();
+size_t MultiNetworkHandler<TPacket, TTransport>::RecvBatch(
+    TaggedPacket<TPacket>* packets_out, const size_t max) {
+  return RecvBatch(max,
+                   [packets_out](TaggedPacket<TPacket>&& packet) mutable {
+                     *packets_out++ = std::move(packet);
+                   });
+}
+
+template <typename TPacket, typename TTransport>
+template <typename TConsume>
+size_t MultiNetworkHandler<TPacket, TTransport>::RecvBatch(
+    const size_t max, TConsume&& consume) {
+  size_t count = 0;
+  const u32 shard_count = GetWorkerCount();
+  for (u32 i = 0; i < shard_count && count < max; i++) {
+    const u32 shard_index = (next_recv_shard_ + i) % shard_count;
+    count += shards_[shard_index].shared_data->recv_queue.PopBatch(
+        max - count, consume);
+  }
+  next_recv_shard_ = (next_recv_shard_ + 1) % shard_count;
+  return count;
+}
+
+template <typename TPacket, typename TTransport>
+std::optional<PooledPacket<TPacket>>
+MultiNetworkHandler<TPacket, TTransport>::RecvPooled() {
+  auto maybe_packet = Recv();
+  if (!maybe_packet.has_value()) {
+    return std::nullopt;
+  }
+  // hand the buffer back to the worker that allocated it
+  SpscRing<TPacket>* recycle_queue =
+      &ShardOf(maybe_packet.value().connection_id).recycle_queue;
+  return std::optional<PooledPacket<TPacket>>(
+      PooledPacket<TPacket>(std::move(maybe_packet.value()), recycle_queue));
 }
 
 template <typename TPacket, typename TTransport>
-NetworkEvent NetworkHandler<TPacket, TTransport>::GetEvent() {
+void MultiNetworkHandler<TPacket, TTransport>::Recycle(TPacket&& packet) {
+  // no need to wake the worker, it picks them up on its next wakeup. If the
+  // ring is full the buffer is freed with packet instead
+  (void)shards_[next_recycle_shard_].shared_data->recycle_queue.Push(
+      std::move(packet));
+  next_recycle_shard_ = (next_recycle_shard_ + 1) % GetWorkerCount();
+}
+
+template <typename TPacket, typename TTransport>
+bool MultiNetworkHandler<TPacket, TTransport>::HasEvent() {
+  for (auto& shard : shards_) {
+    if (!shard.shared_data->eventQueue.Empty()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename TPacket, typename TTransport>
+NetworkEvent MultiNetworkHandler<TPacket, TTransport>::GetEvent() {
   // TODO have event be returned instead of output param
-  NetworkEvent event{
-      NetworkEvent::Type::kNewData};  // will be overwritten next line
+  NetworkEvent event{};
   // TODO how to handle error from eventQueue?
-  shared_data_.eventQueue.Pop(event);
+  const u32 shard_count = GetWorkerCount();
+  for (u32 i = 0; i < shard_count; i++) {
+    const u32 shard_index = (next_event_shard_ + i) % shard_count;
+    const Result res =
+        shards_[shard_index].shared_data->eventQueue.Pop(event);
+    if (res == Result::kSuccess) {
+      next_event_shard_ = (shard_index + 1) % shard_count;
+      OnEvent(event);
+      break;
+    }
+  }
   return event;
 }
 
 template <typename TPacket, typename TTransport>
-void NetworkHandler<TPacket, TTransport>::Connect(const std::string& ip,
-                                                  u16 port) {
-  if (!shared_data_.connect_flag) {
-    shared_data_.ip = ip;
-    shared_data_.port = port;
-    shared_data_.connect_flag = true;
+void MultiNetworkHandler<TPacket, TTransport>::OnEvent(
+    const NetworkEvent& event) {
+  if (event.type() == NetworkEvent::Type::kDisconnected ||
+      event.type() == NetworkEvent::Type::kFailedToConnect) {
+    connections_.erase(event.connection_id());
   }
 }
 
 template <typename TPacket, typename TTransport>
-bool NetworkHandler<TPacket, TTransport>::IsConnected() {
-  return shared_data_.is_connected;
+ConnectionId MultiNetworkHandler<TPacket, TTransport>::Connect(
+    const std::string& ip, const u16 port) {
+  const ConnectionId connection_id = next_connection_id_;
+  SharedData<TPacket>& shared_data = ShardOf(connection_id);
+  ConnectedFlag is_connected = std::make_shared<std::atomic<bool>>(false);
+  // resolved here, a lookup that is not cached would stall every connection
+  // the worker serves
+  const Endpoint endpoint =
+      Resolver::Default().Resolve(ip, port).value_or(Endpoint{});
+  const Result res = shared_data.command_queue.Push(WorkerCommand{
+      WorkerCommand::Type::kConnect, connection_id, endpoint, is_connected});
+  if (res != Result::kSuccess) {
+    return kInvalidConnectionId;
+  }
+  shared_data.poller.Wake();
+  connections_.emplace(connection_id, std::move(is_connected));
+
+  ++next_connection_id_;
+  if (next_connection_id_ == kInvalidConnectionId) {
+    ++next_connection_id_;
+  }
+  return connection_id;
 }
 
 template <typename TPacket, typename TTransport>
-void NetworkHandler<TPacket, TTransport>::Disconnect() {
-  shared_data_.disconnect_flag = true;
+bool MultiNetworkHandler<TPacket, TTransport>::IsConnected(
+    const ConnectionId connection_id) {
+  const auto it = connections_.find(connection_id);
+  return it != connections_.end() &&
+         it->second->load(std::memory_order_acquire);
+}
+
+template <typename TPacket, typename TTransport>
+Result MultiNetworkHandler<TPacket, TTransport>::Disconnect(
+    const ConnectionId connection_id) {
+  SharedData<TPacket>& shared_data = ShardOf(connection_id);
+  const Result res = shared_data.command_queue.Push(WorkerCommand{
+      WorkerCommand::Type::kDisconnect, connection_id, Endpoint{}, nullptr});
+  if (res != Result::kSuccess) {
+    return Result::kFail;
+  }
+  shared_data.poller.Wake();
+  connections_.erase(connection_id);
+  return Result::kSuccess;
+}
+
+template <typename TPacket, typename TTransport>
+u32 MultiNetworkHandler<TPacket, TTransport>::GetShardIndex(
+    const ConnectionId connection_id) const {
+  // fibonacci hashing, spreads consecutive ids over the shards
+  const u64 hash = static_cast<u64>(connection_id) * 0x9E3779B97F4A7C15ull;
+  return static_cast<u32>((hash >> 32) % shards_.size());
 }
 
 template <typename TPacket, typename TTransport>
 const SharedData<TPacket>&
-NetworkHandler<TPacket, TTransport>::GetSharedData() {
-  return shared_data_;
+MultiNetworkHandler<TPacket, TTransport>::GetSharedData(
+    const u32 shard_index) {
+  return *shards_[shard_index].shared_data;
+}
+
+// ============================================================ //
+// NetworkHandler template definition
+// ============================================================ //
+
+template <typename TPacket, typename TTransport>
+std::optional<TPacket> NetworkHandler<TPacket, TTransport>::Recv() {
+  auto maybe_packet = handler_.Recv();
+  if (maybe_packet.has_value()) {
+    return std::optional<TPacket>(std::move(maybe_packet.value().packet));
+  }
+  return std::nullopt;
+}
+
+template <typename TPacket, typename TTransport>
+size_t NetworkHandler<TPacket, TTransport>::RecvBatch(TPacket* packets_out,
+                                                      const size_t max) {
+  return handler_.RecvBatch(
+      max, [packets_out](TaggedPacket<TPacket>&& tagged) mutable {
+        *packets_out++ = std::move(tagged.packet);
+      });
+}
+
+template <typename TPacket, typename TTransport>
+Result NetworkHandler<TPacket, TTransport>::Connect(const std::string& ip,
+                                                    const u16 port) {
+  // make sure old connection is closed
+  if (id_ != kInvalidConnectionId) {
+    if (handler_.Disconnect(id_) != Result::kSuccess) {
+      return Result::kFail;
+    }
+    id_ = kInvalidConnectionId;
+  }
+  id_ = handler_.Connect(ip, port);
+  return id_ != kInvalidConnectionId ? Result::kSuccess : Result::kFail;
 }
 
 }  // namespace dnet
@@ -234,9 +759,10 @@ namespace dnet::network_worker {
 // a connection instead. For example the write and read cannot dynamically
 // allocate more memory, which requires you to always allocate the max
 // size a packet could be.
-// TODO when adding NetworkEvent, we dont check for errors on the eventQueue
 /**
- * The network handler worker thread code.
+ * The network handler worker thread code. Owns every connection of a
+ * handler, and registers them in the poller with their ConnectionId as
+ * token.
  *
  * @param TPacket see network handler for info.
  * @param TTransport The transport type that will send the data. Must
@@ -245,7 +771,9 @@ namespace dnet::network_worker {
 template <typename TPacket, typename TTransport>
 class Worker {
  public:
-  Worker() = default;
+  explicit Worker(SharedData<TPacket>& shared_data)
+      : shared_data_(shared_data),
+        read_buffer_(std::numeric_limits<u16>::max()) {}
 
   // no copy
   Worker(const Worker& other) = delete;
@@ -253,144 +781,559 @@ class Worker {
 
   ~Worker() = default;
 
-  void Disconnect(dutil::Queue<NetworkEvent>& eventQueue, bool& is_connected) {
-    const dutil::QueueResult queueResult =
-        eventQueue.Push(NetworkEvent(NetworkEvent::Type::kDisconnected));
-    dnet_assert(queueResult == dutil::QueueResult::kSuccess,
-                "failed to push network event to eventQueue");
-    transport_.Disconnect();
-    is_connected = false;
-  }
-
-  void HandleSend(dutil::Queue<NetworkEvent>& eventQueue,
-                  dutil::Queue<TPacket>& send_queue, bool& is_connected) {
-    TPacket packet{};
-    dutil::QueueResult queueResult = send_queue.Pop(packet);
-    if (queueResult == dutil::QueueResult::kSuccess) {
-      const auto maybe_bytes = transport_.Write(packet.data(), packet.size());
-      if (!maybe_bytes.has_value() ||
-          maybe_bytes.value() != static_cast<int>(packet.size())) {
-        // TODO send the error information with the event?
-        Disconnect(eventQueue, is_connected);
-      }
-    } else {
-      queueResult =
-          eventQueue.Push(NetworkEvent(NetworkEvent::Type::kSendQueueFull));
-      dnet_assert(queueResult == dutil::QueueResult::kSuccess,
-                  "failed to push network event to eventQueue");
-    }
-  }
-
-  bool CanRecv() const { return transport_.CanRead(); }
-
-  void HandleCanRecv(dutil::Queue<NetworkEvent>& eventQueue,
-                     dutil::Queue<TPacket>& recv_queue, bool& is_connected) {
-    TPacket packet(std::numeric_limits<u16>::max());
-    const auto maybe_bytes = transport_.Read(packet.data(), packet.capacity());
-    if (maybe_bytes.has_value()) {
-      packet.resize(maybe_bytes.value());
-    }
-    if (maybe_bytes.has_value() &&
-        maybe_bytes.value() == static_cast<int>(packet.size())) {
-      dutil::QueueResult queueResult;
-      queueResult = recv_queue.Push(std::move(packet));
-      if (queueResult == dutil::QueueResult::kSuccess) {
-        queueResult =
-            eventQueue.Push(NetworkEvent(NetworkEvent::Type::kNewData));
-        dnet_assert(queueResult == dutil::QueueResult::kSuccess,
-                    "failed to push network event to eventQueue");
+  void Disconnect(const ConnectionId connection_id) {
+    const auto it = connections_.find(connection_id);
+    if (it == connections_.end()) {
+      return;
+    }
+
+    Connection& connection = it->second;
+    connection.is_connected->store(false, std::memory_order_release);
+    PushEvent(NetworkEvent(NetworkEvent::Type::kDisconnected, connection_id));
+    // closing the socket below removes it from the poller anyway
+    (void)shared_data_.poller.Remove(connection.transport.GetHandle());
+    timers_.Cancel(connection.idle_timer);
+    timers_.Cancel(connection.connect_timer);
+    connection.transport.Disconnect();
+    connections_.erase(it);
+  }
+
+  /**
+   * Drain the send queue. Packets to a stream transport are gathered per
+   * connection, so that each connection gets one write for everything that
+   * was queued to it since the last wakeup.
+   */
+  void HandleSend() {
+    // the connect of a packet sent right after it may not have been seen
+    HandleCommands();
+    shared_data_.send_queue.PopBatch(
+        shared_data_.send_queue.Capacity(),
+        [this](TaggedPacket<TPacket>&& tagged) {
+          QueueSend(tagged);
+          // the sent packet's buffer can be reused for a received one
+          pool_.Release(std::move(tagged.packet));
+        });
+    FlushSends();
+  }
+
+  /**
+   * Move the buffers the main thread is done with into the pool.
+   */
+  void HandleRecycle() {
+    shared_data_.recycle_queue.PopBatch(
+        shared_data_.recycle_queue.Capacity(),
+        [this](TPacket&& packet) { pool_.Release(std::move(packet)); });
+  }
+
+  void HandleCanRecv(const ConnectionId connection_id) {
+    const auto it = connections_.find(connection_id);
+    if (it == connections_.end()) {
+      return;
+    }
+
+    // read into the shared buffer, then copy only what arrived into a
+    // buffer of fitting size from the pool
+    const auto maybe_bytes =
+        it->second.transport.Read(read_buffer_.data(), read_buffer_.size());
+    if (maybe_bytes.has_value() && maybe_bytes.value() >= 0) {
+      it->second.last_recv = now_;
+      const auto bytes = static_cast<size_t>(maybe_bytes.value());
+      TaggedPacket<TPacket> tagged{connection_id, pool_.Acquire(bytes)};
+      tagged.packet.assign(read_buffer_.data(), read_buffer_.data() + bytes);
+      const Result queueResult =
+          shared_data_.recv_queue.Push(std::move(tagged));
+      // under load the main thread can fall behind on events, only the
+      // notification is lost if the eventQueue is full
+      if (queueResult == Result::kSuccess) {
+        PushDroppableEvent(
+            NetworkEvent(NetworkEvent::Type::kNewData, connection_id));
       } else {
-        // TODO can other errors happen?
-        queueResult =
-            eventQueue.Push(NetworkEvent(NetworkEvent::Type::kRecvQueueFull));
-        dnet_assert(queueResult == dutil::QueueResult::kSuccess,
-                    "failed to push network event to eventQueue");
+        // a failed push leaves the packet with us
+        pool_.Release(std::move(tagged.packet));
+        PushDroppableEvent(
+            NetworkEvent(NetworkEvent::Type::kRecvQueueFull, connection_id));
       }
 
     } else {
       // TODO is dropping the client the right thing to do after failed read?
       // TODO send the error information with the event?
-      Disconnect(eventQueue, is_connected);
+      Disconnect(connection_id);
     }
   }
 
-  void addConnection(dutil::Queue<NetworkEvent>& eventQueue,
-                     const std::string& ip, u16 port, bool& is_connected) {
-    // make sure old connection is closed
-    transport_.Disconnect();
+  /**
+   * Write what is left of the connection's send buffer, now that the
+   * socket has room.
+   */
+  void HandleCanSend(const ConnectionId connection_id) {
+    FlushConnection(connection_id);
+  }
 
-    const auto res = transport_.Connect(ip, port);
-    dutil::QueueResult queueResult;
-    if (res == Result::kSuccess) {
-      // TODO send the information with the event?
-      queueResult =
-          eventQueue.Push(NetworkEvent(NetworkEvent::Type::kConnected));
-      dnet_assert(queueResult == dutil::QueueResult::kSuccess,
-                  "failed to push network event to eventQueue");
-      is_connected = true;
-    } else {
+  /**
+   * Dispatch what the poller reported for a connection.
+   */
+  void HandleEvent(const PollEvent& event) {
+    const auto connection_id = static_cast<ConnectionId>(event.token);
+    const auto it = connections_.find(connection_id);
+    if (it == connections_.end()) {
+      return;
+    }
+    if (it->second.connecting) {
+      // a failed connect may be reported as any mix of the flags
+      FinishConnecting(connection_id);
+      return;
+    }
+    if (event.flags & poll_flag::kWrite) {
+      HandleCanSend(connection_id);
+    }
+    if (event.flags & poll_flag::kRead) {
+      HandleCanRecv(connection_id);
+    } else if (event.flags & poll_flag::kError) {
+      HandleError(connection_id);
+    }
+  }
+
+  /**
+   * Handle an error reported by the poller without the socket being
+   * readable, such as an ICMP error from an earlier datagram.
+   */
+  void HandleError(const ConnectionId connection_id) {
+    const auto it = connections_.find(connection_id);
+    if (it != connections_.end() &&
+        it->second.transport.ClearError() != Result::kSuccess) {
+      Disconnect(connection_id);
+    }
+  }
+
+  /**
+   * Start connecting without waiting for the handshake. The poller reports
+   * the socket writable once it completes, see FinishConnecting, and a
+   * timer fails it at the connect timeout.
+   */
+  void addConnection(const ConnectionId connection_id, const Endpoint& endpoint,
+                     ConnectedFlag is_connected) {
+    TTransport transport{};
+    const Result res = endpoint.IsEmpty()
+                           ? Result::kFail
+                           : transport.ConnectNonBlocking(endpoint);
+    if (res == Result::kFail) {
       // TODO send the error information with the event?
-      queueResult =
-          eventQueue.Push(NetworkEvent(NetworkEvent::Type::kFailedToConnect));
-      dnet_assert(queueResult == dutil::QueueResult::kSuccess,
-                  "failed to push network event to eventQueue");
+      PushEvent(
+          NetworkEvent(NetworkEvent::Type::kFailedToConnect, connection_id));
+      return;
+    }
+
+    Connection& connection =
+        connections_
+            .emplace(connection_id,
+                     Connection{std::move(transport), std::move(is_connected)})
+            .first->second;
+    if (res == Result::kSuccess) {
+      OnConnected(connection_id, connection);
+      return;
+    }
+    connection.connecting = true;
+    if (shared_data_.poller.Add(connection.transport.GetHandle(),
+                                connection_id,
+                                poll_flag::kWrite) != Result::kSuccess) {
+      FailConnecting(connection_id);
+      return;
+    }
+    connection.connect_timer =
+        timers_.Schedule(now_ + shared_data_.connect_timeout,
+                         [this, connection_id]() {
+                           const auto it = connections_.find(connection_id);
+                           if (it != connections_.end()) {
+                             it->second.connect_timer = kInvalidTimerId;
+                             FailConnecting(connection_id);
+                           }
+                         });
+  }
+
+  /**
+   * Run every command queued by the main thread.
+   */
+  void HandleCommands() {
+    WorkerCommand command{};
+    while (shared_data_.command_queue.Pop(command) == Result::kSuccess) {
+      switch (command.type) {
+        case WorkerCommand::Type::kConnect:
+          addConnection(command.connection_id, command.endpoint,
+                        std::move(command.is_connected));
+          break;
+        case WorkerCommand::Type::kDisconnect:
+          Disconnect(command.connection_id);
+          break;
+      }
+    }
+  }
+
+  /**
+   * Move the events that did not fit in the eventQueue over, as far as
+   * the main thread has made room.
+   */
+  void HandleOverflowEvents() {
+    while (!overflow_events_.empty() &&
+           shared_data_.eventQueue.Push(overflow_events_.front()) ==
+               Result::kSuccess) {
+      overflow_events_.pop_front();
+    }
+  }
+
+  /**
+   * Take the time once per wakeup, for everything handled until the next.
+   */
+  void UpdateNow() { now_ = TimerWheel::Clock::now(); }
+
+  /**
+   * Fire the timers that are due.
+   */
+  void HandleTimers() { timers_.Advance(now_); }
+
+  /**
+   * @return How long the poller may sleep before the next timer is due.
+   */
+  int TimeoutMs() const {
+    const int timeout_ms = timers_.TimeoutMs(TimerWheel::Clock::now());
+    if (!overflow_events_.empty()) {
+      // the main thread does not wake us when it makes room for events
+      return timeout_ms >= 0 && timeout_ms < kOverflowRetryMs
+                 ? timeout_ms
+                 : kOverflowRetryMs;
     }
+    return timeout_ms >= 0 ? timeout_ms : Poller::kInfinite;
   }
 
   /**
    * Explicitly check if the connection is open. Note, best way to check for a
    * broken connection is to acually send data and expect a response.
    */
-  bool isClientConnected() const { return transport_.CanWrite(); }
+  bool isClientConnected(const ConnectionId connection_id) const {
+    const auto it = connections_.find(connection_id);
+    return it != connections_.end() && it->second.transport.CanWrite();
+  }
 
  private:
-  TTransport transport_{};
+  static constexpr int kOverflowRetryMs = 1;
+
+  struct Connection {
+    TTransport transport;
+    ConnectedFlag is_connected;
+    // until the handshake completes, only registered for kWrite
+    bool connecting = false;
+    TimerId connect_timer = kInvalidTimerId;
+    // stream transports only, bytes waiting to be written
+    std::vector<u8> send_buffer{};
+    // datagram transports only, packets sent while connecting, and their
+    // total size
+    std::vector<TPacket> held_packets{};
+    size_t held_bytes = 0;
+    // registered for kWrite, as the socket did not take all of send_buffer
+    bool awaiting_write = false;
+    TimerWheel::Clock::time_point last_recv{};
+    TimerId idle_timer = kInvalidTimerId;
+  };
+
+  /**
+   * Check on a connect the poller reported progress on.
+   */
+  void FinishConnecting(const ConnectionId connection_id) {
+    const auto it = connections_.find(connection_id);
+    if (it == connections_.end()) {
+      return;
+    }
+    Connection& connection = it->second;
+    const Result res = connection.transport.FinishConnect();
+    if (res == Result::kWouldBlock) {
+      return;
+    }
+    if (res == Result::kFail ||
+        shared_data_.poller.Modify(connection.transport.GetHandle(),
+                                   connection_id,
+                                   poll_flag::kRead) != Result::kSuccess) {
+      FailConnecting(connection_id);
+      return;
+    }
+    timers_.Cancel(connection.connect_timer);
+    connection.connect_timer = kInvalidTimerId;
+    OnConnected(connection_id, connection);
+  }
+
+  /**
+   * The handshake completed, register for kRead and start serving it.
+   */
+  void OnConnected(const ConnectionId connection_id, Connection& connection) {
+    if (!connection.connecting &&
+        shared_data_.poller.Add(connection.transport.GetHandle(),
+                                connection_id,
+                                poll_flag::kRead) != Result::kSuccess) {
+      FailConnecting(connection_id);
+      return;
+    }
+    connection.connecting = false;
+    // the transport is read from when readable only, and stream writes do
+    // not block either way
+    if (connection.transport.SetBlocking(true) != Result::kSuccess) {
+      FailConnecting(connection_id);
+      return;
+    }
+    connection.is_connected->store(true, std::memory_order_release);
+    connection.last_recv = now_;
+    if (shared_data_.idle_timeout.count() > 0) {
+      ScheduleIdleCheck(connection_id, connection,
+                        now_ + shared_data_.idle_timeout);
+    }
+    // TODO send the information with the event?
+    PushEvent(NetworkEvent(NetworkEvent::Type::kConnected, connection_id));
+    SendHeld(connection_id, connection);
+  }
+
+  /**
+   * Write what was sent to the connection while it was connecting.
+   */
+  void SendHeld(const ConnectionId connection_id, Connection& connection) {
+    if constexpr (TTransport::kIsStream) {
+      if (!connection.send_buffer.empty()) {
+        FlushConnection(connection_id);
+      }
+    } else {
+      std::vector<TPacket> packets = std::move(connection.held_packets);
+      connection.held_packets.clear();
+      connection.held_bytes = 0;
+      bool ok = true;
+      for (TPacket& packet : packets) {
+        if (ok) {
+          const auto maybe_bytes =
+              connection.transport.Write(packet.data(), packet.size());
+          ok = maybe_bytes.has_value() &&
+               maybe_bytes.value() == static_cast<int>(packet.size());
+        }
+        pool_.Release(std::move(packet));
+      }
+      if (!ok) {
+        // TODO send the error information with the event?
+        Disconnect(connection_id);
+      }
+    }
+  }
+
+  void FailConnecting(const ConnectionId connection_id) {
+    const auto it = connections_.find(connection_id);
+    if (it == connections_.end()) {
+      return;
+    }
+    Connection& connection = it->second;
+    (void)shared_data_.poller.Remove(connection.transport.GetHandle());
+    timers_.Cancel(connection.connect_timer);
+    connection.transport.Disconnect();
+    connections_.erase(it);
+    // TODO send the error information with the event?
+    PushEvent(
+        NetworkEvent(NetworkEvent::Type::kFailedToConnect, connection_id));
+  }
+
+  /**
+   * Queue an event the main thread must see, such as a disconnect. If the
+   * eventQueue is full, it waits in the overflow list, behind the earlier
+   * events, until there is room.
+   */
+  void PushEvent(const NetworkEvent& event) {
+    if (!overflow_events_.empty() ||
+        shared_data_.eventQueue.Push(event) != Result::kSuccess) {
+      overflow_events_.push_back(event);
+    }
+  }
+
+  /**
+   * Queue a notification that can be lost, the main thread finds out by
+   * other means, such as the recv_queue. Dropped while events are waiting
+   * in the overflow list, so it cannot overtake them.
+   */
+  void PushDroppableEvent(const NetworkEvent& event) {
+    if (overflow_events_.empty()) {
+      (void)shared_data_.eventQueue.Push(event);
+    }
+  }
+
+  void ScheduleIdleCheck(const ConnectionId connection_id,
+                         Connection& connection,
+                         const TimerWheel::Clock::time_point deadline) {
+    connection.idle_timer = timers_.Schedule(
+        deadline, [this, connection_id]() { CheckIdle(connection_id); });
+  }
+
+  /**
+   * Rather than moving the timer on every read, it is only moved when it
+   * fires, to when the connection would be idle for long enough given its
+   * last read.
+   */
+  void CheckIdle(const ConnectionId connection_id) {
+    const auto it = connections_.find(connection_id);
+    if (it == connections_.end()) {
+      return;
+    }
+    Connection& connection = it->second;
+    connection.idle_timer = kInvalidTimerId;
+    const auto idle_deadline = connection.last_recv + shared_data_.idle_timeout;
+    if (idle_deadline <= now_) {
+      Disconnect(connection_id);
+    } else {
+      ScheduleIdleCheck(connection_id, connection, idle_deadline);
+    }
+  }
+
+  void QueueSend(const TaggedPacket<TPacket>& tagged) {
+    const auto it = connections_.find(tagged.connection_id);
+    if (it == connections_.end()) {
+      // TODO report packets dropped for unknown connections?
+      return;
+    }
+    Connection& connection = it->second;
+    const TPacket& packet = tagged.packet;
+    if (connection.connecting) {
+      // held until the connect completes, see SendHeld
+      size_t held_bytes = 0;
+      if constexpr (TTransport::kIsStream) {
+        connection.send_buffer.insert(connection.send_buffer.end(),
+                                      packet.data(),
+                                      packet.data() + packet.size());
+        held_bytes = connection.send_buffer.size();
+      } else {
+        TPacket held = pool_.Acquire(packet.size());
+        held.assign(packet.data(), packet.data() + packet.size());
+        connection.held_packets.push_back(std::move(held));
+        connection.held_bytes += packet.size();
+        held_bytes = connection.held_bytes;
+      }
+      if (held_bytes > shared_data_.max_pending_send_bytes) {
+        FailConnecting(tagged.connection_id);
+      }
+      return;
+    }
+    if constexpr (TTransport::kIsStream) {
+      if (connection.send_buffer.empty()) {
+        pending_sends_.push_back(tagged.connection_id);
+      }
+      connection.send_buffer.insert(connection.send_buffer.end(),
+                                    packet.data(),
+                                    packet.data() + packet.size());
+    } else {
+      const auto maybe_bytes =
+          connection.transport.Write(packet.data(), packet.size());
+      if (!maybe_bytes.has_value() ||
+          maybe_bytes.value() != static_cast<int>(packet.size())) {
+        // TODO send the error information with the event?
+        Disconnect(tagged.connection_id);
+      }
+    }
+  }
+
+  void FlushSends() {
+    for (const ConnectionId connection_id : pending_sends_) {
+      FlushConnection(connection_id);
+    }
+    pending_sends_.clear();
+  }
+
+  /**
+   * Write as much of the connection's send buffer as the socket takes,
+   * without blocking, so that one peer that does not read cannot stall the
+   * others. The rest is written when the poller reports the socket
+   * writable.
+   */
+  void FlushConnection(const ConnectionId connection_id) {
+    if constexpr (TTransport::kIsStream) {
+      const auto it = connections_.find(connection_id);
+      if (it == connections_.end()) {
+        return;
+      }
+      Connection& connection = it->second;
+      std::vector<u8>& buffer = connection.send_buffer;
+      size_t written = 0;
+      while (written < buffer.size()) {
+        const auto maybe_bytes = connection.transport.WriteNonBlocking(
+            buffer.data() + written, buffer.size() - written);
+        if (!maybe_bytes.has_value()) {
+          // TODO send the error information with the event?
+          Disconnect(connection_id);
+          return;
+        }
+        if (maybe_bytes.value() == 0) {
+          break;
+        }
+        written += static_cast<size_t>(maybe_bytes.value());
+      }
+      // keep the capacity for the next wakeup
+      buffer.erase(buffer.begin(),
+                   buffer.begin() + static_cast<std::ptrdiff_t>(written));
+
+      const bool want_write = !buffer.empty();
+      if (buffer.size() > shared_data_.max_pending_send_bytes) {
+        Disconnect(connection_id);
+        return;
+      }
+      if (want_write != connection.awaiting_write) {
+        const u32 interest = want_write
+                                 ? poll_flag::kRead | poll_flag::kWrite
+                                 : poll_flag::kRead;
+        if (shared_data_.poller.Modify(connection.transport.GetHandle(),
+                                       connection_id,
+                                       interest) != Result::kSuccess) {
+          Disconnect(connection_id);
+          return;
+        }
+        connection.awaiting_write = want_write;
+      }
+    } else {
+      (void)connection_id;
+    }
+  }
+
+  SharedData<TPacket>& shared_data_;
+  std::unordered_map<ConnectionId, Connection> connections_{};
+  BufferPool<TPacket> pool_{};
+  // every read lands here first, sized for the largest datagram
+  std::vector<u8> read_buffer_;
+  // connections with bytes in their send_buffer
+  std::vector<ConnectionId> pending_sends_{};
+  TimerWheel timers_{};
+  TimerWheel::Clock::time_point now_ = TimerWheel::Clock::now();
+  // events that did not fit in the eventQueue, oldest first
+  std::deque<NetworkEvent> overflow_events_{};
 };
 
 /**
- * This is the loop the network worker thread will be running.
+ * This is the loop the network worker thread will be running. It sleeps in
+ * the poller until a socket is readable, the main thread wakes it up or
+ * its next timer is due.
  * @param shared_data This is used to communicate between main thread and
  * worker.
  */
 template <typename TPacket, typename TTransport>
 void Loop(SharedData<TPacket>& shared_data) {
-  Worker<TPacket, TTransport> worker{};
-
-  bool did_work;
-  while (shared_data.run_worker_thread_flag) {
-    did_work = false;
-    if (worker.isClientConnected()) {
-      if (!shared_data.send_queue.Empty()) {
-        did_work = true;
-        worker.HandleSend(shared_data.eventQueue, shared_data.send_queue,
-                          shared_data.is_connected);
-      }
+  Worker<TPacket, TTransport> worker{shared_data};
 
-      if (worker.CanRecv()) {
-        did_work = true;
-        worker.HandleCanRecv(shared_data.eventQueue, shared_data.recv_queue,
-                             shared_data.is_connected);
-      }
-    }
-
-    if (shared_data.connect_flag) {
-      did_work = true;
-      worker.addConnection(shared_data.eventQueue, shared_data.ip,
-                           shared_data.port, shared_data.is_connected);
-      shared_data.connect_flag = false;
-    }
+  constexpr int kMaxEvents = 64;
+  PollEvent events[kMaxEvents];
+  while (shared_data.run_worker_thread_flag.load(std::memory_order_acquire)) {
+    worker.HandleOverflowEvents();
+    worker.HandleCommands();
+    worker.HandleRecycle();
 
-    if (shared_data.disconnect_flag) {
-      did_work = true;
-      worker.Disconnect(shared_data.eventQueue, shared_data.is_connected);
-      shared_data.disconnect_flag = false;
+    if (!shared_data.send_queue.Empty()) {
+      worker.HandleSend();
     }
 
-    // to not use 100% CPU, let it sleeep every loop
-    if (!did_work) {
-      constexpr std::chrono::microseconds sleep_time_us{100};
-      std::this_thread::sleep_for(sleep_time_us);
+    // only block if there is nothing left for us to send
+    const int timeout_ms =
+        shared_data.send_queue.Empty() ? worker.TimeoutMs() : 0;
+    const int event_count =
+        shared_data.poller.Wait(events, kMaxEvents, timeout_ms);
+    worker.UpdateNow();
+    for (int i = 0; i < event_count; i++) {
+      worker.HandleEvent(events[i]);
     }
+    worker.HandleTimers();
   }
 }
 
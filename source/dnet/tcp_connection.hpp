@@ -30,11 +30,16 @@
 #include <dnet/util/dnet_assert.hpp>
 #include <dnet/util/result.hpp>
 #include <dnet/util/types.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
 #include <limits>
 #include <optional>
 #include <string>
 #include <tuple>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace dnet {
 
@@ -75,14 +80,71 @@ class TcpConnection {
 
   Result Connect(const std::string& address, u16 port);
 
+  /**
+   * Give up once @timeout has passed, see Socket::Connect.
+   */
+  Result Connect(const std::string& address, u16 port,
+                 std::chrono::milliseconds timeout);
+
+  /**
+   * Start connecting, and return without waiting for the handshake. Call
+   * FinishConnect once the socket is writable, or use ConnectMany to
+   * connect many at once. The connection is left non-blocking.
+   * @return kSuccess if connected right away, kWouldBlock while in flight,
+   * or kFail.
+   */
+  Result ConnectNonBlocking(const Endpoint& endpoint);
+
+  /**
+   * @return kSuccess once connected, kWouldBlock while in flight, or kFail.
+   */
+  Result FinishConnect() const { return transport_.FinishConnect(); }
+
   void Disconnect();
 
-  std::tuple<Result, THeaderData> Read(TVector& payload_out) const;
+  /**
+   * Read one packet. Reads pull in as many bytes as the kernel has ready,
+   * and following calls are served from the connection's buffer until it
+   * runs dry, so small packets rarely cost a syscall each.
+   */
+  std::tuple<Result, THeaderData> Read(TVector& payload_out);
+
+  /**
+   * Like Read, but never waits for the peer. Does at most one read syscall
+   * per call, and keeps a partially received packet until a later call
+   * completes it, so one thread can serve many connections from a Poller.
+   * Do not call Read while a packet is partially received.
+   * @return kNeedMoreData if no whole packet has arrived yet, call again
+   * when the socket is readable.
+   */
+  std::tuple<Result, THeaderData> TryRead(TVector& payload_out);
 
   Result Write(const THeaderData& header_data, const TVector& payload) const;
 
   /**
-   * @return Any error occured while attempting to check, will return false.
+   * Like Write, but only queue the packet in the connection's send buffer,
+   * so that many packets leave in one syscall on the next Flush. Do not call
+   * Write while packets are queued.
+   */
+  Result WriteBuffered(const THeaderData& header_data, const TVector& payload);
+
+  /**
+   * Write as much of the send buffer as the socket takes, without waiting.
+   * @return kWouldBlock if bytes are left, call again when the socket is
+   * writable.
+   */
+  Result Flush();
+
+  /**
+   * @return Bytes queued by WriteBuffered, not yet taken by the socket.
+   */
+  size_t PendingWriteBytes() const { return send_buffer_.size(); }
+
+  /**
+   * @return If a whole packet is buffered, or the socket is readable. When
+   * waiting on the socket in a Poller, keep calling Read until this is false,
+   * buffered packets do not wake the poller. Any error occured while
+   * attempting to check, will return false.
    */
   bool CanRead() const;
 
@@ -95,7 +157,7 @@ class TcpConnection {
   // Server methods
   // ====================================================================== //
 
-  Result StartServer(u16 port);
+  Result StartServer(u16 port, const ListenOptions& options = ListenOptions{});
 
   std::optional<TcpConnection> Accept() const;
 
@@ -133,12 +195,63 @@ class TcpConnection {
     return transport_.SetBlocking(blocking);
   }
 
+  /**
+   * Tuning applied by Connect and StartServer, and to accepted connections,
+   * see SocketOptions.
+   */
+  void set_options(const SocketOptions& options) {
+    transport_.set_options(options);
+  }
+
+  std::optional<SocketOptions> GetOptions() const {
+    return transport_.GetOptions();
+  }
+
+  /**
+   * Size of the receive buffer, allocated on the first read. When holding
+   * many connections, a smaller buffer saves memory at the cost of more
+   * read syscalls for large packets. Call before the first read.
+   */
+  void set_recv_buffer_size(const size_t size) {
+    recv_buffer_size_ =
+        size > Header::header_size() ? size : Header::header_size() + 1;
+  }
+
+  chif_net_socket GetHandle() const { return transport_.GetHandle(); }
+
   // ====================================================================== //
   // Data members
   // ====================================================================== //
 
  private:
+  static constexpr size_t kRecvBufferSize = 64 * 1024;
+
+  size_t Buffered() const { return recv_end_ - recv_begin_; }
+
+  /**
+   * Read as many bytes as fit, and are available, into the receive buffer.
+   * @param blocking If false, return kNeedMoreData instead of waiting.
+   */
+  Result FillRecvBuffer(bool blocking);
+
+  /**
+   * Move buffered bytes to the end of @payload, until it holds @size bytes.
+   */
+  void TakeFromRecvBuffer(TVector& payload, size_t size);
+
   Tcp transport_;
+  // received bytes not yet handed out live in [recv_begin_, recv_end_)
+  std::vector<u8> recv_buffer_{};
+  size_t recv_buffer_size_ = kRecvBufferSize;
+  size_t recv_begin_ = 0;
+  size_t recv_end_ = 0;
+  // TryRead state, for a packet whose header has arrived but not its
+  // whole payload
+  Header pending_header_{};
+  bool has_pending_header_ = false;
+  TVector pending_payload_{};
+  // packets queued by WriteBuffered
+  std::vector<u8> send_buffer_{};
 };
 
 // ====================================================================== //
@@ -156,13 +269,36 @@ TcpConnection<TVector, THeaderData>::TcpConnection(Tcp&& transport)
 template <typename TVector, typename THeaderData>
 TcpConnection<TVector, THeaderData>::TcpConnection(
     TcpConnection<TVector, THeaderData>&& other) noexcept
-    : transport_(std::move(other.transport_)) {}
+    : transport_(std::move(other.transport_)),
+      recv_buffer_(std::move(other.recv_buffer_)),
+      recv_buffer_size_(other.recv_buffer_size_),
+      recv_begin_(other.recv_begin_),
+      recv_end_(other.recv_end_),
+      pending_header_(other.pending_header_),
+      has_pending_header_(other.has_pending_header_),
+      pending_payload_(std::move(other.pending_payload_)),
+      send_buffer_(std::move(other.send_buffer_)) {
+  other.recv_begin_ = 0;
+  other.recv_end_ = 0;
+  other.has_pending_header_ = false;
+}
 
 template <typename TVector, typename THeaderData>
 TcpConnection<TVector, THeaderData>& TcpConnection<TVector, THeaderData>::
 operator=(TcpConnection<TVector, THeaderData>&& other) noexcept {
   if (&other != this) {
     transport_ = std::move(other.transport_);
+    recv_buffer_ = std::move(other.recv_buffer_);
+    recv_buffer_size_ = other.recv_buffer_size_;
+    recv_begin_ = other.recv_begin_;
+    recv_end_ = other.recv_end_;
+    pending_header_ = other.pending_header_;
+    has_pending_header_ = other.has_pending_header_;
+    pending_payload_ = std::move(other.pending_payload_);
+    send_buffer_ = std::move(other.send_buffer_);
+    other.recv_begin_ = 0;
+    other.recv_end_ = 0;
+    other.has_pending_header_ = false;
   }
   return *this;
 }
@@ -173,55 +309,170 @@ Result TcpConnection<TVector, THeaderData>::Connect(const std::string& address,
   return transport_.Connect(address, port);
 }
 
+template <typename TVector, typename THeaderData>
+Result TcpConnection<TVector, THeaderData>::Connect(
+    const std::string& address, const u16 port,
+    const std::chrono::milliseconds timeout) {
+  return transport_.Connect(address, port, timeout);
+}
+
+template <typename TVector, typename THeaderData>
+Result TcpConnection<TVector, THeaderData>::ConnectNonBlocking(
+    const Endpoint& endpoint) {
+  return transport_.ConnectNonBlocking(endpoint);
+}
+
 template <typename TVector, typename THeaderData>
 void TcpConnection<TVector, THeaderData>::Disconnect() {
   transport_.Disconnect();
+  recv_begin_ = 0;
+  recv_end_ = 0;
+  has_pending_header_ = false;
+  send_buffer_.clear();
+}
+
+template <typename TVector, typename THeaderData>
+Result TcpConnection<TVector, THeaderData>::FillRecvBuffer(
+    const bool blocking) {
+  if (recv_buffer_.empty()) {
+    recv_buffer_.resize(recv_buffer_size_);
+  }
+  // only called with less than a header buffered, so the move is small
+  if (recv_begin_ > 0) {
+    std::memmove(recv_buffer_.data(), recv_buffer_.data() + recv_begin_,
+                 Buffered());
+    recv_end_ -= recv_begin_;
+    recv_begin_ = 0;
+  }
+  u8* const free_begin = recv_buffer_.data() + recv_end_;
+  const size_t free_size = recv_buffer_.size() - recv_end_;
+  const auto maybe_bytes =
+      blocking ? transport_.Read(free_begin, free_size)
+               : transport_.ReadNonBlocking(free_begin, free_size);
+  if (maybe_bytes.has_value() && maybe_bytes.value() > 0) {
+    recv_end_ += static_cast<size_t>(maybe_bytes.value());
+    return Result::kSuccess;
+  }
+  if (maybe_bytes.has_value() && !blocking) {
+    return Result::kNeedMoreData;
+  }
+  if (maybe_bytes.has_value() ||
+      transport_.GetLastError() == CHIF_NET_RESULT_TCP_CONNECTION_CLOSED) {
+    return Result::kConnectionClosed;
+  }
+  return Result::kFail;
 }
 
-// TODO go over the types used
 // TODO utilize NRVO
 template <typename TVector, typename THeaderData>
 std::tuple<Result, THeaderData> TcpConnection<TVector, THeaderData>::Read(
-    TVector& payload_out) const {
-  Header header{};
-  int bytes = 0;
-  static_assert(Header::header_size() < std::numeric_limits<int>::max());
-      // TODO make it possible to break out of loops if bad header
-  while (bytes < static_cast<int>(Header::header_size())) {
-    const auto maybe_bytes =
-        transport_.Read(header.get(), Header::header_size());
-    if (maybe_bytes.has_value()) {
-      bytes += maybe_bytes.value();
-    } else if (transport_.GetLastError() == CHIF_NET_RESULT_TCP_CONNECTION_CLOSED) {
-      return std::make_tuple<Result, THeaderData>(Result::kConnectionClosed, THeaderData{});
-    } else {
-      return std::make_tuple<Result, THeaderData>(Result::kFail, THeaderData{});
+    TVector& payload_out) {
+  static_assert(Header::header_size() < kRecvBufferSize);
+  dnet_assert(!has_pending_header_,
+              "Read called with a packet partially received by TryRead");
+  while (Buffered() < Header::header_size()) {
+    const Result res = FillRecvBuffer(true);
+    if (res != Result::kSuccess) {
+      return std::make_tuple<Result, THeaderData>(Result(res), THeaderData{});
     }
   }
-
-  if (payload_out.capacity() < header.payload_size()) {
-    payload_out.reserve(header.payload_size());
+  Header header{};
+  std::memcpy(header.get(), recv_buffer_.data() + recv_begin_,
+              Header::header_size());
+  recv_begin_ += Header::header_size();
+
+  // the start of the payload is buffered, what is left is read straight
+  // into payload_out, so large payloads are not copied twice
+  const size_t payload_size = header.payload_size();
+  payload_out.resize(payload_size);
+  const size_t from_buffer = payload_size < Buffered() ? payload_size
+                                                       : Buffered();
+  std::memcpy(payload_out.data(), recv_buffer_.data() + recv_begin_,
+              from_buffer);
+  recv_begin_ += from_buffer;
+  if (recv_begin_ == recv_end_) {
+    recv_begin_ = 0;
+    recv_end_ = 0;
   }
 
-  payload_out.resize(payload_out.capacity());
-  bytes = 0;
-  // TODO bad cast
-  while (static_cast<size_t>(bytes) < header.payload_size()) {
+  size_t bytes = from_buffer;
+  while (bytes < payload_size) {
     // TODO timeout read in case bad info in header
     const auto maybe_bytes =
-        transport_.Read(&payload_out[bytes], header.payload_size() - bytes);
-    if (maybe_bytes.has_value()) {
-      bytes += maybe_bytes.value();
+        transport_.Read(payload_out.data() + bytes, payload_size - bytes);
+    if (maybe_bytes.has_value() && maybe_bytes.value() > 0) {
+      bytes += static_cast<size_t>(maybe_bytes.value());
     } else {
       return std::make_tuple<Result, THeaderData>(Result::kFail,
                                                   header.header_data());
     }
   }
-  payload_out.resize(static_cast<size_t>(bytes));
   return std::make_tuple<Result, THeaderData>(Result::kSuccess,
                                               header.header_data());
 }
 
+template <typename TVector, typename THeaderData>
+void TcpConnection<TVector, THeaderData>::TakeFromRecvBuffer(
+    TVector& payload, const size_t size) {
+  const size_t had = payload.size();
+  const size_t wanted = size - had;
+  const size_t taken = wanted < Buffered() ? wanted : Buffered();
+  payload.resize(had + taken);
+  std::memcpy(payload.data() + had, recv_buffer_.data() + recv_begin_, taken);
+  recv_begin_ += taken;
+  if (recv_begin_ == recv_end_) {
+    recv_begin_ = 0;
+    recv_end_ = 0;
+  }
+}
+
+template <typename TVector, typename THeaderData>
+std::tuple<Result, THeaderData> TcpConnection<TVector, THeaderData>::TryRead(
+    TVector& payload_out) {
+  bool did_read = false;
+  if (!has_pending_header_) {
+    if (Buffered() < Header::header_size()) {
+      const Result res = FillRecvBuffer(false);
+      did_read = true;
+      if (res != Result::kSuccess) {
+        return std::make_tuple<Result, THeaderData>(Result(res),
+                                                    THeaderData{});
+      }
+      if (Buffered() < Header::header_size()) {
+        return std::make_tuple<Result, THeaderData>(Result::kNeedMoreData,
+                                                    THeaderData{});
+      }
+    }
+    std::memcpy(pending_header_.get(), recv_buffer_.data() + recv_begin_,
+                Header::header_size());
+    recv_begin_ += Header::header_size();
+    has_pending_header_ = true;
+    pending_payload_.clear();
+  }
+
+  // the payload grows as bytes arrive, a peer that announces a large
+  // payload has to actually send it before we allocate for it
+  const size_t payload_size = pending_header_.payload_size();
+  TakeFromRecvBuffer(pending_payload_, payload_size);
+  if (pending_payload_.size() < payload_size && !did_read) {
+    const Result res = FillRecvBuffer(false);
+    if (res != Result::kSuccess) {
+      return std::make_tuple<Result, THeaderData>(Result(res), THeaderData{});
+    }
+    TakeFromRecvBuffer(pending_payload_, payload_size);
+  }
+  if (pending_payload_.size() < payload_size) {
+    return std::make_tuple<Result, THeaderData>(Result::kNeedMoreData,
+                                                THeaderData{});
+  }
+
+  has_pending_header_ = false;
+  // hand over the payload, and keep the caller's old buffer for the next one
+  std::swap(payload_out, pending_payload_);
+  return std::make_tuple<Result, THeaderData>(Result::kSuccess,
+                                              pending_header_.header_data());
+}
+
 // TODO utilize NRVO
 template <typename TVector, typename THeaderData>
 Result TcpConnection<TVector, THeaderData>::Write(
@@ -240,37 +491,75 @@ Result TcpConnection<TVector, THeaderData>::Write(
   const Header header{static_cast<typename Header::PayloadSize>(payload_size),
                       header_data};
 
-  int bytes = 0;
-  // TODO make it possible to break out of loops if bad header
-  // TODO bad cast
-  while (static_cast<size_t>(bytes) < header.header_size()) {
-    const auto maybe_bytes =
-        transport_.Write(header.get(), Header::header_size());
-    if (maybe_bytes.has_value()) {
-      bytes += maybe_bytes.value();
-    } else {
+  // header and payload leave in the same syscall, and the same segment
+  IoBuffer buffers[2]{{header.get(), Header::header_size()},
+                      {payload.data(), header.payload_size()}};
+  IoBuffer* remaining = buffers;
+  size_t count = 2;
+  while (count > 0) {
+    const auto maybe_bytes = transport_.WriteV(remaining, count);
+    if (!maybe_bytes.has_value()) {
       return Result::kFail;
     }
-    // TODO not using bytes
+    AdvanceIoBuffers(remaining, count,
+                     static_cast<size_t>(maybe_bytes.value()));
   }
 
-  bytes = 0;
-  // TODO bad cast
-  while (static_cast<size_t>(bytes) < header.payload_size()) {
-    const auto maybe_bytes =
-        transport_.Write(&payload[bytes], header.payload_size() - bytes);
-    if (maybe_bytes.has_value()) {
-      bytes += maybe_bytes.value();
-    } else {
-      return Result::kFail;
-    }
+  return Result::kSuccess;
+}
+
+template <typename TVector, typename THeaderData>
+Result TcpConnection<TVector, THeaderData>::WriteBuffered(
+    const THeaderData& header_data, const TVector& payload) {
+  const auto payload_size = payload.size();
+  if (payload_size >
+      std::numeric_limits<typename Header::PayloadSize>::max()) {
+    return Result::kFail;
   }
+  const Header header{static_cast<typename Header::PayloadSize>(payload_size),
+                      header_data};
+  send_buffer_.insert(send_buffer_.end(), header.get(),
+                      header.get() + Header::header_size());
+  send_buffer_.insert(send_buffer_.end(), payload.data(),
+                      payload.data() + payload_size);
+  return Result::kSuccess;
+}
 
+template <typename TVector, typename THeaderData>
+Result TcpConnection<TVector, THeaderData>::Flush() {
+  size_t written = 0;
+  while (written < send_buffer_.size()) {
+    const auto maybe_bytes = transport_.WriteNonBlocking(
+        send_buffer_.data() + written, send_buffer_.size() - written);
+    if (!maybe_bytes.has_value()) {
+      return transport_.GetLastError() == CHIF_NET_RESULT_TCP_CONNECTION_CLOSED
+                 ? Result::kConnectionClosed
+                 : Result::kFail;
+    }
+    if (maybe_bytes.value() == 0) {
+      // keep only what is left, so a slow peer does not grow the buffer
+      send_buffer_.erase(
+          send_buffer_.begin(),
+          send_buffer_.begin() + static_cast<std::ptrdiff_t>(written));
+      return Result::kWouldBlock;
+    }
+    written += static_cast<size_t>(maybe_bytes.value());
+  }
+  // keep the capacity for the next packets
+  send_buffer_.clear();
   return Result::kSuccess;
 }
 
 template <typename TVector, typename THeaderData>
 bool TcpConnection<TVector, THeaderData>::CanRead() const {
+  if (!has_pending_header_ && Buffered() >= Header::header_size()) {
+    Header header{};
+    std::memcpy(header.get(), recv_buffer_.data() + recv_begin_,
+                Header::header_size());
+    if (Buffered() - Header::header_size() >= header.payload_size()) {
+      return true;
+    }
+  }
   return transport_.CanRead();
 }
 
@@ -290,8 +579,9 @@ bool TcpConnection<TVector, THeaderData>::HasError() const {
 }
 
 template <typename TVector, typename THeaderData>
-Result TcpConnection<TVector, THeaderData>::StartServer(u16 port) {
-  return transport_.StartServer(port);
+Result TcpConnection<TVector, THeaderData>::StartServer(
+    u16 port, const ListenOptions& options) {
+  return transport_.StartServer(port, options);
 }
 
 template <typename TVector, typename THeaderData>
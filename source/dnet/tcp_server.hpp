@@ -0,0 +1,513 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef TCP_SERVER_HPP_
+#define TCP_SERVER_HPP_
+
+#include <dnet/net/packet_header.hpp>
+#include <dnet/net/poller.hpp>
+#include <dnet/tcp_connection.hpp>
+#include <dnet/util/dnet_assert.hpp>
+#include <dnet/util/result.hpp>
+#include <dnet/util/spsc_ring.hpp>
+#include <dnet/util/types.hpp>
+#include <dnet/util/util.hpp>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace dnet {
+
+/**
+ * Identifies a client of a TcpServer, unique for the server's lifetime.
+ */
+using ClientId = u64;
+
+struct TcpServerOptions {
+  // event loop threads, each serves its share of the clients. One loop
+  // serves thousands of clients, add more when it saturates its core.
+  u32 loop_count = 1;
+  // pin loop n to cpu n, best effort, ignored where unsupported
+  bool pin_loops = false;
+  // give every loop its own listening socket on the port, and let the
+  // kernel spread new clients over them, see ListenOptions::reuse_port.
+  // Otherwise the first loop accepts for all of them.
+  bool reuse_port = false;
+  // with reuse_port, ask the kernel to hand loop n the clients whose
+  // packets it processes on cpu n, best effort. Use with pin_loops.
+  bool incoming_cpu = false;
+  // per client, see TcpConnection::set_recv_buffer_size
+  size_t recv_buffer_size = 4 * 1024;
+  // a client that does not read its replies is dropped once this many
+  // bytes wait to be sent to it
+  size_t max_pending_write_bytes = 1024 * 1024;
+  // tuning of the listening sockets, and every accepted client
+  SocketOptions socket_options{};
+};
+
+/**
+ * Serves many TcpConnection clients from a small, fixed set of event loop
+ * threads, instead of a thread per client. Each loop sleeps in a Poller on
+ * its clients' non-blocking sockets, reads whatever has arrived, and hands
+ * every whole packet to the message callback. Replies written from the
+ * callback are queued in the client's send buffer, and leave in one write
+ * once all packets that arrived have been handled.
+ *
+ * The first loop also accepts, and hands the new clients to the loops in
+ * turn, or with TcpServerOptions::reuse_port every loop accepts its own. A
+ * client stays on its loop, and all callbacks about it are called from
+ * that loop's thread. Callbacks about clients on different loops run
+ * concurrently.
+ *
+ * @tparam TVector A container that has the functionality of std::vector<u8>.
+ * @tparam THeaderData See TcpConnection.
+ */
+template <typename TVector, typename THeaderData = HeaderDataExample>
+class TcpServer {
+ public:
+  using Connection = TcpConnection<TVector, THeaderData>;
+
+  /**
+   * A connected client, handed to the callbacks. Only valid during the
+   * callback.
+   */
+  class Client {
+   public:
+    ClientId id() const { return id_; }
+
+    /**
+     * Queue a packet to the client, it is sent once the loop is done with
+     * the packets that arrived.
+     * @return kFail if too many bytes already wait to be sent to the
+     * client, it is then disconnected.
+     */
+    Result Write(const THeaderData& header_data, const TVector& payload) {
+      if (connection_.PendingWriteBytes() > max_pending_write_bytes_) {
+        closing_ = true;
+        return Result::kFail;
+      }
+      return connection_.WriteBuffered(header_data, payload);
+    }
+
+    /**
+     * Close the connection, after giving the socket what it takes of the
+     * queued packets.
+     */
+    void Disconnect() { closing_ = true; }
+
+    /**
+     * @return Result of the call, Ip and port of the client.
+     */
+    std::tuple<Result, std::string, u16> GetPeer() const {
+      return connection_.GetPeer();
+    }
+
+   private:
+    friend class TcpServer;
+
+    Client(Connection&& connection, const ClientId id,
+           const size_t max_pending_write_bytes)
+        : connection_(std::move(connection)),
+          id_(id),
+          max_pending_write_bytes_(max_pending_write_bytes) {}
+
+    Connection connection_;
+    ClientId id_;
+    size_t max_pending_write_bytes_;
+    bool closing_ = false;
+    // registered for writability, while the send buffer does not drain
+    bool want_write_ = false;
+  };
+
+  using MessageCallback = std::function<void(
+      Client& client, const THeaderData& header_data, TVector& payload)>;
+  using ClientCallback = std::function<void(Client& client)>;
+
+  // ============================================================ //
+  // Lifetime
+  // ============================================================ //
+
+  explicit TcpServer(const TcpServerOptions& options = TcpServerOptions{})
+      : options_(options) {}
+
+  // the loops hold a pointer to the server
+  TcpServer(const TcpServer& other) = delete;
+  TcpServer& operator=(const TcpServer& other) = delete;
+  TcpServer(TcpServer&& other) = delete;
+  TcpServer& operator=(TcpServer&& other) = delete;
+
+  ~TcpServer() { Stop(); }
+
+  // ============================================================ //
+  // Server
+  // ============================================================ //
+
+  /**
+   * Listen on @port and start the loops. Set the callbacks before.
+   */
+  Result Start(u16 port);
+
+  /**
+   * Stop the loops, and close every connection. The disconnect callback is
+   * not called.
+   */
+  void Stop();
+
+  // ============================================================ //
+  // Misc
+  // ============================================================ //
+
+  void set_on_message(MessageCallback on_message) {
+    on_message_ = std::move(on_message);
+  }
+
+  void set_on_connect(ClientCallback on_connect) {
+    on_connect_ = std::move(on_connect);
+  }
+
+  void set_on_disconnect(ClientCallback on_disconnect) {
+    on_disconnect_ = std::move(on_disconnect);
+  }
+
+  /**
+   * Thread safe.
+   * @return Amount of connected clients.
+   */
+  size_t client_count() const {
+    size_t count = 0;
+    for (const auto& loop : loops_) {
+      count += loop->client_count.load(std::memory_order_relaxed);
+    }
+    return count;
+  }
+
+  u32 loop_count() const { return static_cast<u32>(loops_.size()); }
+
+  std::optional<u16> GetPort() const {
+    return loops_.empty() ? std::nullopt : loops_.front()->listener.GetPort();
+  }
+
+  // ============================================================ //
+  // Data
+  // ============================================================ //
+
+ private:
+  // the listener's token, client ids start at 1
+  static constexpr u64 kListenerToken = 0;
+  static constexpr int kMaxEvents = 256;
+  static constexpr size_t kAcceptQueueSize = 1024;
+
+  struct Loop {
+    explicit Loop(const u32 loop_index) : next_id(loop_index + 1) {}
+
+    Poller poller{};
+    // open on the first loop, or on all with reuse_port
+    Connection listener{};
+    // clients accepted by the first loop, for this loop to serve
+    SpscRing<Connection> accepted{kAcceptQueueSize};
+    std::unordered_map<ClientId, Client> clients{};
+    std::atomic<size_t> client_count{0};
+    // ids of different loops never collide, as they step by loop count
+    ClientId next_id;
+    // every packet is read into here, and handed to the message callback
+    TVector payload{};
+    std::thread thread{};
+  };
+
+  void Run(Loop& loop);
+
+  /**
+   * Accept every pending client on the loop's listener.
+   */
+  void AcceptAll(Loop& loop);
+
+  void AddClient(Loop& loop, Connection&& connection);
+
+  /**
+   * @return False if the client was closed.
+   */
+  bool HandleRead(Loop& loop, Client& client);
+
+  /**
+   * Send what the client's socket takes, and wait for it to become writable
+   * if some is left.
+   * @return False if the client was closed.
+   */
+  bool Flush(Loop& loop, Client& client);
+
+  void Close(Loop& loop, ClientId id);
+
+  Result Listen(Loop& loop, u16 port, u32 loop_index);
+
+  TcpServerOptions options_;
+  std::vector<std::unique_ptr<Loop>> loops_{};
+  std::atomic<bool> run_{false};
+  // the loop the next accepted client goes to
+  u32 next_loop_ = 0;
+  MessageCallback on_message_{};
+  ClientCallback on_connect_{};
+  ClientCallback on_disconnect_{};
+};
+
+// ============================================================ //
+// template definition
+// ============================================================ //
+
+template <typename TVector, typename THeaderData>
+Result TcpServer<TVector, THeaderData>::Start(const u16 port) {
+  if (!loops_.empty()) {
+    return Result::kFail;
+  }
+  const u32 loop_count = options_.loop_count > 0 ? options_.loop_count : 1;
+  for (u32 i = 0; i < loop_count; i++) {
+    loops_.push_back(std::make_unique<Loop>(i));
+  }
+  const u32 listener_count = options_.reuse_port ? loop_count : 1;
+  for (u32 i = 0; i < listener_count; i++) {
+    // with port 0 the first listener gets a free port, the others join it
+    const u16 listen_port =
+        i == 0 ? port : loops_.front()->listener.GetPort().value_or(0);
+    const Result res = Listen(*loops_[i], listen_port, i);
+    if (res != Result::kSuccess) {
+      // closes the listeners
+      loops_.clear();
+      return res;
+    }
+  }
+
+  next_loop_ = 0;
+  run_.store(true, std::memory_order_release);
+  const u32 cpu_count = std::thread::hardware_concurrency();
+  for (u32 i = 0; i < loop_count; i++) {
+    Loop& loop = *loops_[i];
+    loop.thread = std::thread([this, &loop]() { Run(loop); });
+    if (options_.pin_loops && cpu_count > 0) {
+      PinThreadToCpu(loop.thread, i % cpu_count);
+    }
+  }
+  return Result::kSuccess;
+}
+
+template <typename TVector, typename THeaderData>
+void TcpServer<TVector, THeaderData>::Stop() {
+  if (loops_.empty()) {
+    return;
+  }
+  // tell every loop before joining, so they shut down in parallel
+  run_.store(false, std::memory_order_release);
+  for (auto& loop : loops_) {
+    loop->poller.Wake();
+  }
+  for (auto& loop : loops_) {
+    loop->thread.join();
+  }
+  for (auto& loop : loops_) {
+    for (auto& [id, client] : loop->clients) {
+      client.connection_.Disconnect();
+    }
+  }
+  loops_.clear();
+}
+
+template <typename TVector, typename THeaderData>
+Result TcpServer<TVector, THeaderData>::Listen(Loop& loop, const u16 port,
+                                               const u32 loop_index) {
+  ListenOptions listen_options{};
+  listen_options.reuse_port = options_.reuse_port;
+  const u32 cpu_count = std::thread::hardware_concurrency();
+  if (options_.incoming_cpu && cpu_count > 0) {
+    listen_options.incoming_cpu = loop_index % cpu_count;
+  }
+  loop.listener.set_options(options_.socket_options);
+  Result res = loop.listener.StartServer(port, listen_options);
+  if (res == Result::kSuccess) {
+    // accept until the queue is empty, without waiting for more
+    res = loop.listener.SetBlocking(false);
+  }
+  if (res == Result::kSuccess) {
+    res = loop.poller.Add(loop.listener.GetHandle(), kListenerToken,
+                          poll_flag::kRead);
+  }
+  return res;
+}
+
+template <typename TVector, typename THeaderData>
+void TcpServer<TVector, THeaderData>::Run(Loop& loop) {
+  PollEvent events[kMaxEvents];
+  while (run_.load(std::memory_order_acquire)) {
+    loop.accepted.PopBatch(loop.accepted.Capacity(),
+                           [this, &loop](Connection&& connection) {
+                             AddClient(loop, std::move(connection));
+                           });
+
+    const int event_count =
+        loop.poller.Wait(events, kMaxEvents, Poller::kInfinite);
+    for (int i = 0; i < event_count; i++) {
+      if (events[i].token == kListenerToken) {
+        AcceptAll(loop);
+        continue;
+      }
+      const auto it = loop.clients.find(events[i].token);
+      if (it == loop.clients.end()) {
+        continue;
+      }
+      Client& client = it->second;
+      // a hang up or error is found by the read
+      if ((events[i].flags & (poll_flag::kRead | poll_flag::kError)) &&
+          !HandleRead(loop, client)) {
+        continue;
+      }
+      if (events[i].flags & poll_flag::kWrite) {
+        Flush(loop, client);
+      }
+    }
+  }
+}
+
+template <typename TVector, typename THeaderData>
+void TcpServer<TVector, THeaderData>::AcceptAll(Loop& loop) {
+  for (auto maybe_connection = loop.listener.Accept();
+       maybe_connection.has_value();
+       maybe_connection = loop.listener.Accept()) {
+    if (options_.reuse_port) {
+      AddClient(loop, std::move(maybe_connection.value()));
+      continue;
+    }
+    Loop& target = *loops_[next_loop_];
+    next_loop_ = (next_loop_ + 1) % static_cast<u32>(loops_.size());
+    if (&target == &loop) {
+      AddClient(loop, std::move(maybe_connection.value()));
+    } else if (target.accepted.Push(std::move(maybe_connection.value())) ==
+               Result::kSuccess) {
+      target.poller.Wake();
+    }
+    // else the loop is far behind, and the client is closed as it goes out
+    // of scope
+  }
+}
+
+template <typename TVector, typename THeaderData>
+void TcpServer<TVector, THeaderData>::AddClient(Loop& loop,
+                                                Connection&& connection) {
+  // reads and writes never wait, so one slow client can not stall the loop
+  if (connection.SetBlocking(false) != Result::kSuccess) {
+    return;
+  }
+  connection.set_recv_buffer_size(options_.recv_buffer_size);
+  const ClientId id = loop.next_id;
+  loop.next_id += loops_.size();
+  if (loop.poller.Add(connection.GetHandle(), id, poll_flag::kRead) !=
+      Result::kSuccess) {
+    return;
+  }
+  Client& client =
+      loop.clients
+          .emplace(id, Client{std::move(connection), id,
+                              options_.max_pending_write_bytes})
+          .first->second;
+  loop.client_count.fetch_add(1, std::memory_order_relaxed);
+  if (on_connect_) {
+    on_connect_(client);
+  }
+  // send what on_connect wrote, such as a greeting, before the client has
+  // sent anything, and close the client if it was disconnected
+  (void)Flush(loop, client);
+}
+
+template <typename TVector, typename THeaderData>
+bool TcpServer<TVector, THeaderData>::HandleRead(Loop& loop, Client& client) {
+  // read until the socket runs dry, packets left in the connection's
+  // buffer would not wake the poller
+  while (!client.closing_) {
+    auto [res, header_data] = client.connection_.TryRead(loop.payload);
+    if (res == Result::kNeedMoreData) {
+      break;
+    }
+    if (res != Result::kSuccess) {
+      Close(loop, client.id_);
+      return false;
+    }
+    if (on_message_) {
+      on_message_(client, header_data, loop.payload);
+    }
+  }
+  return Flush(loop, client);
+}
+
+template <typename TVector, typename THeaderData>
+bool TcpServer<TVector, THeaderData>::Flush(Loop& loop, Client& client) {
+  const Result res = client.connection_.Flush();
+  if (res == Result::kWouldBlock && !client.closing_) {
+    if (!client.want_write_) {
+      client.want_write_ = true;
+      const Result modified =
+          loop.poller.Modify(client.connection_.GetHandle(), client.id_,
+                             poll_flag::kRead | poll_flag::kWrite);
+      dnet_assert(modified == Result::kSuccess,
+                  "failed to modify socket in poller");
+    }
+    return true;
+  }
+  if (res == Result::kSuccess && !client.closing_) {
+    if (client.want_write_) {
+      client.want_write_ = false;
+      const Result modified = loop.poller.Modify(
+          client.connection_.GetHandle(), client.id_, poll_flag::kRead);
+      dnet_assert(modified == Result::kSuccess,
+                  "failed to modify socket in poller");
+    }
+    return true;
+  }
+  Close(loop, client.id_);
+  return false;
+}
+
+template <typename TVector, typename THeaderData>
+void TcpServer<TVector, THeaderData>::Close(Loop& loop, const ClientId id) {
+  const auto it = loop.clients.find(id);
+  if (it == loop.clients.end()) {
+    return;
+  }
+  Client& client = it->second;
+  const Result res = loop.poller.Remove(client.connection_.GetHandle());
+  dnet_assert(res == Result::kSuccess, "failed to remove socket from poller");
+  if (on_disconnect_) {
+    on_disconnect_(client);
+  }
+  client.connection_.Disconnect();
+  loop.clients.erase(it);
+  loop.client_count.fetch_sub(1, std::memory_order_relaxed);
+}
+
+}  // namespace dnet
+
+#endif  // TCP_SERVER_HPP_
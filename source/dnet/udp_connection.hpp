@@ -25,10 +25,20 @@
 #ifndef UDP_CONNECTION_HPP_
 #define UDP_CONNECTION_HPP_
 
+#include <dnet/net/channel.hpp>
+#include <dnet/net/congestion.hpp>
+#include <dnet/net/control.hpp>
+#include <dnet/net/endpoint.hpp>
+#include <dnet/net/fragment.hpp>
+#include <dnet/net/reliability.hpp>
 #include <dnet/net/udp.hpp>
 #include <dnet/util/dnet_assert.hpp>
 #include <dnet/util/result.hpp>
 #include <dnet/util/types.hpp>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <memory>
 #include <optional>
 #include <string>
 #include <tuple>
@@ -37,39 +47,141 @@
 
 namespace dnet {
 
-/**
- * Header, to be placed in front of each payload.
- */
-struct UdpHeader {
-  u32 id;
-  u32 acked_id;
-  u32 acked_bitmask;
-};
+template <typename TVector, typename TCongestionControl>
+class UdpConnection;
+
+template <typename TVector, typename TCongestionControl>
+class UdpServer;
 
 /**
- * A buffer that keeps sizeof(UdpHeader) bytes of room in the front.
+ * A buffer that keeps sizeof(UdpHeader) bytes of room in the front. The
+ * UdpConnection writes the header there, and sends header and payload as
+ * one contiguous datagram. Received datagrams are read in whole, and the
+ * payload is the part after the header, so it is never moved.
+ *
+ * The storage only grows, so reading many datagrams into the same buffer
+ * does not allocate, or clear memory.
  * @tparam TVector A std::vector<u8> like container type.
  */
 template <typename TVector>
 class UdpBuffer {
  public:
-  UdpBuffer() = default;
+  static constexpr size_t kHeadroom = sizeof(UdpHeader);
+
+  UdpBuffer() : vector_(kHeadroom) {}
+
+  explicit UdpBuffer(const size_t payload_size)
+      : vector_(kHeadroom + payload_size), size_(payload_size) {}
+
+  UdpBuffer(const u8* payload, const size_t payload_size)
+      : UdpBuffer(payload_size) {
+    std::memcpy(data(), payload, payload_size);
+  }
+
   ~UdpBuffer() = default;
 
+  // ============================================================ //
+  // Payload
+  // ============================================================ //
+
+  u8* data() { return reinterpret_cast<u8*>(vector_.data()) + kHeadroom; }
+
+  const u8* data() const {
+    return reinterpret_cast<const u8*>(vector_.data()) + kHeadroom;
+  }
+
+  size_t size() const { return size_; }
+
+  bool empty() const { return size_ == 0; }
+
+  /**
+   * New bytes are uninitialized if they fit in the current storage.
+   */
+  void resize(const size_t payload_size) {
+    Grow(payload_size);
+    size_ = payload_size;
+  }
+
+  void reserve(const size_t payload_size) { Grow(payload_size); }
+
+  size_t capacity() const { return vector_.size() - kHeadroom; }
+
+  u8* begin() { return data(); }
+  u8* end() { return data() + size_; }
+  const u8* begin() const { return data(); }
+  const u8* end() const { return data() + size_; }
+
  private:
-  TVector vector_{};
+  template <typename, typename>
+  friend class UdpConnection;
+  template <typename, typename>
+  friend class UdpServer;
+
+  void Grow(const size_t payload_size) {
+    if (vector_.size() < kHeadroom + payload_size) {
+      vector_.resize(kHeadroom + payload_size);
+    }
+  }
+
+  u8* datagram() { return reinterpret_cast<u8*>(vector_.data()); }
+
+  size_t datagram_size() const { return kHeadroom + size_; }
+
+  // the header and payload, vector_.size() is the capacity
+  TVector vector_;
+  size_t size_ = 0;
 };
 
 /**
+ * Sends packets over udp with a UdpHeader in front, and keeps track of
+ * which have been delivered, see Reliability. Nothing is resent, the
+ * delivery callbacks let the user decide what to do about lost packets.
+ *
+ * Writes are held back by a congestion window, and spread out by a Pacer
+ * at the rate the congestion control asks for.
+ *
+ * WriteMessage sends a message of any size reliably, split in fragments
+ * that fit in a datagram. Only the fragments reported lost are resent.
+ * Send does the same on a channel from AddChannel, which may also be
+ * ordered, or unreliable and sequenced, see ChannelType. All channels
+ * share the socket, the acks and the congestion window.
+ *
+ * A connection started as a server talks to the first peer that sends
+ * to it, and drops datagrams from anyone else. For many peers on one
+ * port, see UdpServer. Handshake connects to either of them.
+ *
  * @tparam TVector Same TVector as in UdpBuffer, see it for more info.
+ * @tparam TCongestionControl Policy deciding how much may be in flight,
+ * see congestion.hpp.
  */
-template <typename TVector>
+template <typename TVector, typename TCongestionControl = NewReno>
 class UdpConnection {
   // ============================================================ //
   // Lifetime
   // ============================================================ //
 
  public:
+  using DeliveryCallback = Reliability::DeliveryCallback;
+  using MessageCallback = OutgoingMessages::DeliveryCallback;
+
+  // keeps clear of ip fragmentation on common paths
+  static constexpr size_t kDefaultMaxDatagramSize = 1200;
+
+  // reliable and unordered, used by WriteMessage, and what Read reports
+  // for datagrams from Write
+  static constexpr u8 kDefaultChannel = 0;
+  static constexpr size_t kMaxChannels = 256;
+
+  static constexpr auto kHandshakeInterval = std::chrono::milliseconds(100);
+  static constexpr u32 kMaxHandshakeAttempts = 50;
+  // once connected, an empty packet is sent if nothing else was, so the
+  // server does not time out the connection
+  static constexpr auto kKeepAliveInterval = std::chrono::seconds(1);
+  // acks ride on outgoing packets, if none is sent this long after a
+  // packet with payload arrived, an empty one is sent to carry them. The
+  // retransmit deadlines wait this long for the acks of the peer
+  static constexpr auto kAckDelay = std::chrono::milliseconds(5);
+
   UdpConnection();
   explicit UdpConnection(Udp&& transport);
 
@@ -88,28 +200,114 @@ class UdpConnection {
 
   Result Connect(const std::string& address, u16 port);
 
+  /**
+   * Ask the server connected to, to let us in. The request is sent again
+   * from Update, until accepted, see state, or kMaxHandshakeAttempts.
+   * Needed to talk to a UdpServer, which drops packets from unknown peers.
+   * A challenge from the server is answered right away, see
+   * HandshakeCookies.
+   */
+  Result Handshake();
+
+  /**
+   * Tells the server we are leaving, if the Handshake was made.
+   */
   void Disconnect();
 
   /**
-   * Read incoming packet and put in @buffer_out.
+   * Progress of the Handshake. Servers are always kConnected once a peer
+   * has sent to them.
    */
-  Result Read(UdpBuffer<TVector>& buffer_out) const;
+  ConnectionState state() const { return state_; }
 
   /**
-   * Prepare the header, then copy over the buffer to kernel memory to
-   * be sent of to remote.
+   * Read incoming packet, or message, and put in @buffer_out.
+   * @return kNeedMoreData if a datagram was read, but there is nothing to
+   * hand out. It was a fragment of a message not yet complete, a
+   * duplicate, or a packet too old to track.
    */
-  Result Write(UdpBuffer<TVector>& buffer) const;
+  Result Read(UdpBuffer<TVector>& buffer_out);
 
   /**
-   * @return Any error occured while attempting to check, will return false.
+   * Same as Read, and tell which channel it came in on.
+   */
+  Result Read(UdpBuffer<TVector>& buffer_out, u8& channel_out);
+
+  /**
+   * Prepare the header in the headroom of @buffer, then copy over the
+   * buffer to kernel memory to be sent of to remote.
+   * @param on_delivery Optional, called with the packet id once it is known
+   * whether the packet was delivered, from within a later Read or Update.
+   * @return kWouldBlock if the congestion window is full, or the pacer
+   * wants to wait, see TimeUntilWrite. Nothing is sent then. An empty
+   * buffer, sent only to carry acks, is never held back. kFail on a
+   * server no peer has sent to yet.
+   */
+  Result Write(UdpBuffer<TVector>& buffer, DeliveryCallback on_delivery = {});
+
+  /**
+   * Send @size bytes of @data reliably, as fragments of at most
+   * max_datagram_size. Fragments that cannot be sent yet, and lost
+   * fragments, are sent from Update.
+   * @param on_delivery Optional, called with the message id once every
+   * fragment is acked.
+   * @return kWouldBlock if OutgoingMessages::kMaxMessages messages are in
+   * flight, kFail if the message is larger than kMaxMessageSize.
+   */
+  Result WriteMessage(const u8* data, size_t size,
+                      MessageCallback on_delivery = {});
+
+  /**
+   * Add a channel. Both ends must add the same channels, in the same order.
+   * @return Id of the channel, to Send on.
    */
-  bool CanRead() const;
+  u8 AddChannel(ChannelType type);
+
+  /**
+   * Send @size bytes of @data on @channel. Reliable channels work as
+   * WriteMessage, each with its own window of messages, so a loss on one
+   * does not hold back the others. An unreliable channel sends the data
+   * right away, in one datagram.
+   * @param on_delivery Optional, called with the message id, or sequence
+   * number, once acked.
+   * @return kWouldBlock if the window of the channel is full, or for an
+   * unreliable channel, as Write. kFail if the data is too large, or as
+   * Write.
+   */
+  Result Send(u8 channel, const u8* data, size_t size,
+              MessageCallback on_delivery = {});
+
+  /**
+   * Report packets that were not acked before their retransmit deadline
+   * as lost, through their delivery callbacks, send the message fragments
+   * waiting to be sent, and drive the Handshake. Acks still waiting for
+   * an outgoing packet after kAckDelay are sent in an empty one, so a
+   * peer that only sends is not stalled. Call regularly.
+   */
+  void Update();
+
+  /**
+   * @return How long until the pacer lets @payload_size bytes through.
+   * The congestion window may still be full, it opens as acks arrive.
+   */
+  Pacer::Duration TimeUntilWrite(size_t payload_size) const {
+    return pacer_.TimeUntilSend(UdpBuffer<TVector>::kHeadroom + payload_size,
+                                Pacer::Clock::now());
+  }
+
+  /**
+   * @return True if a datagram is waiting, or an ordered channel holds a
+   * message ready to Read. Any error occured while attempting to check,
+   * will return false.
+   */
+  bool CanRead() const {
+    return HasHeldBackMessage() || socket().CanRead();
+  }
 
   /**
    * @return Any error occured while attempting to check, will return false.
    */
-  bool CanWrite() const;
+  bool CanWrite() const { return socket().CanWrite(); }
 
   // ============================================================ //
   // Server
@@ -127,7 +325,7 @@ class UdpConnection {
   /**
    * @return Any error occured while attempting to check, will return false.
    */
-  bool HasError() const;
+  bool HasError() const { return transport_.HasError(); }
 
   std::optional<std::string> GetIp() const { return transport_.GetIp(); }
 
@@ -149,68 +347,689 @@ class UdpConnection {
     return transport_.SetBlocking(blocking);
   }
 
+  /**
+   * Sequence numbers, delivery statistics, and round trip time estimates.
+   */
+  const Reliability& reliability() const { return reliability_; }
+
+  const TCongestionControl& congestion_control() const {
+    return congestion_control_;
+  }
+
+  /**
+   * @param size Largest datagram WriteMessage sends, headers included.
+   */
+  void set_max_datagram_size(const size_t size) {
+    dnet_assert(size > sizeof(UdpHeader) + sizeof(FragmentHeader),
+                "No room for a fragment in the datagram");
+    max_datagram_size_ = size;
+  }
+
+  size_t max_datagram_size() const { return max_datagram_size_; }
+
+  u64 fragments_resent() const {
+    u64 resent = 0;
+    for (const Channel& channel : channels_) {
+      resent += channel.outgoing->fragments_resent();
+    }
+    return resent;
+  }
+
   // ============================================================ //
   // Data
   // ============================================================ //
 
  private:
+  template <typename, typename>
+  friend class UdpServer;
+
+  static constexpr size_t kMaxDatagramSize = std::numeric_limits<u16>::max();
+
+  struct Channel {
+    ChannelType type = ChannelType::kReliableUnordered;
+    // the delivery callbacks of fragments point to it, so it must not move
+    std::unique_ptr<OutgoingMessages> outgoing =
+        std::make_unique<OutgoingMessages>();
+    ReassemblyTable reassembly{};
+    ReorderBuffer reorder{};
+    u32 next_sequence = 0;
+    // newest sequence number received, if any
+    std::optional<u32> last_sequence{};
+  };
+
+  /**
+   * A peer of a UdpServer, sending on its socket.
+   */
+  UdpConnection(Udp* shared_socket, const Endpoint& peer);
+
+  /**
+   * Back to the state of a new connection.
+   */
+  void Reset();
+
+  /**
+   * Our own socket, or the one shared with the UdpServer.
+   */
+  Udp& socket() {
+    return shared_socket_ != nullptr ? *shared_socket_ : transport_;
+  }
+
+  const Udp& socket() const {
+    return shared_socket_ != nullptr ? *shared_socket_ : transport_;
+  }
+
+  /**
+   * Read a whole datagram, header included, into @buffer_out.
+   * @return Size of the datagram.
+   */
+  static std::optional<size_t> ReadDatagram(Udp& socket,
+                                            UdpBuffer<TVector>& buffer_out,
+                                            Endpoint& from);
+
+  /**
+   * Handle the datagram of @bytes bytes in @buffer_out, from our peer.
+   */
+  Result Process(UdpBuffer<TVector>& buffer_out, size_t bytes,
+                 u8& channel_out);
+
+  /**
+   * Put a message held back by an ordered channel in @buffer_out.
+   * @return kNeedMoreData if there is none.
+   */
+  Result ReadHeldBack(UdpBuffer<TVector>& buffer_out, u8& channel_out);
+
+  void HandleControl(const ControlMessage& message);
+
+  Result SendControl(ControlType type, u64 cookie = 0);
+
+  Result WriteDatagram(UdpBuffer<TVector>& buffer, u32 flags,
+                       DeliveryCallback on_delivery);
+
+  /**
+   * Send message fragments until there are none left, or sending would
+   * block. The channels take turns, one fragment each.
+   */
+  Result SendFragments();
+
+  /**
+   * @return kNeedMoreData if @channel has no fragment to send.
+   */
+  Result SendFragment(u8 channel);
+
+  Result ReadFragment(Channel& channel, UdpBuffer<TVector>& buffer_out);
+
+  Result ReadSequenced(Channel& channel, UdpBuffer<TVector>& buffer_out);
+
+  /**
+   * @return True if an ordered channel holds a message that arrived ahead
+   * of one since received.
+   */
+  bool HasHeldBackMessage() const;
+
+  /**
+   * Tell the congestion control about bytes delivered or lost since the
+   * last call.
+   */
+  void ReportCongestion(Reliability::TimePoint now);
+
   Udp transport_;
+  Reliability reliability_{};
+  TCongestionControl congestion_control_{};
+  Pacer pacer_{};
+  u64 reported_delivered_ = 0;
+  u64 reported_lost_ = 0;
+  // indexed by channel id, starting with kDefaultChannel
+  std::vector<Channel> channels_ = std::vector<Channel>(1);
+  UdpBuffer<TVector> send_buffer_{};
+  size_t max_datagram_size_ = kDefaultMaxDatagramSize;
+  // where a server sends to, empty when connected
+  Endpoint peer_{};
+  bool is_server_ = false;
+  // owned by the UdpServer, when a peer of it
+  Udp* shared_socket_ = nullptr;
+  ConnectionState state_ = ConnectionState::kDisconnected;
+  Reliability::TimePoint last_handshake_{};
+  u32 handshake_attempts_ = 0;
+  // from the kChallenge of the server, sent in the kConnect
+  u64 cookie_ = 0;
+  Reliability::TimePoint last_write_{};
+  // a packet with payload was received, and not acked by a write since
+  bool ack_pending_ = false;
+  Reliability::TimePoint ack_pending_since_{};
 };
 
 // ============================================================ //
 // template definition
 // ============================================================ //
 
-template <typename TVector>
-UdpConnection<TVector>::UdpConnection() : transport_() {}
+template <typename TVector, typename TCongestionControl>
+UdpConnection<TVector, TCongestionControl>::UdpConnection() : transport_() {
+  reliability_.set_max_ack_delay(kAckDelay);
+}
 
-template <typename TVector>
-UdpConnection<TVector>::UdpConnection(Udp&& transport)
-    : transport_(std::forward<Udp>(transport)) {}
+template <typename TVector, typename TCongestionControl>
+UdpConnection<TVector, TCongestionControl>::UdpConnection(Udp&& transport)
+    : transport_(std::forward<Udp>(transport)) {
+  reliability_.set_max_ack_delay(kAckDelay);
+}
 
-template <typename TVector>
-UdpConnection<TVector>::UdpConnection(UdpConnection&& other) noexcept
-    : transport_(std::move(other)) {}
+template <typename TVector, typename TCongestionControl>
+UdpConnection<TVector, TCongestionControl>::UdpConnection(
+    Udp* shared_socket, const Endpoint& peer)
+    : transport_(),
+      peer_(peer),
+      is_server_(true),
+      shared_socket_(shared_socket),
+      state_(ConnectionState::kConnected) {
+  reliability_.set_max_ack_delay(kAckDelay);
+}
 
-template <typename TVector>
-UdpConnection<TVector>& UdpConnection<TVector>::operator=(
+template <typename TVector, typename TCongestionControl>
+UdpConnection<TVector, TCongestionControl>::UdpConnection(
+    UdpConnection&& other) noexcept
+    : transport_(std::move(other.transport_)),
+      reliability_(std::move(other.reliability_)),
+      congestion_control_(std::move(other.congestion_control_)),
+      pacer_(other.pacer_),
+      reported_delivered_(other.reported_delivered_),
+      reported_lost_(other.reported_lost_),
+      channels_(std::move(other.channels_)),
+      send_buffer_(std::move(other.send_buffer_)),
+      max_datagram_size_(other.max_datagram_size_),
+      peer_(other.peer_),
+      is_server_(other.is_server_),
+      shared_socket_(other.shared_socket_),
+      state_(other.state_),
+      last_handshake_(other.last_handshake_),
+      handshake_attempts_(other.handshake_attempts_),
+      cookie_(other.cookie_),
+      last_write_(other.last_write_),
+      ack_pending_(other.ack_pending_),
+      ack_pending_since_(other.ack_pending_since_) {}
+
+template <typename TVector, typename TCongestionControl>
+UdpConnection<TVector, TCongestionControl>&
+UdpConnection<TVector, TCongestionControl>::operator=(
     UdpConnection&& other) noexcept {
   if (this != &other) {
     transport_ = std::move(other.transport_);
+    reliability_ = std::move(other.reliability_);
+    congestion_control_ = std::move(other.congestion_control_);
+    pacer_ = other.pacer_;
+    reported_delivered_ = other.reported_delivered_;
+    reported_lost_ = other.reported_lost_;
+    channels_ = std::move(other.channels_);
+    send_buffer_ = std::move(other.send_buffer_);
+    max_datagram_size_ = other.max_datagram_size_;
+    peer_ = other.peer_;
+    is_server_ = other.is_server_;
+    shared_socket_ = other.shared_socket_;
+    state_ = other.state_;
+    last_handshake_ = other.last_handshake_;
+    handshake_attempts_ = other.handshake_attempts_;
+    cookie_ = other.cookie_;
+    last_write_ = other.last_write_;
+    ack_pending_ = other.ack_pending_;
+    ack_pending_since_ = other.ack_pending_since_;
   }
   return *this;
 }
 
-template <typename TVector>
-Result UdpConnection<TVector>::Connect(const std::string& address,
-                                       u16 port) {
+template <typename TVector, typename TCongestionControl>
+Result UdpConnection<TVector, TCongestionControl>::Connect(
+    const std::string& address, u16 port) {
+  Reset();
+  is_server_ = false;
   return transport_.Connect(address, port);
 }
 
-template <typename TVector>
-void UdpConnection<TVector>::Disconnect() {
+template <typename TVector, typename TCongestionControl>
+Result UdpConnection<TVector, TCongestionControl>::Handshake() {
+  dnet_assert(!is_server_, "Handshake is made by the client");
+  state_ = ConnectionState::kConnecting;
+  last_handshake_ = Reliability::Clock::now();
+  handshake_attempts_ = 1;
+  cookie_ = 0;
+  return SendControl(ControlType::kConnect);
+}
+
+template <typename TVector, typename TCongestionControl>
+void UdpConnection<TVector, TCongestionControl>::Disconnect() {
+  if (!is_server_ && state_ != ConnectionState::kDisconnected) {
+    // best effort, else the server times us out
+    (void)SendControl(ControlType::kDisconnect);
+  }
   transport_.Disconnect();
+  Reset();
 }
 
-template <typename TVector>
-Result UdpConnection<TVector>::Read(UdpBuffer<TVector>& buffer_out) const {
-  // TODO
-  buffer_out.resize(buffer_out.capacity());
-  const auto res = transport_.Read(reinterpret_cast<u8*>(buffer_out.data()),
-                                   buffer_out.size());
-  if (res.has_value()) {
-    buffer_out.resize(res.value());
+template <typename TVector, typename TCongestionControl>
+Result UdpConnection<TVector, TCongestionControl>::Read(
+    UdpBuffer<TVector>& buffer_out) {
+  u8 channel = kDefaultChannel;
+  return Read(buffer_out, channel);
+}
+
+template <typename TVector, typename TCongestionControl>
+Result UdpConnection<TVector, TCongestionControl>::Read(
+    UdpBuffer<TVector>& buffer_out, u8& channel_out) {
+  if (ReadHeldBack(buffer_out, channel_out) == Result::kSuccess) {
+    return Result::kSuccess;
+  }
+
+  Endpoint from{};
+  const auto maybe_bytes = ReadDatagram(transport_, buffer_out, from);
+  if (!maybe_bytes.has_value()) {
+    return Result::kFail;
+  }
+  if (is_server_) {
+    if (peer_.IsEmpty()) {
+      peer_ = from;
+      state_ = ConnectionState::kConnected;
+    } else if (from != peer_) {
+      return Result::kNeedMoreData;
+    }
+  }
+  return Process(buffer_out, maybe_bytes.value(), channel_out);
+}
+
+template <typename TVector, typename TCongestionControl>
+std::optional<size_t> UdpConnection<TVector, TCongestionControl>::ReadDatagram(
+    Udp& socket, UdpBuffer<TVector>& buffer_out, Endpoint& from) {
+  buffer_out.reserve(kMaxDatagramSize);
+  const auto maybe_bytes = socket.ReadFrom(
+      buffer_out.datagram(), UdpBuffer<TVector>::kHeadroom + kMaxDatagramSize,
+      from);
+  if (!maybe_bytes.has_value()) {
+    return std::nullopt;
+  }
+  return static_cast<size_t>(maybe_bytes.value());
+}
+
+template <typename TVector, typename TCongestionControl>
+Result UdpConnection<TVector, TCongestionControl>::ReadHeldBack(
+    UdpBuffer<TVector>& buffer_out, u8& channel_out) {
+  for (size_t i = 0; i < channels_.size(); i++) {
+    const std::vector<u8>* message = channels_[i].reorder.Pop();
+    if (message != nullptr) {
+      buffer_out.resize(message->size());
+      std::memcpy(buffer_out.data(), message->data(), message->size());
+      channel_out = static_cast<u8>(i);
+      return Result::kSuccess;
+    }
+  }
+  return Result::kNeedMoreData;
+}
+
+template <typename TVector, typename TCongestionControl>
+Result UdpConnection<TVector, TCongestionControl>::Process(
+    UdpBuffer<TVector>& buffer_out, const size_t bytes, u8& channel_out) {
+  if (bytes < sizeof(UdpHeader)) {
+    return Result::kNeedMoreData;
+  }
+  const auto control = ParseControlPacket(buffer_out.datagram(), bytes);
+  if (control.has_value()) {
+    HandleControl(control.value());
+    return Result::kNeedMoreData;
+  }
+
+  UdpHeader header{};
+  std::memcpy(&header, buffer_out.datagram(), sizeof(UdpHeader));
+  const auto now = Reliability::Clock::now();
+  const bool is_new = reliability_.ProcessHeader(header, now);
+  ReportCongestion(now);
+  if (!is_new) {
+    return Result::kNeedMoreData;
+  }
+  buffer_out.size_ = bytes - sizeof(UdpHeader);
+  // empty packets only carry acks, acking them would never end
+  if (!buffer_out.empty() && !ack_pending_) {
+    ack_pending_ = true;
+    ack_pending_since_ = now;
+  }
+  const u32 channel = (header.flags & kUdpChannelMask) >> kUdpChannelShift;
+  if (channel >= channels_.size()) {
+    return Result::kNeedMoreData;
+  }
+  channel_out = static_cast<u8>(channel);
+  if ((header.flags & kUdpSequenced) != 0) {
+    return ReadSequenced(channels_[channel], buffer_out);
+  }
+  if ((header.flags & kUdpFragment) != 0) {
+    return ReadFragment(channels_[channel], buffer_out);
+  }
+  return Result::kSuccess;
+}
+
+template <typename TVector, typename TCongestionControl>
+Result UdpConnection<TVector, TCongestionControl>::ReadFragment(
+    Channel& channel, UdpBuffer<TVector>& buffer_out) {
+  if (buffer_out.size() < sizeof(FragmentHeader)) {
+    return Result::kNeedMoreData;
+  }
+  FragmentHeader fragment{};
+  std::memcpy(&fragment, buffer_out.data(), sizeof(FragmentHeader));
+  const std::vector<u8>* message = channel.reassembly.Insert(
+      fragment, buffer_out.data() + sizeof(FragmentHeader),
+      buffer_out.size() - sizeof(FragmentHeader));
+  if (message != nullptr && channel.type == ChannelType::kReliableOrdered) {
+    channel.reorder.Insert(fragment.message_id, *message);
+    message = channel.reorder.Pop();
+  }
+  if (message == nullptr) {
+    return Result::kNeedMoreData;
+  }
+  buffer_out.resize(message->size());
+  std::memcpy(buffer_out.data(), message->data(), message->size());
+  return Result::kSuccess;
+}
+
+template <typename TVector, typename TCongestionControl>
+Result UdpConnection<TVector, TCongestionControl>::ReadSequenced(
+    Channel& channel, UdpBuffer<TVector>& buffer_out) {
+  u32 sequence = 0;
+  if (buffer_out.size() < sizeof(sequence)) {
+    return Result::kNeedMoreData;
+  }
+  std::memcpy(&sequence, buffer_out.data(), sizeof(sequence));
+  if (channel.last_sequence.has_value() &&
+      !SequenceGreaterThan(sequence, channel.last_sequence.value())) {
+    return Result::kNeedMoreData;
+  }
+  channel.last_sequence = sequence;
+  const size_t size = buffer_out.size() - sizeof(sequence);
+  std::memmove(buffer_out.data(), buffer_out.data() + sizeof(sequence), size);
+  buffer_out.size_ = size;
+  return Result::kSuccess;
+}
+
+template <typename TVector, typename TCongestionControl>
+Result UdpConnection<TVector, TCongestionControl>::Write(
+    UdpBuffer<TVector>& buffer, DeliveryCallback on_delivery) {
+  return WriteDatagram(buffer, 0, std::move(on_delivery));
+}
+
+template <typename TVector, typename TCongestionControl>
+Result UdpConnection<TVector, TCongestionControl>::WriteMessage(
+    const u8* data, const size_t size, MessageCallback on_delivery) {
+  return Send(kDefaultChannel, data, size, std::move(on_delivery));
+}
+
+template <typename TVector, typename TCongestionControl>
+u8 UdpConnection<TVector, TCongestionControl>::AddChannel(
+    const ChannelType type) {
+  dnet_assert(channels_.size() < kMaxChannels, "Too many channels");
+  channels_.emplace_back();
+  channels_.back().type = type;
+  return static_cast<u8>(channels_.size() - 1);
+}
+
+template <typename TVector, typename TCongestionControl>
+Result UdpConnection<TVector, TCongestionControl>::Send(
+    const u8 channel, const u8* data, const size_t size,
+    MessageCallback on_delivery) {
+  dnet_assert(channel < channels_.size(), "No such channel");
+  if (is_server_ && peer_.IsEmpty()) {
+    // else the fragments would be dropped, and never reported lost
+    return Result::kFail;
+  }
+  Channel& target = channels_[channel];
+  const u32 channel_flags = static_cast<u32>(channel) << kUdpChannelShift;
+
+  if (target.type == ChannelType::kUnreliableSequenced) {
+    const u32 sequence = target.next_sequence;
+    if (sizeof(UdpHeader) + sizeof(sequence) + size > max_datagram_size_) {
+      return Result::kFail;
+    }
+    send_buffer_.resize(sizeof(sequence) + size);
+    std::memcpy(send_buffer_.data(), &sequence, sizeof(sequence));
+    std::memcpy(send_buffer_.data() + sizeof(sequence), data, size);
+    DeliveryCallback on_ack{};
+    if (on_delivery) {
+      on_ack = [on_delivery = std::move(on_delivery), sequence](
+                   u32, const bool delivered) {
+        if (delivered) {
+          on_delivery(sequence);
+        }
+      };
+    }
+    const Result res = WriteDatagram(
+        send_buffer_, kUdpSequenced | channel_flags, std::move(on_ack));
+    if (res == Result::kSuccess) {
+      ++target.next_sequence;
+    }
+    return res;
+  }
+
+  const size_t max_fragment_size =
+      max_datagram_size_ - sizeof(UdpHeader) - sizeof(FragmentHeader);
+  if (size > kMaxMessageSize ||
+      FragmentCount(size, max_fragment_size) > kMaxFragments) {
+    return Result::kFail;
+  }
+  if (!target.outgoing
+           ->Add(data, size, max_fragment_size, std::move(on_delivery))
+           .has_value()) {
+    return Result::kWouldBlock;
+  }
+  const Result res = SendFragments();
+  return res == Result::kFail ? Result::kFail : Result::kSuccess;
+}
+
+template <typename TVector, typename TCongestionControl>
+Result UdpConnection<TVector, TCongestionControl>::WriteDatagram(
+    UdpBuffer<TVector>& buffer, const u32 flags,
+    DeliveryCallback on_delivery) {
+  if (is_server_ && peer_.IsEmpty()) {
+    // no peer has sent to us yet, so there is no one to write to
+    return Result::kFail;
+  }
+  const auto now = Reliability::Clock::now();
+  const size_t bytes = buffer.datagram_size();
+  // as pure acks in tcp, a packet without payload is only there to carry
+  // acks, so it is not held back, and not counted as in flight
+  const size_t counted_bytes = buffer.empty() ? 0 : bytes;
+  if (counted_bytes > 0) {
+    if (!congestion_control_.CanSend(reliability_.bytes_in_flight())) {
+      return Result::kWouldBlock;
+    }
+    pacer_.set_rate(congestion_control_.PacingRate(reliability_.srtt()));
+    if (!pacer_.TrySend(bytes, now)) {
+      return Result::kWouldBlock;
+    }
+    congestion_control_.OnPacketSent(bytes, now);
+  }
+
+  // the peer does not ack a packet without payload, unless someone waits
+  // for its delivery, tracking it would only time out
+  UdpHeader header =
+      counted_bytes > 0 || on_delivery
+          ? reliability_.PrepareHeader(std::move(on_delivery), now,
+                                       counted_bytes)
+          : reliability_.PrepareAckHeader();
+  header.flags = flags;
+  std::memcpy(buffer.datagram(), &header, sizeof(UdpHeader));
+  last_write_ = now;
+  ack_pending_ = false;
+  const auto maybe_bytes =
+      is_server_ ? socket().WriteTo(buffer.datagram(), bytes, peer_)
+                 : socket().Write(buffer.datagram(), bytes);
+  return maybe_bytes.has_value() ? Result::kSuccess : Result::kFail;
+}
+
+template <typename TVector, typename TCongestionControl>
+void UdpConnection<TVector, TCongestionControl>::HandleControl(
+    const ControlMessage& message) {
+  switch (message.type) {
+    case ControlType::kConnect:
+      if (is_server_) {
+        (void)SendControl(ControlType::kAccept);
+      }
+      break;
+    case ControlType::kChallenge:
+      if (state_ == ConnectionState::kConnecting && message.cookie != 0) {
+        cookie_ = message.cookie;
+        last_handshake_ = Reliability::Clock::now();
+        (void)SendControl(ControlType::kConnect, cookie_);
+      }
+      break;
+    case ControlType::kAccept:
+      if (state_ == ConnectionState::kConnecting) {
+        state_ = ConnectionState::kConnected;
+      }
+      break;
+    case ControlType::kDisconnect:
+      if (is_server_) {
+        // free to talk to the next peer that comes along
+        Reset();
+      } else {
+        state_ = ConnectionState::kDisconnected;
+      }
+      break;
+  }
+}
+
+template <typename TVector, typename TCongestionControl>
+Result UdpConnection<TVector, TCongestionControl>::SendControl(
+    const ControlType type, const u64 cookie) {
+  const ControlPacket packet = MakeControlPacket(type, cookie);
+  const auto maybe_bytes =
+      is_server_ ? socket().WriteTo(packet.data(), packet.size(), peer_)
+                 : socket().Write(packet.data(), packet.size());
+  return maybe_bytes.has_value() ? Result::kSuccess : Result::kFail;
+}
+
+template <typename TVector, typename TCongestionControl>
+Result UdpConnection<TVector, TCongestionControl>::SendFragments() {
+  for (bool sent = true; sent;) {
+    sent = false;
+    for (size_t i = 0; i < channels_.size(); i++) {
+      const Result res = SendFragment(static_cast<u8>(i));
+      if (res == Result::kWouldBlock || res == Result::kFail) {
+        return res;
+      }
+      sent = sent || res == Result::kSuccess;
+    }
+  }
+  return Result::kSuccess;
+}
+
+template <typename TVector, typename TCongestionControl>
+Result UdpConnection<TVector, TCongestionControl>::SendFragment(
+    const u8 channel) {
+  OutgoingMessages* outgoing = channels_[channel].outgoing.get();
+  FragmentHeader header{};
+  const u8* data = nullptr;
+  size_t size = 0;
+  if (!outgoing->PeekNext(header, data, size)) {
+    return Result::kNeedMoreData;
+  }
+  send_buffer_.resize(sizeof(FragmentHeader) + size);
+  std::memcpy(send_buffer_.data(), &header, sizeof(FragmentHeader));
+  std::memcpy(send_buffer_.data() + sizeof(FragmentHeader), data, size);
+  const Result res = WriteDatagram(
+      send_buffer_,
+      kUdpFragment | (static_cast<u32>(channel) << kUdpChannelShift),
+      [outgoing, id = header.message_id, index = header.index](
+          u32, const bool delivered) {
+        outgoing->OnFragmentDelivered(id, index, delivered);
+      });
+  if (res != Result::kWouldBlock) {
+    // a failed send is reported lost, and resent, like any other
+    outgoing->PopNext();
   }
   return res;
 }
 
-template <typename TVector>
-Result Write(UdpBuffer<TVector>& buffer);
+template <typename TVector, typename TCongestionControl>
+bool UdpConnection<TVector, TCongestionControl>::HasHeldBackMessage() const {
+  for (const Channel& channel : channels_) {
+    if (channel.reorder.HasNext()) {
+      return true;
+    }
+  }
+  return false;
+}
 
-template <typename TVector>
-Result UdpConnection<TVector>::StartServer(u16 port) {
+template <typename TVector, typename TCongestionControl>
+void UdpConnection<TVector, TCongestionControl>::Update() {
+  const auto now = Reliability::Clock::now();
+  reliability_.Update(now);
+  ReportCongestion(now);
+  (void)SendFragments();
+
+  if (state_ == ConnectionState::kConnecting &&
+      now - last_handshake_ >= kHandshakeInterval) {
+    if (handshake_attempts_ >= kMaxHandshakeAttempts) {
+      state_ = ConnectionState::kDisconnected;
+    } else {
+      last_handshake_ = now;
+      ++handshake_attempts_;
+      (void)SendControl(ControlType::kConnect, cookie_);
+    }
+  } else if (!is_server_ && state_ == ConnectionState::kConnected &&
+             now - last_write_ >= kKeepAliveInterval) {
+    send_buffer_.resize(0);
+    (void)WriteDatagram(send_buffer_, 0, {});
+  }
+
+  if (ack_pending_ && now - ack_pending_since_ >= kAckDelay) {
+    send_buffer_.resize(0);
+    (void)WriteDatagram(send_buffer_, 0, {});
+  }
+}
+
+template <typename TVector, typename TCongestionControl>
+Result UdpConnection<TVector, TCongestionControl>::StartServer(u16 port) {
+  Reset();
+  is_server_ = true;
   return transport_.StartServer(port);
 }
+
+template <typename TVector, typename TCongestionControl>
+void UdpConnection<TVector, TCongestionControl>::Reset() {
+  reliability_.Reset();
+  congestion_control_ = TCongestionControl{};
+  pacer_ = Pacer{};
+  reported_delivered_ = 0;
+  reported_lost_ = 0;
+  if (channels_.empty()) {
+    channels_.resize(1);
+  }
+  // the channels added are kept, only their state is reset
+  for (Channel& channel : channels_) {
+    channel.outgoing->Reset();
+    channel.reassembly.Reset();
+    channel.reorder.Reset();
+    channel.next_sequence = 0;
+    channel.last_sequence.reset();
+  }
+  peer_ = Endpoint{};
+  state_ = ConnectionState::kDisconnected;
+  handshake_attempts_ = 0;
+  cookie_ = 0;
+  ack_pending_ = false;
+}
+
+template <typename TVector, typename TCongestionControl>
+void UdpConnection<TVector, TCongestionControl>::ReportCongestion(
+    const Reliability::TimePoint now) {
+  const u64 delivered = reliability_.bytes_delivered();
+  const u64 lost = reliability_.bytes_lost();
+  // losses first, so acks in the same batch see the reduced window
+  if (lost != reported_lost_) {
+    congestion_control_.OnPacketsLost(
+        static_cast<size_t>(lost - reported_lost_), reliability_.srtt(), now);
+    reported_lost_ = lost;
+  }
+  if (delivered != reported_delivered_) {
+    congestion_control_.OnPacketsAcked(
+        static_cast<size_t>(delivered - reported_delivered_),
+        reliability_.srtt(), now);
+    reported_delivered_ = delivered;
+  }
+}
+
 }  // namespace dnet
 
 #endif  // UDP_CONNECTION_HPP_
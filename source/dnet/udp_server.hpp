@@ -0,0 +1,365 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef UDP_SERVER_HPP_
+#define UDP_SERVER_HPP_
+
+#include <dnet/net/channel.hpp>
+#include <dnet/net/control.hpp>
+#include <dnet/net/endpoint.hpp>
+#include <dnet/net/endpoint_map.hpp>
+#include <dnet/net/udp.hpp>
+#include <dnet/udp_connection.hpp>
+#include <dnet/util/result.hpp>
+#include <dnet/util/types.hpp>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace dnet {
+
+enum class DisconnectReason : u8 {
+  // the peer said so
+  kRequested,
+  // nothing heard from the peer within the idle timeout
+  kTimedOut,
+};
+
+/**
+ * Many UdpConnection peers on one socket. Datagrams are handed to the
+ * connection of the Endpoint they came from, found in an EndpointMap.
+ *
+ * Peers come in through the Handshake of a UdpConnection, and leave by
+ * disconnecting, or by being silent for the idle timeout. A kConnect is
+ * first answered with a challenge, see HandshakeCookies, and the peer
+ * is only added once it sends the cookie back. Datagrams from endpoints
+ * that have not made the handshake are answered with a kDisconnect, and
+ * not given a connection, so they cost no memory.
+ *
+ * Connections hold a pointer to the socket, so the server is not movable.
+ *
+ * @tparam TVector Same TVector as in UdpBuffer, see it for more info.
+ * @tparam TCongestionControl Of each peer, see congestion.hpp.
+ */
+template <typename TVector, typename TCongestionControl = NewReno>
+class UdpServer {
+  // ============================================================ //
+  // Lifetime
+  // ============================================================ //
+
+ public:
+  using Connection = UdpConnection<TVector, TCongestionControl>;
+  using Clock = std::chrono::steady_clock;
+  using ConnectCallback = std::function<void(const Endpoint& peer)>;
+  using DisconnectCallback =
+      std::function<void(const Endpoint& peer, DisconnectReason reason)>;
+
+  static constexpr Clock::duration kDefaultIdleTimeout =
+      std::chrono::seconds(10);
+
+  /**
+   * @param max_peers Handshakes past this many peers are refused.
+   */
+  explicit UdpServer(size_t max_peers = 1024);
+
+  UdpServer(const UdpServer& other) = delete;
+  UdpServer& operator=(const UdpServer& other) = delete;
+  UdpServer(UdpServer&& other) = delete;
+  UdpServer& operator=(UdpServer&& other) = delete;
+
+  ~UdpServer() = default;
+
+  // ============================================================ //
+  // Server
+  // ============================================================ //
+
+  /**
+   * @param options With reuse_port, several servers, each on its own
+   * thread, can serve the same port. The kernel sends all datagrams of a
+   * peer to the same server.
+   */
+  Result Start(u16 port, const ListenOptions& options = ListenOptions{});
+
+  /**
+   * Tell every peer we are leaving, forget them, and close the socket.
+   */
+  void Stop();
+
+  /**
+   * Read one datagram, and hand it to the connection of its peer, see
+   * UdpConnection::Read.
+   * @param peer_out Who sent it.
+   * @param channel_out Which channel it came in on.
+   * @return kNeedMoreData if there is nothing to hand out, such as for
+   * handshake packets, or datagrams from unknown peers.
+   */
+  Result Read(UdpBuffer<TVector>& buffer_out, Endpoint& peer_out,
+              u8& channel_out);
+
+  /**
+   * @return The connection to @peer, to write to, or nullptr if @peer is
+   * not connected. Invalidated when any peer connects or leaves.
+   */
+  Connection* Find(const Endpoint& peer);
+
+  /**
+   * Tell @peer we are leaving, and forget it. The disconnect callback is
+   * not called.
+   */
+  void Disconnect(const Endpoint& peer);
+
+  /**
+   * Update every connection, see UdpConnection::Update, and time out the
+   * peers that have been silent too long. Call regularly.
+   */
+  void Update();
+
+  /**
+   * Add a channel to every peer, see UdpConnection::AddChannel. Do so
+   * before peers connect.
+   */
+  u8 AddChannel(ChannelType type);
+
+  /**
+   * @return True if a datagram is waiting, or a connection holds a message
+   * ready to Read.
+   */
+  bool CanRead() const { return !held_back_.empty() || socket_.CanRead(); }
+
+  // ============================================================ //
+  // Misc
+  // ============================================================ //
+
+  void set_on_connect(ConnectCallback on_connect) {
+    on_connect_ = std::move(on_connect);
+  }
+
+  void set_on_disconnect(DisconnectCallback on_disconnect) {
+    on_disconnect_ = std::move(on_disconnect);
+  }
+
+  void set_idle_timeout(const Clock::duration idle_timeout) {
+    idle_timeout_ = idle_timeout;
+  }
+
+  size_t peer_count() const { return peers_.size(); }
+
+  size_t max_peers() const { return max_peers_; }
+
+  std::optional<u16> GetPort() const { return socket_.GetPort(); }
+
+  // ============================================================ //
+  // Data
+  // ============================================================ //
+
+ private:
+  struct Peer {
+    // on the heap, so the table stays small, and moving entries is cheap
+    std::unique_ptr<Connection> connection{};
+    Clock::time_point last_heard{};
+  };
+
+  void HandleControl(const Endpoint& from, Peer* peer,
+                     const ControlMessage& message, Clock::time_point now);
+
+  void SendControl(const Endpoint& to, ControlType type, u64 cookie = 0);
+
+  Udp socket_{};
+  EndpointMap<Peer> peers_;
+  size_t max_peers_;
+  HandshakeCookies cookies_{};
+  Clock::duration idle_timeout_ = kDefaultIdleTimeout;
+  std::vector<ChannelType> channels_{};
+  // peers with a message held back by an ordered channel
+  std::vector<Endpoint> held_back_{};
+  std::vector<Endpoint> timed_out_{};
+  ConnectCallback on_connect_{};
+  DisconnectCallback on_disconnect_{};
+};
+
+// ============================================================ //
+// template definition
+// ============================================================ //
+
+template <typename TVector, typename TCongestionControl>
+UdpServer<TVector, TCongestionControl>::UdpServer(const size_t max_peers)
+    : peers_(max_peers), max_peers_(max_peers) {}
+
+template <typename TVector, typename TCongestionControl>
+Result UdpServer<TVector, TCongestionControl>::Start(
+    const u16 port, const ListenOptions& options) {
+  return socket_.StartServer(port, options);
+}
+
+template <typename TVector, typename TCongestionControl>
+void UdpServer<TVector, TCongestionControl>::Stop() {
+  peers_.ForEach([this](const Endpoint& peer, Peer&) {
+    SendControl(peer, ControlType::kDisconnect);
+  });
+  peers_.Clear();
+  held_back_.clear();
+  socket_.Disconnect();
+}
+
+template <typename TVector, typename TCongestionControl>
+Result UdpServer<TVector, TCongestionControl>::Read(
+    UdpBuffer<TVector>& buffer_out, Endpoint& peer_out, u8& channel_out) {
+  while (!held_back_.empty()) {
+    peer_out = held_back_.back();
+    Peer* peer = peers_.Find(peer_out);
+    if (peer != nullptr && peer->connection->ReadHeldBack(
+                               buffer_out, channel_out) == Result::kSuccess) {
+      if (!peer->connection->HasHeldBackMessage()) {
+        held_back_.pop_back();
+      }
+      return Result::kSuccess;
+    }
+    held_back_.pop_back();
+  }
+
+  const auto maybe_bytes =
+      Connection::ReadDatagram(socket_, buffer_out, peer_out);
+  if (!maybe_bytes.has_value()) {
+    return Result::kFail;
+  }
+  const size_t bytes = maybe_bytes.value();
+  const auto now = Clock::now();
+  Peer* peer = peers_.Find(peer_out);
+  const auto control = ParseControlPacket(buffer_out.datagram(), bytes);
+  if (control.has_value()) {
+    HandleControl(peer_out, peer, control.value(), now);
+    return Result::kNeedMoreData;
+  }
+  if (peer == nullptr) {
+    // most likely we timed it out, or restarted, let it know
+    SendControl(peer_out, ControlType::kDisconnect);
+    return Result::kNeedMoreData;
+  }
+
+  peer->last_heard = now;
+  const Result res = peer->connection->Process(buffer_out, bytes, channel_out);
+  if (res == Result::kSuccess && peer->connection->HasHeldBackMessage()) {
+    held_back_.push_back(peer_out);
+  }
+  return res;
+}
+
+template <typename TVector, typename TCongestionControl>
+typename UdpServer<TVector, TCongestionControl>::Connection*
+UdpServer<TVector, TCongestionControl>::Find(const Endpoint& peer) {
+  Peer* found = peers_.Find(peer);
+  return found == nullptr ? nullptr : found->connection.get();
+}
+
+template <typename TVector, typename TCongestionControl>
+void UdpServer<TVector, TCongestionControl>::Disconnect(const Endpoint& peer) {
+  if (peers_.Erase(peer)) {
+    SendControl(peer, ControlType::kDisconnect);
+  }
+}
+
+template <typename TVector, typename TCongestionControl>
+void UdpServer<TVector, TCongestionControl>::Update() {
+  const auto now = Clock::now();
+  timed_out_.clear();
+  peers_.ForEach([this, now](const Endpoint& endpoint, Peer& peer) {
+    if (now - peer.last_heard > idle_timeout_) {
+      timed_out_.push_back(endpoint);
+    } else {
+      peer.connection->Update();
+    }
+  });
+  for (const Endpoint& peer : timed_out_) {
+    Disconnect(peer);
+    if (on_disconnect_) {
+      on_disconnect_(peer, DisconnectReason::kTimedOut);
+    }
+  }
+}
+
+template <typename TVector, typename TCongestionControl>
+u8 UdpServer<TVector, TCongestionControl>::AddChannel(const ChannelType type) {
+  dnet_assert(peers_.empty(), "Channels must be added before peers connect");
+  channels_.push_back(type);
+  return static_cast<u8>(channels_.size());
+}
+
+template <typename TVector, typename TCongestionControl>
+void UdpServer<TVector, TCongestionControl>::HandleControl(
+    const Endpoint& from, Peer* peer, const ControlMessage& message,
+    const Clock::time_point now) {
+  switch (message.type) {
+    case ControlType::kConnect:
+      if (peer == nullptr) {
+        if (!cookies_.Check(from, message.cookie, now)) {
+          // nothing is kept until the peer shows it got this
+          SendControl(from, ControlType::kChallenge, cookies_.Make(from, now));
+          return;
+        }
+        if (peers_.size() >= max_peers_) {
+          SendControl(from, ControlType::kDisconnect);
+          return;
+        }
+        Peer added{};
+        added.connection =
+            std::unique_ptr<Connection>(new Connection(&socket_, from));
+        for (const ChannelType channel : channels_) {
+          added.connection->AddChannel(channel);
+        }
+        peer = peers_.Insert(from, std::move(added));
+        if (on_connect_) {
+          on_connect_(from);
+        }
+      }
+      // again if the peer asks again, the accept may have been lost
+      peer->last_heard = now;
+      SendControl(from, ControlType::kAccept);
+      break;
+    case ControlType::kAccept:
+    case ControlType::kChallenge:
+      break;
+    case ControlType::kDisconnect:
+      if (peer != nullptr) {
+        peers_.Erase(from);
+        if (on_disconnect_) {
+          on_disconnect_(from, DisconnectReason::kRequested);
+        }
+      }
+      break;
+  }
+}
+
+template <typename TVector, typename TCongestionControl>
+void UdpServer<TVector, TCongestionControl>::SendControl(
+    const Endpoint& to, const ControlType type, const u64 cookie) {
+  const ControlPacket packet = MakeControlPacket(type, cookie);
+  (void)socket_.WriteTo(packet.data(), packet.size(), to);
+}
+
+}  // namespace dnet
+
+#endif  // UDP_SERVER_HPP_
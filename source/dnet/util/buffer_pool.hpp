@@ -0,0 +1,136 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef BUFFER_POOL_HPP_
+#define BUFFER_POOL_HPP_
+
+#include <array>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace dnet {
+
+/**
+ * Recycles buffers, so that they keep their heap allocation between uses.
+ * Buffers are sorted into size classes by capacity, and Acquire hands out
+ * the smallest class that fits. Not thread safe, each worker owns one.
+ *
+ * @tparam TBuffer A std::vector<u8> like container type.
+ */
+template <typename TBuffer>
+class BufferPool {
+ public:
+  static constexpr std::array<size_t, 5> kClassSizes{256, 1024, 4096, 16384,
+                                                     65536};
+
+  /**
+   * @param max_per_class Buffers released to a full class are freed.
+   */
+  explicit BufferPool(const size_t max_per_class = 128)
+      : max_per_class_(max_per_class) {}
+
+  // no copy
+  BufferPool(const BufferPool& other) = delete;
+  BufferPool& operator=(const BufferPool& other) = delete;
+
+  BufferPool(BufferPool&& other) noexcept = default;
+  BufferPool& operator=(BufferPool&& other) noexcept = default;
+
+  ~BufferPool() = default;
+
+  /**
+   * @return An empty buffer with at least @size bytes of capacity. Sizes
+   * above the largest class are allocated, and not pooled on release.
+   */
+  TBuffer Acquire(const size_t size) {
+    TBuffer buffer{};
+    const size_t class_index = ClassFitting(size);
+    if (class_index < kClassSizes.size()) {
+      std::vector<TBuffer>& free_list = free_lists_[class_index];
+      if (!free_list.empty()) {
+        buffer = std::move(free_list.back());
+        free_list.pop_back();
+        return buffer;
+      }
+      buffer.reserve(kClassSizes[class_index]);
+    } else {
+      buffer.reserve(size);
+    }
+    return buffer;
+  }
+
+  /**
+   * Give @buffer back to the pool, it is cleared but keeps its capacity.
+   */
+  void Release(TBuffer&& buffer) {
+    const size_t capacity = buffer.capacity();
+    if (capacity < kClassSizes[0]) {
+      return;
+    }
+    // the largest class the buffer can serve
+    size_t class_index = 0;
+    while (class_index + 1 < kClassSizes.size() &&
+           kClassSizes[class_index + 1] <= capacity) {
+      ++class_index;
+    }
+    std::vector<TBuffer>& free_list = free_lists_[class_index];
+    if (free_list.size() < max_per_class_) {
+      buffer.clear();
+      free_list.push_back(std::move(buffer));
+    }
+  }
+
+  /**
+   * @return Amount of buffers waiting in the pool.
+   */
+  size_t Size() const {
+    size_t size = 0;
+    for (const auto& free_list : free_lists_) {
+      size += free_list.size();
+    }
+    return size;
+  }
+
+ private:
+  /**
+   * @return Index of the smallest class that fits @size, or
+   * kClassSizes.size() if none does.
+   */
+  static size_t ClassFitting(const size_t size) {
+    size_t class_index = 0;
+    while (class_index < kClassSizes.size() &&
+           kClassSizes[class_index] < size) {
+      ++class_index;
+    }
+    return class_index;
+  }
+
+  size_t max_per_class_;
+  std::array<std::vector<TBuffer>, kClassSizes.size()> free_lists_{};
+};
+
+}  // namespace dnet
+
+#endif  // BUFFER_POOL_HPP_
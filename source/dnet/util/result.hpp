@@ -33,7 +33,12 @@ using ResultUnderlyingType = u8_fast;
 enum class [[nodiscard]] Result : ResultUnderlyingType {
   kFail = 0,
           kSuccess,
-          kConnectionClosed
+          kConnectionClosed,
+          // a non-blocking call that has to be retried once more data has
+          // arrived
+          kNeedMoreData,
+          // nothing was done, as it would have to wait, retry later
+          kWouldBlock
           };
 
 }  // namespace dnet
@@ -0,0 +1,162 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef SEQUENCE_BUFFER_HPP_
+#define SEQUENCE_BUFFER_HPP_
+
+#include <dnet/util/types.hpp>
+#include <cstddef>
+#include <vector>
+
+namespace dnet {
+
+/**
+ * @return True if sequence number @a is more recent than @b, taking wrap
+ * around into account.
+ */
+inline bool SequenceGreaterThan(const u32 a, const u32 b) {
+  return static_cast<s32>(a - b) > 0;
+}
+
+/**
+ * Remembers an entry for each of the last @kSize sequence numbers. Entries
+ * live in a ring indexed by sequence modulo @kSize, so inserting, finding
+ * and removing are O(1), and an entry is dropped once a sequence number
+ * @kSize newer is inserted.
+ *
+ * The ring is allocated by the first Insert, so a buffer never used, such
+ * as in a connection that never sends, costs no memory.
+ *
+ * @tparam T Default constructible, reset to T{} when inserted.
+ */
+template <typename T, size_t kSize>
+class SequenceBuffer {
+ public:
+  // so that sequence % kSize stays continuous when the sequence wraps
+  static_assert(kSize > 0 && (kSize & (kSize - 1)) == 0,
+                "SequenceBuffer size must be a power of two");
+
+  SequenceBuffer() = default;
+
+  /**
+   * Forget every entry, the next sequence number goes back to 0.
+   */
+  void Reset() {
+    for (Slot& slot : slots_) {
+      slot.used = false;
+    }
+    sequence_ = 0;
+  }
+
+  /**
+   * Insert @sequence, clearing the slots of any skipped sequence numbers.
+   * @return The entry, or nullptr if @sequence is too old to fit.
+   */
+  T* Insert(const u32 sequence) {
+    if (slots_.empty()) {
+      slots_.resize(kSize);
+    }
+    if (SequenceGreaterThan(sequence + 1, sequence_)) {
+      // skipped sequence numbers must not find what was there before
+      const u32 skipped = sequence - sequence_;
+      const u32 to_clear = skipped < kSize ? skipped : kSize;
+      for (u32 i = 0; i < to_clear; i++) {
+        slots_[(sequence_ + i) % kSize].used = false;
+      }
+      sequence_ = sequence + 1;
+    } else if (SequenceGreaterThan(static_cast<u32>(sequence_ - kSize),
+                                   sequence)) {
+      return nullptr;
+    }
+    Slot& slot = slots_[sequence % kSize];
+    slot.sequence = sequence;
+    slot.used = true;
+    slot.value = T{};
+    return &slot.value;
+  }
+
+  void Remove(const u32 sequence) {
+    if (slots_.empty()) {
+      return;
+    }
+    Slot& slot = slots_[sequence % kSize];
+    if (slot.used && slot.sequence == sequence) {
+      slot.used = false;
+    }
+  }
+
+  bool Exists(const u32 sequence) const {
+    if (slots_.empty()) {
+      return false;
+    }
+    const Slot& slot = slots_[sequence % kSize];
+    return slot.used && slot.sequence == sequence;
+  }
+
+  /**
+   * @return The entry, or nullptr if @sequence is not in the buffer.
+   */
+  T* Find(const u32 sequence) {
+    if (slots_.empty()) {
+      return nullptr;
+    }
+    Slot& slot = slots_[sequence % kSize];
+    return slot.used && slot.sequence == sequence ? &slot.value : nullptr;
+  }
+
+  const T* Find(const u32 sequence) const {
+    if (slots_.empty()) {
+      return nullptr;
+    }
+    const Slot& slot = slots_[sequence % kSize];
+    return slot.used && slot.sequence == sequence ? &slot.value : nullptr;
+  }
+
+  /**
+   * @return One past the most recent inserted sequence number.
+   */
+  u32 sequence() const { return sequence_; }
+
+  static constexpr size_t size() { return kSize; }
+
+  /**
+   * @return True once the ring has been allocated.
+   */
+  bool allocated() const { return !slots_.empty(); }
+
+ private:
+  struct Slot {
+    u32 sequence = 0;
+    bool used = false;
+    T value{};
+  };
+
+  // empty until the first Insert
+  std::vector<Slot> slots_{};
+  u32 sequence_ = 0;
+};
+
+}  // namespace dnet
+
+#endif  // SEQUENCE_BUFFER_HPP_
@@ -0,0 +1,184 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef SPSC_RING_HPP_
+#define SPSC_RING_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <dnet/util/result.hpp>
+#include <memory>
+#include <utility>
+
+namespace dnet {
+
+/**
+ * Bounded lock free queue for exactly one producer thread and one consumer
+ * thread.
+ *
+ * The producer owns tail_ and the consumer owns head_, they live on
+ * separate cache lines so the two threads never write to the same line.
+ * Each side also keeps a cached copy of the other side's index, and only
+ * reloads it when the ring looks full, or empty.
+ */
+template <typename T>
+class SpscRing {
+ public:
+  /**
+   * @param capacity Rounded up to the next power of two.
+   */
+  explicit SpscRing(size_t capacity)
+      : capacity_(RoundUpToPowerOfTwo(capacity)),
+        slots_(std::make_unique<T[]>(capacity_)) {}
+
+  ~SpscRing() = default;
+
+  // no copy, no move, the threads hold references to it
+  SpscRing(const SpscRing& other) = delete;
+  SpscRing& operator=(const SpscRing& other) = delete;
+  SpscRing(SpscRing&& other) = delete;
+  SpscRing& operator=(SpscRing&& other) = delete;
+
+  /**
+   * Producer only.
+   * @return kFail if the ring is full.
+   */
+  Result Push(const T& value) { return Emplace(value); }
+  Result Push(T&& value) { return Emplace(std::move(value)); }
+
+  /**
+   * Consumer only.
+   * @return kFail if the ring is empty.
+   */
+  Result Pop(T& value_out) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == cached_tail_) {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+      if (head == cached_tail_) {
+        return Result::kFail;
+      }
+    }
+    value_out = std::move(slots_[head & (capacity_ - 1)]);
+    head_.store(head + 1, std::memory_order_release);
+    return Result::kSuccess;
+  }
+
+  /**
+   * Producer only. Push up to @count values, publishing them to the consumer
+   * with a single store.
+   * @param make Called as make(i) for the i:th value, must return a T.
+   * @return Amount of values pushed, less than @count if the ring filled up.
+   */
+  template <typename TMake>
+  size_t PushBatch(const size_t count, TMake&& make) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (capacity_ - (tail - cached_head_) < count) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+    }
+    const size_t free_slots = capacity_ - (tail - cached_head_);
+    const size_t pushed = count < free_slots ? count : free_slots;
+    for (size_t i = 0; i < pushed; i++) {
+      slots_[(tail + i) & (capacity_ - 1)] = make(i);
+    }
+    if (pushed > 0) {
+      tail_.store(tail + pushed, std::memory_order_release);
+    }
+    return pushed;
+  }
+
+  /**
+   * Consumer only. Pop up to @max values, releasing their slots to the
+   * producer with a single store.
+   * @param consume Called as consume(T&&) for each value, in order.
+   * @return Amount of values popped.
+   */
+  template <typename TConsume>
+  size_t PopBatch(const size_t max, TConsume&& consume) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (cached_tail_ - head < max) {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+    }
+    const size_t available = cached_tail_ - head;
+    const size_t popped = max < available ? max : available;
+    for (size_t i = 0; i < popped; i++) {
+      consume(std::move(slots_[(head + i) & (capacity_ - 1)]));
+    }
+    if (popped > 0) {
+      head_.store(head + popped, std::memory_order_release);
+    }
+    return popped;
+  }
+
+  /**
+   * May be called from both threads, but the answer can be outdated as soon
+   * as it is returned.
+   */
+  bool Empty() const {
+    return head_.load(std::memory_order_acquire) ==
+           tail_.load(std::memory_order_acquire);
+  }
+
+  size_t Capacity() const { return capacity_; }
+
+ private:
+  template <typename U>
+  Result Emplace(U&& value) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ == capacity_) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail - cached_head_ == capacity_) {
+        return Result::kFail;
+      }
+    }
+    slots_[tail & (capacity_ - 1)] = std::forward<U>(value);
+    tail_.store(tail + 1, std::memory_order_release);
+    return Result::kSuccess;
+  }
+
+  static size_t RoundUpToPowerOfTwo(const size_t value) {
+    size_t power = 1;
+    while (power < value) {
+      power <<= 1;
+    }
+    return power;
+  }
+
+  static constexpr size_t kCacheLineSize = 64;
+
+  // consumer side
+  alignas(kCacheLineSize) std::atomic<size_t> head_{0};
+  size_t cached_tail_ = 0;
+
+  // producer side
+  alignas(kCacheLineSize) std::atomic<size_t> tail_{0};
+  size_t cached_head_ = 0;
+
+  // read only after construction
+  alignas(kCacheLineSize) const size_t capacity_;
+  std::unique_ptr<T[]> slots_;
+};
+
+}  // namespace dnet
+
+#endif  // SPSC_RING_HPP_
@@ -0,0 +1,283 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "timer_wheel.hpp"
+#include <limits>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace dnet {
+
+namespace {
+
+/**
+ * @return Index of the lowest set bit, @value must not be 0.
+ */
+u32 LowestBit(const u64 value) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward64(&index, value);
+  return static_cast<u32>(index);
+#else
+  return static_cast<u32>(__builtin_ctzll(value));
+#endif
+}
+
+/**
+ * @return Index of the highest set bit, @value must not be 0.
+ */
+u32 HighestBit(const u64 value) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanReverse64(&index, value);
+  return static_cast<u32>(index);
+#else
+  return static_cast<u32>(63 - __builtin_clzll(value));
+#endif
+}
+
+u64 RotateRight(const u64 value, const u32 shift) {
+  return shift == 0 ? value : (value >> shift) | (value << (64 - shift));
+}
+
+}  // namespace
+
+TimerWheel::TimerWheel(const Clock::time_point start,
+                       const std::chrono::nanoseconds resolution)
+    : start_(start),
+      resolution_(resolution.count() > 0 ? resolution
+                                         : std::chrono::nanoseconds{1}) {
+  heads_.fill(kNil);
+}
+
+TimerId TimerWheel::Schedule(const Clock::time_point deadline,
+                             Callback callback) {
+  u32 index;
+  if (free_ != kNil) {
+    index = free_;
+    free_ = nodes_[index].next;
+  } else {
+    index = static_cast<u32>(nodes_.size());
+    nodes_.emplace_back();
+  }
+  Node& node = nodes_[index];
+  node.deadline = TickOf(deadline, true);
+  node.callback = std::move(callback);
+  node.next = kNil;
+  Place(index);
+  size_++;
+  return (static_cast<u64>(node.generation) << 32) | index;
+}
+
+bool TimerWheel::Cancel(const TimerId id) {
+  const auto index = static_cast<u32>(id);
+  const auto generation = static_cast<u32>(id >> 32);
+  if (index >= nodes_.size() || nodes_[index].generation != generation ||
+      nodes_[index].list == kNoList) {
+    return false;
+  }
+  Unlink(index);
+  Free(index);
+  return true;
+}
+
+size_t TimerWheel::Advance(const Clock::time_point now) {
+  u64 now_tick = TickOf(now, false);
+  if (now_tick < elapsed_) {
+    now_tick = elapsed_;
+  }
+
+  // move the due timers to the pending list, and the ones in a slot that
+  // time has reached but are not yet due down a level
+  for (auto expiration = NextExpiration();
+       expiration.has_value() && expiration->tick <= now_tick;
+       expiration = NextExpiration()) {
+    elapsed_ = expiration->tick;
+    const u32 list = expiration->level * kSlots + expiration->slot;
+    u32 index = heads_[list];
+    heads_[list] = kNil;
+    occupied_[expiration->level] &= ~(u64{1} << expiration->slot);
+    while (index != kNil) {
+      Node& node = nodes_[index];
+      const u32 next = node.next;
+      node.prev = kNil;
+      node.next = kNil;
+      node.list = kNoList;
+      if (node.deadline <= elapsed_) {
+        Link(index, kPendingList);
+      } else {
+        Place(index);
+      }
+      index = next;
+    }
+  }
+  elapsed_ = now_tick;
+
+  size_t fired = 0;
+  while (heads_[kPendingList] != kNil) {
+    const u32 index = heads_[kPendingList];
+    Unlink(index);
+    // free first, the callback may schedule into the same node
+    Callback callback = std::move(nodes_[index].callback);
+    Free(index);
+    callback();
+    fired++;
+  }
+  return fired;
+}
+
+std::optional<TimerWheel::Clock::time_point> TimerWheel::NextDeadline() const {
+  const auto expiration = NextExpiration();
+  if (!expiration.has_value()) {
+    return std::nullopt;
+  }
+  return start_ + std::chrono::duration_cast<Clock::duration>(
+                      resolution_ * expiration->tick);
+}
+
+int TimerWheel::TimeoutMs(const Clock::time_point now) const {
+  const auto deadline = NextDeadline();
+  if (!deadline.has_value()) {
+    return -1;
+  }
+  if (deadline.value() <= now) {
+    return 0;
+  }
+  const auto ms =
+      std::chrono::ceil<std::chrono::milliseconds>(deadline.value() - now)
+          .count();
+  return ms < std::numeric_limits<int>::max() ? static_cast<int>(ms)
+                                              : std::numeric_limits<int>::max();
+}
+
+u64 TimerWheel::TickOf(const Clock::time_point time,
+                       const bool round_up) const {
+  if (time <= start_) {
+    return 0;
+  }
+  const auto since_start =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(time - start_);
+  const auto ticks = static_cast<u64>(since_start / resolution_);
+  return round_up && since_start % resolution_ != std::chrono::nanoseconds{0}
+             ? ticks + 1
+             : ticks;
+}
+
+std::optional<TimerWheel::Expiration> TimerWheel::NextExpiration() const {
+  // a lower level only holds timers due before the current slot of the
+  // level above it ends, so the first occupied level has the next deadline
+  for (u32 level = 0; level < kLevels; level++) {
+    if (occupied_[level] == 0) {
+      continue;
+    }
+    const u32 shift = level * kSlotBits;
+    const u64 current = elapsed_ >> shift;
+    const auto current_slot = static_cast<u32>(current & (kSlots - 1));
+    const u32 offset = LowestBit(RotateRight(occupied_[level], current_slot));
+    return Expiration{level, (current_slot + offset) & (kSlots - 1),
+                      (current + offset) << shift};
+  }
+  return std::nullopt;
+}
+
+void TimerWheel::Place(const u32 index) {
+  u64 when = nodes_[index].deadline;
+  if (when < elapsed_) {
+    when = elapsed_;
+  }
+  // beyond what the wheel spans, park it in the furthest slot of the top
+  // level, it is placed again once time reaches that slot
+  constexpr u32 kTopShift = kSlotBits * (kLevels - 1);
+  const u64 furthest = ((elapsed_ >> kTopShift) << kTopShift) +
+                       (u64{1} << (kSlotBits * kLevels)) - 1;
+  if (when > furthest) {
+    when = furthest;
+  }
+
+  // the highest bit that differs from the current tick decides the level
+  u32 level = HighestBit((elapsed_ ^ when) | (kSlots - 1)) / kSlotBits;
+  if (level >= kLevels) {
+    level = kLevels - 1;
+  }
+  const auto slot =
+      static_cast<u32>((when >> (level * kSlotBits)) & (kSlots - 1));
+  Link(index, level * kSlots + slot);
+}
+
+void TimerWheel::Link(const u32 index, const u32 list) {
+  Node& node = nodes_[index];
+  node.list = list;
+  if (list == kPendingList) {
+    node.prev = pending_tail_;
+    node.next = kNil;
+    if (pending_tail_ != kNil) {
+      nodes_[pending_tail_].next = index;
+    } else {
+      heads_[list] = index;
+    }
+    pending_tail_ = index;
+    return;
+  }
+
+  node.prev = kNil;
+  node.next = heads_[list];
+  if (node.next != kNil) {
+    nodes_[node.next].prev = index;
+  }
+  heads_[list] = index;
+  occupied_[list / kSlots] |= u64{1} << (list % kSlots);
+}
+
+void TimerWheel::Unlink(const u32 index) {
+  Node& node = nodes_[index];
+  if (node.prev != kNil) {
+    nodes_[node.prev].next = node.next;
+  } else {
+    heads_[node.list] = node.next;
+  }
+  if (node.next != kNil) {
+    nodes_[node.next].prev = node.prev;
+  } else if (node.list == kPendingList) {
+    pending_tail_ = node.prev;
+  }
+  if (node.list != kPendingList && heads_[node.list] == kNil) {
+    occupied_[node.list / kSlots] &= ~(u64{1} << (node.list % kSlots));
+  }
+  node.prev = kNil;
+  node.next = kNil;
+  node.list = kNoList;
+}
+
+void TimerWheel::Free(const u32 index) {
+  Node& node = nodes_[index];
+  node.callback = nullptr;
+  node.generation = node.generation + 1 != 0 ? node.generation + 1 : 1;
+  node.next = free_;
+  free_ = index;
+  size_--;
+}
+
+}  // namespace dnet
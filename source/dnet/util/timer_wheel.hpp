@@ -0,0 +1,174 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef TIMER_WHEEL_HPP_
+#define TIMER_WHEEL_HPP_
+
+#include <dnet/util/types.hpp>
+#include <array>
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <vector>
+
+namespace dnet {
+
+/**
+ * Identifies a timer scheduled in a TimerWheel.
+ */
+using TimerId = u64;
+
+constexpr TimerId kInvalidTimerId = 0;
+
+/**
+ * Hierarchical timing wheel. Timers are kept in @kLevels wheels of @kSlots
+ * slots, where a slot in level n spans kSlots^n ticks. A timer is placed in
+ * the lowest level whose slot does not contain the current time, and moved
+ * down a level when time reaches its slot, so scheduling and cancelling are
+ * O(1). A bitmap of occupied slots per level finds the next deadline
+ * without walking empty slots, so long idle periods are skipped in one step.
+ *
+ * Timers never fire early, deadlines are rounded up to the next tick.
+ * Callbacks may schedule and cancel timers, timers that become due while
+ * callbacks run are fired by the next call to Advance.
+ *
+ * Not thread safe, owned by a single thread.
+ */
+class TimerWheel {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using Callback = std::function<void()>;
+
+  static constexpr u32 kSlotBits = 6;
+  static constexpr u32 kSlots = 1 << kSlotBits;
+  static constexpr u32 kLevels = 6;
+
+  /**
+   * @param start Time of tick 0.
+   * @param resolution Length of a tick.
+   */
+  explicit TimerWheel(
+      Clock::time_point start = Clock::now(),
+      std::chrono::nanoseconds resolution = std::chrono::milliseconds{1});
+
+  // no copy, the ids refer to this wheel
+  TimerWheel(const TimerWheel& other) = delete;
+  TimerWheel& operator=(const TimerWheel& other) = delete;
+
+  TimerWheel(TimerWheel&& other) noexcept = default;
+  TimerWheel& operator=(TimerWheel&& other) noexcept = default;
+
+  /**
+   * Call @callback once @deadline has passed. A deadline in the past fires
+   * on the next call to Advance.
+   * @return Id to cancel the timer with, valid until it fires.
+   */
+  TimerId Schedule(Clock::time_point deadline, Callback callback);
+
+  /**
+   * @return If the timer was cancelled, false if it already fired, was
+   * cancelled or never existed.
+   */
+  bool Cancel(TimerId id);
+
+  /**
+   * Fire every timer whose deadline is at or before @now.
+   * @return Amount of timers fired.
+   */
+  size_t Advance(Clock::time_point now);
+
+  /**
+   * @return Deadline of the earliest timer, rounded to its tick. Can be
+   * somewhat early for timers far in the future, which are only placed
+   * precisely as time gets closer to them.
+   */
+  std::optional<Clock::time_point> NextDeadline() const;
+
+  /**
+   * @return Milliseconds from @now until the next deadline, rounded up, to
+   * be used as the timeout of a readiness wait. -1 if there are no timers.
+   */
+  int TimeoutMs(Clock::time_point now) const;
+
+  /**
+   * @return Amount of timers scheduled.
+   */
+  size_t size() const { return size_; }
+
+  bool empty() const { return size_ == 0; }
+
+ private:
+  static constexpr u32 kNil = ~u32{0};
+  // lists of the slots, then the list of timers about to fire
+  static constexpr u32 kPendingList = kLevels * kSlots;
+  static constexpr u32 kNoList = kPendingList + 1;
+
+  struct Node {
+    u64 deadline = 0;
+    Callback callback{};
+    u32 prev = kNil;
+    u32 next = kNil;
+    u32 list = kNoList;
+    // bumped when the node is freed, so that old ids stop matching
+    u32 generation = 1;
+  };
+
+  struct Expiration {
+    u32 level;
+    u32 slot;
+    u64 tick;
+  };
+
+  u64 TickOf(Clock::time_point time, bool round_up) const;
+
+  std::optional<Expiration> NextExpiration() const;
+
+  /**
+   * Put the node in the slot for its deadline, relative to elapsed_.
+   */
+  void Place(u32 index);
+
+  void Link(u32 index, u32 list);
+
+  void Unlink(u32 index);
+
+  void Free(u32 index);
+
+  Clock::time_point start_;
+  std::chrono::nanoseconds resolution_;
+  // the current tick, timers at or before it are due
+  u64 elapsed_ = 0;
+  std::vector<Node> nodes_{};
+  u32 free_ = kNil;
+  std::array<u32, kPendingList + 1> heads_{};
+  // fired in deadline order, so appended to instead of prepended
+  u32 pending_tail_ = kNil;
+  std::array<u64, kLevels> occupied_{};
+  size_t size_ = 0;
+};
+
+}  // namespace dnet
+
+#endif  // TIMER_WHEEL_HPP_
@@ -1,9 +1,15 @@
 #include "util.hpp"
 #include <cassert>
 #include "platform.hpp"
-#if !defined(DNET_PLATFORM_WINDOWS)
+#if defined(DNET_PLATFORM_WINDOWS)
+#include <windows.h>
+#else
 #include <sys/resource.h>
 #endif
+#if defined(DNET_PLATFORM_LINUX)
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 namespace dnet {
 
@@ -51,4 +57,24 @@ int GetNofdHardLimit() {
 #endif
 }
 
+bool PinThreadToCpu(std::thread& thread, const u32 cpu) {
+#if defined(DNET_PLATFORM_LINUX)
+  if (cpu >= CPU_SETSIZE) return false;
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  CPU_SET(cpu, &cpu_set);
+  const int res =
+      pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set), &cpu_set);
+  return res == 0;
+#elif defined(DNET_PLATFORM_WINDOWS)
+  if (cpu >= sizeof(DWORD_PTR) * 8) return false;
+  const DWORD_PTR mask = static_cast<DWORD_PTR>(1) << cpu;
+  return SetThreadAffinityMask(thread.native_handle(), mask) != 0;
+#else
+  (void)thread;
+  (void)cpu;
+  return false;
+#endif
+}
+
 }  // namespace dnet
@@ -26,6 +26,8 @@
 #define UTIL_HPP_
 
 #include <chif_net/chif_net.h>
+#include <dnet/util/types.hpp>
+#include <thread>
 
 namespace dnet {
 
@@ -54,6 +56,12 @@ int GetNofdHardLimit();
 
 constexpr int NOFD_HARD_LIMIT = -1;
 
+/**
+ * Restrict @thread to only run on cpu number @cpu.
+ * @return If it was successful or not, always false where unsupported.
+ */
+bool PinThreadToCpu(std::thread& thread, u32 cpu);
+
 }  // namespace dnet
 
 #endif  // UTIL_HPP_
@@ -0,0 +1,80 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <doctest.h>
+#include <dnet/util/buffer_pool.hpp>
+#include <dnet/util/types.hpp>
+#include <vector>
+
+TEST_CASE("buffer pool") {
+  using Buffer = std::vector<u8>;
+  dnet::BufferPool<Buffer> pool{2};
+
+  {  // a new buffer gets the capacity of its size class
+    const Buffer buffer = pool.Acquire(300);
+    CHECK(buffer.empty());
+    CHECK(buffer.capacity() >= 1024);
+    CHECK(pool.Size() == 0);
+  }
+
+  {  // released buffers are handed out again
+    Buffer buffer = pool.Acquire(10);
+    buffer.assign(10, 0xA);
+    const u8* data = buffer.data();
+    pool.Release(std::move(buffer));
+    CHECK(pool.Size() == 1);
+
+    Buffer again = pool.Acquire(200);
+    CHECK(again.empty());
+    CHECK(again.data() == data);
+    CHECK(pool.Size() == 0);
+  }
+
+  {  // but only to sizes they can hold
+    pool.Release(pool.Acquire(10));
+    const Buffer buffer = pool.Acquire(2000);
+    CHECK(buffer.capacity() >= 4096);
+    CHECK(pool.Size() == 1);
+  }
+
+  {  // too small buffers, and full classes, are freed
+    pool.Release(Buffer(16));
+    CHECK(pool.Size() == 1);
+    pool.Release(pool.Acquire(1));
+    pool.Release(pool.Acquire(1));
+    pool.Release(pool.Acquire(1));
+    CHECK(pool.Size() == 1);
+    pool.Release(Buffer(256));
+    pool.Release(Buffer(256));
+    CHECK(pool.Size() == 2);
+  }
+
+  {  // larger than every class is not pooled
+    Buffer buffer = pool.Acquire(100000);
+    CHECK(buffer.capacity() >= 100000);
+    pool.Release(std::move(buffer));
+    CHECK(pool.Size() == 3);
+    CHECK(pool.Acquire(100000).capacity() >= 100000);
+  }
+}
@@ -0,0 +1,179 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <doctest.h>
+#include <dlog.hpp>
+#include <dnet/net/channel.hpp>
+#include <dnet/net/fragment.hpp>
+#include <dnet/udp_connection.hpp>
+#include <dnet/util/types.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+#include "lossy_link.hpp"
+
+using namespace std::chrono_literals;
+
+TEST_CASE("reorder buffer") {
+  dnet::ReorderBuffer reorder{};
+  CHECK(reorder.Pop() == nullptr);
+  reorder.Insert(2, std::vector<u8>{2});
+  reorder.Insert(1, std::vector<u8>{1});
+  CHECK(!reorder.HasNext());
+  CHECK(reorder.Pop() == nullptr);
+
+  reorder.Insert(0, std::vector<u8>{0});
+  CHECK(reorder.HasNext());
+  for (u8 i = 0; i < 3; i++) {
+    const std::vector<u8>* message = reorder.Pop();
+    REQUIRE(message != nullptr);
+    CHECK(*message == std::vector<u8>{i});
+  }
+  CHECK(reorder.Pop() == nullptr);
+
+  // already handed out
+  reorder.Insert(1, std::vector<u8>{1});
+  CHECK(!reorder.HasNext());
+  reorder.Insert(3, std::vector<u8>{3});
+  CHECK(reorder.HasNext());
+}
+
+static std::vector<u8> MakeMessage(const u32 number, const size_t size) {
+  std::vector<u8> message(sizeof(number) + size, static_cast<u8>(number));
+  std::memcpy(message.data(), &number, sizeof(number));
+  return message;
+}
+
+static u32 MessageNumber(const dnet::UdpBuffer<std::vector<u8>>& buffer) {
+  u32 number = 0;
+  REQUIRE(buffer.size() >= sizeof(number));
+  std::memcpy(&number, buffer.data(), sizeof(number));
+  return number;
+}
+
+TEST_CASE("channels over lossy link") {
+  using Buffer = dnet::UdpBuffer<std::vector<u8>>;
+  using Connection = dnet::UdpConnection<std::vector<u8>>;
+  constexpr u16 link_port = 3130;
+  constexpr u16 server_port = 3131;
+  constexpr u32 kCount = 100;
+  LossyLink link{link_port, server_port, 0.1, 10000000, 1000000};
+  // the first send of message 1 on the unordered channel is lost, so the
+  // ones after it arrive before it is resent
+  bool dropped_first = false;
+  link.set_drop_filter([&dropped_first](const u8* datagram,
+                                        const size_t size) {
+    constexpr size_t kOffset = sizeof(dnet::UdpHeader) +
+                               sizeof(dnet::FragmentHeader);
+    if (dropped_first || size < kOffset + sizeof(u32)) {
+      return false;
+    }
+    dnet::UdpHeader header{};
+    std::memcpy(&header, datagram, sizeof(header));
+    dnet::FragmentHeader fragment{};
+    std::memcpy(&fragment, datagram + sizeof(header), sizeof(fragment));
+    u32 number = 0;
+    std::memcpy(&number, datagram + kOffset, sizeof(number));
+    dropped_first = (header.flags & dnet::kUdpFragment) != 0 &&
+                    (header.flags & dnet::kUdpChannelMask) >>
+                            dnet::kUdpChannelShift ==
+                        2 &&
+                    fragment.index == 0 && number == 1;
+    return dropped_first;
+  });
+
+  Connection server{};
+  Connection client{};
+  for (Connection* con : {&server, &client}) {
+    CHECK(con->AddChannel(dnet::ChannelType::kReliableOrdered) == 1);
+    CHECK(con->AddChannel(dnet::ChannelType::kReliableUnordered) == 2);
+    CHECK(con->AddChannel(dnet::ChannelType::kUnreliableSequenced) == 3);
+  }
+  REQUIRE(server.StartServer(server_port) == dnet::Result::kSuccess);
+  REQUIRE(client.Connect("127.0.0.1", link_port) == dnet::Result::kSuccess);
+
+  u32 sent[4]{};
+  std::vector<u32> received[4]{};
+  Buffer in{};
+  Buffer ack{};
+  const auto give_up = std::chrono::steady_clock::now() + 20s;
+  while (std::chrono::steady_clock::now() < give_up &&
+         (received[1].size() < kCount || received[2].size() < kCount)) {
+    for (u8 channel = 1; channel <= 3; channel++) {
+      if (sent[channel] == kCount) {
+        continue;
+      }
+      // some take several fragments
+      const std::vector<u8> message =
+          MakeMessage(sent[channel], (sent[channel] % 4) * 1000);
+      const dnet::Result res =
+          client.Send(channel, message.data(),
+                      channel == 3 ? 8 : message.size());
+      REQUIRE(res != dnet::Result::kFail);
+      sent[channel] += res == dnet::Result::kSuccess ? 1 : 0;
+    }
+    link.Pump();
+    while (server.CanRead()) {
+      u8 channel = 0;
+      const dnet::Result res = server.Read(in, channel);
+      REQUIRE(res != dnet::Result::kFail);
+      if (res == dnet::Result::kSuccess) {
+        REQUIRE(channel < 4);
+        received[channel].push_back(MessageNumber(in));
+      }
+      REQUIRE(server.Write(ack) == dnet::Result::kSuccess);
+    }
+    link.Pump();
+    while (client.CanRead()) {
+      REQUIRE(client.Read(in) != dnet::Result::kFail);
+    }
+    client.Update();
+  }
+
+  DLOG_VERBOSE("dropped {}, sequenced received {} of {}", link.dropped(),
+               received[3].size(), sent[3]);
+  CHECK(link.dropped() > 0);
+  CHECK(received[0].empty());
+  std::vector<u32> expected(kCount);
+  for (u32 i = 0; i < kCount; i++) {
+    expected[i] = i;
+  }
+  CHECK(received[1] == expected);
+  // no head of line blocking, later messages did not wait for message 1
+  CHECK(dropped_first);
+  const auto first = std::find(received[2].begin(), received[2].end(), 1u);
+  CHECK(std::any_of(received[2].begin(), first,
+                    [](const u32 number) { return number > 1; }));
+  CHECK(received[2].size() == kCount);
+  std::sort(received[2].begin(), received[2].end());
+  CHECK(received[2] == expected);
+  // lost ones are not resent, nor is anything handed out twice or late
+  CHECK(!received[3].empty());
+  CHECK(received[3].size() < kCount);
+  CHECK(std::adjacent_find(received[3].begin(), received[3].end(),
+                           [](const u32 a, const u32 b) { return a >= b; }) ==
+        received[3].end());
+}
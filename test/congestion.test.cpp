@@ -0,0 +1,175 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <doctest.h>
+#include <dlog.hpp>
+#include <dnet/net/congestion.hpp>
+#include <dnet/udp_connection.hpp>
+#include <dnet/util/types.hpp>
+#include <chrono>
+#include <vector>
+#include "lossy_link.hpp"
+
+using namespace std::chrono_literals;
+
+TEST_CASE("new reno window") {
+  dnet::NewReno reno{};
+  const dnet::NewReno::TimePoint start{};
+  const auto srtt = 10ms;
+  CHECK(reno.window() == dnet::NewReno::kInitialWindow);
+  CHECK(reno.in_slow_start());
+  CHECK(reno.CanSend(reno.window() - 1));
+  CHECK(!reno.CanSend(reno.window()));
+
+  // slow start grows by the acked bytes
+  reno.OnPacketsAcked(1000, srtt, start);
+  CHECK(reno.window() == dnet::NewReno::kInitialWindow + 1000);
+
+  // loss halves the window, once per round trip
+  const size_t before = reno.window();
+  reno.OnPacketsLost(1000, srtt, start + 1ms);
+  CHECK(reno.window() == before / 2);
+  CHECK(!reno.in_slow_start());
+  reno.OnPacketsLost(1000, srtt, start + 5ms);
+  CHECK(reno.window() == before / 2);
+  // acks for packets sent before the cut do not grow it
+  reno.OnPacketsAcked(5000, srtt, start + 5ms);
+  CHECK(reno.window() == before / 2);
+
+  // congestion avoidance, one datagram per window of acks
+  const size_t window = reno.window();
+  reno.OnPacketsAcked(window - 1, srtt, start + 20ms);
+  CHECK(reno.window() == window);
+  reno.OnPacketsAcked(1, srtt, start + 20ms);
+  CHECK(reno.window() == window + dnet::NewReno::kDatagramSize);
+
+  // never below the minimum
+  for (int i = 0; i < 20; i++) {
+    reno.OnPacketsLost(1000, srtt, start + 100ms * (i + 1));
+  }
+  CHECK(reno.window() == dnet::NewReno::kMinWindow);
+}
+
+TEST_CASE("new reno pacing rate") {
+  dnet::NewReno reno{};
+  CHECK(reno.PacingRate(0ms) == 0);
+  // a window of 12000 bytes per 10ms, doubled in slow start
+  CHECK(reno.PacingRate(10ms) == 2 * 1200000);
+}
+
+TEST_CASE("pacer") {
+  dnet::Pacer pacer{2000};
+  const dnet::Pacer::TimePoint start = dnet::Pacer::Clock::now();
+  // unpaced
+  CHECK(pacer.TrySend(100000, start));
+
+  pacer.set_rate(1000000);  // 1 byte per us
+  CHECK(pacer.TrySend(1000, start));
+  CHECK(pacer.TrySend(1000, start));
+  CHECK(!pacer.TrySend(1000, start));
+  CHECK(pacer.TimeUntilSend(1000, start) == 1ms);
+  CHECK(!pacer.TrySend(1000, start + 999us));
+  CHECK(pacer.TrySend(1000, start + 1ms));
+
+  // larger than the burst, once the bucket is full
+  CHECK(!pacer.TrySend(5000, start + 2ms));
+  CHECK(pacer.TrySend(5000, start + 3ms));
+  CHECK(pacer.TimeUntilSend(1000, start + 3ms) == 4ms);
+}
+
+struct LinkStats {
+  u64 sent = 0;
+  u64 delivered = 0;
+  u64 lost = 0;
+};
+
+/**
+ * Send @count datagrams over a lossy link, with the server acking each,
+ * all from this thread.
+ */
+template <typename TCongestionControl>
+static LinkStats SendOverLossyLink(const u16 base_port, const int count) {
+  using Buffer = dnet::UdpBuffer<std::vector<u8>>;
+  const u16 link_port = base_port;
+  const u16 server_port = base_port + 1;
+  // 2 MB/s with 16 KB of queue, and 1% random loss
+  LossyLink link{link_port, server_port, 0.01, 2000000, 16000};
+  dnet::UdpConnection<std::vector<u8>, TCongestionControl> server{};
+  REQUIRE(server.StartServer(server_port) == dnet::Result::kSuccess);
+  dnet::UdpConnection<std::vector<u8>, TCongestionControl> client{};
+  REQUIRE(client.Connect("127.0.0.1", link_port) == dnet::Result::kSuccess);
+
+  Buffer out{1000};
+  Buffer in{};
+  Buffer ack{};
+  int written = 0;
+  const auto give_up = std::chrono::steady_clock::now() + 20s;
+  while (std::chrono::steady_clock::now() < give_up) {
+    const auto& reliability = client.reliability();
+    if (written == count &&
+        reliability.packets_delivered() + reliability.packets_lost() ==
+            reliability.packets_sent()) {
+      break;
+    }
+    if (written < count) {
+      const auto res = client.Write(out);
+      REQUIRE(res != dnet::Result::kFail);
+      written += res == dnet::Result::kSuccess ? 1 : 0;
+    }
+    link.Pump();
+    while (server.CanRead()) {
+      REQUIRE(server.Read(in) == dnet::Result::kSuccess);
+      // an empty reply, only carrying the acks
+      REQUIRE(server.Write(ack) == dnet::Result::kSuccess);
+    }
+    link.Pump();
+    while (client.CanRead()) {
+      REQUIRE(client.Read(in) == dnet::Result::kSuccess);
+    }
+    client.Update();
+  }
+
+  const auto& reliability = client.reliability();
+  REQUIRE(written == count);
+  REQUIRE(reliability.packets_delivered() + reliability.packets_lost() ==
+          reliability.packets_sent());
+  return LinkStats{reliability.packets_sent(), reliability.packets_delivered(),
+                   reliability.packets_lost()};
+}
+
+TEST_CASE("congestion control over lossy link") {
+  constexpr int kCount = 2000;
+  const LinkStats blast =
+      SendOverLossyLink<dnet::NoCongestionControl>(3100, kCount);
+  const LinkStats reno = SendOverLossyLink<dnet::NewReno>(3110, kCount);
+  const double blast_loss = static_cast<double>(blast.lost) / blast.sent;
+  const double reno_loss = static_cast<double>(reno.lost) / reno.sent;
+  DLOG_VERBOSE("loss without congestion control {:.3f}, with {:.3f}",
+               blast_loss, reno_loss);
+  CHECK(blast.sent == kCount);
+  CHECK(reno.sent == kCount);
+  CHECK(reno.lost > 0);
+  // the window keeps the bottleneck queue from overflowing most of the time
+  CHECK(reno_loss < blast_loss / 2);
+}
@@ -0,0 +1,137 @@
+#include <doctest.h>
+#include <dlog.hpp>
+#include <dnet/net/connect_many.hpp>
+#include <dnet/net/endpoint.hpp>
+#include <dnet/net/tcp.hpp>
+#include <dnet/util/platform.hpp>
+#include <dnet/util/types.hpp>
+#include <chrono>
+#include <vector>
+#if defined(DNET_PLATFORM_LINUX)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+using namespace std::chrono_literals;
+
+/**
+ * Call FinishConnect until it is no longer in flight.
+ */
+static dnet::Result WaitForConnect(const dnet::Tcp& tcp) {
+  const auto start = std::chrono::steady_clock::now();
+  dnet::Result res = tcp.FinishConnect();
+  while (res == dnet::Result::kWouldBlock &&
+         std::chrono::steady_clock::now() - start < 5s) {
+    (void)tcp.CanWrite();
+    res = tcp.FinishConnect();
+  }
+  return res;
+}
+
+TEST_CASE("connect non blocking") {
+  constexpr u16 port = 12050;
+  dnet::Tcp server{};
+  REQUIRE(server.StartServer(port) == dnet::Result::kSuccess);
+  const auto endpoint = dnet::Endpoint::Resolve("127.0.0.1", port);
+  REQUIRE(endpoint.has_value());
+
+  dnet::Tcp client{};
+  const dnet::Result res = client.ConnectNonBlocking(endpoint.value());
+  REQUIRE(res != dnet::Result::kFail);
+  CHECK(WaitForConnect(client) == dnet::Result::kSuccess);
+  auto accepted = server.Accept();
+  REQUIRE(accepted.has_value());
+  const u8 byte = 7;
+  CHECK(client.Write(&byte, 1) == 1);
+  u8 read = 0;
+  CHECK(accepted.value().Read(&read, 1) == 1);
+  CHECK(read == byte);
+
+  // with a timeout, and connected, it is blocking like after Connect
+  dnet::Tcp timed{};
+  CHECK(timed.Connect("localhost", port, 1s) == dnet::Result::kSuccess);
+  accepted = server.Accept();
+  REQUIRE(accepted.has_value());
+  CHECK(accepted.value().Write(&byte, 1) == 1);
+  CHECK(timed.Read(&read, 1) == 1);
+}
+
+TEST_CASE("connect refused") {
+  constexpr u16 port = 12051;
+  const auto endpoint = dnet::Endpoint::Resolve("127.0.0.1", port);
+  REQUIRE(endpoint.has_value());
+  dnet::Tcp client{};
+  const dnet::Result res = client.ConnectNonBlocking(endpoint.value());
+  if (res == dnet::Result::kWouldBlock) {
+    CHECK(WaitForConnect(client) == dnet::Result::kFail);
+  } else {
+    CHECK(res == dnet::Result::kFail);
+  }
+  CHECK(client.Connect("127.0.0.1", port, 1s) == dnet::Result::kFail);
+  CHECK(client.GetHandle() == CHIF_NET_INVALID_SOCKET);
+}
+
+#if defined(DNET_PLATFORM_LINUX)
+TEST_CASE("connect times out") {
+  constexpr u16 port = 12052;
+  // a listener that is never accepted from, with the smallest backlog. Once
+  // it is full, the kernel drops further handshakes, as an unreachable host
+  // would.
+  const int listener = socket(AF_INET, SOCK_STREAM, 0);
+  REQUIRE(listener != -1);
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  REQUIRE(bind(listener, reinterpret_cast<sockaddr*>(&address),
+               sizeof(address)) == 0);
+  REQUIRE(listen(listener, 0) == 0);
+  std::vector<dnet::Tcp> fillers(4);
+  for (dnet::Tcp& filler : fillers) {
+    (void)filler.Connect("127.0.0.1", port, 100ms);
+  }
+
+  dnet::Tcp client{};
+  const auto start = std::chrono::steady_clock::now();
+  CHECK(client.Connect("127.0.0.1", port, 200ms) == dnet::Result::kFail);
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  CHECK(elapsed >= 150ms);
+  CHECK(elapsed < 2s);
+  close(listener);
+}
+#endif
+
+TEST_CASE("connect many") {
+  constexpr u16 port = 12053;
+  constexpr u16 refused_port = 12054;
+  constexpr size_t kCount = 100;
+  dnet::Tcp server{};
+  REQUIRE(server.StartServer(port) == dnet::Result::kSuccess);
+  const auto good = dnet::Endpoint::Resolve("127.0.0.1", port);
+  const auto bad = dnet::Endpoint::Resolve("127.0.0.1", refused_port);
+  REQUIRE(good.has_value());
+  REQUIRE(bad.has_value());
+
+  // every tenth to a port nobody listens on
+  std::vector<dnet::Endpoint> endpoints{};
+  for (size_t i = 0; i < kCount; i++) {
+    endpoints.push_back(i % 10 == 0 ? bad.value() : good.value());
+  }
+  std::vector<dnet::Tcp> clients(kCount);
+  std::vector<dnet::Result> results(kCount, dnet::Result::kFail);
+  const size_t connected = dnet::ConnectMany(
+      clients.data(), endpoints.data(), kCount, 2s, results.data());
+  CHECK(connected == kCount - kCount / 10);
+  for (size_t i = 0; i < kCount; i++) {
+    CHECK(results[i] ==
+          (i % 10 == 0 ? dnet::Result::kFail : dnet::Result::kSuccess));
+  }
+
+  for (size_t i = 0; i < connected; i++) {
+    CHECK(server.Accept().has_value());
+  }
+  const u8 byte = 1;
+  CHECK(clients[1].Write(&byte, 1) == 1);
+}
@@ -0,0 +1,67 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <doctest.h>
+#include <dnet/net/endpoint.hpp>
+#include <dnet/util/types.hpp>
+#include <unordered_set>
+
+TEST_CASE("endpoint") {
+  const auto a = dnet::Endpoint::Resolve("127.0.0.1", 1337);
+  REQUIRE(a.has_value());
+  CHECK(!a->IsEmpty());
+  CHECK(a->GetIp().value() == "127.0.0.1");
+  CHECK(a->GetPort() == 1337);
+
+  const auto b = dnet::Endpoint::Resolve("127.0.0.1", 1337);
+  const auto c = dnet::Endpoint::Resolve("127.0.0.1", 1338);
+  REQUIRE(b.has_value());
+  REQUIRE(c.has_value());
+  CHECK(a.value() == b.value());
+  CHECK(a->Hash() == b->Hash());
+  CHECK(a.value() != c.value());
+
+  // round trips through the sockaddr
+  const auto d = dnet::Endpoint::FromSockaddr(a->data(), a->length());
+  CHECK(d == a.value());
+
+  std::unordered_set<dnet::Endpoint> set{a.value(), b.value(), c.value()};
+  CHECK(set.size() == 2);
+
+  const dnet::Endpoint empty{};
+  CHECK(empty.IsEmpty());
+  CHECK(!empty.GetIp().has_value());
+  CHECK(empty.GetPort() == 0);
+}
+
+TEST_CASE("endpoint ipv6") {
+  const auto a =
+      dnet::Endpoint::Resolve("::1", 1337, dnet::AddressFamily::kIPv6);
+  REQUIRE(a.has_value());
+  CHECK(a->GetIp().value() == "::1");
+  CHECK(a->GetPort() == 1337);
+  const auto b = dnet::Endpoint::Resolve("127.0.0.1", 1337);
+  REQUIRE(b.has_value());
+  CHECK(a.value() != b.value());
+}
@@ -0,0 +1,130 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef LOSSY_LINK_HPP_
+#define LOSSY_LINK_HPP_
+
+#include <doctest.h>
+#include <dnet/net/endpoint.hpp>
+#include <dnet/net/udp.hpp>
+#include <dnet/util/types.hpp>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <random>
+#include <vector>
+
+// ============================================================ //
+// Lossy link
+// ============================================================ //
+
+/**
+ * Forwards datagrams between a client and a server. Those going to the
+ * server pass a bottleneck, a queue emptied at a fixed rate and dropping
+ * what does not fit, as on a real path, and are also dropped at random,
+ * or when they match the drop filter.
+ */
+class LossyLink {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  LossyLink(const u16 port, const u16 server_port, const double loss,
+            const u64 bytes_per_second, const size_t queue_size)
+      : server_(dnet::Endpoint::Resolve("127.0.0.1", server_port).value()),
+        loss_(loss),
+        rate_(static_cast<double>(bytes_per_second)),
+        queue_size_(queue_size) {
+    REQUIRE(socket_.StartServer(port) == dnet::Result::kSuccess);
+  }
+
+  using DropFilter = std::function<bool(const u8* datagram, size_t size)>;
+
+  /**
+   * @param drop Called for each datagram going to the server, which is
+   * dropped if it returns true.
+   */
+  void set_drop_filter(DropFilter drop) { drop_ = std::move(drop); }
+
+  void Pump() {
+    const auto now = Clock::now();
+    while (!queue_.empty() && queue_.front().leaves <= now) {
+      const auto& datagram = queue_.front().datagram;
+      REQUIRE(socket_.WriteTo(datagram.data(), datagram.size(), server_)
+                  .has_value());
+      queued_bytes_ -= datagram.size();
+      queue_.pop_front();
+    }
+
+    while (socket_.CanRead()) {
+      dnet::Endpoint from{};
+      const auto maybe_bytes =
+          socket_.ReadFrom(buffer_.data(), buffer_.size(), from);
+      REQUIRE(maybe_bytes.has_value());
+      const auto bytes = static_cast<size_t>(maybe_bytes.value());
+      if (from == server_) {
+        REQUIRE(socket_.WriteTo(buffer_.data(), bytes, client_).has_value());
+        continue;
+      }
+      client_ = from;
+      if ((drop_ && drop_(buffer_.data(), bytes)) ||
+          chance_(rng_) < loss_ || queued_bytes_ + bytes > queue_size_) {
+        ++dropped_;
+        continue;
+      }
+      // leaves once the datagrams ahead of it, and itself, are sent
+      const auto start = queue_.empty() ? now : queue_.back().leaves;
+      const auto leaves =
+          start + std::chrono::duration_cast<Clock::duration>(
+                      std::chrono::duration<double>(bytes / rate_));
+      queue_.push_back(
+          Queued{leaves, std::vector<u8>(buffer_.data(),
+                                         buffer_.data() + bytes)});
+      queued_bytes_ += bytes;
+    }
+  }
+
+  size_t dropped() const { return dropped_; }
+
+ private:
+  struct Queued {
+    Clock::time_point leaves;
+    std::vector<u8> datagram;
+  };
+
+  dnet::Udp socket_{};
+  dnet::Endpoint server_;
+  dnet::Endpoint client_{};
+  double loss_;
+  double rate_;
+  size_t queue_size_;
+  DropFilter drop_{};
+  std::deque<Queued> queue_{};
+  size_t queued_bytes_ = 0;
+  size_t dropped_ = 0;
+  std::mt19937 rng_{1337};
+  std::uniform_real_distribution<double> chance_{0.0, 1.0};
+  std::vector<u8> buffer_ = std::vector<u8>(65536);
+};
+
+#endif  // LOSSY_LINK_HPP_
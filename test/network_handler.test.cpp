@@ -1,13 +1,22 @@
 #include <doctest.h>
 #include <dlog.hpp>
+#include <dnet/net/tcp.hpp>
 #include <dnet/net/udp.hpp>
 #include <dnet/network_handler.hpp>
+#include <dnet/util/platform.hpp>
 #include <dnet/util/types.hpp>
 #include <dutil/stopwatch.hpp>
 #include <functional>
 #include <limits>
+#include <set>
 #include <thread>
 #include <vector>
+#if defined(DNET_PLATFORM_LINUX)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
 
 
 /**
@@ -87,7 +96,7 @@ TEST_CASE("network handler basics") {
 
     {  // connect & get the connected event
       sw.Start();
-      nh.Connect("localhost", port);
+      REQUIRE(nh.Connect("localhost", port) == dnet::Result::kSuccess);
 
       REQUIRE(WaitForEvent());
       sw.Stop();
@@ -193,7 +202,7 @@ TEST_CASE("connecting to closed port") {
       &dnet::NetworkHandler<std::vector<u8>, dnet::Udp>::HasEvent, &nh);
 
   {  // connect should return "connected" (because of udp)
-    nh.Connect("localhost", 60123);
+    REQUIRE(nh.Connect("localhost", 60123) == dnet::Result::kSuccess);
     const bool check = dutil::TimedCheck(100, fn);
     REQUIRE(check);
     auto event = nh.GetEvent();
@@ -208,3 +217,438 @@ TEST_CASE("connecting to closed port") {
     CHECK(!check);
   }
 }
+
+static void RunMultiClient(const u16 port,
+                           const dnet::WorkerPoolOptions& options) {
+  bool run_server = true;
+  int packets = 0;
+  std::thread server_thread{RunEchoServer, port, std::ref(run_server),
+                            std::ref(packets)};
+  // make sure server gets to start
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  using Handler = dnet::MultiNetworkHandler<std::vector<u8>, dnet::Udp>;
+  constexpr int kConnections = 16;
+  {
+    Handler nh{options};
+    const auto fn = std::bind(&Handler::HasEvent, &nh);
+
+    std::vector<dnet::ConnectionId> ids{};
+    for (int i = 0; i < kConnections; i++) {
+      ids.push_back(nh.Connect("localhost", port));
+      REQUIRE(ids.back() != dnet::kInvalidConnectionId);
+    }
+
+    {  // every connection gets its own connected event
+      std::set<dnet::ConnectionId> connected{};
+      for (int i = 0; i < kConnections; i++) {
+        REQUIRE(dutil::TimedCheck(200, fn));
+        const auto event = nh.GetEvent();
+        REQUIRE(event.type() == dnet::NetworkEvent::Type::kConnected);
+        CHECK(nh.IsConnected(event.connection_id()));
+        connected.insert(event.connection_id());
+      }
+      CHECK(connected == std::set<dnet::ConnectionId>(ids.begin(), ids.end()));
+    }
+
+    {  // the echo comes back tagged with the connection it was sent on
+      for (int i = 0; i < kConnections; i++) {
+        // two bytes, to not be mistaken for the disconnect packet
+        REQUIRE(nh.Send(ids[i], std::vector<u8>(2, static_cast<u8>(i))));
+      }
+      for (int i = 0; i < kConnections; i++) {
+        REQUIRE(dutil::TimedCheck(200, fn));
+        const auto event = nh.GetEvent();
+        REQUIRE(event.type() == dnet::NetworkEvent::Type::kNewData);
+        auto maybe_packet = nh.Recv();
+        REQUIRE(maybe_packet.has_value());
+        const auto& tagged = maybe_packet.value();
+        REQUIRE(tagged.packet.size() == 2);
+        CHECK(ids[tagged.packet[0]] == tagged.connection_id);
+      }
+    }
+
+    {  // disconnect one, the others stay connected
+      REQUIRE(nh.Disconnect(ids[0]) == dnet::Result::kSuccess);
+      REQUIRE(dutil::TimedCheck(200, fn));
+      const auto event = nh.GetEvent();
+      CHECK(event.type() == dnet::NetworkEvent::Type::kDisconnected);
+      CHECK(event.connection_id() == ids[0]);
+      CHECK(!nh.IsConnected(ids[0]));
+      CHECK(nh.IsConnected(ids[1]));
+    }
+
+    {  // send disconnect packet
+      std::vector<u8> packet(1);
+      packet[0] = 0xF;
+      CHECK(nh.Send(ids[1], packet));
+    }
+
+    // allow for the worker thread to send the last packet
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  run_server = false;
+  server_thread.join();
+  CHECK(packets == kConnections + 1);
+}
+
+TEST_CASE("multi network handler") {
+  RunMultiClient(2052, dnet::WorkerPoolOptions{1, false});
+}
+
+TEST_CASE("sharded network handler") {
+  RunMultiClient(2053, dnet::WorkerPoolOptions{4, true});
+
+  {  // connections are spread over the workers
+    dnet::MultiNetworkHandler<std::vector<u8>, dnet::Udp> nh{
+        dnet::WorkerPoolOptions{4, false}};
+    CHECK(nh.GetWorkerCount() == 4);
+    std::vector<int> per_shard(4, 0);
+    for (dnet::ConnectionId id = 1; id <= 400; id++) {
+      ++per_shard[nh.GetShardIndex(id)];
+    }
+    for (const int count : per_shard) {
+      CHECK(count > 50);
+    }
+  }
+}
+
+TEST_CASE("network handler batches") {
+  constexpr u16 port = 2054;
+  bool run_server = true;
+  int packets = 0;
+  std::thread server_thread{RunEchoServer, port, std::ref(run_server),
+                            std::ref(packets)};
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  constexpr size_t kCount = 32;
+  {
+    dnet::NetworkHandler<std::vector<u8>, dnet::Udp> nh{};
+    const auto fn = std::bind(
+        &dnet::NetworkHandler<std::vector<u8>, dnet::Udp>::HasEvent, &nh);
+    REQUIRE(nh.Connect("localhost", port) == dnet::Result::kSuccess);
+    REQUIRE(dutil::TimedCheck(200, fn));
+    REQUIRE(nh.GetEvent().type() == dnet::NetworkEvent::Type::kConnected);
+
+    std::vector<std::vector<u8>> batch{};
+    for (size_t i = 0; i < kCount; i++) {
+      // two bytes, to not be mistaken for the disconnect packet
+      batch.emplace_back(2, static_cast<u8>(i));
+    }
+    REQUIRE(nh.SendBatch(batch.data(), batch.size()) == kCount);
+
+    // every datagram is echoed back on its own, in order
+    std::vector<std::vector<u8>> echoed(kCount);
+    size_t received = 0;
+    dutil::Stopwatch sw{};
+    sw.Start();
+    while (received < kCount && sw.now_ms() < 1000) {
+      received += nh.RecvBatch(&echoed[received], kCount - received);
+    }
+    REQUIRE(received == kCount);
+    CHECK(echoed == batch);
+
+    CHECK(nh.Send(std::vector<u8>(1, 0xF)));
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  run_server = false;
+  server_thread.join();
+  CHECK(packets == static_cast<int>(kCount) + 1);
+}
+
+TEST_CASE("network handler coalesces stream writes") {
+  constexpr u16 port = 2055;
+  constexpr size_t kCount = 64;
+  dnet::Tcp server{};
+  REQUIRE(server.StartServer(port) == dnet::Result::kSuccess);
+
+  dnet::NetworkHandler<std::vector<u8>, dnet::Tcp> nh{};
+  const auto fn = std::bind(
+      &dnet::NetworkHandler<std::vector<u8>, dnet::Tcp>::HasEvent, &nh);
+  REQUIRE(nh.Connect("localhost", port) == dnet::Result::kSuccess);
+  REQUIRE(dutil::TimedCheck(1000, fn));
+  REQUIRE(nh.GetEvent().type() == dnet::NetworkEvent::Type::kConnected);
+  auto maybe_client = server.Accept();
+  REQUIRE(maybe_client.has_value());
+
+  std::vector<std::vector<u8>> batch{};
+  for (size_t i = 0; i < kCount; i++) {
+    batch.emplace_back(1, static_cast<u8>(i));
+  }
+  REQUIRE(nh.SendBatch(batch.data(), batch.size()) == kCount);
+
+  // the bytes arrive in order, however the worker merged the writes
+  std::vector<u8> stream(kCount);
+  size_t bytes = 0;
+  while (bytes < kCount) {
+    const auto maybe_bytes =
+        maybe_client.value().Read(&stream[bytes], kCount - bytes);
+    REQUIRE(maybe_bytes.has_value());
+    REQUIRE(maybe_bytes.value() > 0);
+    bytes += static_cast<size_t>(maybe_bytes.value());
+  }
+  for (size_t i = 0; i < kCount; i++) {
+    CHECK(stream[i] == static_cast<u8>(i));
+  }
+}
+
+TEST_CASE("network handler recycles packets") {
+  constexpr u16 port = 2056;
+  bool run_server = true;
+  int packets = 0;
+  std::thread server_thread{RunEchoServer, port, std::ref(run_server),
+                            std::ref(packets)};
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  {
+    using Handler = dnet::NetworkHandler<std::vector<u8>, dnet::Udp>;
+    Handler nh{};
+    const auto fn = std::bind(&Handler::HasEvent, &nh);
+    REQUIRE(nh.Connect("localhost", port) == dnet::Result::kSuccess);
+    REQUIRE(dutil::TimedCheck(200, fn));
+    REQUIRE(nh.GetEvent().type() == dnet::NetworkEvent::Type::kConnected);
+
+    const auto Echo = [&](const u8 value) {
+      REQUIRE(nh.Send(std::vector<u8>(2, value)));
+      REQUIRE(dutil::TimedCheck(200, fn));
+      REQUIRE(nh.GetEvent().type() == dnet::NetworkEvent::Type::kNewData);
+      auto maybe_packet = nh.RecvPooled();
+      REQUIRE(maybe_packet.has_value());
+      CHECK(maybe_packet.value().packet() == std::vector<u8>(2, value));
+      return std::move(maybe_packet.value());
+    };
+
+    const u8* data = nullptr;
+    {  // going out of scope gives the buffer back to the worker
+      auto packet = Echo(1);
+      data = packet.packet().data();
+    }
+    CHECK(Echo(2).packet().data() == data);
+
+    {  // or give it back by hand
+      std::vector<u8> packet = Echo(3).Release();
+      data = packet.data();
+      nh.Recycle(std::move(packet));
+    }
+    CHECK(Echo(4).packet().data() == data);
+
+    CHECK(nh.Send(std::vector<u8>(1, 0xF)));
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  run_server = false;
+  server_thread.join();
+  CHECK(packets == 5);
+}
+
+TEST_CASE("network handler idle timeout") {
+  using Handler = dnet::MultiNetworkHandler<std::vector<u8>, dnet::Udp>;
+  dnet::WorkerPoolOptions options{1, false};
+  options.idle_timeout = std::chrono::milliseconds(50);
+  Handler nh{options};
+  const auto fn = std::bind(&Handler::HasEvent, &nh);
+
+  dutil::Stopwatch sw{};
+  sw.Start();
+  const dnet::ConnectionId id = nh.Connect("localhost", 60124);
+  REQUIRE(dutil::TimedCheck(200, fn));
+  REQUIRE(nh.GetEvent().type() == dnet::NetworkEvent::Type::kConnected);
+  CHECK(nh.IsConnected(id));
+
+  // nothing is received, so the worker's timer drops the connection
+  REQUIRE(dutil::TimedCheck(500, fn));
+  sw.Stop();
+  const dnet::NetworkEvent event = nh.GetEvent();
+  CHECK(event.type() == dnet::NetworkEvent::Type::kDisconnected);
+  CHECK(event.connection_id() == id);
+  CHECK(!nh.IsConnected(id));
+  CHECK(sw.fms() >= 50.0);
+}
+
+TEST_CASE("network handler keeps events past a full event queue") {
+  using Handler = dnet::MultiNetworkHandler<std::vector<u8>, dnet::Udp>;
+  Handler nh{dnet::WorkerPoolOptions{1, false}};
+  // more connections than the eventQueue has room for, and the events are
+  // not read until every connect has been handled
+  constexpr size_t kConnections = 600;
+  std::vector<dnet::ConnectionId> ids{};
+  while (ids.size() < kConnections) {
+    const dnet::ConnectionId id = nh.Connect("127.0.0.1", 60125);
+    if (id == dnet::kInvalidConnectionId) {
+      // the worker is behind on commands
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    } else {
+      ids.push_back(id);
+    }
+  }
+  REQUIRE(dutil::TimedCheck(
+      2000, [&]() { return nh.IsConnected(ids.back()); }));
+
+  const auto CountEvents = [&](const dnet::NetworkEvent::Type type) {
+    size_t count = 0;
+    (void)dutil::TimedCheck(2000, [&]() {
+      while (nh.HasEvent()) {
+        if (nh.GetEvent().type() == type) {
+          count++;
+        }
+      }
+      return count == kConnections;
+    });
+    return count;
+  };
+  CHECK(CountEvents(dnet::NetworkEvent::Type::kConnected) == kConnections);
+
+  for (size_t i = 0; i < kConnections;) {
+    if (nh.Disconnect(ids[i]) == dnet::Result::kSuccess) {
+      i++;
+    } else {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  CHECK(CountEvents(dnet::NetworkEvent::Type::kDisconnected) == kConnections);
+}
+
+TEST_CASE("network handler is not stalled by a peer that does not read") {
+  constexpr u16 port = 2057;
+  using Handler = dnet::MultiNetworkHandler<std::vector<u8>, dnet::Tcp>;
+  dnet::Tcp server{};
+  REQUIRE(server.StartServer(port) == dnet::Result::kSuccess);
+  dnet::WorkerPoolOptions options{1, false};
+  options.max_pending_send_bytes = 64 * 1024 * 1024;
+  Handler nh{options};
+  const auto fn = std::bind(&Handler::HasEvent, &nh);
+
+  // both connections are served by the same worker
+  const dnet::ConnectionId stalled = nh.Connect("127.0.0.1", port);
+  REQUIRE(dutil::TimedCheck(1000, fn));
+  REQUIRE(nh.GetEvent().type() == dnet::NetworkEvent::Type::kConnected);
+  auto stalled_peer = server.Accept();
+  REQUIRE(stalled_peer.has_value());
+  const dnet::ConnectionId active = nh.Connect("127.0.0.1", port);
+  REQUIRE(dutil::TimedCheck(1000, fn));
+  REQUIRE(nh.GetEvent().type() == dnet::NetworkEvent::Type::kConnected);
+  auto active_peer = server.Accept();
+  REQUIRE(active_peer.has_value());
+
+  // far more than the socket buffers hold, and the peer never reads it
+  const std::vector<u8> chunk(64 * 1024, 1);
+  for (int i = 0; i < 256;) {
+    if (nh.Send(stalled, chunk)) {
+      i++;
+    } else {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  // the other connection is still served
+  REQUIRE(nh.Send(active, std::vector<u8>{1, 2, 3}));
+  std::vector<u8> read(3);
+  REQUIRE(active_peer.value().SetBlocking(false) == dnet::Result::kSuccess);
+  CHECK(dutil::TimedCheck(1000, [&]() {
+    const auto maybe_bytes = active_peer.value().Read(read.data(), read.size());
+    return maybe_bytes.has_value() && maybe_bytes.value() == 3;
+  }));
+  CHECK(read == std::vector<u8>{1, 2, 3});
+
+  // and the stalled one catches up once its peer reads
+  std::vector<u8> buffer(64 * 1024);
+  size_t received = 0;
+  dutil::Stopwatch sw{};
+  sw.Start();
+  while (received < 256 * chunk.size() && sw.now_ms() < 5000) {
+    const auto maybe_bytes =
+        stalled_peer.value().Read(buffer.data(), buffer.size());
+    REQUIRE(maybe_bytes.has_value());
+    received += static_cast<size_t>(maybe_bytes.value());
+  }
+  CHECK(received == 256 * chunk.size());
+  CHECK(nh.IsConnected(stalled));
+}
+
+TEST_CASE("network handler sends what is queued while connecting") {
+  constexpr u16 port = 2062;
+  using Handler = dnet::MultiNetworkHandler<std::vector<u8>, dnet::Tcp>;
+  dnet::Tcp server{};
+  REQUIRE(server.StartServer(port) == dnet::Result::kSuccess);
+  Handler nh{dnet::WorkerPoolOptions{1, false}};
+  const auto fn = std::bind(&Handler::HasEvent, &nh);
+
+  // sent before the handshake can have completed
+  const dnet::ConnectionId id = nh.Connect("127.0.0.1", port);
+  REQUIRE(nh.Send(id, std::vector<u8>{1, 2}));
+  REQUIRE(nh.Send(id, std::vector<u8>{3}));
+  REQUIRE(dutil::TimedCheck(1000, fn));
+  REQUIRE(nh.GetEvent().type() == dnet::NetworkEvent::Type::kConnected);
+  auto peer = server.Accept();
+  REQUIRE(peer.has_value());
+
+  std::vector<u8> read(3);
+  size_t bytes = 0;
+  REQUIRE(peer.value().SetBlocking(false) == dnet::Result::kSuccess);
+  CHECK(dutil::TimedCheck(1000, [&]() {
+    const auto maybe_bytes =
+        peer.value().Read(read.data() + bytes, read.size() - bytes);
+    if (maybe_bytes.has_value() && maybe_bytes.value() > 0) {
+      bytes += static_cast<size_t>(maybe_bytes.value());
+    }
+    return bytes == read.size();
+  }));
+  CHECK(read == std::vector<u8>{1, 2, 3});
+}
+
+#if defined(DNET_PLATFORM_LINUX)
+TEST_CASE("network handler is not stalled by a connect that hangs") {
+  constexpr u16 hung_port = 2058;
+  constexpr u16 port = 2059;
+  using Handler = dnet::MultiNetworkHandler<std::vector<u8>, dnet::Tcp>;
+  // a listener that is never accepted from, with the smallest backlog. Once
+  // it is full, the kernel drops further handshakes, as an unreachable host
+  // would.
+  const int listener = socket(AF_INET, SOCK_STREAM, 0);
+  REQUIRE(listener != -1);
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(hung_port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  REQUIRE(bind(listener, reinterpret_cast<sockaddr*>(&address),
+               sizeof(address)) == 0);
+  REQUIRE(listen(listener, 0) == 0);
+  std::vector<dnet::Tcp> fillers(4);
+  for (dnet::Tcp& filler : fillers) {
+    (void)filler.Connect("127.0.0.1", hung_port,
+                         std::chrono::milliseconds(100));
+  }
+  dnet::Tcp server{};
+  REQUIRE(server.StartServer(port) == dnet::Result::kSuccess);
+
+  dnet::WorkerPoolOptions options{1, false};
+  options.connect_timeout = std::chrono::milliseconds(300);
+  Handler nh{options};
+  const auto fn = std::bind(&Handler::HasEvent, &nh);
+
+  // both connects are handled by the same worker
+  dutil::Stopwatch sw{};
+  sw.Start();
+  const dnet::ConnectionId hung = nh.Connect("127.0.0.1", hung_port);
+  const dnet::ConnectionId active = nh.Connect("127.0.0.1", port);
+  REQUIRE(dutil::TimedCheck(1000, fn));
+  dnet::NetworkEvent event = nh.GetEvent();
+  CHECK(event.type() == dnet::NetworkEvent::Type::kConnected);
+  CHECK(event.connection_id() == active);
+  CHECK(sw.now_ms() < 250.0);
+  CHECK(!nh.IsConnected(hung));
+
+  REQUIRE(dutil::TimedCheck(2000, fn));
+  sw.Stop();
+  event = nh.GetEvent();
+  CHECK(event.type() == dnet::NetworkEvent::Type::kFailedToConnect);
+  CHECK(event.connection_id() == hung);
+  CHECK(sw.fms() >= 250.0);
+  CHECK(!nh.IsConnected(hung));
+  CHECK(nh.IsConnected(active));
+  close(listener);
+}
+#endif
@@ -0,0 +1,86 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <doctest.h>
+#include <chrono>
+#include <dnet/net/poller.hpp>
+#include <dnet/net/udp.hpp>
+#include <dnet/util/types.hpp>
+#include <dutil/stopwatch.hpp>
+#include <string>
+#include <thread>
+
+TEST_CASE("poller wake") {
+  dnet::Poller poller{};
+  dnet::PollEvent events[4];
+
+  {  // a pending wake makes the next wait return without events
+    poller.Wake();
+    CHECK(poller.Wait(events, 4, dnet::Poller::kInfinite) == 0);
+  }
+
+  {  // wake is consumed
+    CHECK(poller.Wait(events, 4, 0) == 0);
+  }
+
+  {  // wake from another thread
+    std::thread waker{[&poller]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      poller.Wake();
+    }};
+    dutil::Stopwatch sw{};
+    sw.Start();
+    CHECK(poller.Wait(events, 4, 2000) == 0);
+    sw.Stop();
+    CHECK(sw.fms() < 1000);
+    waker.join();
+  }
+}
+
+TEST_CASE("poller readable socket") {
+  constexpr u16 port = 2051;
+  dnet::Udp server{};
+  REQUIRE(server.StartServer(port) == dnet::Result::kSuccess);
+
+  dnet::Poller poller{};
+  constexpr u64 token = 42;
+  REQUIRE(poller.Add(server.GetHandle(), token, dnet::poll_flag::kRead) ==
+          dnet::Result::kSuccess);
+
+  dnet::PollEvent events[4];
+  CHECK(poller.Wait(events, 4, 0) == 0);
+
+  dnet::Udp client{};
+  REQUIRE(client.Connect("localhost", port) == dnet::Result::kSuccess);
+  const std::string msg{"wake up"};
+  REQUIRE(client.Write(reinterpret_cast<const u8*>(msg.data()), msg.size())
+              .has_value());
+
+  REQUIRE(poller.Wait(events, 4, 2000) == 1);
+  CHECK(events[0].token == token);
+  CHECK((events[0].flags & dnet::poll_flag::kRead) != 0);
+
+  CHECK(poller.Remove(server.GetHandle()) == dnet::Result::kSuccess);
+  CHECK(poller.Wait(events, 4, 0) == 0);
+}
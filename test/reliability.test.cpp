@@ -0,0 +1,175 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <doctest.h>
+#include <dnet/net/reliability.hpp>
+#include <dnet/util/types.hpp>
+#include <chrono>
+#include <vector>
+
+TEST_CASE("reliability acks") {
+  dnet::Reliability a{};
+  dnet::Reliability b{};
+  std::vector<u32> delivered{};
+  std::vector<u32> lost{};
+  const auto on_delivery = [&](const u32 id, const bool ok) {
+    (ok ? delivered : lost).push_back(id);
+  };
+
+  // a sends 1..5, 2 and 4 are lost
+  for (u32 id = 1; id <= 5; id++) {
+    const dnet::UdpHeader header = a.PrepareHeader(on_delivery);
+    CHECK(header.id == id);
+    CHECK(header.acked_id == 0);
+    if (id != 2 && id != 4) {
+      CHECK(b.ProcessHeader(header));
+    }
+  }
+
+  const dnet::UdpHeader reply = b.PrepareHeader();
+  CHECK(reply.acked_id == 5);
+  // 4 and 2 missing, 3 and 1 received
+  CHECK(reply.acked_bitmask == 0b1010);
+  CHECK(a.ProcessHeader(reply));
+  CHECK(delivered == std::vector<u32>{5, 3, 1});
+  CHECK(lost.empty());
+
+  // duplicates are rejected, but still carry acks
+  CHECK(!a.ProcessHeader(reply));
+  CHECK(a.packets_delivered() == 3);
+}
+
+TEST_CASE("reliability loss") {
+  dnet::Reliability a{};
+  dnet::Reliability b{};
+  std::vector<u32> lost{};
+  const auto on_delivery = [&](const u32 id, const bool ok) {
+    if (!ok) {
+      lost.push_back(id);
+    }
+  };
+
+  // 1 is lost, then enough get through that no ack can cover it anymore
+  a.PrepareHeader(on_delivery);
+  for (u32 i = 0; i < dnet::Reliability::kAckBits; i++) {
+    CHECK(b.ProcessHeader(a.PrepareHeader(on_delivery)));
+  }
+  CHECK(a.ProcessHeader(b.PrepareHeader()));
+  CHECK(lost.empty());
+  CHECK(b.ProcessHeader(a.PrepareHeader(on_delivery)));
+  CHECK(a.ProcessHeader(b.PrepareHeader()));
+  CHECK(lost == std::vector<u32>{1});
+  CHECK(a.packets_lost() == 1);
+  CHECK(a.packets_delivered() == dnet::Reliability::kAckBits + 1);
+}
+
+TEST_CASE("reliability ring overflow") {
+  dnet::Reliability a{};
+  u32 lost = 0;
+  // nothing is ever acked, sending a whole ring later expires the oldest
+  for (size_t i = 0; i < dnet::Reliability::kBufferSize + 10; i++) {
+    a.PrepareHeader([&lost](u32, const bool ok) { lost += ok ? 0 : 1; });
+  }
+  CHECK(lost == 10);
+  CHECK(a.packets_lost() == 10);
+}
+
+TEST_CASE("reliability rtt") {
+  using namespace std::chrono_literals;
+  dnet::Reliability a{};
+  dnet::Reliability b{};
+  const dnet::Reliability::TimePoint start{};
+  CHECK(!a.has_rtt_sample());
+  CHECK(a.rto() == dnet::Reliability::kInitialRto);
+
+  // first sample, srtt = r, rttvar = r / 2, rto = srtt + 4 * rttvar
+  CHECK(b.ProcessHeader(a.PrepareHeader({}, start)));
+  CHECK(a.ProcessHeader(b.PrepareHeader(), start + 100ms));
+  REQUIRE(a.has_rtt_sample());
+  CHECK(a.srtt() == 100ms);
+  CHECK(a.rttvar() == 50ms);
+  CHECK(a.rto() == 300ms);
+
+  // second sample of 20ms
+  CHECK(b.ProcessHeader(a.PrepareHeader({}, start + 200ms)));
+  CHECK(a.ProcessHeader(b.PrepareHeader(), start + 220ms));
+  CHECK(a.rttvar() == 57500us);
+  CHECK(a.srtt() == 90ms);
+  CHECK(a.rto() == 320ms);
+
+  // acks of an already acked packet give no new sample
+  CHECK(a.ProcessHeader(b.PrepareHeader(), start + 900ms));
+  CHECK(a.srtt() == 90ms);
+}
+
+TEST_CASE("reliability retransmit deadline") {
+  using namespace std::chrono_literals;
+  dnet::Reliability a{};
+  dnet::Reliability b{};
+  const dnet::Reliability::TimePoint start{};
+  CHECK(b.ProcessHeader(a.PrepareHeader({}, start)));
+  CHECK(a.ProcessHeader(b.PrepareHeader(), start + 10ms));
+  const auto rto = a.rto();
+  CHECK(rto == 30ms);
+
+  std::vector<u32> lost{};
+  const auto on_delivery = [&lost](const u32 id, const bool ok) {
+    if (!ok) {
+      lost.push_back(id);
+    }
+  };
+  const u32 first = a.PrepareHeader(on_delivery, start + 20ms).id;
+  const u32 second = a.PrepareHeader(on_delivery, start + 40ms).id;
+
+  a.Update(start + 20ms + rto - 1ms);
+  CHECK(lost.empty());
+  a.Update(start + 20ms + rto);
+  CHECK(lost == std::vector<u32>{first});
+  // backed off, which also gives the second packet more time
+  CHECK(a.rto() == rto * 2);
+  a.Update(start + 40ms + rto);
+  CHECK(lost == std::vector<u32>{first});
+  a.Update(start + 40ms + rto * 2);
+  CHECK(lost == std::vector<u32>{first, second});
+  CHECK(a.packets_lost() == 2);
+}
+
+TEST_CASE("reliability max ack delay") {
+  using namespace std::chrono_literals;
+  dnet::Reliability a{};
+  dnet::Reliability b{};
+  a.set_max_ack_delay(5ms);
+  const dnet::Reliability::TimePoint start{};
+  CHECK(b.ProcessHeader(a.PrepareHeader({}, start)));
+  CHECK(a.ProcessHeader(b.PrepareHeader(), start + 1ms));
+  const auto rto = a.rto();
+  CHECK(rto < 5ms);
+
+  // an ack the peer held back for the full delay is not too late
+  a.PrepareHeader({}, start + 2ms);
+  a.Update(start + 2ms + rto + 5ms - 1us);
+  CHECK(a.packets_lost() == 0);
+  a.Update(start + 2ms + rto + 5ms);
+  CHECK(a.packets_lost() == 1);
+}
@@ -0,0 +1,134 @@
+#include <doctest.h>
+#include <dlog.hpp>
+#include <dnet/net/resolver.hpp>
+#include <dnet/net/udp.hpp>
+#include <dnet/util/types.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+TEST_CASE("resolver caches by host and port") {
+  dnet::Resolver resolver{};
+  const auto first = resolver.Resolve("localhost", 1234);
+  REQUIRE(first.has_value());
+  CHECK(first.value().GetIp() == std::string{"127.0.0.1"});
+  CHECK(first.value().GetPort() == 1234);
+  CHECK(resolver.lookups() == 1);
+
+  const auto second = resolver.Resolve("localhost", 1234);
+  REQUIRE(second.has_value());
+  CHECK(second.value() == first.value());
+  CHECK(resolver.lookups() == 1);
+
+  const auto other_port = resolver.Resolve("localhost", 1235);
+  REQUIRE(other_port.has_value());
+  CHECK(other_port.value().GetPort() == 1235);
+  CHECK(resolver.lookups() == 2);
+  CHECK(resolver.size() == 2);
+
+  resolver.Clear();
+  CHECK(resolver.size() == 0);
+  CHECK(resolver.Resolve("localhost", 1234).has_value());
+  CHECK(resolver.lookups() == 3);
+}
+
+TEST_CASE("resolver expires entries") {
+  dnet::Resolver resolver{20ms, 20ms};
+  CHECK(resolver.Resolve("localhost", 1234).has_value());
+  CHECK(resolver.Resolve("localhost", 1234).has_value());
+  CHECK(resolver.lookups() == 1);
+  std::this_thread::sleep_for(30ms);
+  CHECK(resolver.Resolve("localhost", 1234).has_value());
+  CHECK(resolver.lookups() == 2);
+
+  // failures are remembered too, for the negative ttl
+  CHECK(!resolver.Resolve("does-not-exist.invalid", 1234).has_value());
+  CHECK(!resolver.Resolve("does-not-exist.invalid", 1234).has_value());
+  CHECK(resolver.lookups() == 3);
+  std::this_thread::sleep_for(30ms);
+  CHECK(!resolver.Resolve("does-not-exist.invalid", 1234).has_value());
+  CHECK(resolver.lookups() == 4);
+}
+
+TEST_CASE("resolver resolves hosts file names") {
+  // every ipv4 name in the hosts file resolves to the address of the first
+  // line it is listed on
+  std::ifstream hosts{"/etc/hosts"};
+  std::vector<std::pair<std::string, std::string>> names{};
+  std::string line{};
+  while (std::getline(hosts, line)) {
+    std::istringstream words{line.substr(0, line.find('#'))};
+    std::string ip{};
+    std::string name{};
+    if (words >> ip && ip.find('.') != std::string::npos) {
+      while (words >> name) {
+        const bool seen = std::any_of(
+            names.begin(), names.end(),
+            [&name](const auto& entry) { return entry.first == name; });
+        if (!seen) {
+          names.emplace_back(name, ip);
+        }
+      }
+    }
+  }
+  REQUIRE(!names.empty());
+
+  dnet::Resolver resolver{};
+  for (const auto& [name, ip] : names) {
+    const auto endpoint = resolver.Resolve(name, 80);
+    REQUIRE(endpoint.has_value());
+    CHECK(endpoint.value().GetIp() == ip);
+    CHECK(resolver.Resolve(name, 80) == endpoint);
+  }
+  CHECK(resolver.lookups() <= names.size());
+}
+
+TEST_CASE("resolver is thread safe") {
+  dnet::Resolver resolver{};
+  std::atomic<int> failures{0};
+  std::vector<std::thread> threads{};
+  for (int i = 0; i < 4; i++) {
+    threads.emplace_back([&resolver, &failures]() {
+      for (u16 port = 0; port < 1000; port++) {
+        const auto endpoint = resolver.Resolve("localhost", port % 10);
+        if (!endpoint.has_value() || endpoint.value().GetPort() != port % 10) {
+          failures++;
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  CHECK(failures == 0);
+  CHECK(resolver.size() == 10);
+  // threads asking for a name being looked up wait for its result
+  CHECK(resolver.lookups() == 10);
+}
+
+TEST_CASE("resolver used by socket calls") {
+  constexpr u16 port = 12060;
+  dnet::Udp server{};
+  REQUIRE(server.StartServer(port) == dnet::Result::kSuccess);
+  dnet::Udp client{};
+  REQUIRE(client.Connect("localhost", port + 1) == dnet::Result::kSuccess);
+
+  const u64 before = dnet::Resolver::Default().lookups();
+  const u8 byte = 3;
+  for (int i = 0; i < 10; i++) {
+    CHECK(client.WriteTo(&byte, 1, "localhost", port) == 1);
+    CHECK(client.Connect("localhost", port) == dnet::Result::kSuccess);
+  }
+  CHECK(dnet::Resolver::Default().lookups() - before <= 1);
+  u8 read = 0;
+  CHECK(server.Read(&read, 1) == 1);
+  CHECK(read == byte);
+}
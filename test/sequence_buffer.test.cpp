@@ -0,0 +1,80 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <doctest.h>
+#include <dnet/util/sequence_buffer.hpp>
+#include <dnet/util/types.hpp>
+
+TEST_CASE("sequence buffer") {
+  dnet::SequenceBuffer<int, 8> buffer{};
+  CHECK(buffer.sequence() == 0);
+  CHECK(!buffer.Exists(0));
+  CHECK(buffer.Find(0) == nullptr);
+  buffer.Remove(0);
+  // nothing inserted yet
+  CHECK(!buffer.allocated());
+
+  *buffer.Insert(0) = 10;
+  CHECK(buffer.allocated());
+  *buffer.Insert(1) = 11;
+  CHECK(buffer.sequence() == 2);
+  CHECK(*buffer.Find(0) == 10);
+  CHECK(*buffer.Find(1) == 11);
+
+  // skipping ahead clears the slots in between
+  *buffer.Insert(9) = 19;
+  CHECK(buffer.sequence() == 10);
+  CHECK(!buffer.Exists(1));
+  CHECK(buffer.Find(1) == nullptr);
+  CHECK(*buffer.Find(9) == 19);
+
+  // late, but still inside the window
+  REQUIRE(buffer.Insert(3) != nullptr);
+  CHECK(buffer.Exists(3));
+  // too old
+  CHECK(buffer.Insert(1) == nullptr);
+
+  buffer.Remove(9);
+  CHECK(!buffer.Exists(9));
+
+  buffer.Reset();
+  CHECK(buffer.sequence() == 0);
+  CHECK(!buffer.Exists(3));
+}
+
+TEST_CASE("sequence buffer wrap around") {
+  CHECK(dnet::SequenceGreaterThan(1, 0));
+  CHECK(dnet::SequenceGreaterThan(0, 0xFFFFFFFF));
+  CHECK(!dnet::SequenceGreaterThan(0xFFFFFFFF, 0));
+
+  dnet::SequenceBuffer<int, 8> buffer{};
+  *buffer.Insert(0xFFFFFFFE) = 1;
+  *buffer.Insert(0xFFFFFFFF) = 2;
+  *buffer.Insert(0) = 3;
+  *buffer.Insert(1) = 4;
+  CHECK(buffer.sequence() == 2);
+  CHECK(*buffer.Find(0xFFFFFFFE) == 1);
+  CHECK(*buffer.Find(0xFFFFFFFF) == 2);
+  CHECK(*buffer.Find(0) == 3);
+}
@@ -0,0 +1,72 @@
+#include <doctest.h>
+#include <dlog.hpp>
+#include <dnet/net/socket_options.hpp>
+#include <dnet/net/tcp.hpp>
+#include <dnet/net/udp.hpp>
+#include <dnet/util/platform.hpp>
+#include <dnet/util/types.hpp>
+
+TEST_CASE("socket options applied at connect and accept") {
+  constexpr u16 port = 12040;
+  dnet::SocketOptions options = dnet::SocketOptions::LowLatency();
+  options.send_buffer_size = 64 * 1024;
+
+  dnet::Tcp server{};
+  server.set_options(options);
+  REQUIRE(server.StartServer(port) == dnet::Result::kSuccess);
+  dnet::Tcp client{};
+  client.set_options(options);
+  REQUIRE(client.Connect("localhost", port) == dnet::Result::kSuccess);
+  auto maybe_accepted = server.Accept();
+  REQUIRE(maybe_accepted.has_value());
+
+  for (const dnet::Tcp* tcp : {&client, &maybe_accepted.value()}) {
+    const auto maybe_options = tcp->GetOptions();
+    REQUIRE(maybe_options.has_value());
+    const dnet::SocketOptions& effective = maybe_options.value();
+    CHECK(effective.no_delay == true);
+    // the system may round it up, never down
+    REQUIRE(effective.send_buffer_size.has_value());
+    CHECK(effective.send_buffer_size.value() >= 64 * 1024);
+#if defined(DNET_PLATFORM_LINUX)
+    CHECK(effective.priority == 6);
+    CHECK(effective.not_sent_low_water == 16 * 1024);
+#endif
+  }
+
+  // without options, the system defaults are kept
+  dnet::Tcp plain{};
+  REQUIRE(plain.Connect("localhost", port) == dnet::Result::kSuccess);
+  const auto maybe_options = plain.GetOptions();
+  REQUIRE(maybe_options.has_value());
+  CHECK(maybe_options.value().no_delay == false);
+}
+
+TEST_CASE("socket options skip tcp options on udp") {
+  dnet::Udp udp{};
+  udp.set_options(dnet::SocketOptions::LowLatency());
+  REQUIRE(udp.StartServer(12041) == dnet::Result::kSuccess);
+  const auto maybe_options = udp.GetOptions();
+  REQUIRE(maybe_options.has_value());
+  CHECK(!maybe_options.value().no_delay.has_value());
+  CHECK(!maybe_options.value().not_sent_low_water.has_value());
+#if defined(DNET_PLATFORM_LINUX)
+  CHECK(maybe_options.value().priority == 6);
+#endif
+}
+
+#if defined(DNET_PLATFORM_LINUX)
+TEST_CASE("socket options failing to apply fail the socket") {
+  dnet::SocketOptions options{};
+  options.no_delay = true;
+  // rejected by the kernel
+  options.busy_poll_us = -1;
+  dnet::Tcp tcp{};
+  tcp.set_options(options);
+  CHECK(tcp.StartServer(12042) == dnet::Result::kFail);
+  // and closed, rather than left half configured
+  CHECK(tcp.GetHandle() == CHIF_NET_INVALID_SOCKET);
+  CHECK(tcp.Connect("localhost", 12042) == dnet::Result::kFail);
+  CHECK(tcp.GetHandle() == CHIF_NET_INVALID_SOCKET);
+}
+#endif
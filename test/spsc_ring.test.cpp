@@ -0,0 +1,115 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <doctest.h>
+#include <dnet/util/spsc_ring.hpp>
+#include <dnet/util/types.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST_CASE("spsc ring basics") {
+  dnet::SpscRing<std::string> ring{3};
+  // rounded up to a power of two
+  CHECK(ring.Capacity() == 4);
+  CHECK(ring.Empty());
+
+  std::string out{};
+  CHECK(ring.Pop(out) == dnet::Result::kFail);
+
+  {  // fill it up
+    for (int i = 0; i < 4; i++) {
+      CHECK(ring.Push(std::to_string(i)) == dnet::Result::kSuccess);
+    }
+    CHECK(ring.Push("full") == dnet::Result::kFail);
+    CHECK(!ring.Empty());
+  }
+
+  {  // fifo order, also when wrapping around
+    for (int round = 0; round < 3; round++) {
+      REQUIRE(ring.Pop(out) == dnet::Result::kSuccess);
+      CHECK(out == std::to_string(round));
+      CHECK(ring.Push(std::to_string(round + 4)) == dnet::Result::kSuccess);
+    }
+    for (int i = 3; i < 7; i++) {
+      REQUIRE(ring.Pop(out) == dnet::Result::kSuccess);
+      CHECK(out == std::to_string(i));
+    }
+    CHECK(ring.Empty());
+  }
+}
+
+TEST_CASE("spsc ring batches") {
+  dnet::SpscRing<int> ring{8};
+
+  {  // only what fits is pushed
+    const size_t pushed = ring.PushBatch(6, [](size_t i) { return int(i); });
+    CHECK(pushed == 6);
+    CHECK(ring.PushBatch(6, [](size_t i) { return int(i + 6); }) == 2);
+    CHECK(ring.PushBatch(1, [](size_t) { return -1; }) == 0);
+  }
+
+  {  // popped in order, also when wrapping around
+    std::vector<int> out{};
+    const auto consume = [&out](int&& value) { out.push_back(value); };
+    CHECK(ring.PopBatch(5, consume) == 5);
+    CHECK(ring.PushBatch(4, [](size_t i) { return int(i + 8); }) == 4);
+    CHECK(ring.PopBatch(100, consume) == 7);
+    CHECK(ring.PopBatch(100, consume) == 0);
+    REQUIRE(out.size() == 12);
+    for (int i = 0; i < 12; i++) {
+      CHECK(out[i] == i);
+    }
+    CHECK(ring.Empty());
+  }
+}
+
+TEST_CASE("spsc ring two threads") {
+  constexpr u64 kCount = 1000000;
+  dnet::SpscRing<u64> ring{512};
+
+  std::thread producer{[&ring]() {
+    for (u64 i = 0; i < kCount; i++) {
+      while (ring.Push(i) != dnet::Result::kSuccess) {
+        std::this_thread::yield();
+      }
+    }
+  }};
+
+  u64 expected = 0;
+  bool in_order = true;
+  while (expected < kCount) {
+    u64 value;
+    if (ring.Pop(value) == dnet::Result::kSuccess) {
+      in_order = in_order && value == expected;
+      ++expected;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+
+  CHECK(in_order);
+  CHECK(ring.Empty());
+}
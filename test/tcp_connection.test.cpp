@@ -115,3 +115,158 @@ TEST_CASE("tcp basic") {
 }
 
 // ============================================================ //
+
+TEST_CASE("tcp vectored write") {
+  {  // partial writes resume at the first unwritten byte
+    const u8 a[3]{1, 2, 3};
+    const u8 b[2]{4, 5};
+    dnet::IoBuffer buffers[3]{{a, 3}, {nullptr, 0}, {b, 2}};
+    dnet::IoBuffer* remaining = buffers;
+    size_t count = 3;
+    dnet::AdvanceIoBuffers(remaining, count, 2);
+    CHECK(count == 3);
+    CHECK(remaining->data == a + 2);
+    CHECK(remaining->size == 1);
+    dnet::AdvanceIoBuffers(remaining, count, 2);
+    CHECK(count == 1);
+    CHECK(remaining->data == b + 1);
+    dnet::AdvanceIoBuffers(remaining, count, 1);
+    CHECK(count == 0);
+  }
+
+  {  // header and payload arrive as one message
+    constexpr u16 port = 12022;
+    TestConnection server{};
+    REQUIRE(server.StartServer(port) == dnet::Result::kSuccess);
+    TestConnection client{};
+    REQUIRE(client.Connect("localhost", port) == dnet::Result::kSuccess);
+    auto maybe_peer = server.Accept();
+    REQUIRE(maybe_peer.has_value());
+
+    std::vector<u8> payload(100000);
+    for (size_t i = 0; i < payload.size(); i++) {
+      payload[i] = static_cast<u8>(i % 251);
+    }
+    std::thread writer{[&client, &payload]() {
+      CHECK(client.Write(TestHeaderData{}, payload) == dnet::Result::kSuccess);
+      CHECK(client.Write(TestHeaderData{}, std::vector<u8>{}) ==
+            dnet::Result::kSuccess);
+    }};
+
+    std::vector<u8> received{};
+    auto [res, header_data] = maybe_peer.value().Read(received);
+    CHECK(res == dnet::Result::kSuccess);
+    CHECK(header_data.magic_number == 14);
+    CHECK(received == payload);
+    auto [empty_res, empty_header_data] = maybe_peer.value().Read(received);
+    CHECK(empty_res == dnet::Result::kSuccess);
+    CHECK(received.empty());
+    writer.join();
+  }
+}
+
+TEST_CASE("tcp buffered read") {
+  constexpr u16 port = 12023;
+  TestConnection server{};
+  REQUIRE(server.StartServer(port) == dnet::Result::kSuccess);
+  TestConnection client{};
+  REQUIRE(client.Connect("localhost", port) == dnet::Result::kSuccess);
+  auto maybe_peer = server.Accept();
+  REQUIRE(maybe_peer.has_value());
+  TestConnection& peer = maybe_peer.value();
+
+  constexpr int kCount = 100;
+  for (int i = 0; i < kCount; i++) {
+    const std::vector<u8> payload(static_cast<size_t>(i % 7),
+                                  static_cast<u8>(i));
+    REQUIRE(client.Write(TestHeaderData{}, payload) == dnet::Result::kSuccess);
+  }
+  // let every packet arrive, so the first read buffers all of them
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  std::vector<u8> payload{};
+  for (int i = 0; i < kCount; i++) {
+    // served from the buffer, even though the socket has nothing left
+    REQUIRE(peer.CanRead());
+    auto [res, header_data] = peer.Read(payload);
+    REQUIRE(res == dnet::Result::kSuccess);
+    CHECK(payload ==
+          std::vector<u8>(static_cast<size_t>(i % 7), static_cast<u8>(i)));
+  }
+  CHECK(!peer.CanRead());
+
+  client.Disconnect();
+  auto [res, header_data] = peer.Read(payload);
+  CHECK(res == dnet::Result::kConnectionClosed);
+}
+
+TEST_CASE("tcp try read") {
+  constexpr u16 port = 12024;
+  TestConnection server{};
+  REQUIRE(server.StartServer(port) == dnet::Result::kSuccess);
+  // write raw bytes, to split packets wherever we want
+  dnet::Tcp client{};
+  REQUIRE(client.Connect("localhost", port) == dnet::Result::kSuccess);
+  auto maybe_peer = server.Accept();
+  REQUIRE(maybe_peer.has_value());
+  TestConnection& peer = maybe_peer.value();
+
+  const std::vector<u8> payload{1, 2, 3, 4, 5, 6, 7, 8};
+  const TestConnection::Header header{static_cast<u32>(payload.size()),
+                                      TestHeaderData{}};
+  std::vector<u8> bytes(header.get(), header.get() + header.header_size());
+  bytes.insert(bytes.end(), payload.begin(), payload.end());
+  // a second packet, to be read by the same call that completes the first
+  const std::vector<u8> packet = bytes;
+  bytes.insert(bytes.end(), packet.begin(), packet.end());
+
+  const auto WriteAndWait = [&client, &bytes](const size_t from,
+                                              const size_t to) {
+    const auto maybe_bytes = client.Write(bytes.data() + from, to - from);
+    REQUIRE(maybe_bytes.has_value());
+    REQUIRE(maybe_bytes.value() == static_cast<int>(to - from));
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  };
+
+  std::vector<u8> payload_out{};
+  {  // nothing sent, returns right away
+    auto [res, header_data] = peer.TryRead(payload_out);
+    CHECK(res == dnet::Result::kNeedMoreData);
+  }
+
+  {  // half a header
+    WriteAndWait(0, 2);
+    auto [res, header_data] = peer.TryRead(payload_out);
+    CHECK(res == dnet::Result::kNeedMoreData);
+  }
+
+  {  // the header and part of the payload
+    WriteAndWait(2, header.header_size() + 3);
+    auto [res, header_data] = peer.TryRead(payload_out);
+    CHECK(res == dnet::Result::kNeedMoreData);
+  }
+
+  {  // the rest
+    WriteAndWait(header.header_size() + 3, bytes.size());
+    auto [res, header_data] = peer.TryRead(payload_out);
+    CHECK(res == dnet::Result::kSuccess);
+    CHECK(header_data.magic_number == 14);
+    CHECK(payload_out == payload);
+  }
+
+  {  // the second packet is already buffered
+    CHECK(peer.CanRead());
+    auto [res, header_data] = peer.TryRead(payload_out);
+    CHECK(res == dnet::Result::kSuccess);
+    CHECK(payload_out == payload);
+    auto [empty_res, empty_header_data] = peer.TryRead(payload_out);
+    CHECK(empty_res == dnet::Result::kNeedMoreData);
+  }
+
+  {  // peer closing is reported
+    client.Disconnect();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    auto [res, header_data] = peer.TryRead(payload_out);
+    CHECK(res == dnet::Result::kConnectionClosed);
+  }
+}
@@ -0,0 +1,225 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <doctest.h>
+#include <dnet/tcp_connection.hpp>
+#include <dnet/tcp_server.hpp>
+#include <dnet/util/types.hpp>
+#include <dutil/stopwatch.hpp>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+struct EchoHeaderData {
+  u32 sequence = 0;
+};
+
+using EchoServer = dnet::TcpServer<std::vector<u8>, EchoHeaderData>;
+using EchoClient = dnet::TcpConnection<std::vector<u8>, EchoHeaderData>;
+
+static void StartEchoServer(EchoServer& server, const u16 port,
+                            std::atomic<int>& refused_writes) {
+  server.set_on_message([&refused_writes](EchoServer::Client& client,
+                           const EchoHeaderData& header_data,
+                           std::vector<u8>& payload) {
+    if (payload.size() == 3 && payload[0] == 'b' && payload[1] == 'y' &&
+        payload[2] == 'e') {
+      client.Disconnect();
+      return;
+    }
+    if (client.Write(header_data, payload) != dnet::Result::kSuccess) {
+      refused_writes++;
+    }
+  });
+  REQUIRE(server.Start(port) == dnet::Result::kSuccess);
+}
+
+static bool WaitFor(const std::function<bool()>& check) {
+  dutil::Stopwatch stopwatch{};
+  stopwatch.Start();
+  while (!check()) {
+    if (stopwatch.now_ms() > 2000) {
+      return false;
+    }
+    std::this_thread::yield();
+  }
+  return true;
+}
+
+TEST_CASE("tcp server echo") {
+  constexpr u16 port = 12030;
+  dnet::TcpServerOptions options{};
+  options.loop_count = 2;
+  EchoServer server{options};
+  std::atomic<int> connects{0};
+  std::atomic<int> disconnects{0};
+  server.set_on_connect([&](EchoServer::Client&) { connects++; });
+  server.set_on_disconnect([&](EchoServer::Client&) { disconnects++; });
+  std::atomic<int> refused_writes{0};
+  StartEchoServer(server, port, refused_writes);
+  CHECK(server.loop_count() == 2);
+  CHECK(server.GetPort() == port);
+
+  constexpr int kClientCount = 8;
+  constexpr u32 kMessageCount = 100;
+  std::vector<EchoClient> clients(kClientCount);
+  for (EchoClient& client : clients) {
+    REQUIRE(client.Connect("localhost", port) == dnet::Result::kSuccess);
+  }
+  CHECK(WaitFor([&]() { return server.client_count() == kClientCount; }));
+  CHECK(connects == kClientCount);
+
+  // every client has all its messages in flight at once, so the echoes
+  // are read and written many per wakeup
+  std::vector<u8> payload{};
+  for (EchoClient& client : clients) {
+    for (u32 i = 0; i < kMessageCount; i++) {
+      payload.assign(i + 1, static_cast<u8>(i));
+      REQUIRE(client.Write(EchoHeaderData{i}, payload) ==
+              dnet::Result::kSuccess);
+    }
+  }
+  for (EchoClient& client : clients) {
+    for (u32 i = 0; i < kMessageCount; i++) {
+      auto [res, header_data] = client.Read(payload);
+      REQUIRE(res == dnet::Result::kSuccess);
+      CHECK(header_data.sequence == i);
+      CHECK(payload == std::vector<u8>(i + 1, static_cast<u8>(i)));
+    }
+  }
+
+  {  // larger than the receive buffer, arrives over many reads
+    constexpr size_t kSize = 200000;
+    std::vector<u8> large(kSize);
+    for (size_t i = 0; i < kSize; i++) {
+      large[i] = static_cast<u8>(i % 251);
+    }
+    REQUIRE(clients[0].Write(EchoHeaderData{7}, large) ==
+            dnet::Result::kSuccess);
+    auto [res, header_data] = clients[0].Read(payload);
+    REQUIRE(res == dnet::Result::kSuccess);
+    CHECK(header_data.sequence == 7);
+    CHECK(payload == large);
+  }
+
+  {  // the server hangs up on request
+    const std::vector<u8> bye{'b', 'y', 'e'};
+    REQUIRE(clients[1].Write(EchoHeaderData{}, bye) == dnet::Result::kSuccess);
+    auto [res, header_data] = clients[1].Read(payload);
+    CHECK(res == dnet::Result::kConnectionClosed);
+    CHECK(WaitFor([&]() { return disconnects == 1; }));
+  }
+
+  // and notices clients hanging up
+  clients[2].Disconnect();
+  CHECK(WaitFor([&]() { return disconnects == 2; }));
+  CHECK(server.client_count() == kClientCount - 2);
+
+  server.Stop();
+  CHECK(server.client_count() == 0);
+  CHECK(disconnects == 2);
+  CHECK(refused_writes == 0);
+}
+
+TEST_CASE("tcp server drops slow readers") {
+  constexpr u16 port = 12031;
+  dnet::TcpServerOptions options{};
+  options.max_pending_write_bytes = 64 * 1024;
+  EchoServer server{options};
+  std::atomic<int> disconnects{0};
+  server.set_on_disconnect([&](EchoServer::Client&) { disconnects++; });
+  std::atomic<int> refused_writes{0};
+  StartEchoServer(server, port, refused_writes);
+
+  // never reads the echoes, until the socket buffers are full and the
+  // server gives up on it
+  EchoClient client{};
+  REQUIRE(client.Connect("localhost", port) == dnet::Result::kSuccess);
+  REQUIRE(client.SetBlocking(false) == dnet::Result::kSuccess);
+  const std::vector<u8> payload(16 * 1024, 1);
+  CHECK(WaitFor([&]() {
+    if (client.PendingWriteBytes() == 0) {
+      (void)client.WriteBuffered(EchoHeaderData{}, payload);
+    }
+    const dnet::Result res = client.Flush();
+    return res == dnet::Result::kFail ||
+           res == dnet::Result::kConnectionClosed || disconnects == 1;
+  }));
+  CHECK(WaitFor([&]() { return disconnects == 1; }));
+  CHECK(refused_writes == 1);
+}
+
+TEST_CASE("tcp server greets from on connect") {
+  constexpr u16 port = 12033;
+  EchoServer server{};
+  server.set_on_connect([](EchoServer::Client& client) {
+    const std::vector<u8> hello{'h', 'i'};
+    (void)client.Write(EchoHeaderData{42}, hello);
+  });
+  std::atomic<int> refused_writes{0};
+  StartEchoServer(server, port, refused_writes);
+
+  // the greeting arrives without the client sending anything
+  EchoClient client{};
+  REQUIRE(client.Connect("localhost", port) == dnet::Result::kSuccess);
+  REQUIRE(WaitFor([&]() { return client.CanRead(); }));
+  std::vector<u8> payload{};
+  auto [res, header_data] = client.Read(payload);
+  REQUIRE(res == dnet::Result::kSuccess);
+  CHECK(header_data.sequence == 42);
+  CHECK(payload == std::vector<u8>{'h', 'i'});
+}
+
+TEST_CASE("tcp server reuse port") {
+  constexpr u16 port = 12032;
+  dnet::TcpServerOptions options{};
+  options.loop_count = 2;
+  options.reuse_port = true;
+  options.incoming_cpu = true;
+  EchoServer server{options};
+  std::atomic<int> refused_writes{0};
+  StartEchoServer(server, port, refused_writes);
+  CHECK(server.GetPort() == port);
+  // a listener without the option can not join
+  EchoClient other{};
+  CHECK(other.StartServer(port) == dnet::Result::kFail);
+
+  // the kernel picks the loop, every client is served all the same
+  std::vector<EchoClient> clients(16);
+  std::vector<u8> payload{1, 2, 3};
+  for (EchoClient& client : clients) {
+    REQUIRE(client.Connect("localhost", port) == dnet::Result::kSuccess);
+    REQUIRE(client.Write(EchoHeaderData{5}, payload) == dnet::Result::kSuccess);
+  }
+  for (EchoClient& client : clients) {
+    auto [res, header_data] = client.Read(payload);
+    REQUIRE(res == dnet::Result::kSuccess);
+    CHECK(header_data.sequence == 5);
+    CHECK(payload == std::vector<u8>{1, 2, 3});
+  }
+  CHECK(server.client_count() == clients.size());
+  CHECK(refused_writes == 0);
+}
@@ -0,0 +1,148 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <doctest.h>
+#include <dnet/util/timer_wheel.hpp>
+#include <dnet/util/types.hpp>
+#include <chrono>
+#include <functional>
+#include <vector>
+
+using Clock = dnet::TimerWheel::Clock;
+using std::chrono::milliseconds;
+
+TEST_CASE("timer wheel fires in order") {
+  const Clock::time_point start = Clock::now();
+  dnet::TimerWheel wheel{start};
+  std::vector<int> fired{};
+
+  wheel.Schedule(start + milliseconds(30), [&]() { fired.push_back(30); });
+  wheel.Schedule(start + milliseconds(10), [&]() { fired.push_back(10); });
+  wheel.Schedule(start + milliseconds(20), [&]() { fired.push_back(20); });
+  CHECK(wheel.size() == 3);
+  CHECK(wheel.NextDeadline() == start + milliseconds(10));
+  CHECK(wheel.TimeoutMs(start) == 10);
+
+  // never early
+  CHECK(wheel.Advance(start + milliseconds(9)) == 0);
+  CHECK(fired.empty());
+
+  CHECK(wheel.Advance(start + milliseconds(25)) == 2);
+  CHECK(fired == std::vector<int>{10, 20});
+  CHECK(wheel.TimeoutMs(start + milliseconds(25)) == 5);
+
+  CHECK(wheel.Advance(start + milliseconds(30)) == 1);
+  CHECK(fired == std::vector<int>{10, 20, 30});
+  CHECK(wheel.empty());
+  CHECK(!wheel.NextDeadline().has_value());
+  CHECK(wheel.TimeoutMs(start) == -1);
+}
+
+TEST_CASE("timer wheel cancel") {
+  const Clock::time_point start = Clock::now();
+  dnet::TimerWheel wheel{start};
+  int fired = 0;
+
+  const dnet::TimerId a =
+      wheel.Schedule(start + milliseconds(5), [&]() { fired++; });
+  const dnet::TimerId b =
+      wheel.Schedule(start + milliseconds(5), [&]() { fired++; });
+  CHECK(wheel.Cancel(a));
+  CHECK(!wheel.Cancel(a));
+  CHECK(!wheel.Cancel(dnet::kInvalidTimerId));
+  CHECK(wheel.size() == 1);
+
+  CHECK(wheel.Advance(start + milliseconds(5)) == 1);
+  CHECK(fired == 1);
+  // fired timers can not be cancelled, even once their node is reused
+  CHECK(!wheel.Cancel(b));
+  const dnet::TimerId c =
+      wheel.Schedule(start + milliseconds(10), [&]() { fired++; });
+  CHECK(c != b);
+  CHECK(!wheel.Cancel(b));
+  CHECK(wheel.Cancel(c));
+  CHECK(wheel.Advance(start + milliseconds(100)) == 0);
+}
+
+TEST_CASE("timer wheel far deadlines") {
+  const Clock::time_point start = Clock::now();
+  dnet::TimerWheel wheel{start};
+  std::vector<s64> fired{};
+  // spread over every level, and past what the wheel spans
+  const std::vector<s64> delays{1,         63,         64,         65,
+                                4095,      4096,       4097,       262143,
+                                262145,    16777217,   1073741825, 68719476737,
+                                140000000000};
+  for (const s64 delay : delays) {
+    wheel.Schedule(start + milliseconds(delay),
+                   [&fired, delay]() { fired.push_back(delay); });
+  }
+
+  // step from deadline to deadline, as the worker does
+  Clock::time_point now = start;
+  while (!wheel.empty()) {
+    const auto deadline = wheel.NextDeadline();
+    REQUIRE(deadline.has_value());
+    REQUIRE(deadline.value() >= now);
+    now = deadline.value();
+    wheel.Advance(now);
+  }
+  CHECK(fired == delays);
+
+  // and in one large step
+  fired.clear();
+  for (const s64 delay : delays) {
+    wheel.Schedule(now + milliseconds(delay),
+                   [&fired, delay]() { fired.push_back(delay); });
+  }
+  CHECK(wheel.Advance(now + milliseconds(delays.back())) == delays.size());
+  CHECK(fired == delays);
+}
+
+TEST_CASE("timer wheel callbacks schedule") {
+  const Clock::time_point start = Clock::now();
+  dnet::TimerWheel wheel{start};
+  int ticks = 0;
+  std::function<void()> tick = [&]() {
+    ticks++;
+    wheel.Schedule(start + milliseconds(ticks * 100), tick);
+  };
+  wheel.Schedule(start + milliseconds(100), tick);
+
+  // a timer scheduled from a callback waits for the next advance
+  CHECK(wheel.Advance(start + milliseconds(1000)) == 1);
+  CHECK(wheel.Advance(start + milliseconds(1000)) == 1);
+  CHECK(ticks == 2);
+
+  // two due timers that cancel each other, only the first to run fires
+  dnet::TimerId a = dnet::kInvalidTimerId;
+  dnet::TimerId b = dnet::kInvalidTimerId;
+  a = wheel.Schedule(start + milliseconds(1000), [&]() { wheel.Cancel(b); });
+  b = wheel.Schedule(start + milliseconds(1000), [&]() { wheel.Cancel(a); });
+  CHECK(wheel.size() == 3);
+  CHECK(wheel.Advance(start + milliseconds(1000)) == 2);
+  CHECK(ticks == 3);
+  CHECK(wheel.size() == 1);
+}
@@ -277,3 +277,216 @@ TEST_CASE("ReadFrom and WriteTo") {
     CHECK(buf2 == msg);
   }
 }
+
+TEST_CASE("ReadFrom and WriteTo with endpoints") {
+  const u16 port = 2058;
+  dnet::Udp server{};
+  REQUIRE(server.StartServer(port) == dnet::Result::kSuccess);
+  dnet::Udp client{};
+  REQUIRE(client.Open() == dnet::Result::kSuccess);
+
+  const auto server_endpoint = dnet::Endpoint::Resolve("127.0.0.1", port);
+  REQUIRE(server_endpoint.has_value());
+  const std::string msg{"hey from client"};
+  auto written = client.WriteTo(reinterpret_cast<const u8*>(msg.data()),
+                                msg.size(), server_endpoint.value());
+  REQUIRE(written.has_value());
+  CHECK(written.value() == static_cast<int>(msg.size()));
+
+  dnet::Endpoint from{};
+  std::string buf(32, '\0');
+  const auto read_bytes =
+      server.ReadFrom(reinterpret_cast<u8*>(buf.data()), buf.size(), from);
+  REQUIRE(read_bytes.has_value());
+  buf.resize(read_bytes.value());
+  CHECK(buf == msg);
+  CHECK(from.GetPort() == client.GetPort().value());
+
+  // reply to the endpoint as it was read
+  written = server.WriteTo(reinterpret_cast<const u8*>(buf.data()),
+                           buf.size(), from);
+  REQUIRE(written.has_value());
+  std::string buf2(32, '\0');
+  const auto read_bytes2 =
+      client.Read(reinterpret_cast<u8*>(buf2.data()), buf2.size());
+  REQUIRE(read_bytes2.has_value());
+  buf2.resize(read_bytes2.value());
+  CHECK(buf2 == msg);
+}
+
+TEST_CASE("udp batches") {
+  const u16 port = 2057;
+  dnet::Udp server{};
+  REQUIRE(server.StartServer(port) == dnet::Result::kSuccess);
+  dnet::Udp client{};
+  REQUIRE(client.Connect("localhost", port) == dnet::Result::kSuccess);
+
+  constexpr size_t kCount = 8;
+  std::vector<std::vector<u8>> sent{};
+  std::vector<dnet::IoBuffer> out{};
+  for (size_t i = 0; i < kCount; i++) {
+    sent.emplace_back(i + 1, static_cast<u8>(i));
+    out.push_back(dnet::IoBuffer{sent.back().data(), sent.back().size()});
+  }
+
+  // client -> server, to the connected address
+  auto written = client.WriteBatch(out.data(), out.size());
+  REQUIRE(written.has_value());
+  REQUIRE(written.value() == static_cast<int>(kCount));
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  // server reads them all, and who sent them
+  std::vector<std::vector<u8>> storage(kCount, std::vector<u8>(64));
+  std::vector<dnet::DatagramBuffer> in{};
+  for (auto& buffer : storage) {
+    in.push_back(dnet::DatagramBuffer{buffer.data(), buffer.size(), 0});
+  }
+  std::vector<dnet::Endpoint> endpoints(kCount);
+  auto read = server.ReadFromBatch(in.data(), in.size(), endpoints.data());
+  REQUIRE(read.has_value());
+  REQUIRE(read.value() == static_cast<int>(kCount));
+  for (size_t i = 0; i < kCount; i++) {
+    CHECK(std::vector<u8>(in[i].data, in[i].data + in[i].size) == sent[i]);
+    CHECK(endpoints[i].GetPort() == client.GetPort().value());
+    CHECK(endpoints[i] == endpoints[0]);
+  }
+
+  // server -> client, echo to where they came from
+  for (size_t i = 0; i < kCount; i++) {
+    out[i] = dnet::IoBuffer{in[i].data, in[i].size};
+  }
+  written = server.WriteToBatch(out.data(), out.size(), endpoints.data());
+  REQUIRE(written.has_value());
+  REQUIRE(written.value() == static_cast<int>(kCount));
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  std::vector<std::vector<u8>> echo_storage(kCount, std::vector<u8>(64));
+  for (size_t i = 0; i < kCount; i++) {
+    in[i] = dnet::DatagramBuffer{echo_storage[i].data(), 64, 0};
+  }
+  read = client.ReadBatch(in.data(), in.size());
+  REQUIRE(read.has_value());
+  REQUIRE(read.value() == static_cast<int>(kCount));
+  for (size_t i = 0; i < kCount; i++) {
+    CHECK(std::vector<u8>(in[i].data, in[i].data + in[i].size) == sent[i]);
+  }
+}
+
+TEST_CASE("split segments") {
+  const std::vector<u8> data(10);
+  dnet::IoBuffer datagrams[4];
+  CHECK(dnet::SplitSegments(data.data(), data.size(), 4, datagrams, 4) == 3);
+  CHECK(datagrams[0].size == 4);
+  CHECK(datagrams[2].data == data.data() + 8);
+  CHECK(datagrams[2].size == 2);
+  CHECK(dnet::SplitSegments(data.data(), data.size(), 1, datagrams, 4) == 4);
+  CHECK(dnet::SplitSegments(data.data(), 0, 4, datagrams, 4) == 1);
+  CHECK(datagrams[0].size == 0);
+}
+
+/**
+ * Write datagrams of different sizes in one segmented write to @port, and
+ * read them back.
+ * @param offload False to send them in a batch, as without kernel support.
+ */
+static void CheckSegmentedWrite(const u16 port, const bool offload) {
+  dnet::Udp server{};
+  REQUIRE(server.StartServer(port) == dnet::Result::kSuccess);
+  // not everywhere, reads then get one datagram each
+  const bool gro = server.SetReceiveOffload(true) == dnet::Result::kSuccess;
+  dnet::Udp client{};
+  REQUIRE(client.Connect("127.0.0.1", port) == dnet::Result::kSuccess);
+  if (!offload) {
+    client.DisableSegmentationOffload();
+  }
+
+  // ten full datagrams and a short one
+  constexpr size_t kSegmentSize = 1000;
+  constexpr size_t kCount = 11;
+  std::vector<u8> sent(10 * kSegmentSize + 500);
+  for (size_t i = 0; i < sent.size(); i++) {
+    sent[i] = static_cast<u8>(i / kSegmentSize + i);
+  }
+  const auto written =
+      client.WriteSegmented(sent.data(), sent.size(), kSegmentSize);
+  REQUIRE(written.has_value());
+  REQUIRE(written.value() == static_cast<int>(kCount));
+  DLOG_VERBOSE("segmentation offload {}, receive offload {}",
+               client.HasSegmentationOffload(), gro);
+  if (!offload) {
+    CHECK(!client.HasSegmentationOffload());
+  }
+
+  std::vector<u8> buffer(dnet::Socket::kMaxSegmentedSize);
+  dnet::IoBuffer datagrams[dnet::Socket::kMaxSegments];
+  std::vector<u8> received{};
+  size_t count = 0;
+  while (count < kCount) {
+    dnet::Endpoint from{};
+    const auto read = server.ReadFromSegmented(
+        buffer.data(), buffer.size(), datagrams, dnet::Socket::kMaxSegments,
+        from);
+    REQUIRE(read.has_value());
+    REQUIRE(read.value() > 0);
+    CHECK(from.GetPort() == client.GetPort().value());
+    for (int i = 0; i < read.value(); i++) {
+      const dnet::IoBuffer& datagram = datagrams[i];
+      CHECK(datagram.size == (count == kCount - 1 ? 500 : kSegmentSize));
+      received.insert(received.end(), datagram.data,
+                      datagram.data + datagram.size);
+      ++count;
+    }
+  }
+  CHECK(count == kCount);
+  CHECK(received == sent);
+}
+
+TEST_CASE("udp segmentation offload") { CheckSegmentedWrite(2056, true); }
+
+TEST_CASE("udp segmentation offload fallback") {
+  CheckSegmentedWrite(2061, false);
+}
+
+TEST_CASE("udp reuse port") {
+  const u16 port = 2060;
+  dnet::ListenOptions options{};
+  options.reuse_port = true;
+  dnet::Udp servers[2]{};
+  REQUIRE(servers[0].StartServer(port, options) == dnet::Result::kSuccess);
+  if (servers[1].StartServer(port, options) != dnet::Result::kSuccess) {
+    DLOG_VERBOSE("reuse port is not supported");
+    return;
+  }
+  // every client sends twice, both datagrams of a flow reach the same socket
+  constexpr u8 kClientCount = 32;
+  std::vector<dnet::Udp> clients(kClientCount);
+  for (u8 i = 0; i < kClientCount; i++) {
+    REQUIRE(clients[i].Connect("127.0.0.1", port) == dnet::Result::kSuccess);
+    for (int n = 0; n < 2; n++) {
+      REQUIRE(clients[i].Write(&i, 1).has_value());
+    }
+  }
+
+  std::vector<int> received_by(kClientCount, -1);
+  int received = 0;
+  dutil::Stopwatch stopwatch{};
+  stopwatch.Start();
+  while (received < 2 * kClientCount && stopwatch.now_ms() < 1000) {
+    for (int s = 0; s < 2; s++) {
+      if (!servers[s].CanRead()) {
+        continue;
+      }
+      u8 id = 0;
+      dnet::Endpoint from{};
+      const auto bytes = servers[s].ReadFrom(&id, 1, from);
+      REQUIRE(bytes.has_value());
+      REQUIRE(id < kClientCount);
+      if (received_by[id] == -1) {
+        received_by[id] = s;
+      }
+      CHECK(received_by[id] == s);
+      received++;
+    }
+  }
+  CHECK(received == 2 * kClientCount);
+}
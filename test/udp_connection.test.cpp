@@ -3,6 +3,8 @@
 #include <dnet/udp_connection.hpp>
 #include <dnet/util/types.hpp>
 #include <dutil/stopwatch.hpp>
+#include <algorithm>
+#include <chrono>
 #include <memory>
 #include <thread>
 #include <vector>
@@ -61,3 +63,176 @@ TEST_CASE("udp basic") {
 }
 
 // ============================================================ //
+
+TEST_CASE("udp connection delivery") {
+  constexpr u16 port = 3001;
+  using Buffer = dnet::UdpBuffer<std::vector<u8>>;
+  dnet::UdpConnection<std::vector<u8>> server{};
+  REQUIRE(server.StartServer(port) == dnet::Result::kSuccess);
+  dnet::UdpConnection<std::vector<u8>> client{};
+  REQUIRE(client.Connect("localhost", port) == dnet::Result::kSuccess);
+
+  std::vector<u32> delivered{};
+  const auto on_delivery = [&delivered](const u32 id, const bool ok) {
+    CHECK(ok);
+    delivered.push_back(id);
+  };
+  constexpr int kCount = 3;
+  for (int i = 0; i < kCount; i++) {
+    Buffer buffer{8};
+    std::fill(buffer.begin(), buffer.end(), static_cast<u8>(i));
+    REQUIRE(client.Write(buffer, on_delivery) == dnet::Result::kSuccess);
+  }
+
+  Buffer in{};
+  for (int i = 0; i < kCount; i++) {
+    REQUIRE(server.Read(in) == dnet::Result::kSuccess);
+    CHECK(std::vector<u8>(in.begin(), in.end()) ==
+          std::vector<u8>(8, static_cast<u8>(i)));
+  }
+  CHECK(server.reliability().remote_sequence() == kCount);
+
+  // the reply carries the acks
+  const u8 reply[]{1, 2, 3};
+  Buffer out{reply, sizeof(reply)};
+  REQUIRE(server.Write(out) == dnet::Result::kSuccess);
+  CHECK(delivered.empty());
+  REQUIRE(client.Read(in) == dnet::Result::kSuccess);
+  CHECK(std::vector<u8>(in.begin(), in.end()) == std::vector<u8>{1, 2, 3});
+  CHECK(delivered == std::vector<u32>{3, 2, 1});
+  CHECK(client.reliability().packets_delivered() == kCount);
+  CHECK(client.reliability().packets_lost() == 0);
+}
+
+TEST_CASE("udp connection server without a peer") {
+  constexpr u16 port = 3002;
+  using Buffer = dnet::UdpBuffer<std::vector<u8>>;
+  dnet::UdpConnection<std::vector<u8>> server{};
+  REQUIRE(server.StartServer(port) == dnet::Result::kSuccess);
+
+  // nobody has sent to it, so there is no one to write to
+  Buffer out{4};
+  CHECK(server.Write(out) == dnet::Result::kFail);
+  const u8 data[]{1, 2, 3};
+  CHECK(server.WriteMessage(data, sizeof(data)) == dnet::Result::kFail);
+  server.Update();
+  CHECK(server.reliability().packets_sent() == 0);
+
+  // until one does
+  dnet::UdpConnection<std::vector<u8>> client{};
+  REQUIRE(client.Connect("localhost", port) == dnet::Result::kSuccess);
+  REQUIRE(client.Write(out) == dnet::Result::kSuccess);
+  Buffer in{};
+  REQUIRE(server.Read(in) == dnet::Result::kSuccess);
+  CHECK(server.Write(out) == dnet::Result::kSuccess);
+}
+
+TEST_CASE("udp connection one way transfer") {
+  constexpr u16 port = 3003;
+  using Buffer = dnet::UdpBuffer<std::vector<u8>>;
+  // the default congestion control, which only sends more as acks arrive
+  dnet::UdpConnection<std::vector<u8>> server{};
+  REQUIRE(server.StartServer(port) == dnet::Result::kSuccess);
+  dnet::UdpConnection<std::vector<u8>> client{};
+  REQUIRE(client.Connect("127.0.0.1", port) == dnet::Result::kSuccess);
+
+  // many times the initial window, the server never writes anything
+  constexpr size_t kMessages = 16;
+  const std::vector<u8> message(64 * 1024, 7);
+  size_t sent = 0;
+  size_t delivered = 0;
+  size_t received = 0;
+  Buffer in{};
+  dutil::Stopwatch sw{};
+  sw.Start();
+  while (delivered < kMessages && sw.now_ms() < 5000) {
+    if (sent < kMessages &&
+        client.WriteMessage(message.data(), message.size(),
+                            [&delivered](u32) { delivered++; }) ==
+            dnet::Result::kSuccess) {
+      sent++;
+    }
+    while (server.CanRead()) {
+      const dnet::Result res = server.Read(in);
+      REQUIRE(res != dnet::Result::kFail);
+      if (res == dnet::Result::kSuccess) {
+        CHECK(in.size() == message.size());
+        received++;
+      }
+    }
+    server.Update();
+    while (client.CanRead()) {
+      REQUIRE(client.Read(in) != dnet::Result::kFail);
+    }
+    client.Update();
+  }
+  CHECK(delivered == kMessages);
+  CHECK(received == kMessages);
+  // only empty packets carried the acks
+  CHECK(server.reliability().bytes_delivered() == 0);
+  CHECK(server.reliability().packets_sent() > 0);
+  CHECK(server.reliability().packets_sent() <
+        client.reliability().packets_sent());
+}
+
+TEST_CASE("udp connection idle") {
+  constexpr u16 port = 3004;
+  using Buffer = dnet::UdpBuffer<std::vector<u8>>;
+  dnet::UdpConnection<std::vector<u8>> server{};
+  REQUIRE(server.StartServer(port) == dnet::Result::kSuccess);
+  dnet::UdpConnection<std::vector<u8>> client{};
+  REQUIRE(client.Connect("127.0.0.1", port) == dnet::Result::kSuccess);
+
+  Buffer in{};
+  const auto pump = [&](const long ms) {
+    dutil::Stopwatch sw{};
+    sw.Start();
+    while (sw.now_ms() < ms) {
+      while (server.CanRead()) {
+        REQUIRE(server.Read(in) != dnet::Result::kFail);
+      }
+      server.Update();
+      while (client.CanRead()) {
+        REQUIRE(client.Read(in) != dnet::Result::kFail);
+      }
+      client.Update();
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  };
+
+  // the client only sends keep-alives once connected
+  REQUIRE(client.Handshake() == dnet::Result::kSuccess);
+  pump(100);
+  REQUIRE(client.state() == dnet::ConnectionState::kConnected);
+
+  // one acked packet for an rtt sample
+  Buffer out{8};
+  bool delivered = false;
+  REQUIRE(client.Write(out, [&delivered](u32, bool ok) { delivered = ok; }) ==
+          dnet::Result::kSuccess);
+  pump(100);
+  REQUIRE(delivered);
+  const auto rto = client.reliability().rto();
+
+  // the keep-alives are never acked, which is not a loss
+  pump(2500);
+  CHECK(client.reliability().packets_sent() >= 3);
+  CHECK(client.reliability().packets_lost() == 0);
+  CHECK(client.reliability().rto() == rto);
+}
+
+TEST_CASE("udp buffer headroom") {
+  dnet::UdpBuffer<std::vector<u8>> buffer{};
+  CHECK(buffer.empty());
+  buffer.resize(4);
+  CHECK(buffer.size() == 4);
+  CHECK(buffer.capacity() >= 4);
+
+  // shrinking keeps the storage, growing within it does not move the data
+  buffer.reserve(1024);
+  const u8* data = buffer.data();
+  buffer.resize(1);
+  buffer.resize(1024);
+  CHECK(buffer.data() == data);
+  CHECK(buffer.capacity() == 1024);
+}
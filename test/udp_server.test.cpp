@@ -0,0 +1,318 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2019 Christoffer Gustafsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <doctest.h>
+#include <dlog.hpp>
+#include <dnet/net/control.hpp>
+#include <dnet/net/endpoint.hpp>
+#include <dnet/net/endpoint_map.hpp>
+#include <dnet/udp_connection.hpp>
+#include <dnet/udp_server.hpp>
+#include <dnet/util/types.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+static dnet::Endpoint MakeEndpoint(const u32 n) {
+  const std::string ip = "10." + std::to_string((n >> 16) & 0xff) + "." +
+                         std::to_string((n >> 8) & 0xff) + "." +
+                         std::to_string(n & 0xff);
+  return dnet::Endpoint::Resolve(ip, static_cast<u16>(1000 + n % 7)).value();
+}
+
+TEST_CASE("endpoint map") {
+  constexpr u32 kCount = 50000;
+  std::vector<dnet::Endpoint> endpoints{};
+  for (u32 i = 0; i < kCount; i++) {
+    endpoints.push_back(MakeEndpoint(i));
+  }
+
+  dnet::EndpointMap<u32> map{};
+  for (u32 i = 0; i < kCount; i++) {
+    REQUIRE(map.Insert(endpoints[i], i) != nullptr);
+  }
+  CHECK(map.size() == kCount);
+  CHECK(map.capacity() >= 2 * kCount);
+  // replacing does not add
+  *map.Insert(endpoints[7], 70) = 7;
+  CHECK(map.size() == kCount);
+
+  for (u32 i = 0; i < kCount; i++) {
+    const u32* value = map.Find(endpoints[i]);
+    REQUIRE(value != nullptr);
+    CHECK(*value == i);
+  }
+  CHECK(map.Find(MakeEndpoint(kCount)) == nullptr);
+
+  // erase every other, the rest must still be found past the holes
+  for (u32 i = 0; i < kCount; i += 2) {
+    CHECK(map.Erase(endpoints[i]));
+  }
+  CHECK(!map.Erase(endpoints[0]));
+  CHECK(map.size() == kCount / 2);
+  for (u32 i = 0; i < kCount; i++) {
+    const u32* value = map.Find(endpoints[i]);
+    if (i % 2 == 0) {
+      CHECK(value == nullptr);
+    } else {
+      REQUIRE(value != nullptr);
+      CHECK(*value == i);
+    }
+  }
+
+  size_t visited = 0;
+  map.ForEach([&visited](const dnet::Endpoint&, u32& value) {
+    CHECK(value % 2 == 1);
+    ++visited;
+  });
+  CHECK(visited == kCount / 2);
+  map.Clear();
+  CHECK(map.empty());
+  CHECK(map.Find(endpoints[1]) == nullptr);
+}
+
+TEST_CASE("control packet") {
+  const dnet::ControlPacket packet =
+      dnet::MakeControlPacket(dnet::ControlType::kChallenge, 42);
+  const auto message = dnet::ParseControlPacket(packet.data(), packet.size());
+  REQUIRE(message.has_value());
+  CHECK(message.value().type == dnet::ControlType::kChallenge);
+  CHECK(message.value().cookie == 42);
+  CHECK(!dnet::ParseControlPacket(packet.data(), packet.size() - 1));
+
+  // a data packet is not one
+  const dnet::UdpHeader header{1, 0, 0, dnet::kUdpControl};
+  dnet::ControlPacket data{};
+  std::memcpy(data.data(), &header, sizeof(header));
+  CHECK(!dnet::ParseControlPacket(data.data(), data.size()));
+}
+
+TEST_CASE("handshake cookies") {
+  using Clock = dnet::HandshakeCookies::Clock;
+  const dnet::HandshakeCookies cookies{1, 2};
+  const dnet::Endpoint peer = MakeEndpoint(1);
+  const auto now = Clock::now();
+  const u64 cookie = cookies.Make(peer, now);
+  CHECK(cookie != 0);
+  CHECK(cookies.Check(peer, cookie, now));
+  CHECK(!cookies.Check(peer, 0, now));
+  CHECK(!cookies.Check(peer, cookie + 1, now));
+  CHECK(!cookies.Check(MakeEndpoint(2), cookie, now));
+  // valid for the period after, not longer
+  CHECK(cookies.Check(peer, cookie, now + dnet::HandshakeCookies::kPeriod));
+  CHECK(!cookies.Check(peer, cookie,
+                       now + 2 * dnet::HandshakeCookies::kPeriod));
+  // and only with the key it was made with
+  const dnet::HandshakeCookies other{1, 3};
+  CHECK(!other.Check(peer, cookie, now));
+}
+
+// ============================================================ //
+
+using Buffer = dnet::UdpBuffer<std::vector<u8>>;
+using Server = dnet::UdpServer<std::vector<u8>>;
+using Client = dnet::UdpConnection<std::vector<u8>>;
+
+/**
+ * Pump both ends until @done, or a second has passed.
+ */
+template <typename TDone>
+static bool PumpUntil(Server& server, std::vector<Client>& clients,
+                      TDone&& done, std::vector<u32>* received = nullptr) {
+  Buffer in{};
+  const auto give_up = std::chrono::steady_clock::now() + 1s;
+  while (!done()) {
+    if (std::chrono::steady_clock::now() > give_up) {
+      return false;
+    }
+    while (server.CanRead()) {
+      dnet::Endpoint peer{};
+      u8 channel = 0;
+      const dnet::Result res = server.Read(in, peer, channel);
+      REQUIRE(res != dnet::Result::kFail);
+      // skipping the empty keep alives
+      if (res == dnet::Result::kSuccess && !in.empty() &&
+          received != nullptr) {
+        REQUIRE(in.size() == sizeof(u32));
+        u32 value = 0;
+        std::memcpy(&value, in.data(), sizeof(value));
+        received->push_back(value);
+      }
+    }
+    server.Update();
+    for (Client& client : clients) {
+      while (client.CanRead()) {
+        REQUIRE(client.Read(in) != dnet::Result::kFail);
+      }
+      client.Update();
+    }
+    std::this_thread::sleep_for(1ms);
+  }
+  return true;
+}
+
+TEST_CASE("udp server handshake") {
+  constexpr u16 port = 3140;
+  Server server{2};
+  std::vector<dnet::Endpoint> connected{};
+  std::vector<dnet::DisconnectReason> disconnected{};
+  server.set_on_connect(
+      [&](const dnet::Endpoint& peer) { connected.push_back(peer); });
+  server.set_on_disconnect(
+      [&](const dnet::Endpoint&, const dnet::DisconnectReason reason) {
+        disconnected.push_back(reason);
+      });
+  REQUIRE(server.Start(port) == dnet::Result::kSuccess);
+
+  std::vector<Client> clients(3);
+  for (Client& client : clients) {
+    REQUIRE(client.Connect("127.0.0.1", port) == dnet::Result::kSuccess);
+    CHECK(client.state() == dnet::ConnectionState::kDisconnected);
+  }
+
+  // unknown peers are turned away
+  Buffer out{sizeof(u32)};
+  std::memset(out.data(), 0, out.size());
+  REQUIRE(clients[0].Write(out) == dnet::Result::kSuccess);
+  CHECK(PumpUntil(server, clients, [&] { return !server.CanRead(); }));
+  CHECK(server.peer_count() == 0);
+
+  for (Client& client : clients) {
+    REQUIRE(client.Handshake() == dnet::Result::kSuccess);
+    CHECK(client.state() == dnet::ConnectionState::kConnecting);
+  }
+  // the third is refused, the server is full
+  CHECK(PumpUntil(server, clients, [&] {
+    return clients[0].state() == dnet::ConnectionState::kConnected &&
+           clients[1].state() == dnet::ConnectionState::kConnected &&
+           clients[2].state() == dnet::ConnectionState::kDisconnected;
+  }));
+  CHECK(server.peer_count() == 2);
+  CHECK(connected.size() == 2);
+
+  // each peer gets its own connection, and acks
+  std::vector<u32> received{};
+  for (u32 i = 0; i < 2; i++) {
+    std::memcpy(out.data(), &i, sizeof(i));
+    REQUIRE(clients[i].WriteMessage(out.data(), out.size()) ==
+            dnet::Result::kSuccess);
+  }
+  CHECK(PumpUntil(
+      server, clients, [&] { return received.size() == 2; }, &received));
+  std::sort(received.begin(), received.end());
+  CHECK(received == std::vector<u32>{0, 1});
+  const auto peer_port = clients[1].GetPort();
+  REQUIRE(peer_port.has_value());
+  dnet::Endpoint peer =
+      dnet::Endpoint::Resolve("127.0.0.1", peer_port.value()).value();
+  REQUIRE(server.Find(peer) != nullptr);
+
+  // leaving frees the slot
+  clients[1].Disconnect();
+  CHECK(PumpUntil(server, clients, [&] { return server.peer_count() == 1; }));
+  CHECK(server.Find(peer) == nullptr);
+  REQUIRE(disconnected.size() == 1);
+  CHECK(disconnected[0] == dnet::DisconnectReason::kRequested);
+}
+
+TEST_CASE("udp server idle timeout") {
+  constexpr u16 port = 3141;
+  Server server{};
+  server.set_idle_timeout(50ms);
+  std::vector<dnet::DisconnectReason> disconnected{};
+  server.set_on_disconnect(
+      [&](const dnet::Endpoint&, const dnet::DisconnectReason reason) {
+        disconnected.push_back(reason);
+      });
+  REQUIRE(server.Start(port) == dnet::Result::kSuccess);
+  std::vector<Client> clients(1);
+  REQUIRE(clients[0].Connect("127.0.0.1", port) == dnet::Result::kSuccess);
+  REQUIRE(clients[0].Handshake() == dnet::Result::kSuccess);
+  CHECK(PumpUntil(server, clients, [&] {
+    return clients[0].state() == dnet::ConnectionState::kConnected;
+  }));
+
+  // the client goes silent, its keep alive is slower than the timeout
+  std::vector<Client> none{};
+  CHECK(PumpUntil(server, none, [&] { return server.peer_count() == 0; }));
+  REQUIRE(disconnected.size() == 1);
+  CHECK(disconnected[0] == dnet::DisconnectReason::kTimedOut);
+  // and is told so
+  CHECK(PumpUntil(server, clients, [&] {
+    return clients[0].state() == dnet::ConnectionState::kDisconnected;
+  }));
+}
+
+TEST_CASE("udp server challenges before adding a peer") {
+  constexpr u16 port = 3142;
+  Server server{};
+  REQUIRE(server.Start(port) == dnet::Result::kSuccess);
+  dnet::Udp raw{};
+  REQUIRE(raw.Connect("127.0.0.1", port) == dnet::Result::kSuccess);
+
+  // send a control packet, and pump the server until it answers
+  const auto Exchange = [&](const dnet::ControlType type, const u64 cookie) {
+    const dnet::ControlPacket packet = dnet::MakeControlPacket(type, cookie);
+    REQUIRE(raw.Write(packet.data(), packet.size()).has_value());
+    Buffer in{};
+    const auto give_up = std::chrono::steady_clock::now() + 1s;
+    while (!raw.CanRead() && std::chrono::steady_clock::now() < give_up) {
+      while (server.CanRead()) {
+        dnet::Endpoint peer{};
+        u8 channel = 0;
+        CHECK(server.Read(in, peer, channel) == dnet::Result::kNeedMoreData);
+      }
+      std::this_thread::sleep_for(1ms);
+    }
+    dnet::ControlPacket answer{};
+    const auto maybe_bytes = raw.Read(answer.data(), answer.size());
+    REQUIRE(maybe_bytes.has_value());
+    const auto message = dnet::ParseControlPacket(
+        answer.data(), static_cast<size_t>(maybe_bytes.value()));
+    REQUIRE(message.has_value());
+    return message.value();
+  };
+
+  // a kConnect without the cookie, or with a made up one, adds no peer
+  const dnet::ControlMessage challenge =
+      Exchange(dnet::ControlType::kConnect, 0);
+  CHECK(challenge.type == dnet::ControlType::kChallenge);
+  CHECK(challenge.cookie != 0);
+  CHECK(server.peer_count() == 0);
+  const dnet::ControlMessage again =
+      Exchange(dnet::ControlType::kConnect, challenge.cookie + 1);
+  CHECK(again.type == dnet::ControlType::kChallenge);
+  CHECK(server.peer_count() == 0);
+
+  const dnet::ControlMessage accept =
+      Exchange(dnet::ControlType::kConnect, challenge.cookie);
+  CHECK(accept.type == dnet::ControlType::kAccept);
+  CHECK(server.peer_count() == 1);
+}